@@ -3,11 +3,22 @@
  * Handles the client side of the game. 
  * 
  * server.c runs the game server that individual clients can connect to.
- * Usage: ./client hostname port [playername]
+ * Usage: ./client [--headless [--keys scriptFile]] hostname port [playername]
  *   hostname = IP address that the server's running on
  *   port = number which the server listens for messages on
  *   playername, if provided = client joins as a player
  *               if not provided = client joins as a view-only spectator
+ *   --headless = no ncurses: every message is still parsed, and the map is
+ *               kept in an in-memory framebuffer; keys are read from stdin,
+ *               or from scriptFile, one per character (whitespace ignored).
+ *               At the end of input the client sends Q, and when the server
+ *               says QUIT it prints key-to-DISPLAY latency and frame stats.
+ *               As in support/loadgen, a key that should move us is timed
+ *               until the first DISPLAY showing our '@' somewhere else, or
+ *               an ERROR; one unanswered after a second is lost. Keys are
+ *               paced: after such a key, the next is not sent until it is
+ *               answered or lost, so each move shown is the timed key's.
+ *               Keys that cannot move us (into a wall, say) are not waited for.
  * 
  * Selena Zhou, Kyla Widodo, 23S
  */
@@ -16,15 +27,20 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <fcntl.h>
 #include <ncurses.h>
 #include "common/mem.h"
 #include <unistd.h>
 #include "support/message.h"
 #include "common/grid.h"
 #include "common/player.h"
+#include "common/stats.h"
 
 /**************** global integer ****************/
 #define MAX_PLAYER_NAME_LENGTH 50
+#define MAX_STATUS_LENGTH 200
 
 /**************** global types ****************/
 typedef struct clientStruct {
@@ -37,19 +53,50 @@ typedef struct clientStruct {
     int curY;
     int goldNuggets; 
     int totalNuggets;
+
+    // headless mode: the screen is kept in memory, and we time the server
+    bool headless;
+    char* frame;                    // nrows rows of ncols characters, or NULL before GRID
+    int nrows, ncols;
+    char status[MAX_STATUS_LENGTH]; // what the status line would show
+    char* keys;                     // keys read but not yet sent, from nextKey on
+    int numKeys, nextKey, keyCapacity;
+    bool queuedQuit;                // a Q key has been read
+    bool sentQuit;                  // a Q key has been sent
+    int quitTries;                  // times Q was resent while waiting for QUIT
+    uint64_t startTime;             // when we joined
+    uint64_t keySentAt;             // when the key being timed was sent; 0 if none
+    int keyRow, keyCol;             // where our '@' was when it was sent
+    long keysLost;                  // timed keys never answered
+    uint64_t* latencies;            // key-to-DISPLAY times, nanoseconds
+    int numLatencies, latencyCapacity;
+    long keysSent, frames, frameBytes, goldMessages, errors;
+    uint64_t frameTime, maxFrameTime;   // time to copy DISPLAYs into the framebuffer
 } clientStruct_t;
 
+/**************** global constants ****************/
+static const uint64_t LostAfterNs = 1000000000; // a timed key unanswered after 1 s is lost
+
 /**************** global variables ****************/
 clientStruct_t* clientStruct;
 char* playMessage;
 
 /**************** global functions ****************/
 int main(const int argc, char* argv[]);
-static void parseArgs(const int argc, char* argv[]);
+static int parseArgs(const int argc, char* argv[]);
 void initializeDisplay();
 void initializeNetwork(char* serverHost, char* port, FILE* errorFile, char* playerName);
 static bool handleInput(void* arg);
+static bool handleScriptInput(void* arg);
+static bool handleQuitTimeout(void* arg);
+static void sendQueuedKeys(void);
+static bool expectMove(const char key, int* row, int* col);
 static bool handleMessage(void* arg, const addr_t incoming, const char* message);
+static void showStatus(const char* format, ...);
+static void recordLatency(uint64_t latency);
+static bool findSelf(int* row, int* col);
+static void printHeadlessStats(FILE* fp);
+static int compareLatency(const void* a, const void* b);
 
 /**************** main ****************/
 /*
@@ -65,17 +112,25 @@ int main(const int argc, char* argv[]) {
         exit(1);
     }    
 
-    parseArgs(argc, argv); //Parse the incoming arguments
-    initializeDisplay(); //Initialize the ncurses and window
-    initializeNetwork(argv[1], argv[2], stderr, clientStruct->isPlayer ? clientStruct->playername : NULL); //Initialize the connection, message_send, and message_loop
+    int first = parseArgs(argc, argv); //Parse the incoming arguments; returns index of hostname
+    if (!clientStruct->headless) {
+        initializeDisplay(); //Initialize the ncurses and window
+    }
+    initializeNetwork(argv[first], argv[first+1], stderr, clientStruct->isPlayer ? clientStruct->playername : NULL); //Initialize the connection, message_send, and message_loop
     
     // Shutting down program
-    delwin(clientStruct->clientwindow);  //Delete the window
-    endwin(); //end ncurses
+    if (clientStruct->headless) {
+        // the server never said QUIT, but report what we saw
+        printHeadlessStats(stdout);
+    } else {
+        delwin(clientStruct->clientwindow);  //Delete the window
+        endwin(); //end ncurses
+    }
     
     //Freeing memory
     mem_free(clientStruct->playerID);
-    mem_free(clientStruct->playername);
+    mem_free(clientStruct->frame);
+    free(clientStruct->latencies);
     mem_free(clientStruct);
 
     exit(0);
@@ -85,25 +140,48 @@ int main(const int argc, char* argv[]) {
 /*
  * Checks the validity of command-line arguments and initializes the clientStruct accordingly. 
  * If a player name is provided, the client is set to be a player; otherwise, it is set to be a spectator.
+ * With --headless, the client runs without ncurses; with --keys, stdin is replaced by the script file.
  *
  * Caller provides: Command-line arguments argc and argv[].
- * Returns: Nothing.
+ * Returns: index in argv[] of the hostname.
  */
-static void parseArgs(const int argc, char* argv[]) {
-    if (argc < 3 || argc > 4) { //If the usage is incorect
-        fprintf(stderr, "Invalid arguments; Usage: ./client hostname port [player_name]\n");
+static int parseArgs(const int argc, char* argv[]) {
+    int first = 1; // skip the options
+    while (first < argc && strncmp(argv[first], "--", 2) == 0) {
+        if (strcmp(argv[first], "--headless") == 0) {
+            clientStruct->headless = true;
+            first++;
+        }
+        else if (strcmp(argv[first], "--keys") == 0 && first + 1 < argc) {
+            int fd = open(argv[first+1], O_RDONLY);
+            if (fd < 0 || dup2(fd, 0) < 0) { // the message loop watches stdin, so make the script stdin
+                fprintf(stderr, "Error: cannot read key script '%s'\n", argv[first+1]);
+                exit(2);
+            }
+            close(fd);
+            first += 2;
+        }
+        else {
+            break;
+        }
+    }
+
+    int nargs = argc - first;
+    if (nargs < 2 || nargs > 3) { //If the usage is incorect
+        fprintf(stderr, "Invalid arguments; Usage: ./client [--headless [--keys scriptFile]] hostname port [player_name]\n");
         exit(2); //Exit program
     }
     else {
-        if (argc == 4) { //If arguments is player, boolean true
+        if (nargs == 3) { //If arguments is player, boolean true
             clientStruct->isPlayer = true; 
-            strncpy(clientStruct->playername, argv[3], MAX_PLAYER_NAME_LENGTH - 1);
+            strncpy(clientStruct->playername, argv[first+2], MAX_PLAYER_NAME_LENGTH - 1);
             clientStruct->playername[MAX_PLAYER_NAME_LENGTH - 1] = '\0';
         }
         else {
             clientStruct->isPlayer = false; //if not, spectator
         }
     }
+    return first;
 }
 
 
@@ -185,12 +263,19 @@ void initializeNetwork(char* server, char* port, FILE* errorFile, char* playerNa
     }
 
     // Join the server
+    clientStruct->startTime = stats_now();
     message_send(clientStruct->serverAddr, playMessage);
     mem_free(playMessage);
 
     // Loop, waiting for input or for messages; provide callback functions.
     // We use the 'arg' parameter to carry a pointer to 'server'.
-    bool ok = message_loop(&(clientStruct->serverAddr), 0, NULL, handleInput, handleMessage);
+    bool ok = clientStruct->headless
+        ? message_loop(&(clientStruct->serverAddr), 0.5, handleQuitTimeout, handleScriptInput, handleMessage)
+        : message_loop(&(clientStruct->serverAddr), 0, NULL, handleInput, handleMessage);
+    if (ok && clientStruct->headless) {
+        // input has ended and Q is queued; send what is left, and wait for the server's QUIT
+        ok = message_loop(&(clientStruct->serverAddr), 0.5, handleQuitTimeout, NULL, handleMessage);
+    }
 
     // Shut down the message module
     message_done();
@@ -224,6 +309,18 @@ static bool handleMessage(void* arg, const addr_t incoming, const char* message)
             fprintf(stderr, "Error: Cannot parse GRID message.\n");
             return false;
         }
+        if (clientStruct->headless) { // no window to fit; make the framebuffer instead
+            if (nrows <= 0 || ncols <= 0) {
+                fprintf(stderr, "Error: Bad GRID size.\n");
+                return false;
+            }
+            mem_free(clientStruct->frame);
+            clientStruct->frame = mem_malloc((size_t) nrows * ncols);
+            memset(clientStruct->frame, ' ', (size_t) nrows * ncols);
+            clientStruct->nrows = nrows;
+            clientStruct->ncols = ncols;
+            return false;
+        }
         while (clientStruct->curY < (nrows+1) || clientStruct->curX < (ncols+1)) { // While the window is too small
             mvprintw(0,0,"Error: Display is not large enough for the grid. Please resize and press enter.\n");  // Let client know 
             mvprintw(2,0,"Your window must be at least %d wide and %d tall.\n", ncols+1, nrows+1);
@@ -251,25 +348,23 @@ static bool handleMessage(void* arg, const addr_t incoming, const char* message)
         clientStruct->goldNuggets = p;
         clientStruct->totalNuggets = r;
         
+        clientStruct->goldMessages++;
+        
         // Update status line
         if (clientStruct->isPlayer) {
             if (n < 0) {
-                mvprintw(0, 0, "Player %s has %d nuggets (%d nuggets unclaimed). Player '%c' stole %d from you!", clientStruct->playerID, p, r, otherPlayID, n*(-1));  
+                showStatus("Player %s has %d nuggets (%d nuggets unclaimed). Player '%c' stole %d from you!", clientStruct->playerID, p, r, otherPlayID, n*(-1));  
             }
             else if (n > 0) {
-                mvprintw(0, 0, "Player %s has %d nuggets (%d nuggets unclaimed). You stole %d from player '%c'!", clientStruct->playerID, p, r, n, otherPlayID);
+                showStatus("Player %s has %d nuggets (%d nuggets unclaimed). You stole %d from player '%c'!", clientStruct->playerID, p, r, n, otherPlayID);
             }
             else {
-                mvprintw(0, 0, "Player %s has %d nuggets (%d nuggets unclaimed). Player '%c' is too poor!", clientStruct->playerID, p, r, otherPlayID);
+                showStatus("Player %s has %d nuggets (%d nuggets unclaimed). Player '%c' is too poor!", clientStruct->playerID, p, r, otherPlayID);
             }
-            refresh();
         }
         else {
-            mvprintw(0, 0, "Spectator: %3d nuggets unclaimed.", r);
+            showStatus("Spectator: %3d nuggets unclaimed.", r);
         }
-        
-        // Refresh the screen to display changes
-        refresh();
     }
     // Handle GOLD message
     else if (strncmp(message, "GOLD", 4) == 0) {
@@ -282,25 +377,50 @@ static bool handleMessage(void* arg, const addr_t incoming, const char* message)
         clientStruct->goldNuggets = p;
         clientStruct->totalNuggets = r;
         
+        clientStruct->goldMessages++;
+        
         // Update status line
         if (clientStruct->isPlayer) {
             if (n == 0) {
-                mvprintw(0, 0, "Player %s has %d nuggets (%d nuggets unclaimed).", clientStruct->playerID, p, r);
+                showStatus("Player %s has %d nuggets (%d nuggets unclaimed).", clientStruct->playerID, p, r);
             }
             else {
-                mvprintw(0, 0, "Player %s has %d nuggets (%d nuggets unclaimed). GOLD received: %d", clientStruct->playerID, p, r, n);
+                showStatus("Player %s has %d nuggets (%d nuggets unclaimed). GOLD received: %d", clientStruct->playerID, p, r, n);
             }
-            refresh();
         }
         else {
-            mvprintw(0, 0, "Spectator: %3d nuggets unclaimed.", r);
+            showStatus("Spectator: %3d nuggets unclaimed.", r);
         }
-        
-        // Refresh the screen to display changes
-        refresh();
     }
     // Handle DISPLAY message
     else if (strncmp(message, "DISPLAY", 7) == 0) {
+        if (clientStruct->headless) {
+            uint64_t start = stats_now();
+            // copy each line of the map into its row of the framebuffer
+            const char* line = message + 8;  // Skip "DISPLAY\n"
+            for (int row = 0; row < clientStruct->nrows && *line != '\0'; row++) {
+                const char* next_newline = strchr(line, '\n');
+                int line_length = next_newline ? next_newline - line : strlen(line);
+                memcpy(clientStruct->frame + (size_t) row * clientStruct->ncols, line,
+                       line_length < clientStruct->ncols ? line_length : clientStruct->ncols);
+                line = next_newline ? next_newline + 1 : line + line_length;
+            }
+            uint64_t elapsed = stats_now() - start;
+            int row, col;
+            if (clientStruct->keySentAt != 0 && findSelf(&row, &col)
+                && (row != clientStruct->keyRow || col != clientStruct->keyCol)) {
+                recordLatency(start - clientStruct->keySentAt); // the key we are timing moved us
+                clientStruct->keySentAt = 0;
+            }
+            clientStruct->frames++;
+            clientStruct->frameBytes += strlen(message);
+            clientStruct->frameTime += elapsed;
+            if (elapsed > clientStruct->maxFrameTime) {
+                clientStruct->maxFrameTime = elapsed;
+            }
+            sendQueuedKeys();
+            return false;
+        }
         int lineNumber = 1; // Start from the first character after "DISPLAY\n"
         const char* line = message + 8;  // Skip "DISPLAY\n"
 
@@ -334,6 +454,17 @@ static bool handleMessage(void* arg, const addr_t incoming, const char* message)
     }
     // Handle QUIT message
     else if (strncmp(message, "QUIT", 4) == 0) {
+        if (clientStruct->headless) {
+            printf("%s\n", message);
+            printHeadlessStats(stdout);
+            mem_free(clientStruct->playerID);
+            mem_free(clientStruct->frame);
+            free(clientStruct->latencies);
+            free(clientStruct->keys);
+            mem_free(clientStruct);
+            message_done();
+            exit(0);
+        }
         delwin(clientStruct->clientwindow); // Delete the window
         endwin(); // end ncurser
 
@@ -351,13 +482,19 @@ static bool handleMessage(void* arg, const addr_t incoming, const char* message)
     // Handle ERROR message
     else if (strncmp(message, "ERROR", 5) == 0) {
         fprintf(stderr, "Error: %s\n", message);
+        clientStruct->errors++;
+        if (clientStruct->headless && clientStruct->keySentAt != 0) { // the key we are timing was refused
+            recordLatency(stats_now() - clientStruct->keySentAt);
+            clientStruct->keySentAt = 0;
+        }
+        if (clientStruct->headless) {
+            sendQueuedKeys();
+        }
         // Update the status line with the error message
         if (clientStruct->isPlayer) {
-            mvprintw(0, 0, "Player %s has %d nuggets (%d nuggets unclaimed). %s", clientStruct->playerID, clientStruct->goldNuggets, clientStruct->totalNuggets, message);
-            refresh();
+            showStatus("Player %s has %d nuggets (%d nuggets unclaimed). %s", clientStruct->playerID, clientStruct->goldNuggets, clientStruct->totalNuggets, message);
         } else {
-            mvprintw(0, 0, "Spectator: %s", message);
-            refresh();
+            showStatus("Spectator: %s", message);
         }
     }
     // Unknown/ Misordered message
@@ -366,11 +503,9 @@ static bool handleMessage(void* arg, const addr_t incoming, const char* message)
 
         // Update the status line with the unknown message
         if (clientStruct->isPlayer) {
-            mvprintw(0, 0, "Player %s has %d nuggets (%d nuggets unclaimed). Unknown message: %s", clientStruct->playerID, clientStruct->goldNuggets, clientStruct->totalNuggets, message);
-            refresh();
+            showStatus("Player %s has %d nuggets (%d nuggets unclaimed). Unknown message: %s", clientStruct->playerID, clientStruct->goldNuggets, clientStruct->totalNuggets, message);
         } else {
-            mvprintw(0, 0, "Spectator: Unknown message: %s", message);
-            refresh();
+            showStatus("Spectator: Unknown message: %s", message);
         }
     }
     return false;
@@ -412,4 +547,220 @@ static bool handleInput(void* arg) {
     clrtoeol(); // Clear
 
     return false;  // Return false to continue the input loop.
-}
\ No newline at end of file
+}
+
+/**************** handleScriptInput() ****************/
+/* 
+ * Headless replacement for handleInput: reads what is ready on stdin (the key
+ * script, or a pipe), queues it as keys, skipping whitespace, and sends what
+ * the pacing allows (see sendQueuedKeys). At the end of input, queues Q
+ * (unless the script already did) and ends the loop.
+ * 
+ * Caller provides: void pointer arg (can be NULL)
+ * Returns: true at the end of input, false to continue the input loop.
+ */
+static bool handleScriptInput(void* arg) {
+    char buf[256];
+    ssize_t n = read(0, buf, sizeof(buf));
+    if (n <= 0 && !clientStruct->queuedQuit) { // end of the script
+        buf[0] = 'Q';
+        n = 1;
+    }
+    if (clientStruct->numKeys + n > clientStruct->keyCapacity) {
+        int capacity = (clientStruct->keyCapacity > 0) ? clientStruct->keyCapacity * 2 : 256;
+        while (capacity < clientStruct->numKeys + n) {
+            capacity *= 2;
+        }
+        char* keys = realloc(clientStruct->keys, capacity);
+        if (keys == NULL) {
+            fprintf(stderr, "Error: out of memory for keys.\n");
+            return true;
+        }
+        clientStruct->keys = keys;
+        clientStruct->keyCapacity = capacity;
+    }
+    for (int i = 0; i < n; i++) {
+        char keyChar = buf[i];
+        if (keyChar != ' ' && keyChar != '\t' && keyChar != '\n' && keyChar != '\r') {
+            clientStruct->keys[clientStruct->numKeys++] = keyChar;
+            clientStruct->queuedQuit = clientStruct->queuedQuit || keyChar == 'Q';
+        }
+    }
+    sendQueuedKeys();
+    return clientStruct->queuedQuit;
+}
+
+/**************** handleQuitTimeout() ****************/
+/* 
+ * Called when the headless client has heard nothing for a while: a timed key
+ * may be lost, so send what can be sent now. Once Q has been sent, the server
+ * should say QUIT; the Q may have been dropped, so resend it a few times
+ * before giving up.
+ *
+ * Returns: true, to give up waiting; false to keep waiting.
+ */
+static bool handleQuitTimeout(void* arg) {
+    sendQueuedKeys();
+    if (!clientStruct->sentQuit) {
+        return false;
+    }
+    if (clientStruct->quitTries++ < 3) {
+        message_send(clientStruct->serverAddr, "KEY Q");
+        return false;
+    }
+    fprintf(stderr, "Error: no QUIT from server.\n");
+    return true;
+}
+
+/**************** sendQueuedKeys() ****************/
+/* 
+ * Headless: sends queued keys, in order, once we have joined (seen a DISPLAY).
+ * A key that should move us is timed, and the keys after it wait until it is
+ * answered (a DISPLAY shows our '@' moved, or an ERROR) or, after a second
+ * without an answer, lost.
+ */
+static void sendQueuedKeys(void) {
+    if (clientStruct->frames == 0) {
+        return;
+    }
+    uint64_t now = stats_now();
+    if (clientStruct->keySentAt != 0) {
+        if (now - clientStruct->keySentAt <= LostAfterNs) {
+            return;
+        }
+        clientStruct->keysLost++;
+        clientStruct->keySentAt = 0;
+    }
+    while (clientStruct->nextKey < clientStruct->numKeys && clientStruct->keySentAt == 0) {
+        char keyChar = clientStruct->keys[clientStruct->nextKey++];
+        char keySend[10];
+        sprintf(keySend, "KEY %c", keyChar);
+        int row, col;
+        if (expectMove(keyChar, &row, &col)) {
+            clientStruct->keySentAt = now;
+            clientStruct->keyRow = row;
+            clientStruct->keyCol = col;
+        }
+        message_send(clientStruct->serverAddr, keySend);
+        clientStruct->keysSent++;
+        if (keyChar == 'Q') {
+            clientStruct->sentQuit = true;
+        }
+    }
+}
+
+/**************** expectMove() ****************/
+/* 
+ * Headless: would this key move our '@', as far as the framebuffer shows?
+ * It would if it is a movement key and the spot it first steps to is room,
+ * passage, gold, or another player (we swap).
+ * Returns: true, with where '@' is now; false if not.
+ */
+static bool expectMove(const char key, int* row, int* col) {
+    static const char* keys = "hjklyubn";
+    static const int dr[] = {0, 1, -1, 0, -1, -1, 1, 1};
+    static const int dc[] = {-1, 0, 0, 1, -1, 1, -1, 1};
+    const char* k = strchr(keys, key >= 'A' && key <= 'Z' ? key - 'A' + 'a' : key);
+    if (key == '\0' || k == NULL || !findSelf(row, col)) {
+        return false;
+    }
+    int r = *row + dr[k - keys], c = *col + dc[k - keys];
+    if (r < 0 || r >= clientStruct->nrows || c < 0 || c >= clientStruct->ncols) {
+        return false;
+    }
+    char spot = clientStruct->frame[(size_t) r * clientStruct->ncols + c];
+    return spot == '.' || spot == '#' || spot == '*' || (spot >= 'A' && spot <= 'Z');
+}
+
+/**************** showStatus() ****************/
+/* 
+ * Shows a printf-style message on the status line (top line) of the window,
+ * or in headless mode keeps it in the clientStruct instead.
+ */
+static void showStatus(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    if (clientStruct->headless) {
+        vsnprintf(clientStruct->status, MAX_STATUS_LENGTH, format, args);
+    }
+    else {
+        move(0, 0);
+        vw_printw(stdscr, format, args);
+        refresh();
+    }
+    va_end(args);
+}
+
+/**************** recordLatency() ****************/
+/* 
+ * Remembers one key-to-DISPLAY time, in nanoseconds, growing the array as needed.
+ */
+static void recordLatency(uint64_t latency) {
+    if (clientStruct->numLatencies == clientStruct->latencyCapacity) {
+        int capacity = (clientStruct->latencyCapacity > 0) ? clientStruct->latencyCapacity * 2 : 256;
+        uint64_t* latencies = realloc(clientStruct->latencies, capacity * sizeof(uint64_t));
+        if (latencies == NULL) {
+            return;
+        }
+        clientStruct->latencies = latencies;
+        clientStruct->latencyCapacity = capacity;
+    }
+    clientStruct->latencies[clientStruct->numLatencies++] = latency;
+}
+
+/**************** findSelf() ****************/
+/* 
+ * Finds our '@' in the headless framebuffer.
+ * Returns: true, with its row and column, if it is there; false if not.
+ */
+static bool findSelf(int* row, int* col) {
+    if (clientStruct->frame == NULL || clientStruct->frames == 0) {
+        return false;
+    }
+    const char* at = memchr(clientStruct->frame, '@', (size_t) clientStruct->nrows * clientStruct->ncols);
+    if (at == NULL) {
+        return false;
+    }
+    *row = (at - clientStruct->frame) / clientStruct->ncols;
+    *col = (at - clientStruct->frame) % clientStruct->ncols;
+    return true;
+}
+
+/**************** printHeadlessStats() ****************/
+/* 
+ * Prints what the headless client sent and received, the key-to-DISPLAY
+ * latency percentiles, and the time spent filling the framebuffer.
+ */
+static void printHeadlessStats(FILE* fp) {
+    double seconds = (stats_now() - clientStruct->startTime) / 1e9;
+    fprintf(fp, "headless: %.2f s, %ld keys sent, %ld frames (%.1f/s, %ld bytes), %ld GOLD, %ld ERROR\n",
+            seconds, clientStruct->keysSent, clientStruct->frames,
+            seconds > 0 ? clientStruct->frames / seconds : 0.0, clientStruct->frameBytes,
+            clientStruct->goldMessages, clientStruct->errors);
+
+    int n = clientStruct->numLatencies;
+    if (n > 0) {
+        uint64_t* sorted = clientStruct->latencies;
+        qsort(sorted, n, sizeof(uint64_t), compareLatency);
+        fprintf(fp, "key-to-DISPLAY latency (ms), %d keys timed (%ld lost): p50 %.3f  p90 %.3f  p99 %.3f  max %.3f\n",
+                n, clientStruct->keysLost, sorted[n / 2] / 1e6, sorted[n * 9 / 10] / 1e6, sorted[n * 99 / 100] / 1e6,
+                sorted[n - 1] / 1e6);
+    }
+    if (clientStruct->frames > 0) {
+        fprintf(fp, "framebuffer update (us): mean %.2f  max %.2f\n",
+                clientStruct->frameTime / 1e3 / clientStruct->frames, clientStruct->maxFrameTime / 1e3);
+    }
+    if (clientStruct->status[0] != '\0') {
+        fprintf(fp, "status: %s\n", clientStruct->status);
+    }
+}
+
+/**************** compareLatency() ****************/
+/* 
+ * For qsort: orders latencies from shortest to longest.
+ */
+static int compareLatency(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*) a;
+    uint64_t y = *(const uint64_t*) b;
+    return (x > y) - (x < y);
+}
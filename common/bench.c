@@ -0,0 +1,298 @@
+/*
+ * bench.c - micro-benchmarks for the Nuggets 'common' modules
+ *
+ * usage: ./bench [--json] [--time seconds] mapFile...
+ *
+ * For each map, times grid_fromFile, grid_visible from every spot, grid_overlay,
+ * player_updateVisibility, gold_foundPile, and the two roster lookups, and prints
+ * one record per map and operation: nanoseconds and allocations per operation.
+ * Records are CSV (the default) or, with --json, a JSON array.
+ *
+ * Each operation is repeated until it has run for the given time (default 0.05 s),
+ * so cheap operations are not lost in the clock's resolution.
+ * Allocations are malloc, calloc and realloc calls; bench is linked with
+ * -Wl,--wrap for each (see Makefile), so they are counted wherever they happen.
+ *
+ * Selena Zhou, Kyla Widodo, 23S
+ */
+
+#define _POSIX_C_SOURCE 200809L     // for clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "grid.h"
+#include "player.h"
+#include "roster.h"
+#include "gold.h"
+#include "../support/message.h"
+
+/**************** file-local global variables ****************/
+
+static const double DefaultTime = 0.05;     // seconds to run each operation
+static const int NumPlayers = 26;           // players in the roster, as in a full game
+static const int NumPiles = 20;             // gold piles per map, as in a typical game
+
+static atomic_ulong allocs;                 // allocations counted by the wrappers
+static bool json = false;                   // print JSON rather than CSV
+static int records = 0;                     // records printed so far
+
+/**************** local types ****************/
+
+/* What every benchmark of one map needs; built once per map. */
+typedef struct fixture {
+    const char* mapFile;
+    grid_t* map;                // the map, as loaded
+    grid_t* goldMap;            // NumPiles piles on room spots
+    grid_t* scratch;            // output grid, same size as map
+    grid_point_t* spots;        // every spot in the map
+    int numSpots;
+    gold_t* gold;               // the piles in goldMap
+    player_t* player;           // a player on the map
+    roster_t* roster;           // NumPlayers players
+    player_t* members[26];      // the roster's players, [NumPlayers]
+} fixture_t;
+
+/* One operation: 'run' does iteration i of it. */
+typedef struct benchmark {
+    const char* name;
+    void (*run)(fixture_t* fixture, long i);
+} benchmark_t;
+
+/**************** allocation counting ****************/
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size) {
+    atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+    return __real_realloc(ptr, size);
+}
+
+/**************** helper functions ****************/
+
+/**************** now ****************/
+/* Returns a monotonic timestamp in nanoseconds.
+ */
+static uint64_t now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+/**************** the benchmarks ****************/
+/* Each cycles through the map's spots (or players), so every one is measured. */
+
+static void bench_fromFile(fixture_t* f, long i) {
+    grid_delete(grid_fromFile(f->mapFile));
+}
+
+static void bench_visible(fixture_t* f, long i) {
+    grid_point_t spot = f->spots[i % f->numSpots];
+    grid_visible(f->map, spot.r, spot.c, f->scratch);
+}
+
+static void bench_overlay(fixture_t* f, long i) {
+    grid_overlay(f->map, f->goldMap, f->map, f->scratch);
+}
+
+static void bench_updateVisibility(fixture_t* f, long i) {
+    grid_point_t spot = f->spots[i % f->numSpots];
+    player_setLocation(f->player, spot.c, spot.r);
+    player_updateVisibility(f->player, f->map, f->goldMap);
+}
+
+static void bench_foundPile(fixture_t* f, long i) {
+    grid_point_t spot = f->spots[i % f->numSpots];
+    gold_foundPile(f->gold, spot.r, spot.c);
+}
+
+static void bench_playerFromAddr(fixture_t* f, long i) {
+    roster_getPlayerFromAddr(f->roster, player_getAddr(f->members[i % NumPlayers]));
+}
+
+static void bench_playerFromID(fixture_t* f, long i) {
+    roster_getPlayerFromID(f->roster, player_getID(f->members[i % NumPlayers]));
+}
+
+static void bench_playerAt(fixture_t* f, long i) {
+    grid_point_t spot = f->spots[i % f->numSpots];
+    roster_getPlayerAt(f->roster, spot.c, spot.r);
+}
+
+static const benchmark_t Benchmarks[] = {
+    { "grid_fromFile", bench_fromFile },
+    { "grid_visible", bench_visible },
+    { "grid_overlay", bench_overlay },
+    { "player_updateVisibility", bench_updateVisibility },
+    { "gold_foundPile", bench_foundPile },
+    { "roster_getPlayerFromAddr", bench_playerFromAddr },
+    { "roster_getPlayerFromID", bench_playerFromID },
+    { "roster_getPlayerAt", bench_playerAt },
+};
+static const int NumBenchmarks = sizeof(Benchmarks) / sizeof(Benchmarks[0]);
+
+/**************** fixture_new ****************/
+/* Loads the map and builds everything the benchmarks use.
+ * Returns: new fixture, or NULL if the map cannot be loaded or has no spots.
+ */
+static fixture_t* fixture_new(const char* mapFile) {
+    grid_t* map = grid_fromFile(mapFile);
+    if (map == NULL) return NULL;
+    const int nrows = grid_nrows(map), ncols = grid_ncols(map);
+
+    fixture_t* f = calloc(1, sizeof(fixture_t));
+    f->mapFile = mapFile;
+    f->map = map;
+    f->spots = malloc(nrows * ncols * sizeof(grid_point_t));
+    for (int r = 0; r < nrows; r++) {
+        for (int c = 0; c < ncols; c++) {
+            if (grid_isSpot(map, r, c)) {
+                f->spots[f->numSpots++] = (grid_point_t) { r, c };
+            }
+        }
+    }
+    if (f->numSpots == 0) {
+        free(f->spots);
+        free(f);
+        grid_delete(map);
+        return NULL;
+    }
+    f->scratch = grid_new(nrows, ncols);
+
+    // gold piles on room spots, the same ones every run
+    f->goldMap = grid_new(nrows, ncols);
+    f->gold = gold_new(NumPiles);
+    srand(1);
+    for (int p = 0, tries = 0; p < NumPiles && tries < 100 * NumPiles; tries++) {
+        grid_point_t spot = f->spots[rand() % f->numSpots];
+        if (grid_isRoomSpot(map, spot.r, spot.c) && !grid_isGold(f->goldMap, spot.r, spot.c)) {
+            grid_set(f->goldMap, spot.r, spot.c, GRID_GOLD);
+            gold_addGoldPile(f->gold, spot.r, spot.c, 1 + rand() % 10);
+            p++;
+        }
+    }
+
+    // a player standing on the first spot, and a roster of players with distinct addresses,
+    // spread over the spots
+    f->player = player_new();
+    player_setName(f->player, strcpy(malloc(strlen("bench") + 1), "bench"));
+    player_initializeGridAndLocation(f->player, grid_new(nrows, ncols), f->goldMap, f->spots[0].c, f->spots[0].r);
+    f->roster = roster_new();
+    roster_setMapSize(f->roster, nrows, ncols);
+    for (int p = 0; p < NumPlayers; p++) {
+        player_t* member = player_new();
+        char port[8];
+        addr_t addr;
+        sprintf(port, "%d", 20000 + p);
+        message_setAddr("127.0.0.1", port, &addr);
+        player_setAddress(member, addr);
+        player_setName(member, strcpy(malloc(strlen("member") + 1), "member"));
+        grid_point_t spot = f->spots[(long) p * f->numSpots / NumPlayers];
+        player_initializeGridAndLocation(member, grid_new(nrows, ncols), f->goldMap, spot.c, spot.r);
+        roster_addPlayer(f->roster, member);
+        f->members[p] = member;
+    }
+    return f;
+}
+
+/**************** fixture_delete ****************/
+static void fixture_delete(fixture_t* f) {
+    roster_delete(f->roster);
+    player_delete(f->player);
+    gold_delete(f->gold);
+    grid_delete(f->goldMap);
+    grid_delete(f->scratch);
+    grid_delete(f->map);
+    free(f->spots);
+    free(f);
+}
+
+/**************** report ****************/
+/* Prints one record, as CSV or JSON.
+ */
+static void report(const char* mapFile, const char* op, long iterations, double nsPerOp, double allocsPerOp) {
+    if (json) {
+        printf("%s\n  {\"map\": \"%s\", \"op\": \"%s\", \"iterations\": %ld, \"ns_per_op\": %.1f, \"allocs_per_op\": %.2f}",
+               records == 0 ? "[" : ",", mapFile, op, iterations, nsPerOp, allocsPerOp);
+    } else {
+        if (records == 0) printf("map,op,iterations,ns_per_op,allocs_per_op\n");
+        printf("%s,%s,%ld,%.1f,%.2f\n", mapFile, op, iterations, nsPerOp, allocsPerOp);
+    }
+    records++;
+    fflush(stdout);
+}
+
+/**************** measure ****************/
+/* Runs the benchmark on the fixture for at least 'seconds', and reports it.
+ */
+static void measure(fixture_t* f, const benchmark_t* b, double seconds) {
+    b->run(f, 0);                       // warm up: build ray tables, fault in pages
+    const uint64_t budget = (uint64_t) (seconds * 1e9);
+    long iterations = 0;
+    long batch = 1;
+    unsigned long allocsBefore = atomic_load(&allocs);
+    uint64_t start = now(), elapsed = 0;
+    while (elapsed < budget) {
+        for (long i = 0; i < batch; i++) {
+            b->run(f, iterations + i);
+        }
+        iterations += batch;
+        elapsed = now() - start;
+        if (batch < 1 << 20) batch *= 2;    // read the clock less as we learn the pace
+    }
+    unsigned long allocsUsed = atomic_load(&allocs) - allocsBefore;
+    report(f->mapFile, b->name, iterations, (double) elapsed / iterations, (double) allocsUsed / iterations);
+}
+
+/**************** main ****************/
+int main(const int argc, char* argv[]) {
+    double seconds = DefaultTime;
+    int first = 1;
+    while (first < argc && strncmp(argv[first], "--", 2) == 0) {
+        if (strcmp(argv[first], "--json") == 0) {
+            json = true;
+            first++;
+        } else if (strcmp(argv[first], "--time") == 0 && first + 1 < argc
+                   && sscanf(argv[first + 1], "%lf", &seconds) == 1 && seconds > 0) {
+            first += 2;
+        } else {
+            break;
+        }
+    }
+    if (first >= argc) {
+        fprintf(stderr, "usage: %s [--json] [--time seconds] mapFile...\n", argv[0]);
+        exit(1);
+    }
+
+    int failures = 0;
+    for (int m = first; m < argc; m++) {
+        fixture_t* f = fixture_new(argv[m]);
+        if (f == NULL) {
+            fprintf(stderr, "%s: cannot load map, or it has no spots; skipped\n", argv[m]);
+            failures++;
+            continue;
+        }
+        for (int b = 0; b < NumBenchmarks; b++) {
+            measure(f, &Benchmarks[b], seconds);
+        }
+        fixture_delete(f);
+    }
+    if (json) printf("%s\n", records == 0 ? "[]" : "\n]");
+    grid_freeRays();
+    return (failures < argc - first) ? 0 : 2;      // some maps in the corpus are malformed
+}
@@ -0,0 +1,380 @@
+/*
+ * broadcast.c - Nuggets 'broadcast' module
+ *
+ * See broadcast.h for more information.
+ *
+ * The server thread and the broadcaster thread share two snapshot buffers.
+ * Snapshots are reclaimed by epoch: each is stamped with the epoch in which
+ * it was published, and the broadcaster announces the latest epoch it has
+ * finished reading; a buffer is refilled only once that announcement has
+ * reached the buffer's epoch. Frames and plain messages reach the
+ * broadcaster, in order, through a single-producer ring of events.
+ *
+ * The broadcaster keeps its own copy of the full map (with bit planes and a
+ * visibility cache, updated cell by cell from each snapshot) and its own copy
+ * of each player's view, so it shares nothing mutable with the server thread.
+ *
+ * Selena Zhou, Kyla Widodo, 23S
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include "grid.h"
+#include "player.h"
+#include "roster.h"
+#include "broadcast.h"
+#include "stats.h"
+#include "../support/message.h"
+#include "../support/ring.h"
+
+/**************** file-local global variables ****************/
+
+static const int QueueSize = 1024;      // events waiting for the broadcaster
+#define NumSnapshots 2                  // double buffered
+
+/**************** local types ****************/
+
+typedef struct frameEntry {
+    playerID_t playerID;
+    addr_t addr;
+    int x, y;                       // location
+    player_t* newView;              // copy of the player, the first time they appear
+} frameEntry_t;
+
+typedef struct snapshot {
+    unsigned long epoch;            // when published; 0 if never
+    grid_t* fullMap;
+    grid_t* goldMap;
+    addr_t spectator;
+    frameEntry_t* players;          // in roster order
+    int numPlayers;
+    int capacity;                   // size of players array
+} snapshot_t;
+
+typedef enum { EventSend, EventFrame, EventStop } eventKind_t;
+
+typedef struct event {
+    eventKind_t kind;
+    snapshot_t* snapshot;           // for EventFrame
+    addr_t to;                      // for EventSend
+    char message[];                 // for EventSend
+} event_t;
+
+/**************** global types ****************/
+
+typedef struct broadcast {
+    roster_t* roster;               // for its worker threads
+    int numIDs;                     // the roster's maxPlayers: IDs are 0...numIDs-1
+    pthread_t thread;
+    ring_t* events;                 // server thread -> broadcaster
+    sem_t eventReady;               // posted once per event queued
+    snapshot_t snapshots[NumSnapshots];
+
+    pthread_mutex_t lock;
+    pthread_cond_t finished;        // signaled when finishedEpoch advances
+    unsigned long finishedEpoch;    // protected by lock
+
+    // used only by the server thread
+    unsigned long publishedEpoch;
+    bool* announced;                // [numIDs]: players whose view was handed over
+    player_t** scratch;             // for roster_getPlayers
+    int scratchSize;
+
+    // used only by the broadcaster thread
+    player_t** views;               // [numIDs]: our copy of each player
+    grid_t* mirror;                 // full map as of the latest frame
+    grid_t* spectatorGrid;          // spectator's display
+} broadcast_t;
+
+/**************** file local helper functions ****************/
+/* opaque to those outside of the file*/
+
+/**************** broadcast_queue ****************/
+/* Hands an event to the broadcaster, waiting for room if the queue is full.
+ */
+static void broadcast_queue(broadcast_t* broadcast, event_t* event) {
+    while (!ring_push(broadcast->events, event)) {
+        sched_yield();
+    }
+    sem_post(&broadcast->eventReady);
+}
+
+/**************** broadcast_sendFrame ****************/
+/* Broadcaster thread: sends the DISPLAY frames for one snapshot, exactly as
+ * game_updateAllUsers would have at the time it was published.
+ */
+static void broadcast_sendFrame(broadcast_t* broadcast, const snapshot_t* snapshot) {
+    // bring our map up to date; only changed cells are written, keeping the cache warm
+    grid_copy(snapshot->fullMap, broadcast->mirror);
+
+    if (message_isAddr(snapshot->spectator)) {
+        grid_overlay(broadcast->mirror, snapshot->goldMap, broadcast->mirror, broadcast->spectatorGrid);
+        const char* gridString = grid_string(broadcast->spectatorGrid);
+        char* sendDisplayMsg = malloc(strlen("DISPLAY\n") + strlen(gridString) + 5);
+        if (sendDisplayMsg != NULL) {
+            sprintf(sendDisplayMsg, "DISPLAY\n%s", gridString);
+            stats_send(snapshot->spectator, sendDisplayMsg);
+            free(sendDisplayMsg);
+        }
+    }
+
+    if (snapshot->numPlayers == 0) return;
+    player_t** players = malloc(snapshot->numPlayers * sizeof(player_t*));
+    if (players == NULL) return;
+    int numPlayers = 0;
+    for (int i = 0; i < snapshot->numPlayers; i++) {
+        const frameEntry_t* entry = &snapshot->players[i];
+        playerID_t id = entry->playerID;
+        if (id >= broadcast->numIDs) continue;      // not announced; see broadcast_new
+        if (entry->newView != NULL) {
+            if (broadcast->views[id] != NULL) {
+                player_delete(broadcast->views[id]);
+            }
+            broadcast->views[id] = entry->newView;  // ours from now on
+        }
+        player_t* view = broadcast->views[id];
+        if (view == NULL) continue;                 // copy failed; skip them
+        player_setAddress(view, entry->addr);
+        player_setLocation(view, entry->x, entry->y);
+        players[numPlayers++] = view;
+    }
+    roster_sendDisplays(broadcast->roster, players, numPlayers, broadcast->mirror, snapshot->goldMap);
+    free(players);
+}
+
+/**************** broadcast_main ****************/
+/* Thread body for the broadcaster: handle events in order until told to stop.
+ */
+static void* broadcast_main(void* arg) {
+    broadcast_t* broadcast = arg;
+
+    while (true) {
+        sem_wait(&broadcast->eventReady);
+        event_t* event = ring_pop(broadcast->events);
+        if (event == NULL) continue;
+
+        switch (event->kind) {
+        case EventSend:
+            stats_send(event->to, event->message);
+            break;
+        case EventFrame:
+            broadcast_sendFrame(broadcast, event->snapshot);
+            // announce we are done reading it, so it may be reclaimed
+            pthread_mutex_lock(&broadcast->lock);
+            broadcast->finishedEpoch = event->snapshot->epoch;
+            pthread_cond_broadcast(&broadcast->finished);
+            pthread_mutex_unlock(&broadcast->lock);
+            break;
+        case EventStop:             // (not malloc'd)
+            grid_freeRays();        // this thread's ray templates
+            return NULL;
+        }
+        free(event);
+    }
+}
+
+/**************** broadcast_reclaim ****************/
+/* Server thread: returns the oldest snapshot the broadcaster has finished
+ * reading, waiting if it is still reading both.
+ */
+static snapshot_t* broadcast_reclaim(broadcast_t* broadcast) {
+    snapshot_t* oldest = NULL;
+    pthread_mutex_lock(&broadcast->lock);
+    while (true) {
+        for (int i = 0; i < NumSnapshots; i++) {
+            snapshot_t* snapshot = &broadcast->snapshots[i];
+            if (snapshot->epoch <= broadcast->finishedEpoch
+                && (oldest == NULL || snapshot->epoch < oldest->epoch)) {
+                oldest = snapshot;
+            }
+        }
+        if (oldest != NULL) break;
+        pthread_cond_wait(&broadcast->finished, &broadcast->lock);
+    }
+    pthread_mutex_unlock(&broadcast->lock);
+    return oldest;
+}
+
+/**************** broadcast_free ****************/
+/* Frees everything but the thread, ring, and synchronization.
+ */
+static void broadcast_free(broadcast_t* broadcast) {
+    for (int i = 0; i < NumSnapshots; i++) {
+        grid_delete(broadcast->snapshots[i].fullMap);
+        grid_delete(broadcast->snapshots[i].goldMap);
+        free(broadcast->snapshots[i].players);
+    }
+    for (int id = 0; broadcast->views != NULL && id < broadcast->numIDs; id++) {
+        if (broadcast->views[id] != NULL) {
+            player_delete(broadcast->views[id]);
+        }
+    }
+    free(broadcast->views);
+    free(broadcast->announced);
+    grid_delete(broadcast->mirror);
+    grid_delete(broadcast->spectatorGrid);
+    free(broadcast->scratch);
+    free(broadcast);
+}
+
+/**************** functions ****************/
+
+/**************** broadcast_new ****************/
+/* see broadcast.h for description */
+broadcast_t* broadcast_new(roster_t* roster, grid_t* fullMap, size_t visCacheBudget) {
+
+    broadcast_t* broadcast = calloc(1, sizeof(broadcast_t));
+    if (broadcast == NULL) return NULL;
+    broadcast->roster = roster;
+    broadcast->numIDs = roster_maxPlayers(roster);
+    broadcast->announced = calloc(broadcast->numIDs, sizeof(bool));
+    broadcast->views = calloc(broadcast->numIDs, sizeof(player_t*));
+    if (broadcast->announced == NULL || broadcast->views == NULL) {
+        broadcast_free(broadcast);
+        return NULL;
+    }
+
+    int nrows = grid_nrows(fullMap);
+    int ncols = grid_ncols(fullMap);
+    bool ok = true;
+    for (int i = 0; i < NumSnapshots; i++) {
+        broadcast->snapshots[i].fullMap = grid_new(nrows, ncols);
+        broadcast->snapshots[i].goldMap = grid_new(nrows, ncols);
+        ok = ok && broadcast->snapshots[i].fullMap != NULL && broadcast->snapshots[i].goldMap != NULL;
+    }
+    broadcast->mirror = grid_new(nrows, ncols);
+    broadcast->spectatorGrid = grid_new(nrows, ncols);
+    if (!ok || broadcast->mirror == NULL || broadcast->spectatorGrid == NULL) {
+        broadcast_free(broadcast);
+        return NULL;
+    }
+    grid_copy(fullMap, broadcast->mirror);
+    grid_buildPlanes(broadcast->mirror);
+    grid_buildSegments(broadcast->mirror);
+    if (visCacheBudget > 0) {
+        grid_enableVisCache(broadcast->mirror, visCacheBudget);
+    }
+
+    broadcast->events = ring_newSPSC(QueueSize);
+    if (broadcast->events == NULL) {
+        broadcast_free(broadcast);
+        return NULL;
+    }
+    sem_init(&broadcast->eventReady, 0, 0);
+    pthread_mutex_init(&broadcast->lock, NULL);
+    pthread_cond_init(&broadcast->finished, NULL);
+
+    if (pthread_create(&broadcast->thread, NULL, broadcast_main, broadcast) != 0) {
+        sem_destroy(&broadcast->eventReady);
+        pthread_mutex_destroy(&broadcast->lock);
+        pthread_cond_destroy(&broadcast->finished);
+        ring_delete(broadcast->events);
+        broadcast_free(broadcast);
+        return NULL;
+    }
+    return broadcast;
+}
+
+/**************** broadcast_send ****************/
+/* see broadcast.h for description */
+void broadcast_send(broadcast_t* broadcast, addr_t to, const char* message) {
+    if (message == NULL) return;
+
+    event_t* event = (broadcast == NULL) ? NULL : malloc(sizeof(event_t) + strlen(message) + 1);
+    if (event == NULL) {
+        stats_send(to, message);      // no broadcaster, or no memory
+        return;
+    }
+    event->kind = EventSend;
+    event->snapshot = NULL;
+    event->to = to;
+    strcpy(event->message, message);
+    broadcast_queue(broadcast, event);
+}
+
+/**************** broadcast_publish ****************/
+/* see broadcast.h for description */
+void broadcast_publish(broadcast_t* broadcast, roster_t* roster, grid_t* fullMap, grid_t* goldMap, addr_t spectator) {
+    if (broadcast == NULL) return;
+
+    event_t* event = malloc(sizeof(event_t));
+    if (event == NULL) return;
+
+    // gather the players first, so the snapshot buffer is held no longer than needed
+    int numPlayers = roster_numPlayers(roster);
+    if (numPlayers > broadcast->scratchSize) {
+        player_t** scratch = realloc(broadcast->scratch, numPlayers * sizeof(player_t*));
+        if (scratch == NULL) {
+            free(event);
+            return;
+        }
+        broadcast->scratch = scratch;
+        broadcast->scratchSize = numPlayers;
+    }
+    numPlayers = roster_getInterested(roster, broadcast->scratch);
+
+    snapshot_t* snapshot = broadcast_reclaim(broadcast);
+    if (numPlayers > snapshot->capacity) {
+        frameEntry_t* entries = realloc(snapshot->players, numPlayers * sizeof(frameEntry_t));
+        if (entries == NULL) {
+            free(event);
+            return;
+        }
+        snapshot->players = entries;
+        snapshot->capacity = numPlayers;
+    }
+
+    grid_copy(fullMap, snapshot->fullMap);
+    grid_copy(goldMap, snapshot->goldMap);
+    snapshot->spectator = spectator;
+    snapshot->numPlayers = numPlayers;
+    for (int i = 0; i < numPlayers; i++) {
+        player_t* player = broadcast->scratch[i];
+        playerID_t id = player_getID(player);
+        frameEntry_t* entry = &snapshot->players[i];
+        entry->playerID = id;
+        entry->addr = player_getAddr(player);
+        entry->x = player_getXLocation(player);
+        entry->y = player_getYLocation(player);
+        entry->newView = NULL;
+        if (id < broadcast->numIDs && !broadcast->announced[id]) {
+            entry->newView = player_copy(player);
+            broadcast->announced[id] = (entry->newView != NULL);
+        }
+    }
+    snapshot->epoch = ++broadcast->publishedEpoch;
+
+    event->kind = EventFrame;
+    event->snapshot = snapshot;
+    broadcast_queue(broadcast, event);
+}
+
+/**************** broadcast_removePlayer ****************/
+/* see broadcast.h for description */
+void broadcast_removePlayer(broadcast_t* broadcast, playerID_t playerID) {
+    if (broadcast == NULL || playerID >= broadcast->numIDs) return;
+    // the next player with this ID is announced afresh, and their copy
+    // replaces the broadcaster's copy of this one
+    broadcast->announced[playerID] = false;
+}
+
+/**************** broadcast_delete ****************/
+/* see broadcast.h for description */
+void broadcast_delete(broadcast_t* broadcast) {
+    if (broadcast == NULL) return;
+
+    // everything queued before the stop is handled first
+    event_t stop = { .kind = EventStop, .snapshot = NULL };
+    broadcast_queue(broadcast, &stop);
+    pthread_join(broadcast->thread, NULL);
+
+    sem_destroy(&broadcast->eventReady);
+    pthread_mutex_destroy(&broadcast->lock);
+    pthread_cond_destroy(&broadcast->finished);
+    ring_delete(broadcast->events);
+    broadcast_free(broadcast);
+}
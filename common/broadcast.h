@@ -0,0 +1,77 @@
+/*
+ * broadcast.h - header file for Nuggets 'broadcast' module
+ *
+ * A 'broadcast' takes the building and sending of DISPLAY frames off the
+ * server thread. After each change to the game, the server thread publishes
+ * an immutable snapshot of the full map, the gold map, and every player's
+ * position; a broadcaster thread builds and sends each client's frame from
+ * that snapshot while the server thread goes on to handle the next input.
+ * Every other message the game sends is queued behind the frames, so each
+ * client receives exactly the messages, in the order, it would without one.
+ *
+ * Selena Zhou, Kyla Widodo, 23S
+ */
+
+#ifndef __BROADCAST_H
+#define __BROADCAST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "grid.h"
+#include "roster.h"
+#include "../support/message.h"
+
+/**************** global types ****************/
+typedef struct broadcast broadcast_t;
+
+/**************** functions ****************/
+
+/**************** broadcast_new ****************/
+/* Starts a broadcaster thread for the game whose players and map are given.
+ *
+ * Caller provides: roster (whose worker threads build the frames), the game's
+ *   full map as it is now, and a memory budget for the broadcaster's own
+ *   visibility cache (0 for none).
+ * Returns: new broadcaster, or NULL upon failure.
+ * Note: from then on, the broadcaster owns a copy of each player's visible
+ *   map; the player's own visible map is no longer used for broadcasts.
+ *   It keeps room for the roster's maxPlayers IDs (see roster_setLimits),
+ *   so the roster's limits must be set first, and not changed after.
+ */
+broadcast_t* broadcast_new(roster_t* roster, grid_t* fullMap, size_t visCacheBudget);
+
+/**************** broadcast_send ****************/
+/* Queues a message to be sent after everything published or queued so far.
+ * Sends it right away if broadcast is NULL.
+ *
+ * Caller provides: broadcaster or NULL, destination address, message to copy.
+ */
+void broadcast_send(broadcast_t* broadcast, addr_t to, const char* message);
+
+/**************** broadcast_publish ****************/
+/* Publishes a snapshot of the game, from which the broadcaster sends a
+ * DISPLAY to the spectator (if any) and to every player in the roster,
+ * just as game_updateAllUsers does. Returns once the snapshot is taken.
+ * Two snapshots are kept; if the broadcaster is still reading both,
+ * waits until it finishes the older one.
+ *
+ * Caller provides: broadcaster, the roster, and the game's maps and spectator.
+ */
+void broadcast_publish(broadcast_t* broadcast, roster_t* roster, grid_t* fullMap, grid_t* goldMap, addr_t spectator);
+
+/**************** broadcast_removePlayer ****************/
+/* Notes that the player with the given ID has left the roster, so that a
+ * later player given the same ID is not taken for them. Does nothing if
+ * broadcast is NULL.
+ *
+ * Caller provides: broadcaster or NULL, ID of the player removed.
+ */
+void broadcast_removePlayer(broadcast_t* broadcast, playerID_t playerID);
+
+/**************** broadcast_delete ****************/
+/* Sends everything still queued, stops the broadcaster thread, and frees it.
+ */
+void broadcast_delete(broadcast_t* broadcast);
+
+#endif // __BROADCAST_H
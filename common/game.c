@@ -8,27 +8,36 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <ctype.h>
+#include <unistd.h>
 #include "grid.h"
 #include "player.h"
 #include "roster.h"
 #include "../support/message.h"
 #include "gold.h"
+#include "broadcast.h"
+#include "snapshot.h"
+#include "../support/trace.h"
 
 /**************** file-local global variables ****************/
 
 static const int MaxNameLength = 50;   // max number of chars in playerName
-static const int MaxPlayers = 26;      // maximum number of players
+static const int MaxPlayers = 26;      // maximum number of players, unless game_setLimits
 static const int GoldTotal = 250;      // amount of gold in the game
 static const int GoldMinNumPiles = 10; // minimum number of gold piles
 static const int GoldMaxNumPiles = 30; // maximum number of gold piles
+static const size_t VisCacheBudget = 4 << 20; // bytes for cached visible sets
+static const char CompiledSuffix[] = ".nugmap"; // maps loaded by grid_fromCompiled
 
 /**************** global types ****************/
 
 typedef struct game {
-    roster_t* players;       // holds char* playerID to player_t* player
+    roster_t* players;       // players who have joined and not quit
     int numbPlayers;
+    int maxPlayers;
+    int radius;                 // interest radius (see game_setLimits)
     addr_t spectator;
     grid_t* originalMap;
     grid_t* fullMap;
@@ -37,33 +46,161 @@ typedef struct game {
     int mapRows;
     int mapCols;
     int remainingGold;
+    broadcast_t* broadcaster;   // sends displays on another thread, or NULL
+    unsigned long seed;         // the game's random numbers all follow from it
+    uint64_t rng[4];            // xoshiro256** state
+    snapshotWriter_t* snapshots;    // writes game_snapshot's out, or NULL if none yet
 } game_t;
 
 /**************** helper functions ****************/
 /* these functions are opaque to outside files */
 
+/* game_seedRandom(game_t* game, unsigned long seed)
+ *
+ * Seeds the game's own xoshiro256** generator, filling its state from the
+ * seed with splitmix64 (as its authors recommend), so that one game's random
+ * numbers depend on nothing but its seed: not on other games, other threads,
+ * or the C library's rand().
+ * Caller provides: game
+ * Returns: nothing
+ */
+static void game_seedRandom(game_t* game, unsigned long seed) {
+    game->seed = seed;
+    uint64_t z = seed;
+    for (int i = 0; i < 4; i++) {
+        uint64_t x = (z += 0x9E3779B97F4A7C15ULL);
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+        game->rng[i] = x ^ (x >> 31);
+    }
+}
+
+/* game_random(game_t* game, int n)
+ *
+ * Returns the next number from the game's generator, reduced to [0, n).
+ * Caller provides: seeded game, n > 0
+ */
+static int game_random(game_t* game, int n) {
+    uint64_t* s = game->rng;
+    uint64_t x = s[1] * 5;
+    uint64_t result = ((x << 7) | (x >> 57)) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = (s[3] << 45) | (s[3] >> 19);
+    return (int) ((result >> 32) * (uint64_t) n >> 32);     // high bits, no division
+}
+
+/* game_create(grid_t* fullMap, grid_t* originalMap, bool compiled)
+ *
+ * Makes a game, with no players, gold or seed yet, of the maps given, and
+ * readies the full map for the game's hot paths: its bit planes (unless
+ * compiled, when grid_fromCompiled built them), rooms, and visibility cache.
+ * Caller provides: the map, and a copy of it, which the game then owns
+ * Returns: new game, or NULL upon failure
+ */
+static game_t* game_create(grid_t* fullMap, grid_t* originalMap, bool compiled) {
+
+    game_t* game = malloc(sizeof(game_t));
+    if (game == NULL) return NULL;
+
+    game->players = roster_new();
+    if (game->players == NULL) return NULL;
+    game->spectator = message_noAddr();
+
+    game->fullMap = fullMap;
+    if (!compiled) {
+        grid_buildPlanes(game->fullMap);    // bit tests for the hot predicates
+    }
+    grid_buildSegments(game->fullMap);      // rooms, for the convex-room fast path
+    grid_enableVisCache(game->fullMap, VisCacheBudget);
+    game->originalMap = originalMap;
+    game->mapRows = grid_nrows(game->fullMap);
+    game->mapCols = grid_ncols(game->fullMap);
+    roster_setMapSize(game->players, game->mapRows, game->mapCols);  // who is where, without a scan
+    game->goldMap = NULL;
+    game->goldNuggets = NULL;
+
+    game->remainingGold = GoldTotal;
+    game->numbPlayers = 0;
+    game->maxPlayers = MaxPlayers;
+    game->radius = 0;
+    game->broadcaster = NULL;
+    game->snapshots = NULL;
+
+    return game;
+}
+
+/* game_parseAddr(const char* string, addr_t* addr)
+ *
+ * Sets *addr to the address message_stringAddr gave as string ("host:port"),
+ * or to no address if string is empty; for restoring a snapshot.
+ * Caller provides: string, or NULL; where to put the address
+ * Returns: false if string is NULL or no address
+ */
+static bool game_parseAddr(const char* string, addr_t* addr) {
+    if (string == NULL) return false;
+    if (string[0] == '\0') {
+        *addr = message_noAddr();
+        return true;
+    }
+    const char* colon = strrchr(string, ':');
+    char host[64];
+    if (colon == NULL || colon - string >= sizeof(host)) return false;
+    memcpy(host, string, colon - string);
+    host[colon - string] = '\0';
+    return message_setAddr(host, colon + 1, addr);
+}
+
+/* game_gatherPile(void* arg, int row, int col, int nuggets, bool found)
+ *
+ * For gold_iterate: appends one pile (row, col, nuggets, found) to the array
+ * of ints at arg, a pileArray_t.
+ */
+typedef struct pileArray {
+    int* fields;            // 4 per pile
+    int numPiles;
+} pileArray_t;
+
+static void game_gatherPile(void* arg, int row, int col, int nuggets, bool found) {
+    pileArray_t* piles = arg;
+    if (piles->fields != NULL) {
+        int* pile = &piles->fields[4 * piles->numPiles];
+        pile[0] = row; pile[1] = col; pile[2] = nuggets; pile[3] = found;
+    }
+    piles->numPiles++;
+}
+
 /* game_setGold(game_t* game)
  * 
  * This function initializes the game by dropping at least GoldMinNumPiles and at most GoldMaxNumPiles
  * gold piles on random room spots with random number of nuggets per pile, remembering on game's gold map.
- * Caller provides: game with valid full map
+ * A game being reset keeps its gold map, erased.
+ * Caller provides: game with valid full map, and no gold piles
  * Returns: nothing
  */
 void game_setGold(game_t* game) {
     
-    game->goldMap = grid_new(game->mapRows, game->mapCols);
-    int numbPiles = rand() % (GoldMaxNumPiles-GoldMinNumPiles+1) + GoldMinNumPiles;     // will generate between 0 and difference, then add to min
+    if (game->goldMap == NULL) {
+        game->goldMap = grid_new(game->mapRows, game->mapCols);
+    } else {
+        grid_erase(game->goldMap);
+    }
+    int numbPiles = game_random(game, GoldMaxNumPiles-GoldMinNumPiles+1) + GoldMinNumPiles;     // will generate between 0 and difference, then add to min
     int maxNuggetsInPile = GoldTotal - numbPiles + 1;               // max nuggets in one pile is total gold - total piles + 1, need to update max
     int allocatedNuggets = 0;   // total allocated number of nuggets (max of GoldTotal)
     game->goldNuggets = gold_new(numbPiles);
 
     for (int i = 0; i < numbPiles; i++) {
         // generate random location, makes sure it is a room spot WITHOUT existing pile
-        int goldRow = rand() % game->mapRows;
-        int goldCol = rand() % game->mapCols;
+        int goldRow = game_random(game, game->mapRows);
+        int goldCol = game_random(game, game->mapCols);
         while(!grid_isRoomSpot(game->fullMap, goldRow, goldCol) || grid_isGold(game->goldMap, goldRow, goldCol)) {
-            goldRow = rand() % game->mapRows;
-            goldCol = rand() % game->mapCols;
+            goldRow = game_random(game, game->mapRows);
+            goldCol = game_random(game, game->mapCols);
         }
 
         int numbNuggets;
@@ -72,7 +209,7 @@ void game_setGold(game_t* game) {
             maxNuggetsInPile = 0;
         } else {
             // generate random nugget number, then update max nuggets for one pile
-            numbNuggets = rand() % maxNuggetsInPile + 1;
+            numbNuggets = game_random(game, maxNuggetsInPile) + 1;
             allocatedNuggets += numbNuggets;
             maxNuggetsInPile = (GoldTotal - allocatedNuggets) - (numbPiles - i) + 1;       // new max is remaining gold - remaining piles + 1
         }
@@ -94,10 +231,10 @@ void game_setGold(game_t* game) {
  * Caller provides: valid player and player address
  * Returns: nothing
  */
-void game_sendOKMessage(player_t* newPlayer, addr_t playerAddr) {
+void game_sendOKMessage(game_t* game, player_t* newPlayer, addr_t playerAddr) {
     char* sendOKmessage = malloc(10);
-    sprintf(sendOKmessage, "OK %c", player_getID(newPlayer));
-    message_send(playerAddr, sendOKmessage);
+    sprintf(sendOKmessage, "OK %c", player_getGlyph(newPlayer));
+    game_send(game, playerAddr, sendOKmessage);
     free(sendOKmessage);
 }
 
@@ -111,7 +248,7 @@ void game_sendOKMessage(player_t* newPlayer, addr_t playerAddr) {
 void game_sendGridMessage(game_t* game, addr_t player) {
     char* sendGridMessage = malloc(strlen("GRID ") + 50);
     sprintf(sendGridMessage, "GRID %d %d", game->mapRows, game->mapCols);
-    message_send(player, sendGridMessage);
+    game_send(game, player, sendGridMessage);
     free(sendGridMessage);
 }
 
@@ -128,7 +265,7 @@ void game_sendGridMessage(game_t* game, addr_t player) {
 void game_sendGoldMessage(game_t* game, addr_t player, int n, int p) {
     char* sendGoldMsg = malloc(20);
     sprintf(sendGoldMsg, "GOLD %d %d %d", n, p, game->remainingGold);
-    message_send(player, sendGoldMsg);
+    game_send(game, player, sendGoldMsg);
     free(sendGoldMsg);
 }
 
@@ -188,7 +325,7 @@ void game_sendDisplayMessage(game_t* game, addr_t player) {
         const char* gridString = grid_string(sendDisplayGrid);
         char* sendDisplayMsg = malloc(strlen("DISPLAY\n") + strlen(gridString) + 5);
         sprintf(sendDisplayMsg, "DISPLAY\n%s", gridString);
-        message_send(player, sendDisplayMsg);
+        game_send(game, player, sendDisplayMsg);
         free(sendDisplayMsg);
         grid_delete(sendDisplayGrid);
         return;
@@ -200,7 +337,7 @@ void game_sendDisplayMessage(game_t* game, addr_t player) {
     const char* gridString = grid_string(visibleGrid);
     char* sendDisplayMsg = malloc(strlen("DISPLAY") + strlen(gridString) + 5);
     sprintf(sendDisplayMsg, "DISPLAY\n%s", gridString);
-    message_send(player, sendDisplayMsg);
+    game_send(game, player, sendDisplayMsg);
     free(sendDisplayMsg);
 }
 
@@ -212,6 +349,10 @@ void game_sendDisplayMessage(game_t* game, addr_t player) {
  * Returns: nothing
  */
 void game_updateAllUsers(game_t* game) {
+    if (game->broadcaster != NULL) {
+        broadcast_publish(game->broadcaster, game->players, game->fullMap, game->goldMap, game->spectator);
+        return;
+    }
     if (message_isAddr(game->spectator)) {
         game_sendDisplayMessage(game, game->spectator);
     }
@@ -227,8 +368,8 @@ void game_stealGold(game_t* game, player_t* thief, player_t* victim) {
     // If victim doesn't have any gold nuggets
     if (player_getGold(victim) <= 0) {
         char* msg = malloc(strlen("GOLDSTEAL ") + 20);
-        sprintf(msg, "GOLDSTEAL %d %d %d %c", 0, player_getGold(thief), game->remainingGold, player_getID(victim));
-        message_send(player_getAddr(thief), msg);
+        sprintf(msg, "GOLDSTEAL %d %d %d %c", 0, player_getGold(thief), game->remainingGold, player_getGlyph(victim));
+        game_send(game, player_getAddr(thief), msg);
         free(msg);
         return;
     }
@@ -237,12 +378,12 @@ void game_stealGold(game_t* game, player_t* thief, player_t* victim) {
     player_foundGoldNuggets(victim, -1);
 
     char* msgToThief = malloc(strlen("GOLDSTEAL ") + 20);
-    sprintf(msgToThief, "GOLDSTEAL %d %d %d %c", 1, player_getGold(thief), game->remainingGold, player_getID(victim));
-    message_send(player_getAddr(thief), msgToThief);
+    sprintf(msgToThief, "GOLDSTEAL %d %d %d %c", 1, player_getGold(thief), game->remainingGold, player_getGlyph(victim));
+    game_send(game, player_getAddr(thief), msgToThief);
     
     char* msgToVictim = malloc(strlen("GOLDSTEAL ") + 20);
-    sprintf(msgToVictim, "GOLDSTEAL %d %d %d %c", -1, player_getGold(victim), game->remainingGold, player_getID(thief));
-    message_send(player_getAddr(victim), msgToVictim);
+    sprintf(msgToVictim, "GOLDSTEAL %d %d %d %c", -1, player_getGold(victim), game->remainingGold, player_getGlyph(thief));
+    game_send(game, player_getAddr(victim), msgToVictim);
 
     free(msgToThief); free(msgToVictim);
 }
@@ -254,32 +395,61 @@ void game_stealGold(game_t* game, player_t* thief, player_t* victim) {
 
 /**************** game_new ****************/
 /* see game.h for description */
-game_t* game_new(char* mapFileName) {
+game_t* game_new(char* mapFileName, unsigned long seed) {
 
-    game_t* game = malloc(sizeof(game_t));
+    // a compiled map (see mapc.c) is mapped in, with its planes already built
+    size_t nameLength = strlen(mapFileName);
+    bool compiled = nameLength >= strlen(CompiledSuffix)
+        && strcmp(mapFileName + nameLength - strlen(CompiledSuffix), CompiledSuffix) == 0;
+    grid_t* fullMap = compiled ? grid_fromCompiled(mapFileName) : grid_fromFile(mapFileName);
+    if (fullMap == NULL) return NULL;
+    grid_t* originalMap = compiled ? grid_fromCompiled(mapFileName) : grid_fromFile(mapFileName);
+
+    game_t* game = game_create(fullMap, originalMap, compiled);
     if (game == NULL) return NULL;
 
-    game->players = roster_new();
-    if (game->players == NULL) return NULL;
-    game->spectator = message_noAddr();
+    game_seedRandom(game, seed);
+    game_setGold(game);
 
-    game->fullMap = grid_fromFile(mapFileName);
-    if (game->fullMap == NULL) return NULL;
-    game->originalMap = grid_fromFile(mapFileName);
-    game->mapRows = grid_nrows(game->fullMap);
-    game->mapCols = grid_ncols(game->fullMap);
+    return game;
+}
 
-    game->remainingGold = GoldTotal;
+/**************** game_reset ****************/
+/* see game.h for description */
+void game_reset(game_t* game, unsigned long seed) {
+    TRACE_SCOPE("game_reset");
+
+    // the finished match's frames go out, and its thread stops until the next match starts one
+    broadcast_delete(game->broadcaster);
+    game->broadcaster = NULL;
+
+    // everyone leaves, newest first, so no one is moved up a slot
+    int numPlayers = roster_numPlayers(game->players);
+    player_t** players = malloc((numPlayers > 0 ? numPlayers : 1) * sizeof(player_t*));
+    if (players != NULL) {
+        roster_getPlayers(game->players, players);
+        for (int i = 0; i < numPlayers; i++) {
+            roster_removePlayer(game->players, players[i]);
+        }
+        free(players);
+    }
     game->numbPlayers = 0;
+    game->spectator = message_noAddr();
 
+    // the map as it was, cell by cell: its planes, rooms and cached views stay good
+    grid_copy(game->originalMap, game->fullMap);
+    gold_delete(game->goldNuggets);
+    game->goldNuggets = NULL;
+    game->remainingGold = GoldTotal;
+    game_seedRandom(game, seed);
     game_setGold(game);
-
-    return game;
 }
 
 /**************** game_delete ****************/
 /* see game.h for description */
 void game_delete(game_t* game) {
+    snapshot_deleteWriter(game->snapshots); // writes anything still queued
+    broadcast_delete(game->broadcaster);    // sends anything still queued
     roster_delete(game->players);
     grid_delete(game->originalMap);
     grid_delete(game->fullMap);
@@ -288,14 +458,51 @@ void game_delete(game_t* game) {
     free(game);
 }
 
+/**************** game_getSeed ****************/
+/* see game.h for description */
+unsigned long game_getSeed(game_t* game) {
+    return game->seed;
+}
+
+/**************** game_setLimits ****************/
+/* see game.h for description */
+bool game_setLimits(game_t* game, int maxPlayers, int radius) {
+    if (game == NULL || game->broadcaster != NULL      // sized for the old limit
+        || !roster_setLimits(game->players, maxPlayers, radius)) return false;
+    game->maxPlayers = maxPlayers;
+    game->radius = radius;
+    return true;
+}
+
+/**************** game_setWorkers ****************/
+/* see game.h for description */
+void game_setWorkers(game_t* game, pool_t* workers) {
+    roster_setWorkers(game->players, workers);
+}
+
+/**************** game_startBroadcaster ****************/
+/* see game.h for description */
+bool game_startBroadcaster(game_t* game) {
+    if (game->broadcaster == NULL) {
+        game->broadcaster = broadcast_new(game->players, game->fullMap, VisCacheBudget);
+    }
+    return game->broadcaster != NULL;
+}
+
+/**************** game_send ****************/
+/* see game.h for description */
+void game_send(game_t* game, addr_t to, const char* message) {
+    broadcast_send(game->broadcaster, to, message);
+}
+
 /**************** end_game ****************/
 /* see game.h for description */
 void end_game(game_t* game) {
     // sends summary to all players
-    char* summary = roster_createGameMessage(game->players);
+    char* summary = roster_createGameMessage(game->players, game);
     // send summary to spectator
     if (message_isAddr(game->spectator)) {
-        message_send(game->spectator, summary);
+        game_send(game, game->spectator, summary);
     }
     free(summary);    
 }
@@ -309,12 +516,12 @@ void game_addSpectator(game_t* game, addr_t newSpectator) {
 
         // Make sure spectator isn't a player already
         if (roster_getPlayerFromAddr(game->players, newSpectator) != NULL) {
-            message_send(newSpectator, "ERROR You are already a player.");
+            game_send(game, newSpectator, "ERROR You are already a player.");
             return;
         }
 
         if (message_isAddr(game->spectator)) {
-            message_send(game->spectator, "QUIT You have been replaced by a new spectator.");
+            game_send(game, game->spectator, "QUIT You have been replaced by a new spectator.");
         }
         game->spectator = newSpectator;
         game_sendGridMessage(game, newSpectator);
@@ -328,14 +535,14 @@ void game_addSpectator(game_t* game, addr_t newSpectator) {
 void game_addPlayer(game_t* game, addr_t playerAddr, const char* message) {
 
     // Send QUIT if at max players
-    if (game->numbPlayers == MaxPlayers) {
-        message_send(playerAddr, "QUIT Game is full: no more players can join.");
+    if (game->numbPlayers >= game->maxPlayers) {
+        game_send(game, playerAddr, "QUIT Game is full: no more players can join.");
         return;
     }
 
     // Send ERROR if Spectator sends
     if (message_eqAddr(game->spectator, playerAddr)) {
-        message_send(playerAddr, "ERROR Invalid key for spectator.");
+        game_send(game, playerAddr, "ERROR Invalid key for spectator.");
         return;
     }
 
@@ -345,7 +552,7 @@ void game_addPlayer(game_t* game, addr_t playerAddr, const char* message) {
 
     // Send QUIT if no player name provided
     if (strlen(playerName) == 0) {
-        message_send(playerAddr, "QUIT Sorry - you must provide player's name.");
+        game_send(game, playerAddr, "QUIT Sorry - you must provide player's name.");
         return;
     }
 
@@ -356,10 +563,16 @@ void game_addPlayer(game_t* game, addr_t playerAddr, const char* message) {
     player_setAddress(newPlayer, playerAddr);
     char* setName = malloc(MaxNameLength);      // need to be free'd in player_delete
     strncpy(setName, playerName, MaxNameLength);
+    setName[MaxNameLength - 1] = '\0';          // a longer name is cut short
     player_setName(newPlayer, setName);
-    roster_addPlayer(game->players, newPlayer);
     free(cmd);
     free(playerName);
+    if (!roster_addPlayer(game->players, newPlayer)) {     // gives them their ID
+        game->numbPlayers -= 1;
+        player_delete(newPlayer);
+        game_send(game, playerAddr, "QUIT Game is full: no more players can join.");
+        return;
+    }
 
     /* Initialize player location
      * Randomly go through full grid, if it's an empty space then
@@ -368,15 +581,24 @@ void game_addPlayer(game_t* game, addr_t playerAddr, const char* message) {
      *      Update player visible grid
      * game_updateAllUsers
      */
-    int playerX = rand() % game->mapCols;
-    int playerY = rand() % game->mapRows;
-    // make sure is in valid room spot and NOT on top of another player
+    int playerX = game_random(game, game->mapCols);
+    int playerY = game_random(game, game->mapRows);
+    // make sure is in valid room spot and NOT on top of another player;
+    // a large game may fill every room spot, so give up eventually
+    long tries = 100L * game->mapRows * game->mapCols;
     while(!grid_isRoomSpot(game->fullMap, playerY, playerX) || grid_isPlayer(game->fullMap, playerY, playerX)) {
-        playerX = rand() % game->mapCols;
-        playerY = rand() % game->mapRows;
+        if (--tries == 0) {
+            game->numbPlayers -= 1;
+            broadcast_removePlayer(game->broadcaster, player_getID(newPlayer));
+            roster_removePlayer(game->players, newPlayer);
+            game_send(game, playerAddr, "QUIT Game is full: no more players can join.");
+            return;
+        }
+        playerX = game_random(game, game->mapCols);
+        playerY = game_random(game, game->mapRows);
     }
     
-    grid_set(game->fullMap, playerY, playerX, player_getID(newPlayer));
+    grid_set(game->fullMap, playerY, playerX, player_getGlyph(newPlayer));
     grid_t* playerVisibleGrid = grid_new(game->mapRows, game->mapCols);
     grid_visible(game->fullMap, playerY, playerX, playerVisibleGrid);
     grid_set(playerVisibleGrid, playerY, playerX, GRID_PLAYER_ME);
@@ -385,7 +607,7 @@ void game_addPlayer(game_t* game, addr_t playerAddr, const char* message) {
     player_updateVisibility(newPlayer, game->fullMap, game->goldMap);
 
     // Send 'OK playerID'
-    game_sendOKMessage(newPlayer, playerAddr);
+    game_sendOKMessage(game, newPlayer, playerAddr);
     game_sendGridMessage(game, playerAddr);
     
     // Send information to client (GRID, GOLD, DISPLAY)
@@ -409,7 +631,7 @@ void game_addPlayer(game_t* game, addr_t playerAddr, const char* message) {
 bool game_Q_quitGame(game_t* game, addr_t player, const char* message) {
 
     if (message_eqAddr(game->spectator, player)) {
-        message_send(player, "QUIT Thanks for watching!");
+        game_send(game, player, "QUIT Thanks for watching!");
         game->spectator = message_noAddr();
         return false;
     }
@@ -427,8 +649,10 @@ bool game_Q_quitGame(game_t* game, addr_t player, const char* message) {
         game_updateAllUsersGold(game);
     }
 
-    player_setAddress(freePlayer, message_noAddr());
-    message_send(player, "QUIT Thanks for playing!");
+    // free their slot and their ID for a later player
+    broadcast_removePlayer(game->broadcaster, player_getID(freePlayer));
+    roster_removePlayer(game->players, freePlayer);
+    game_send(game, player, "QUIT Thanks for playing!");
     game_updateAllUsers(game);
 
     return false;
@@ -438,9 +662,10 @@ bool game_Q_quitGame(game_t* game, addr_t player, const char* message) {
 /**************** game_[KEY]_move[DIRECTION] ****************/
 /* see game.h for description */
 bool game_h_moveLeft(game_t* game, addr_t player, const char* message) {
+    TRACE_SCOPE("game_h_moveLeft");
 
     if (message_eqAddr(game->spectator, player)) {
-        message_send(player, "ERROR unknown keystroke for spectator.");
+        game_send(game, player, "ERROR unknown keystroke for spectator.");
         return false;
     }
 
@@ -462,17 +687,17 @@ bool game_h_moveLeft(game_t* game, addr_t player, const char* message) {
             if (game_foundGold(game, calledPlayer, playerRow, newPlayerCol)) return true;
         }
         grid_set(game->fullMap, playerRow, newPlayerCol+1, moveFrom);                    // reset spot on map
-        grid_set(game->fullMap, playerRow, newPlayerCol, player_getID(calledPlayer));    // update player on map
+        grid_set(game->fullMap, playerRow, newPlayerCol, player_getGlyph(calledPlayer));    // update player on map
         player_moveLeftAndRight(calledPlayer, -1, moveFrom);
         player_updateVisibility(calledPlayer, game->fullMap, game->goldMap);
         game_updateAllUsers(game);
 
     } else if (isalpha(moveTo)) {           // is another player then swap
-        player_t* conflictingPlayer = roster_getPlayerFromID(game->players, moveTo);
+        player_t* conflictingPlayer = roster_getPlayerAt(game->players, newPlayerCol, playerRow);
         game_stealGold(game, calledPlayer, conflictingPlayer);
 
         grid_set(game->fullMap, playerRow, newPlayerCol+1, moveTo);                      // set original player spot on map to conflicting player
-        grid_set(game->fullMap, playerRow, newPlayerCol, player_getID(calledPlayer));    // update player on map
+        grid_set(game->fullMap, playerRow, newPlayerCol, player_getGlyph(calledPlayer));    // update player on map
         // update player
         player_moveLeftAndRight(calledPlayer, -1, moveFrom);
         player_updateVisibility(calledPlayer, game->fullMap, game->goldMap);
@@ -507,9 +732,10 @@ bool game_h_moveLeft(game_t* game, addr_t player, const char* message) {
 }
 
 bool game_l_moveRight(game_t* game, addr_t player, const char* message) {
+    TRACE_SCOPE("game_l_moveRight");
 
     if (message_eqAddr(game->spectator, player)) {
-        message_send(player, "ERROR unknown keystroke for spectator.");
+        game_send(game, player, "ERROR unknown keystroke for spectator.");
         return false;
     }
 
@@ -531,17 +757,17 @@ bool game_l_moveRight(game_t* game, addr_t player, const char* message) {
             if (game_foundGold(game, calledPlayer, playerRow, newPlayerCol)) return true;
         }
         grid_set(game->fullMap, playerRow, newPlayerCol-1, moveFrom);                    // reset spot on map
-        grid_set(game->fullMap, playerRow, newPlayerCol, player_getID(calledPlayer));    // update player on map
+        grid_set(game->fullMap, playerRow, newPlayerCol, player_getGlyph(calledPlayer));    // update player on map
         player_moveLeftAndRight(calledPlayer, 1, moveFrom);
         player_updateVisibility(calledPlayer, game->fullMap, game->goldMap);
         game_updateAllUsers(game);
 
     } else if (isalpha(moveTo)) {           // is another player then swap
-        player_t* conflictingPlayer = roster_getPlayerFromID(game->players, moveTo);
+        player_t* conflictingPlayer = roster_getPlayerAt(game->players, newPlayerCol, playerRow);
         game_stealGold(game, calledPlayer, conflictingPlayer);
 
         grid_set(game->fullMap, playerRow, newPlayerCol-1, moveTo);                    // reset spot on map
-        grid_set(game->fullMap, playerRow, newPlayerCol, player_getID(calledPlayer));    // update player on map
+        grid_set(game->fullMap, playerRow, newPlayerCol, player_getGlyph(calledPlayer));    // update player on map
         // update player
         player_moveLeftAndRight(calledPlayer, 1, moveFrom);
         player_updateVisibility(calledPlayer, game->fullMap, game->goldMap);
@@ -555,9 +781,10 @@ bool game_l_moveRight(game_t* game, addr_t player, const char* message) {
     return false;
 }
 bool game_j_moveDown(game_t* game, addr_t player, const char* message) {
+    TRACE_SCOPE("game_j_moveDown");
 
     if (message_eqAddr(game->spectator, player)) {
-        message_send(player, "ERROR unknown keystroke for spectator.");
+        game_send(game, player, "ERROR unknown keystroke for spectator.");
         return false;
     }
 
@@ -579,17 +806,17 @@ bool game_j_moveDown(game_t* game, addr_t player, const char* message) {
             if (game_foundGold(game, calledPlayer, newPlayerRow, playerCol)) return true;
         }
         grid_set(game->fullMap, newPlayerRow-1, playerCol, moveFrom);                    // reset spot on map
-        grid_set(game->fullMap, newPlayerRow, playerCol, player_getID(calledPlayer));    // update player on map
+        grid_set(game->fullMap, newPlayerRow, playerCol, player_getGlyph(calledPlayer));    // update player on map
         player_moveUpAndDown(calledPlayer, 1, moveFrom);
         player_updateVisibility(calledPlayer, game->fullMap, game->goldMap);
         game_updateAllUsers(game);
 
     } else if (isalpha(moveTo)) {           // is another player then swap
-        player_t* conflictingPlayer = roster_getPlayerFromID(game->players, moveTo);
+        player_t* conflictingPlayer = roster_getPlayerAt(game->players, playerCol, newPlayerRow);
         game_stealGold(game, calledPlayer, conflictingPlayer);
 
         grid_set(game->fullMap, newPlayerRow-1, playerCol, moveTo);                    // reset spot on map
-        grid_set(game->fullMap, newPlayerRow, playerCol, player_getID(calledPlayer));    // update player on map
+        grid_set(game->fullMap, newPlayerRow, playerCol, player_getGlyph(calledPlayer));    // update player on map
         // update player
         player_moveUpAndDown(calledPlayer, 1, moveFrom);
         player_updateVisibility(calledPlayer, game->fullMap, game->goldMap);
@@ -604,9 +831,10 @@ bool game_j_moveDown(game_t* game, addr_t player, const char* message) {
     
 }
 bool game_k_moveUp(game_t* game, addr_t player, const char* message) {
+    TRACE_SCOPE("game_k_moveUp");
 
     if (message_eqAddr(game->spectator, player)) {
-        message_send(player, "ERROR unknown keystroke for spectator.");
+        game_send(game, player, "ERROR unknown keystroke for spectator.");
         return false;
     }
 
@@ -628,17 +856,17 @@ bool game_k_moveUp(game_t* game, addr_t player, const char* message) {
             if (game_foundGold(game, calledPlayer, newPlayerRow, playerCol)) return true;
         }
         grid_set(game->fullMap, newPlayerRow+1, playerCol, moveFrom);                    // reset spot on map
-        grid_set(game->fullMap, newPlayerRow, playerCol, player_getID(calledPlayer));    // update player on map
+        grid_set(game->fullMap, newPlayerRow, playerCol, player_getGlyph(calledPlayer));    // update player on map
         player_moveUpAndDown(calledPlayer, -1, moveFrom);
         player_updateVisibility(calledPlayer, game->fullMap, game->goldMap);
         game_updateAllUsers(game);
 
     } else if (isalpha(moveTo)) {           // is another player then swap
-        player_t* conflictingPlayer = roster_getPlayerFromID(game->players, moveTo);
+        player_t* conflictingPlayer = roster_getPlayerAt(game->players, playerCol, newPlayerRow);
         game_stealGold(game, calledPlayer, conflictingPlayer);
 
         grid_set(game->fullMap, newPlayerRow+1, playerCol, moveTo);                    // reset spot on map
-        grid_set(game->fullMap, newPlayerRow, playerCol, player_getID(calledPlayer));    // update player on map
+        grid_set(game->fullMap, newPlayerRow, playerCol, player_getGlyph(calledPlayer));    // update player on map
         // update player
         player_moveUpAndDown(calledPlayer, -1, moveFrom);
         player_updateVisibility(calledPlayer, game->fullMap, game->goldMap);
@@ -653,9 +881,10 @@ bool game_k_moveUp(game_t* game, addr_t player, const char* message) {
 
 }
 bool game_y_moveDiagUpLeft(game_t* game, addr_t player, const char* message) {
+    TRACE_SCOPE("game_y_moveDiagUpLeft");
 
     if (message_eqAddr(game->spectator, player)) {
-        message_send(player, "ERROR unknown keystroke for spectator.");
+        game_send(game, player, "ERROR unknown keystroke for spectator.");
         return false;
     }
     
@@ -677,7 +906,7 @@ bool game_y_moveDiagUpLeft(game_t* game, addr_t player, const char* message) {
             if (game_foundGold(game, calledPlayer, newPlayerRow, newPlayerCol)) return true;
         }
         grid_set(game->fullMap, newPlayerRow+1, newPlayerCol+1, moveFrom);                      // reset spot on map
-        grid_set(game->fullMap, newPlayerRow, newPlayerCol, player_getID(calledPlayer));        // update player on map
+        grid_set(game->fullMap, newPlayerRow, newPlayerCol, player_getGlyph(calledPlayer));        // update player on map
         player_moveUpAndDown(calledPlayer, -1, moveFrom);
         moveFrom = grid_get(game->originalMap, player_getYLocation(calledPlayer), player_getXLocation(calledPlayer));
         player_moveLeftAndRight(calledPlayer, -1, moveFrom);
@@ -685,11 +914,11 @@ bool game_y_moveDiagUpLeft(game_t* game, addr_t player, const char* message) {
         game_updateAllUsers(game);
 
     } else if (isalpha(moveTo)) {           // is another player then swap
-        player_t* conflictingPlayer = roster_getPlayerFromID(game->players, moveTo);
+        player_t* conflictingPlayer = roster_getPlayerAt(game->players, newPlayerCol, newPlayerRow);
         game_stealGold(game, calledPlayer, conflictingPlayer);
 
         grid_set(game->fullMap, newPlayerRow+1, newPlayerCol+1, moveTo);                      // reset spot on map
-        grid_set(game->fullMap, newPlayerRow, newPlayerCol, player_getID(calledPlayer));        // update player on map
+        grid_set(game->fullMap, newPlayerRow, newPlayerCol, player_getGlyph(calledPlayer));        // update player on map
         // update player
         player_moveUpAndDown(calledPlayer, -1, moveFrom);
         moveFrom = grid_get(game->originalMap, player_getYLocation(calledPlayer), player_getXLocation(calledPlayer));
@@ -707,9 +936,10 @@ bool game_y_moveDiagUpLeft(game_t* game, addr_t player, const char* message) {
 
 }
 bool game_u_moveDiagUpRight(game_t* game, addr_t player, const char* message) {
+    TRACE_SCOPE("game_u_moveDiagUpRight");
 
     if (message_eqAddr(game->spectator, player)) {
-        message_send(player, "ERROR unknown keystroke for spectator.");
+        game_send(game, player, "ERROR unknown keystroke for spectator.");
         return false;
     }
 
@@ -731,7 +961,7 @@ bool game_u_moveDiagUpRight(game_t* game, addr_t player, const char* message) {
             if (game_foundGold(game, calledPlayer, newPlayerRow, newPlayerCol)) return true;
         }
         grid_set(game->fullMap, newPlayerRow+1, newPlayerCol-1, moveFrom);                      // reset spot on map
-        grid_set(game->fullMap, newPlayerRow, newPlayerCol, player_getID(calledPlayer));        // update player on map
+        grid_set(game->fullMap, newPlayerRow, newPlayerCol, player_getGlyph(calledPlayer));        // update player on map
         player_moveUpAndDown(calledPlayer, -1, moveFrom);
         moveFrom = grid_get(game->originalMap, player_getYLocation(calledPlayer), player_getXLocation(calledPlayer));
         player_moveLeftAndRight(calledPlayer, 1, moveFrom);
@@ -739,11 +969,11 @@ bool game_u_moveDiagUpRight(game_t* game, addr_t player, const char* message) {
         game_updateAllUsers(game);
 
     } else if (isalpha(moveTo)) {           // is another player then swap
-        player_t* conflictingPlayer = roster_getPlayerFromID(game->players, moveTo);
+        player_t* conflictingPlayer = roster_getPlayerAt(game->players, newPlayerCol, newPlayerRow);
         game_stealGold(game, calledPlayer, conflictingPlayer);
 
         grid_set(game->fullMap, newPlayerRow+1, newPlayerCol-1, moveTo);                      // reset spot on map
-        grid_set(game->fullMap, newPlayerRow, newPlayerCol, player_getID(calledPlayer));        // update player on map
+        grid_set(game->fullMap, newPlayerRow, newPlayerCol, player_getGlyph(calledPlayer));        // update player on map
         // update player
         player_moveUpAndDown(calledPlayer, -1, moveFrom);
         moveFrom = grid_get(game->originalMap, player_getYLocation(calledPlayer), player_getXLocation(calledPlayer));
@@ -760,9 +990,10 @@ bool game_u_moveDiagUpRight(game_t* game, addr_t player, const char* message) {
     return false;
 }
 bool game_b_moveDiagDownLeft(game_t* game, addr_t player, const char* message) {
+    TRACE_SCOPE("game_b_moveDiagDownLeft");
 
     if (message_eqAddr(game->spectator, player)) {
-        message_send(player, "ERROR unknown keystroke for spectator.");
+        game_send(game, player, "ERROR unknown keystroke for spectator.");
         return false;
     }
 
@@ -784,7 +1015,7 @@ bool game_b_moveDiagDownLeft(game_t* game, addr_t player, const char* message) {
             if (game_foundGold(game, calledPlayer, newPlayerRow, newPlayerCol)) return true;
         }
         grid_set(game->fullMap, newPlayerRow-1, newPlayerCol+1, moveFrom);                      // reset spot on map
-        grid_set(game->fullMap, newPlayerRow, newPlayerCol, player_getID(calledPlayer));        // update player on map
+        grid_set(game->fullMap, newPlayerRow, newPlayerCol, player_getGlyph(calledPlayer));        // update player on map
         player_moveUpAndDown(calledPlayer, 1, moveFrom);
         moveFrom = grid_get(game->originalMap, player_getYLocation(calledPlayer), player_getXLocation(calledPlayer));
         player_moveLeftAndRight(calledPlayer, -1, moveFrom);
@@ -792,11 +1023,11 @@ bool game_b_moveDiagDownLeft(game_t* game, addr_t player, const char* message) {
         game_updateAllUsers(game);
 
     } else if (isalpha(moveTo)) {           // is another player then swap
-        player_t* conflictingPlayer = roster_getPlayerFromID(game->players, moveTo);
+        player_t* conflictingPlayer = roster_getPlayerAt(game->players, newPlayerCol, newPlayerRow);
         game_stealGold(game, calledPlayer, conflictingPlayer);
 
         grid_set(game->fullMap, newPlayerRow-1, newPlayerCol+1, moveTo);                      // reset spot on map
-        grid_set(game->fullMap, newPlayerRow, newPlayerCol, player_getID(calledPlayer));        // update player on map
+        grid_set(game->fullMap, newPlayerRow, newPlayerCol, player_getGlyph(calledPlayer));        // update player on map
         // update player
         player_moveUpAndDown(calledPlayer, 1, moveFrom);
         moveFrom = grid_get(game->originalMap, player_getYLocation(calledPlayer), player_getXLocation(calledPlayer));
@@ -813,9 +1044,10 @@ bool game_b_moveDiagDownLeft(game_t* game, addr_t player, const char* message) {
     return false;
 }
 bool game_n_moveDiagDownRight(game_t* game, addr_t player, const char* message) {
+    TRACE_SCOPE("game_n_moveDiagDownRight");
 
     if (message_eqAddr(game->spectator, player)) {
-        message_send(player, "ERROR unknown keystroke for spectator.");
+        game_send(game, player, "ERROR unknown keystroke for spectator.");
         return false;
     }
 
@@ -837,7 +1069,7 @@ bool game_n_moveDiagDownRight(game_t* game, addr_t player, const char* message)
             if (game_foundGold(game, calledPlayer, newPlayerRow, newPlayerCol)) return true;
         }
         grid_set(game->fullMap, newPlayerRow-1, newPlayerCol-1, moveFrom);                      // reset spot on map
-        grid_set(game->fullMap, newPlayerRow, newPlayerCol, player_getID(calledPlayer));        // update player on map
+        grid_set(game->fullMap, newPlayerRow, newPlayerCol, player_getGlyph(calledPlayer));        // update player on map
         player_moveUpAndDown(calledPlayer, 1, moveFrom);
         moveFrom = grid_get(game->originalMap, player_getYLocation(calledPlayer), player_getXLocation(calledPlayer));
         player_moveLeftAndRight(calledPlayer, 1, moveFrom);
@@ -845,11 +1077,11 @@ bool game_n_moveDiagDownRight(game_t* game, addr_t player, const char* message)
         game_updateAllUsers(game);
 
     } else if (isalpha(moveTo)) {           // is another player then swap
-        player_t* conflictingPlayer = roster_getPlayerFromID(game->players, moveTo);
+        player_t* conflictingPlayer = roster_getPlayerAt(game->players, newPlayerCol, newPlayerRow);
         game_stealGold(game, calledPlayer, conflictingPlayer);
 
         grid_set(game->fullMap, newPlayerRow-1, newPlayerCol-1, moveTo);                      // reset spot on map
-        grid_set(game->fullMap, newPlayerRow, newPlayerCol, player_getID(calledPlayer));        // update player on map
+        grid_set(game->fullMap, newPlayerRow, newPlayerCol, player_getGlyph(calledPlayer));        // update player on map
         // update player
         player_moveUpAndDown(calledPlayer, 1, moveFrom);
         moveFrom = grid_get(game->originalMap, player_getYLocation(calledPlayer), player_getXLocation(calledPlayer));
@@ -870,9 +1102,10 @@ bool game_n_moveDiagDownRight(game_t* game, addr_t player, const char* message)
 /* see game.h for description */
 
 bool game_H_moveLeft(game_t* game, addr_t player, const char* message) {
+    TRACE_SCOPE("game_H_moveLeft");
 
     if (message_eqAddr(game->spectator, player)) {
-        message_send(player, "ERROR unknown keystroke for spectator.");
+        game_send(game, player, "ERROR unknown keystroke for spectator.");
         return false;
     }
 
@@ -894,9 +1127,10 @@ bool game_H_moveLeft(game_t* game, addr_t player, const char* message) {
 }
 
 bool game_L_moveRight(game_t* game, addr_t player, const char* message) {
+    TRACE_SCOPE("game_L_moveRight");
 
     if (message_eqAddr(game->spectator, player)) {
-        message_send(player, "ERROR unknown keystroke for spectator.");
+        game_send(game, player, "ERROR unknown keystroke for spectator.");
         return false;
     }
 
@@ -918,9 +1152,10 @@ bool game_L_moveRight(game_t* game, addr_t player, const char* message) {
 }
 
 bool game_J_moveDown(game_t* game, addr_t player, const char* message) {
+    TRACE_SCOPE("game_J_moveDown");
 
     if (message_eqAddr(game->spectator, player)) {
-        message_send(player, "ERROR unknown keystroke for spectator.");
+        game_send(game, player, "ERROR unknown keystroke for spectator.");
         return false;
     }
     
@@ -942,9 +1177,10 @@ bool game_J_moveDown(game_t* game, addr_t player, const char* message) {
 }
 
 bool game_K_moveUp(game_t* game, addr_t player, const char* message) {
+    TRACE_SCOPE("game_K_moveUp");
 
     if (message_eqAddr(game->spectator, player)) {
-        message_send(player, "ERROR unknown keystroke for spectator.");
+        game_send(game, player, "ERROR unknown keystroke for spectator.");
         return false;
     }
 
@@ -966,9 +1202,10 @@ bool game_K_moveUp(game_t* game, addr_t player, const char* message) {
 }
 
 bool game_Y_moveDiagUpLeft(game_t* game, addr_t player, const char* message) {
+    TRACE_SCOPE("game_Y_moveDiagUpLeft");
         
         if (message_eqAddr(game->spectator, player)) {
-        message_send(player, "ERROR unknown keystroke for spectator.");
+        game_send(game, player, "ERROR unknown keystroke for spectator.");
         return false;
     }
 
@@ -990,9 +1227,10 @@ bool game_Y_moveDiagUpLeft(game_t* game, addr_t player, const char* message) {
 }
 
 bool game_U_moveDiagUpRight(game_t* game, addr_t player, const char* message) {
+    TRACE_SCOPE("game_U_moveDiagUpRight");
         
         if (message_eqAddr(game->spectator, player)) {
-        message_send(player, "ERROR unknown keystroke for spectator.");
+        game_send(game, player, "ERROR unknown keystroke for spectator.");
         return false;
     }
 
@@ -1014,9 +1252,10 @@ bool game_U_moveDiagUpRight(game_t* game, addr_t player, const char* message) {
 }
 
 bool game_B_moveDiagDownLeft(game_t* game, addr_t player, const char* message) {
+    TRACE_SCOPE("game_B_moveDiagDownLeft");
         
         if (message_eqAddr(game->spectator, player)) {
-        message_send(player, "ERROR unknown keystroke for spectator.");
+        game_send(game, player, "ERROR unknown keystroke for spectator.");
         return false;
     }
 
@@ -1038,9 +1277,10 @@ bool game_B_moveDiagDownLeft(game_t* game, addr_t player, const char* message) {
 }
 
 bool game_N_moveDiagDownRight(game_t* game, addr_t player, const char* message) {
+    TRACE_SCOPE("game_N_moveDiagDownRight");
         
         if (message_eqAddr(game->spectator, player)) {
-        message_send(player, "ERROR unknown keystroke for spectator.");
+        game_send(game, player, "ERROR unknown keystroke for spectator.");
         return false;
     }
     
@@ -1064,10 +1304,11 @@ bool game_N_moveDiagDownRight(game_t* game, addr_t player, const char* message)
 /**************** game_keyPress ****************/
 /* see game.h for description */
 bool game_keyPress(game_t* game, addr_t player, const char* message) {
+    TRACE_SCOPE("game_keyPress");
 
     player_t* currPlayer = roster_getPlayerFromAddr(game->players, player);
     if (!message_eqAddr(game->spectator, player) && (currPlayer == NULL)) {
-        message_send(player, "ERROR Please start PLAY or SPECTATE first.");
+        game_send(game, player, "ERROR Please start PLAY or SPECTATE first.");
         return false;
     }
 
@@ -1109,7 +1350,7 @@ bool game_keyPress(game_t* game, addr_t player, const char* message) {
             return game_N_moveDiagDownRight(game, player, message);
 
         default:
-            message_send(player, "ERROR unknown keystroke.");
+            game_send(game, player, "ERROR unknown keystroke.");
             return false;
     }
 
@@ -1133,4 +1374,256 @@ grid_t* game_returnGoldMap(game_t* game) {
 /* see game.h for description */
 int game_returnRemainingGold(game_t* game) {
     return game->remainingGold;
-}
\ No newline at end of file
+}
+
+/**************** game_printPlayers ****************/
+/* see game.h for description */
+void game_printPlayers(game_t* game, FILE* fp) {
+    if (game == NULL || fp == NULL) return;
+
+    int numPlayers = roster_numPlayers(game->players);
+    player_t** players = malloc((numPlayers > 0 ? numPlayers : 1) * sizeof(player_t*));
+    if (players == NULL) return;
+    roster_getPlayers(game->players, players);
+
+    fprintf(fp, "players: %d\n", numPlayers);
+    for (int i = 0; i < numPlayers; i++) {
+        player_t* player = players[i];
+        fprintf(fp, "  %c %-20s %-22s (%d,%d) %d gold\n", player_getGlyph(player), player_getName(player),
+                message_stringAddr(player_getAddr(player)),
+                player_getXLocation(player), player_getYLocation(player), player_getGold(player));
+    }
+    fprintf(fp, "spectator: %s\n", message_isAddr(game->spectator) ? message_stringAddr(game->spectator) : "none");
+    fprintf(fp, "remaining gold: %d\n", game->remainingGold);
+    fflush(fp);
+    free(players);
+}
+
+/**************** game_hash ****************/
+/* see game.h for description */
+uint64_t game_hash(game_t* game) {
+    uint64_t hash = 14695981039346656037ULL;       // FNV-1a
+    const char* maps[] = { grid_string(game->fullMap), grid_string(game->goldMap) };
+    for (int m = 0; m < 2; m++) {
+        for (const char* p = maps[m]; *p != '\0'; p++) {
+            hash = (hash ^ (unsigned char) *p) * 1099511628211ULL;
+        }
+    }
+
+    int numPlayers = roster_numPlayers(game->players);
+    player_t** players = malloc((numPlayers > 0 ? numPlayers : 1) * sizeof(player_t*));
+    if (players != NULL) {
+        roster_getPlayers(game->players, players);
+        for (int i = 0; i < numPlayers; i++) {
+            int fields[] = { player_getID(players[i]), player_getGold(players[i]) };
+            for (int f = 0; f < 2; f++) {
+                for (int b = 0; b < 4; b++) {
+                    hash = (hash ^ ((unsigned) fields[f] >> (8 * b) & 0xff)) * 1099511628211ULL;
+                }
+            }
+        }
+        free(players);
+    }
+    for (int b = 0; b < 4; b++) {
+        hash = (hash ^ ((unsigned) game->remainingGold >> (8 * b) & 0xff)) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/* snapshots */
+
+/**************** game_snapshot ****************/
+/* see game.h for description
+ *
+ * The body of a snapshot (see snapshot.c) is, in order:
+ *   seed, generator state              8 bytes; 4 x 8 bytes
+ *   maxPlayers, radius                 4 bytes each
+ *   numbPlayers, remainingGold         4 bytes each
+ *   spectator's address                string; "" if none
+ *   original, full and gold maps       string each
+ *   number of gold piles               4 bytes; then for each, oldest first:
+ *     row, col, nuggets, found         4, 4, 4, 1 bytes
+ *   number of players                  4 bytes; then for each, oldest first:
+ *     ID                               2 bytes
+ *     name, address                    string each
+ *     x, y, purse                      4 bytes each
+ *     visible map (what they have seen) string
+ */
+bool game_snapshot(game_t* game, int fd) {
+    TRACE_SCOPE("game_snapshot");
+    if (game == NULL || fd < 0) return false;
+
+    int numPlayers = roster_numPlayers(game->players);
+    player_t** players = malloc((numPlayers > 0 ? numPlayers : 1) * sizeof(player_t*));
+    pileArray_t piles = { NULL, 0 };
+    gold_iterate(game->goldNuggets, &piles, game_gatherPile);     // count them
+    piles.fields = malloc((piles.numPiles > 0 ? piles.numPiles : 1) * 4 * sizeof(int));
+    if (game->snapshots == NULL) {
+        game->snapshots = snapshot_newWriter();
+    }
+    if (players == NULL || piles.fields == NULL || game->snapshots == NULL) {
+        free(players);
+        free(piles.fields);
+        close(fd);
+        return false;
+    }
+    roster_getPlayers(game->players, players);      // newest first
+    piles.numPiles = 0;
+    gold_iterate(game->goldNuggets, &piles, game_gatherPile);     // newest first
+
+    snapshot_t* snapshot = snapshot_begin(game->snapshots);
+    snapshot_putInt(snapshot, game->seed, 8);
+    for (int i = 0; i < 4; i++) {
+        snapshot_putInt(snapshot, game->rng[i], 8);
+    }
+    snapshot_putInt(snapshot, game->maxPlayers, 4);
+    snapshot_putInt(snapshot, game->radius, 4);
+    snapshot_putInt(snapshot, game->numbPlayers, 4);
+    snapshot_putInt(snapshot, game->remainingGold, 4);
+    snapshot_putString(snapshot, message_isAddr(game->spectator) ? message_stringAddr(game->spectator) : "");
+    snapshot_putString(snapshot, grid_string(game->originalMap));
+    snapshot_putString(snapshot, grid_string(game->fullMap));
+    snapshot_putString(snapshot, grid_string(game->goldMap));
+
+    snapshot_putInt(snapshot, piles.numPiles, 4);
+    for (int i = piles.numPiles - 1; i >= 0; i--) {
+        const int* pile = &piles.fields[4 * i];
+        snapshot_putInt(snapshot, pile[0], 4);
+        snapshot_putInt(snapshot, pile[1], 4);
+        snapshot_putInt(snapshot, pile[2], 4);
+        snapshot_putInt(snapshot, pile[3], 1);
+    }
+
+    snapshot_putInt(snapshot, numPlayers, 4);
+    for (int i = numPlayers - 1; i >= 0; i--) {
+        player_t* player = players[i];
+        snapshot_putInt(snapshot, player_getID(player), 2);
+        snapshot_putString(snapshot, player_getName(player));
+        addr_t address = player_getAddr(player);
+        snapshot_putString(snapshot, message_isAddr(address) ? message_stringAddr(address) : "");
+        snapshot_putInt(snapshot, player_getXLocation(player), 4);
+        snapshot_putInt(snapshot, player_getYLocation(player), 4);
+        snapshot_putInt(snapshot, player_getGold(player), 4);
+        snapshot_putString(snapshot, grid_string(player_getMap(player)));
+    }
+    free(players);
+    free(piles.fields);
+
+    return snapshot_commit(game->snapshots, snapshot, fd);
+}
+
+/**************** game_snapshotWait ****************/
+/* see game.h for description */
+bool game_snapshotWait(game_t* game) {
+    return game->snapshots == NULL || snapshot_wait(game->snapshots);
+}
+
+/**************** game_snapshotsPending ****************/
+/* see game.h for description */
+int game_snapshotsPending(game_t* game) {
+    return (game->snapshots == NULL) ? 0 : snapshot_pending(game->snapshots);
+}
+
+/**************** game_restore ****************/
+/* see game.h for description */
+game_t* game_restore(int fd) {
+    snapshotReader_t* reader = snapshot_openReader(fd);
+    if (reader == NULL) return NULL;
+
+    const unsigned long seed = snapshot_getInt(reader, 8);
+    uint64_t rng[4];
+    for (int i = 0; i < 4; i++) {
+        rng[i] = snapshot_getInt(reader, 8);
+    }
+    const int maxPlayers = (int32_t) snapshot_getInt(reader, 4);
+    const int radius = (int32_t) snapshot_getInt(reader, 4);
+    const int numbPlayers = (int32_t) snapshot_getInt(reader, 4);
+    const int remainingGold = (int32_t) snapshot_getInt(reader, 4);
+    char* spectator = snapshot_getString(reader);
+
+    // the original, full and gold maps, all the same size
+    grid_t* maps[3];
+    for (int m = 0; m < 3; m++) {
+        char* string = snapshot_getString(reader);
+        maps[m] = (string != NULL) ? grid_fromString(string) : NULL;
+        free(string);
+    }
+    bool ok = true;
+    for (int m = 0; m < 3; m++) {
+        ok = ok && maps[m] != NULL && grid_nrows(maps[m]) == grid_nrows(maps[0])
+            && grid_ncols(maps[m]) == grid_ncols(maps[0]);
+    }
+    game_t* game = ok ? game_create(maps[1], maps[0], false) : NULL;
+    if (game == NULL) {
+        for (int m = 0; m < 3; m++) {
+            grid_delete(maps[m]);
+        }
+        free(spectator);
+        snapshot_closeReader(reader);
+        fprintf(stderr, "game_restore: the snapshot's maps are missing or damaged\n");
+        return NULL;
+    }
+    game->goldMap = maps[2];
+    game->seed = seed;
+    memcpy(game->rng, rng, sizeof(rng));
+    game->remainingGold = remainingGold;
+    ok = game_setLimits(game, maxPlayers, radius) && game_parseAddr(spectator, &game->spectator);
+    free(spectator);
+
+    const int numPiles = (int32_t) snapshot_getInt(reader, 4);
+    game->goldNuggets = gold_new(numPiles);
+    for (int i = 0; ok && i < numPiles; i++) {
+        const int row = (int32_t) snapshot_getInt(reader, 4);
+        const int col = (int32_t) snapshot_getInt(reader, 4);
+        const int nuggets = (int32_t) snapshot_getInt(reader, 4);
+        const bool found = snapshot_getInt(reader, 1) != 0;
+        gold_restorePile(game->goldNuggets, row, col, nuggets, found);
+    }
+
+    // players, oldest first, so each gets back their slot as well as their ID
+    const int numPlayers = (int32_t) snapshot_getInt(reader, 4);
+    for (int i = 0; ok && i < numPlayers; i++) {
+        const int id = snapshot_getInt(reader, 2);
+        char* name = snapshot_getString(reader);
+        char* address = snapshot_getString(reader);
+        const int x = (int32_t) snapshot_getInt(reader, 4);
+        const int y = (int32_t) snapshot_getInt(reader, 4);
+        const int gold = (int32_t) snapshot_getInt(reader, 4);
+        char* visible = snapshot_getString(reader);
+        grid_t* visibleMap = (visible != NULL) ? grid_fromString(visible) : NULL;
+        free(visible);
+
+        addr_t addr;
+        player_t* player = player_new();
+        ok = player != NULL && name != NULL && visibleMap != NULL
+            && grid_nrows(visibleMap) == game->mapRows && grid_ncols(visibleMap) == game->mapCols
+            && x >= 0 && x < game->mapCols && y >= 0 && y < game->mapRows
+            && game_parseAddr(address, &addr);
+        if (ok) {
+            player_setAddress(player, addr);
+            player_setName(player, name);
+            name = NULL;                        // the player's now
+            player_foundGoldNuggets(player, gold);
+            ok = roster_addPlayerWithID(game->players, player, id);
+        }
+        if (ok) {
+            player_initializeGridAndLocation(player, visibleMap, game->goldMap, x, y);
+        } else {
+            if (player != NULL) {
+                player_delete(player);
+            }
+            grid_delete(visibleMap);
+        }
+        free(name);
+        free(address);
+    }
+    game->numbPlayers = numbPlayers;
+
+    ok = snapshot_closeReader(reader) && ok;
+    if (!ok) {
+        fprintf(stderr, "game_restore: the snapshot is damaged\n");
+        game_delete(game);
+        return NULL;
+    }
+    return game;
+}
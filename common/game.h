@@ -13,8 +13,10 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include "grid.h"
+#include "pool.h"
 #include "../support/message.h"
 
 /**************** global types ****************/
@@ -28,17 +30,79 @@ typedef struct game game_t;
 /* Allocates memory for new game, initializes map, map info, and players.
  * Also sets gold in map.
  *
- * Caller provides: valid map file path
+ * Caller provides: valid map file path, and the seed of the game's own random
+ *   number generator, which places the gold now and each player as they join;
+ *   the same map, seed and inputs always give the same game.
  * Returns: initialized game or NULL upon failure.
  */
-game_t* game_new(char* mapFileName);
+game_t* game_new(char* mapFileName, unsigned long seed);
 
 
+/**************** game_reset ****************/
+/* Readies a game that is over (or not) to be played again, in place: every
+ * player and the spectator leave, the full map is put back as it was, and
+ * the gold is placed anew from the given seed, just as game_new would with
+ * the same map and seed. The maps, their bit planes, rooms and visibility
+ * cache, and the game's limits and workers are all kept, so this is much
+ * quicker than game_delete and game_new. The broadcaster, if any, sends
+ * what it has queued and stops; call game_startBroadcaster again for the
+ * next match.
+ *
+ * Caller provides: valid game, and the seed of its next match.
+ * Returns: nothing.
+ */
+void game_reset(game_t* game, unsigned long seed);
+
 /**************** game_delete ****************/
 /* Frees all information game holds and deletes game.
  */
 void game_delete(game_t* game);
 
+/**************** game_getSeed ****************/
+/* Returns the seed the game was created with.
+ */
+unsigned long game_getSeed(game_t* game);
+
+/**************** game_setLimits ****************/
+/* For a large game: lets up to maxPlayers (at most PLAYER_NUM_IDS; usually
+ * 26) join, and if radius is positive, sends each change only to the players
+ * within that many rows and columns of it (see roster_setLimits).
+ * Players beyond 26 share letters on the map and in messages (see player.h).
+ *
+ * Caller provides: valid game no player has yet joined, and whose
+ *   broadcaster has not been started
+ * Returns: true if set, false if the limits are out of range or too late.
+ */
+bool game_setLimits(game_t* game, int maxPlayers, int radius);
+
+/**************** game_setWorkers ****************/
+/* Shares a pool of worker threads with the game, to compute and build its
+ * players' displays on; by default that is done on the game's own thread.
+ * One pool serves every game in the process.
+ *
+ * Caller provides: valid game, and a pool (or NULL) that outlives it.
+ */
+void game_setWorkers(game_t* game, pool_t* workers);
+
+/**************** game_startBroadcaster ****************/
+/* From now on, build and send each update's DISPLAY frames on a separate
+ * thread, from a snapshot of the game, so the next input need not wait.
+ * Every message the game sends then goes through that thread, in order.
+ *
+ * Caller provides: valid game
+ * Returns: true if the broadcaster is running, false if it could not start
+ *   (in which case the game goes on as before).
+ */
+bool game_startBroadcaster(game_t* game);
+
+/**************** game_send ****************/
+/* Sends a message to a client, after any DISPLAY frames still being sent.
+ * Same as message_send if the game has no broadcaster.
+ *
+ * Caller provides: valid game, client address, message
+ * Returns: nothing.
+ */
+void game_send(game_t* game, addr_t to, const char* message);
 
 /**************** end_game ****************/
 /* To be called once remaining gold becomes 0. Sends a GAME OVER summary to all clients.
@@ -140,4 +204,57 @@ grid_t* game_returnGoldMap(game_t* game);
  */
 int game_returnRemainingGold(game_t* game);
 
+/**************** game_printPlayers ****************/
+/* Prints one line per player (letter, name, address, position, gold),
+ * then the spectator and remaining gold, to fp; for the admin console.
+ */
+void game_printPlayers(game_t* game, FILE* fp);
+
+/**************** game_hash ****************/
+/* Returns a 64-bit hash of the game's state: the full map (with every
+ * player's letter where they stand), the gold map, every player's ID and
+ * purse, and the gold remaining. Two games that have seen the same inputs
+ * hash the same; for checking a replay against a journal (see journal.h).
+ */
+uint64_t game_hash(game_t* game);
+
+/**************** game_snapshot ****************/
+/* Saves the whole state of the game to fd, for game_restore to pick up
+ * where it left off: its maps, gold piles, players (IDs, names, addresses,
+ * purses, positions, and what each has seen), spectator, limits, and the
+ * state of its random numbers. The state is copied at once, in memory; the
+ * copy is written out, synced, and fd closed, on a thread of the game's own,
+ * so the caller does not wait for the disk. (If two snapshots are still
+ * being written, waits for the older.)
+ *
+ * Caller provides: valid game, and a file descriptor open for writing,
+ *   which the game then owns.
+ * Returns: true if the snapshot was taken; false (and fd closed) if not.
+ */
+bool game_snapshot(game_t* game, int fd);
+
+/**************** game_snapshotWait ****************/
+/* Waits until every snapshot taken has been written.
+ * Returns: true if all were written in full since the last call.
+ */
+bool game_snapshotWait(game_t* game);
+
+/**************** game_snapshotsPending ****************/
+/* Returns how many snapshots taken are still being written, without
+ * waiting; once 0, game_snapshotWait returns at once.
+ */
+int game_snapshotsPending(game_t* game);
+
+/**************** game_restore ****************/
+/* Makes a game from a snapshot read from fd (see game_snapshot), as it was
+ * when the snapshot was taken; it goes on exactly as the original would
+ * have, given the same inputs. Its players see the game again at their
+ * next update. Starts no broadcaster (see game_startBroadcaster).
+ *
+ * Caller provides: file descriptor open for reading, at the snapshot.
+ * Returns: restored game, or NULL (after saying why on stderr) if the
+ *   snapshot cannot be read, is from another version, or is damaged.
+ */
+game_t* game_restore(int fd);
+
 #endif // __GAME_H
@@ -20,7 +20,10 @@ typedef struct findGoldPile {
     goldPile_t* matchedPile;
 } findGoldPile_t;
 
-char goldID = 'A';
+typedef struct iterateGoldPile {
+    void* arg;
+    void (*itemfunc)(void* arg, int row, int col, int nuggets, bool found);
+} iterateGoldPile_t;
 
 /**************** global types ****************/
 
@@ -33,6 +36,7 @@ typedef struct goldPile {
 
 typedef struct gold {
     int numPiles;
+    int numAdded;           // piles added so far; each is keyed by its number
     set_t* piles;
 } gold_t;
 
@@ -46,6 +50,7 @@ gold_t* gold_new(int totalPiles) {
     if (gold == NULL) return NULL;
 
     gold->numPiles = totalPiles;
+    gold->numAdded = 0;
     gold->piles = set_new();
 
     return gold;
@@ -55,16 +60,7 @@ gold_t* gold_new(int totalPiles) {
 /**************** gold_addGoldPile ****************/
 /* see gold.h for description */
 void gold_addGoldPile(gold_t* gold, int row, int col, int nuggets) {
-
-    goldPile_t* pile = malloc(sizeof(goldPile_t));
-    if (pile == NULL) return;
-    pile->goldRow = row;
-    pile->goldCol = col;
-    pile->numNuggets = nuggets;
-    pile->collected = 0;
-    set_insert(gold->piles, &goldID, pile);
-    goldID++;
-
+    gold_restorePile(gold, row, col, nuggets, false);
 }
 
 /**************** gold_foundPile_Helper ****************/
@@ -95,6 +91,39 @@ int gold_foundPile(gold_t* gold, int row, int col) {
 
 }
 
+/**************** gold_iterate_Helper ****************/
+/* Opaque to users outside of this file.
+ * Helper function to be passed into set_iterate; passes one pile on to the
+ * caller's itemfunc.
+ */
+void gold_iterate_Helper(void* arg, const char* key, void* item) {
+    iterateGoldPile_t* iteration = arg;
+    goldPile_t* pile = item;
+    iteration->itemfunc(iteration->arg, pile->goldRow, pile->goldCol, pile->numNuggets, pile->collected != 0);
+}
+
+/**************** gold_iterate ****************/
+/* see gold.h for description */
+void gold_iterate(gold_t* gold, void* arg,
+                  void (*itemfunc)(void* arg, int row, int col, int nuggets, bool found)) {
+    iterateGoldPile_t iteration = { arg, itemfunc };
+    set_iterate(gold->piles, &iteration, gold_iterate_Helper);
+}
+
+/**************** gold_restorePile ****************/
+/* see gold.h for description */
+void gold_restorePile(gold_t* gold, int row, int col, int nuggets, bool found) {
+    goldPile_t* pile = malloc(sizeof(goldPile_t));
+    if (pile == NULL) return;
+    pile->goldRow = row;
+    pile->goldCol = col;
+    pile->numNuggets = nuggets;
+    pile->collected = found ? 1 : 0;
+    char key[12];
+    sprintf(key, "%d", gold->numAdded++);
+    set_insert(gold->piles, key, pile);
+}
+
 /**************** gold_delete_helper ****************/
 void gold_delete_helper(void* item) {
     goldPile_t* currPile = item;
@@ -12,6 +12,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
 #include "set.h"
 
 /**************** global types ****************/
@@ -41,6 +42,23 @@ void gold_addGoldPile(gold_t* gold, int row, int col, int nuggets);
  */
 int gold_foundPile(gold_t* gold, int row, int col);
 
+/**************** gold_iterate ****************/
+/* Calls itemfunc on each pile, newest first, with its location, its number
+ * of nuggets, and whether it has been found.
+ * Caller provides: valid gold set, arbitrary arg, itemfunc
+ * Return: nothing
+ */
+void gold_iterate(gold_t* gold, void* arg,
+                  void (*itemfunc)(void* arg, int row, int col, int nuggets, bool found));
+
+/**************** gold_restorePile ****************/
+/* Like gold_addGoldPile, but for a pile that may have been found already;
+ * for rebuilding a set of piles, oldest first, from what gold_iterate gave.
+ * Caller provides: valid gold set, XY location, numb nuggets, whether found
+ * Return: nothing
+ */
+void gold_restorePile(gold_t* gold, int row, int col, int nuggets, bool found);
+
 /**************** gold_delete ****************/
 /* Frees memory taken by gold and deletes gold.
  */
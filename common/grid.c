@@ -4,14 +4,22 @@
  * David Kotz, 2019
  */
 
+#define _POSIX_C_SOURCE 200809L // for mmap
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 #include <math.h>
-#include <ctype.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "grid.h"
 #include "../support/message.h" // only for message_MaxBytes
+#include "../support/trace.h"
 
 /**************** types ****************/
 
@@ -23,19 +31,268 @@ typedef struct grid grid_t;   // opaque type shared in grid.h
 struct grid {                 // details of type, known inside this module
   int nrows, ncols;           // number of rows and columns
   char* cells;                // [grid_size(nrows, ncols) + 1]
+  uint64_t* planes;           // [PlaneCount][nrows][planeWords], or NULL
+  int planeWords;             // 64-bit words per row of each plane
+  unsigned long generation;   // names the terrain: which cells are room-transparent
+  unsigned long generations;  // the last generation number handed out
+  uint64_t* baseRoom;         // [ncells bits]: room-transparent in the base terrain, or NULL
+  int baseDiffs;              // cells whose room-transparency differs from the base
+  unsigned long baseGeneration; // generation of the base terrain
+  struct visCache* visCache;  // visibility cache, or NULL
+  struct compiled* compiled;  // mapped compiled-map file, or NULL
+  struct segments* segments;  // rooms and passages, or NULL
 };
 
 // (char) a cell of the grid;
 // by using a macro rather than a function, it is suitable as lvalue or rvalue
 #define CELL(g,r,c) ((g)->cells[(r) * ((g)->ncols + 1) + (c)])
 
+/* Cell classes, used as bit flags by cellClass() and as indexes into
+ * the bit planes: plane p has bit c of row r set iff CELL(r,c) has class 1<<p.
+ */
+enum {
+  PlaneRoom,                  // room-transparent: room spot, gold, or player
+  PlaneSpot,                  // any spot a player may occupy
+  PlaneWall,                  // any wall or corner
+  PlanePlayer,                // a player letter
+  PlaneCount
+};
+#define CLASS_ROOM   (1 << PlaneRoom)
+#define CLASS_SPOT   (1 << PlaneSpot)
+#define CLASS_WALL   (1 << PlaneWall)
+#define CLASS_PLAYER (1 << PlanePlayer)
+
+// (uint64_t) the word of plane p holding the bit for cell r,c; lvalue or rvalue
+#define PLANE_WORD(g,p,r,c) \
+  ((g)->planes[((p) * (g)->nrows + (r)) * (g)->planeWords + ((c) >> 6)])
+// (int) 1 if cell r,c is set in plane p, else 0
+#define PLANE_BIT(g,p,r,c) ((int) (PLANE_WORD(g,p,r,c) >> ((c) & 63)) & 1)
+
+/* A "ray" is the template for testing visibility of a point that lies
+ * (dr,dc) away from the viewer.  It does not depend on where the viewer
+ * stands, only on the offset, so one table of rays serves every viewpoint.
+ * Each probe names one or two cells, as offsets from the viewer;
+ * vision passes the probe iff at least one of its cells is room-transparent.
+ * When the line of sight crosses a row or column exactly on a gridpoint,
+ * both cells of the probe are the same.
+ */
+typedef struct probe {
+  short r1, c1;               // first cell, relative to viewer
+  short r2, c2;               // second cell, relative to viewer
+} probe_t;
+
+typedef struct ray {
+  int nprobes;                // number of probes; -1 until built
+  probe_t* probes;            // [nprobes]
+} ray_t;
+
+/* A "visibility cache" remembers, for recently used viewpoints pr,pc,
+ * the set of gridpoints visible from there, as a bitset of nrows*ncols bits.
+ * An entry is valid only for the grid generation in which it was computed.
+ * Entries are kept in least-recently-used order, in a doubly-linked list
+ * threaded through the entries array; the least-recently-used entry is
+ * recycled when the memory budget allows no more entries.
+ */
+typedef struct visEntry {
+  int key;                    // pr * ncols + pc, or -1 if unused
+  unsigned long generation;   // grid generation when computed
+  int prev, next;             // neighbors in LRU list, or -1
+  uint64_t* bits;             // [words], or NULL until first used
+} visEntry_t;
+
+typedef struct visCache {
+  size_t budget;              // bytes we may use, in total
+  size_t bytes;               // bytes now in use
+  int words;                  // 64-bit words in each entry's bitset
+  int maxEntries;             // entries the budget allows
+  int nentries;               // entries in use
+  int* slotOf;                // [nrows*ncols] entry holding each key, or -1
+  visEntry_t* entries;        // [maxEntries]
+  int head, tail;             // most- and least-recently used entry, or -1
+  unsigned long hits, misses, evictions;
+} visCache_t;
+
+/* A "compiled map" file, written by grid_writeCompiled and mapped by
+ * grid_fromCompiled, holds a grid and the indexes built from it, so that
+ * loading it is a matter of mapping the file rather than parsing and
+ * building.  Integers are in the byte order of the machine that wrote it
+ * (a file from the other byte order fails the version check).  The file is:
+ *   a header;
+ *   a table of nsections sections, each an offset and length in the file;
+ *   the sections, each starting on an 8-byte boundary.
+ * The checksum is FNV-1a over every byte after the header.
+ * Sections are:
+ *   SectionCells:    the grid's string, as grid_string returns it, with its null;
+ *   SectionPlanes:   the bit planes, as grid_buildPlanes lays them out;
+ *   SectionVisIndex: (optional) nrows*ncols+1 uint32 offsets into SectionVisRuns;
+ *     the visible set from spot i is encoded in bytes [index[i], index[i+1]),
+ *     and is empty for non-spots;
+ *   SectionVisRuns:  (optional) each visible set, as the bits of the set in
+ *     row-major order, run-length encoded: pairs of varints (LEB128),
+ *     the number of clear bits and then the number of set bits after them.
+ * The mapping is private and writable, so the grid's cells and planes are
+ * used in place: a change to the grid copies only the page it touches, and
+ * the file is never written.  The visible sets are used by grid_visible
+ * only while the grid is in the generation in which it was loaded, that is,
+ * whenever its terrain is as loaded (see grid_rebase).
+ */
+typedef struct compiledHeader {
+  char magic[8];              // CompiledMagic
+  uint32_t version;           // CompiledVersion
+  uint32_t nsections;         // entries in the section table
+  int32_t nrows, ncols;       // size of the grid
+  uint64_t checksum;          // FNV-1a of every byte after the header
+} compiledHeader_t;
+
+typedef struct compiledSection {
+  uint32_t kind;              // Section*
+  uint32_t reserved;          // zero
+  uint64_t offset, length;    // bytes from start of file, bytes long
+} compiledSection_t;
+
+enum {
+  SectionCells = 1,
+  SectionPlanes,
+  SectionVisIndex,
+  SectionVisRuns,
+  SectionCount                // one more than the largest kind
+};
+
+typedef struct compiled {
+  void* addr;                 // the whole file, mapped
+  size_t length;              // bytes mapped
+  const uint32_t* visIndex;   // [nrows*ncols+1], or NULL if no visible sets
+  const uint8_t* visRuns;     // [visIndex[nrows*ncols]]
+  unsigned long generation;   // grid generation the visible sets are good for
+} compiled_t;
+
+static const char CompiledMagic[8] = { 'N', 'U', 'G', 'M', 'A', 'P', '\r', '\n' };
+static const uint32_t CompiledVersion = 1;
+
+/* The "segments" of a grid are its rooms, the 4-connected regions of
+ * room-transparent cells, and its passages, the 4-connected regions of
+ * passage spots.  A room is "convex" if it contains a rectangle of
+ * room-transparent cells, its interior, that holds all of the room but for
+ * doorways in the rectangle's ring of walls.  From any point of the interior,
+ * every non-blank cell of the interior and of its ring is visible, because
+ * every probe of such a ray finds a room-transparent cell of the interior;
+ * and nothing beyond the ring is visible unless some cell of the ring is
+ * room-transparent (a doorway spot), because every ray out of the ring
+ * crosses it with a probe both of whose cells lie in the ring.  So the
+ * visible set from the interior is the ring-bounded rectangle, plus, only
+ * if the ring has a doorway spot, whatever the rays show beyond it; and
+ * since the probe that crosses the ring lies within one cell of the ray's
+ * line, only rays that pass that close to some doorway need walking.
+ * Segments are valid as a whole for the grid generation in which they were
+ * built; in any other, a room's interior, ring and doorways still hold if
+ * its interior is all room-transparent and its doorways are the only
+ * room-transparent cells of its ring, as when the only player outside the
+ * rooms stands in a passage away from it (one on a passage spot of the ring
+ * would make a new doorway).
+ */
+typedef struct segRoom {
+  int top, left, bottom, right; // interior, inclusive; top > bottom if not convex
+  int firstDoor, ndoors;      // its doorways: room-transparent cells in the ring
+} segRoom_t;
+
+typedef struct segments {
+  unsigned long generation;   // grid generation when built
+  int* label;                 // [nrows*ncols]: room k is k+1, passage k is -(k+1), else 0
+  segRoom_t* rooms;           // [nrooms]
+  grid_point_t* doors;        // [ndoors], each convex room's together
+  int nrooms, npassages, ndoors;
+} segments_t;
+
+/* A "share" of the work of grid_visibleBatch, for one thread: computing the
+ * visible sets of some of the pending viewers, or filling the output grids
+ * of a range of viewers.  Every share has its own viewers, so the threads
+ * write nothing in common, and none of them touches the visibility cache.
+ */
+typedef struct visShare {
+  const grid_t* base;
+  const grid_point_t* viewers;  // all the batch's viewers
+  grid_t** outs;                // and their output grids
+  uint64_t* bits;               // [n * words]: each viewer's visible set
+  int* pending;                 // when computing: this share's viewers
+  int npending;
+  int first, last;              // when filling: viewers first...last-1
+} visShare_t;
+
 /**************** file-local global variables ****************/
 
+// visible sets computed (not answered from a cache), by all grids and threads
+static atomic_ulong visibleComputed;
+
+/* The table of rays, indexed by offset; built lazily, one ray at a time,
+ * as visibility queries need them.  It covers offsets up to the largest
+ * grid seen so far, and grows (keeping existing rays) for a larger grid.
+ * Each thread has its own table, so threads may query visibility at once.
+ */
+static _Thread_local struct {
+  int maxdr, maxdc;           // covers -maxdr..maxdr by -maxdc..maxdc
+  ray_t* rays;                // [(2*maxdr+1) * (2*maxdc+1)]
+} rayTable = { 0, 0, NULL };
+
+// a thread that builds a table is given this key, so its table is freed
+// when it exits (e.g., a pool worker) even if it never calls grid_freeRays
+static pthread_key_t rayKey;
+static pthread_once_t rayKeyOnce = PTHREAD_ONCE_INIT;
+static bool rayKeyMade;
+
 /**************** local function prototypes ****************/
 /* not visible outside this file */
 static grid_t* grid_allocate(const int nrows, const int ncols);
 static int grid_size(const int nrows, const int ncols);
 static bool grid_sizesMatch(const grid_t* grid1, const grid_t* grid2);
+static int cellClass(const char x);
+static void grid_planesSetCell(grid_t* grid, const int r, const int c);
+static void grid_planesSync(grid_t* grid);
+static void grid_rebase(grid_t* grid);
+static inline bool grid_hasClass(const grid_t* grid, const int r, const int c,
+                                 const int plane);
+static inline bool grid_roomAt(const grid_t* grid, const int r, const int c);
+static const ray_t* grid_ray(const grid_t* grid, const int dr, const int dc);
+static void grid_makeRayKey(void);
+static void grid_raysThreadExit(void* arg);
+static void ray_build(ray_t* ray, const int dr, const int dc);
+static bool ray_isClear(const grid_t* base, const ray_t* ray,
+                        const int pr, const int pc);
+static int floorDiv(const int num, const int den);
+static void grid_changed(grid_t* grid);
+static void grid_visibleBits(const grid_t* base, const int pr, const int pc,
+                             uint64_t* bits);
+static const uint64_t* visCache_get(visCache_t* cache, const grid_t* base,
+                                    const int pr, const int pc);
+static const uint64_t* visCache_find(visCache_t* cache, const grid_t* base,
+                                     const int pr, const int pc);
+static uint64_t* visCache_claim(visCache_t* cache, const grid_t* base,
+                                const int pr, const int pc);
+static void visCache_unlink(visCache_t* cache, const int e);
+static void visCache_pushFront(visCache_t* cache, const int e);
+static void visCache_delete(visCache_t* cache);
+static bool compiled_visibleBits(const grid_t* base, const int pr, const int pc,
+                                 uint64_t* bits);
+static bool compiled_validate(const uint8_t* file, const size_t length,
+                              const uint8_t* sections[], uint64_t lengths[]);
+static uint64_t fnv1a(const uint8_t* data, const size_t length);
+static size_t putVarint(uint8_t* out, uint64_t value);
+static bool getVarint(const uint8_t** p, const uint8_t* end, uint64_t* value);
+static void bits_setRange(uint64_t* bits, uint64_t from, uint64_t count);
+static int segments_label(const grid_t* grid, int* label, int* queue,
+                          const int start, const int value, const int plane,
+                          int* top, int* left, int* bottom, int* right);
+static bool segments_findInterior(const grid_t* grid, segments_t* segments,
+                                  const int k, const int size, int top, int left,
+                                  int bottom, int right, segRoom_t* room);
+static void visShare_runAll(pool_t* workers, void (*job)(void* arg),
+                            visShare_t* shares, const int nshares);
+static void visShare_compute(void* arg);
+static void visShare_fill(void* arg);
+static bool segments_roomIntact(const grid_t* grid, const segments_t* segments,
+                                const segRoom_t* room);
+static bool segments_visible(const grid_t* base, const int pr, const int pc,
+                             uint64_t* bits, grid_t* out);
+static void segments_delete(segments_t* segments);
 
 /**************** grid_new ****************/
 /* see grid.h for detailed interface description */
@@ -120,15 +377,215 @@ grid_fromFile(const char* filename)
     return NULL;
   }
 
-  // since any real grid must fit into a message,
-  // we can allocate and try to read that max-size grid.
-  char gridString[message_MaxBytes];
-  // read and null-terminate string from the file
-  size_t nChars = fread(gridString, sizeof(char), message_MaxBytes, fp);
-  gridString[nChars] = '\0';
+  // a grid the game can play must fit into a message, but a grid for
+  // benchmarks may not, so read the whole file, growing the buffer as needed
+  size_t size = message_MaxBytes;
+  size_t nChars = 0;
+  char* gridString = malloc(size + 1);
+  while (gridString != NULL) {
+    nChars += fread(gridString + nChars, sizeof(char), size - nChars, fp);
+    if (nChars < size) {
+      break;
+    }
+    size *= 2;
+    char* bigger = realloc(gridString, size + 1);
+    if (bigger == NULL) {
+      free(gridString);
+    }
+    gridString = bigger;
+  }
   fclose(fp);
+  if (gridString == NULL) {
+    return NULL;
+  }
+  // null-terminate the string
+  gridString[nChars] = '\0';
+
+  grid_t* grid = grid_fromString(gridString);
+  free(gridString);
+  return grid;
+}
+
+/**************** grid_fromCompiled ****************/
+/* see grid.h for detailed interface description */
+grid_t*
+grid_fromCompiled(const char* filename)
+{
+  if (filename == NULL) {
+    return NULL;
+  }
+  const int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(compiledHeader_t)) {
+    close(fd);
+    return NULL;
+  }
+  const size_t length = st.st_size;
+  // private and writable: the grid's cells and planes live in the mapping
+  void* addr = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    return NULL;
+  }
+
+  const uint8_t* sections[SectionCount] = { NULL };
+  uint64_t lengths[SectionCount] = { 0 };
+  if (!compiled_validate(addr, length, sections, lengths)) {
+    fprintf(stderr, "grid_fromCompiled: %s is not a valid compiled map\n", filename);
+    munmap(addr, length);
+    return NULL;
+  }
+  const compiledHeader_t* header = addr;
+
+  grid_t* grid = malloc(sizeof(grid_t));
+  compiled_t* compiled = malloc(sizeof(compiled_t));
+  if (grid == NULL || compiled == NULL) {
+    free(grid);
+    free(compiled);
+    munmap(addr, length);
+    return NULL;
+  }
+  compiled->addr = addr;
+  compiled->length = length;
+  compiled->visIndex = (const uint32_t*) sections[SectionVisIndex];
+  compiled->visRuns = sections[SectionVisRuns];
+  compiled->generation = 0;
+
+  grid->nrows = header->nrows;
+  grid->ncols = header->ncols;
+  grid->cells = (char*) sections[SectionCells];
+  grid->planes = (uint64_t*) sections[SectionPlanes];
+  grid->planeWords = (grid->ncols + 63) / 64;
+  grid->generation = grid->generations = 0;
+  grid->baseRoom = NULL;
+  grid->baseDiffs = 0;
+  grid->baseGeneration = 0;
+  grid->visCache = NULL;
+  grid->segments = NULL;
+  grid->compiled = compiled;
+  grid_rebase(grid);            // the terrain its visible sets describe
+  return grid;
+}
+
+/**************** grid_writeCompiled ****************/
+/* see grid.h for detailed interface description */
+bool
+grid_writeCompiled(const grid_t* grid, const char* filename, const bool withVisibility)
+{
+  if (grid == NULL || filename == NULL) {
+    return false;
+  }
+  const int nrows = grid->nrows;
+  const int ncols = grid->ncols;
+  const int ncells = nrows * ncols;
+  const int words = (ncells + 63) / 64;
+
+  // the planes, built on a scratch copy so the caller's grid is untouched
+  grid_t* copy = grid_fromString(grid->cells);
+  if (copy == NULL || !grid_buildPlanes(copy)) {
+    grid_delete(copy);
+    return false;
+  }
+  const size_t planesLength = (size_t) PlaneCount * nrows * copy->planeWords * sizeof(uint64_t);
+
+  // the visible set from every spot, run-length encoded
+  uint32_t* visIndex = NULL;
+  uint8_t* visRuns = NULL;
+  size_t runsLength = 0, runsCapacity = 0;
+  bool ok = true;
+  if (withVisibility) {
+    visIndex = malloc((ncells + 1) * sizeof(uint32_t));
+    uint64_t* bits = malloc(words * sizeof(uint64_t));
+    ok = (visIndex != NULL && bits != NULL);
+    for (int i = 0; ok && i < ncells; i++) {
+      visIndex[i] = runsLength;
+      const int pr = i / ncols, pc = i % ncols;
+      if (!grid_hasClass(copy, pr, pc, PlaneSpot)) {
+        continue;
+      }
+      grid_visibleBits(copy, pr, pc, bits);
+      uint64_t b = 0;
+      while (ok && b < (uint64_t) ncells) {
+        // count clear bits, then set bits
+        uint64_t clear = 0, set = 0;
+        while (b < (uint64_t) ncells && !((bits[b >> 6] >> (b & 63)) & 1)) {
+          b++, clear++;
+        }
+        while (b < (uint64_t) ncells && ((bits[b >> 6] >> (b & 63)) & 1)) {
+          b++, set++;
+        }
+        if (set == 0) {
+          break;                // the rest are clear
+        }
+        if (runsLength + 20 > runsCapacity) {
+          runsCapacity = runsCapacity ? 2 * runsCapacity : 4096;
+          uint8_t* more = realloc(visRuns, runsCapacity);
+          if (more == NULL) {
+            ok = false;
+            break;
+          }
+          visRuns = more;
+        }
+        runsLength += putVarint(visRuns + runsLength, clear);
+        runsLength += putVarint(visRuns + runsLength, set);
+      }
+      ok = ok && runsLength <= UINT32_MAX;
+    }
+    if (ok) {
+      visIndex[ncells] = runsLength;
+    }
+    free(bits);
+  }
 
-  return grid_fromString(gridString);
+  // lay out the file: header, section table, then sections on 8-byte boundaries
+  const uint32_t nsections = withVisibility ? 4 : 2;
+  compiledSection_t table[4] = {
+    { SectionCells, 0, 0, grid_size(nrows, ncols) + 1 },
+    { SectionPlanes, 0, 0, planesLength },
+    { SectionVisIndex, 0, 0, (ncells + 1) * sizeof(uint32_t) },
+    { SectionVisRuns, 0, 0, runsLength },
+  };
+  const void* data[4] = { copy->cells, copy->planes, visIndex, visRuns };
+  uint64_t offset = sizeof(compiledHeader_t) + nsections * sizeof(compiledSection_t);
+  for (uint32_t s = 0; s < nsections; s++) {
+    offset = (offset + 7) & ~(uint64_t) 7;
+    table[s].offset = offset;
+    offset += table[s].length;
+  }
+  uint8_t* file = ok ? calloc(offset, 1) : NULL;
+  if (file != NULL) {
+    compiledHeader_t* header = (compiledHeader_t*) file;
+    memcpy(header->magic, CompiledMagic, sizeof(CompiledMagic));
+    header->version = CompiledVersion;
+    header->nsections = nsections;
+    header->nrows = nrows;
+    header->ncols = ncols;
+    memcpy(file + sizeof(compiledHeader_t), table, nsections * sizeof(compiledSection_t));
+    for (uint32_t s = 0; s < nsections; s++) {
+      if (table[s].length > 0) {
+        memcpy(file + table[s].offset, data[s], table[s].length);
+      }
+    }
+    header->checksum = fnv1a(file + sizeof(compiledHeader_t),
+                             offset - sizeof(compiledHeader_t));
+
+    FILE* fp = fopen(filename, "wb");
+    ok = (fp != NULL && fwrite(file, 1, offset, fp) == offset);
+    if (fp != NULL && fclose(fp) != 0) {
+      ok = false;
+    }
+  } else {
+    ok = false;
+  }
+
+  free(file);
+  free(visIndex);
+  free(visRuns);
+  grid_delete(copy);
+  return ok;
 }
 
 /**************** grid_overlay ****************/
@@ -155,6 +612,7 @@ void grid_overlay(const grid_t* base, const grid_t* overlay,
       }
     }
   }
+  grid_changed(out);
 }
 
 /**************** grid_visible ****************/
@@ -163,22 +621,167 @@ void grid_overlay(const grid_t* base, const grid_t* overlay,
 void
 grid_visible(const grid_t* base, const int pr, const int pc, grid_t* out)
 {
+  TRACE_SCOPE("grid_visible");
+  // the base itself is updated from a scratch grid, so rays see it unchanged
+  if (out == base && base != NULL) {
+    grid_t* scratch = grid_new(base->nrows, base->ncols);
+    if (scratch != NULL) {
+      grid_visible(base, pr, pc, scratch);
+      grid_copy(scratch, out);
+      grid_delete(scratch);
+    }
+    return;
+  }
   // check grid sizes - they must both be non-NULL and the same size
   if (grid_sizesMatch(base, out)) {
     const int nrows = base->nrows;
     const int ncols = base->ncols;
 
-    // copy the visible cells from base grid to output grid
-    for (int r = 0; r < nrows; r++) {
-      for (int c = 0; c < ncols; c++) {
-        if (grid_isVisible(base, r, c, pr, pc)) {
-          CELL(out, r, c) = CELL(base, r, c);
-        } else {
-          CELL(out, r, c) = GRID_BLANK;
+    // the visible set from the cache, if any
+    const uint64_t* bits = visCache_get(base->visCache, base, pr, pc);
+
+    if (bits != NULL) {
+      // copy the cells whose bit is set from base grid to output grid
+      for (int r = 0, i = 0; r < nrows; r++) {
+        for (int c = 0; c < ncols; c++, i++) {
+          if ((bits[i >> 6] >> (i & 63)) & 1) {
+            CELL(out, r, c) = CELL(base, r, c);
+          } else {
+            CELL(out, r, c) = GRID_BLANK;
+          }
         }
       }
+    } else if (segments_visible(base, pr, pc, NULL, out)) {
+      // inside a convex room
+      atomic_fetch_add_explicit(&visibleComputed, 1, memory_order_relaxed);
+    } else {
+      // copy the visible cells from base grid to output grid,
+      // walking the precomputed ray from pr,pc to each non-blank cell
+      atomic_fetch_add_explicit(&visibleComputed, 1, memory_order_relaxed);
+      for (int r = 0; r < nrows; r++) {
+        for (int c = 0; c < ncols; c++) {
+          if (CELL(base, r, c) != GRID_BLANK
+              && ray_isClear(base, grid_ray(base, r - pr, c - pc), pr, pc)) {
+            CELL(out, r, c) = CELL(base, r, c);
+          } else {
+            CELL(out, r, c) = GRID_BLANK;
+          }
+        }
+      }
+    }
+    grid_changed(out);
+  }
+}
+
+/**************** grid_visibleBatch ****************/
+/* see grid.h for detailed interface description */
+void
+grid_visibleBatch(const grid_t* base, const grid_point_t viewers[],
+                  const int n, grid_t* outs[], pool_t* workers)
+{
+  TRACE_SCOPE("grid_visibleBatch");
+  if (base == NULL || viewers == NULL || outs == NULL || n <= 0) {
+    return;
+  }
+  const int nrows = base->nrows;
+  const int ncols = base->ncols;
+  const int words = (nrows * ncols + 63) / 64;
+
+  // one visible set per viewer; a share of the work for each thread
+  int nshares = pool_numWorkers(workers) + 1;
+  if (nshares > n) {
+    nshares = n;
+  }
+  uint64_t* bits = calloc((size_t) n * words, sizeof(uint64_t));
+  int* pending = malloc(n * sizeof(int));    // indexes of viewers to compute
+  visShare_t* shares = malloc(nshares * sizeof(visShare_t));
+  if (bits == NULL || pending == NULL || shares == NULL) {
+    free(bits);
+    free(pending);
+    free(shares);
+    // fall back to one viewer at a time
+    for (int v = 0; v < n; v++) {
+      grid_visible(base, viewers[v].r, viewers[v].c, outs[v]);
+    }
+    return;
+  }
+
+  // an output that is the base itself is filled in a scratch grid, and
+  // copied over the base once every output is filled from the base
+  grid_t** targets = outs;
+  for (int v = 0; v < n && targets == outs; v++) {
+    if (outs[v] == base) {
+      targets = malloc(n * sizeof(grid_t*));
+      if (targets == NULL) {
+        free(bits);
+        free(pending);
+        free(shares);
+        return;
+      }
+      for (int u = 0; u < n; u++) {
+        targets[u] = (outs[u] == base) ? grid_new(nrows, ncols) : outs[u];
+      }
+    }
+  }
+
+  // take what we can from the cache; viewers off the grid see nothing
+  int npending = 0;
+  for (int v = 0; v < n; v++) {
+    const int pr = viewers[v].r, pc = viewers[v].c;
+    if (!grid_sizesMatch(base, targets[v])
+        || pr < 0 || pr >= nrows || pc < 0 || pc >= ncols) {
+      continue;
+    }
+    const uint64_t* cached = visCache_find(base->visCache, base, pr, pc);
+    if (cached != NULL) {
+      memcpy(&bits[(size_t) v * words], cached, words * sizeof(uint64_t));
+    } else {
+      pending[npending++] = v;
+    }
+  }
+
+  // compute the rest, each thread its share; the cache is not touched
+  if (npending > 0) {
+    atomic_fetch_add_explicit(&visibleComputed, npending, memory_order_relaxed);
+    const int ncompute = (nshares < npending) ? nshares : npending;
+    for (int s = 0; s < ncompute; s++) {
+      const int from = (long) npending * s / ncompute;
+      const int to = (long) npending * (s + 1) / ncompute;
+      shares[s] = (visShare_t) { base, viewers, targets, bits, &pending[from], to - from, 0, 0 };
+    }
+    visShare_runAll(workers, visShare_compute, shares, ncompute);
+
+    // remember the new sets for next time
+    for (int k = 0; k < npending; k++) {
+      const int v = pending[k];
+      uint64_t* entry = visCache_claim(base->visCache, base,
+                                       viewers[v].r, viewers[v].c);
+      if (entry != NULL) {
+        memcpy(entry, &bits[(size_t) v * words], words * sizeof(uint64_t));
+      }
     }
   }
+
+  // fill every output grid, each thread its share of the viewers
+  for (int s = 0; s < nshares; s++) {
+    shares[s] = (visShare_t) { base, viewers, targets, bits, NULL, 0,
+                               (long) n * s / nshares, (long) n * (s + 1) / nshares };
+  }
+  visShare_runAll(workers, visShare_fill, shares, nshares);
+
+  if (targets != outs) {
+    for (int v = 0; v < n; v++) {
+      if (outs[v] == base) {
+        grid_copy(targets[v], outs[v]);
+        grid_delete(targets[v]);
+      }
+    }
+    free(targets);
+  }
+
+  free(bits);
+  free(pending);
+  free(shares);
 }
 
 /**************** grid_erase ****************/
@@ -194,6 +797,24 @@ grid_erase(grid_t* grid)
     for (int r = 0; r < nrows; r++, p += ncols+1) {
       sprintf(p, "%*c\n", ncols, ' ');
     }
+    grid_changed(grid);
+  }
+}
+
+/**************** grid_copy ****************/
+/* see grid.h for detailed interface description */
+void
+grid_copy(const grid_t* from, grid_t* to)
+{
+  if (from == NULL || to == NULL || from == to || !grid_sizesMatch(from, to)) {
+    return;
+  }
+  for (int r = 0; r < to->nrows; r++) {
+    for (int c = 0; c < to->ncols; c++) {
+      if (CELL(to, r, c) != CELL(from, r, c)) {
+        grid_set(to, r, c, CELL(from, r, c));
+      }
+    }
   }
 }
 
@@ -217,7 +838,21 @@ grid_set(grid_t* grid, const int r, const int c, const char x)
 {
   if (grid != NULL) {
     if ((r >= 0 && r < grid->nrows) && (c >= 0 && c < grid->ncols)) {
+      if ((cellClass(CELL(grid, r, c)) ^ cellClass(x)) & CLASS_ROOM) {
+        // a change in what blocks vision: back to the base terrain, or a new one
+        if (grid->baseRoom != NULL) {
+          const int i = r * grid->ncols + c;
+          const bool wasBase = ((grid->baseRoom[i >> 6] >> (i & 63)) & 1)
+            == ((cellClass(CELL(grid, r, c)) & CLASS_ROOM) != 0);
+          grid->baseDiffs += wasBase ? 1 : -1;
+        }
+        grid->generation = (grid->baseRoom != NULL && grid->baseDiffs == 0)
+          ? grid->baseGeneration : ++grid->generations;
+      }
       CELL(grid, r, c) = x;
+      if (grid->planes != NULL) {
+        grid_planesSetCell(grid, r, c);
+      }
     }
   }
 }
@@ -264,9 +899,21 @@ void
 grid_delete(grid_t* grid)
 {
   if (grid != NULL) {
-    if (grid->cells != NULL) {
-      free(grid->cells); // the cells
+    if (grid->compiled != NULL) {
+      // cells and planes live in the mapped file
+      munmap(grid->compiled->addr, grid->compiled->length);
+      free(grid->compiled);
+    } else {
+      if (grid->cells != NULL) {
+        free(grid->cells); // the cells
+      }
+      if (grid->planes != NULL) {
+        free(grid->planes); // the bit planes
+      }
     }
+    visCache_delete(grid->visCache);
+    segments_delete(grid->segments);
+    free(grid->baseRoom);
     free(grid); // the struct
   }
 }
@@ -277,11 +924,7 @@ grid_delete(grid_t* grid)
 bool
 grid_isSpot(const grid_t* grid, const int r, const int c)
 {
-  return grid == NULL ? false :
-       CELL(grid, r, c) == GRID_ROOM_SPOT
-    || CELL(grid, r, c) == GRID_PASS_SPOT
-    || CELL(grid, r, c) == GRID_GOLD
-    || isalpha(CELL(grid, r, c));
+  return grid_hasClass(grid, r, c, PlaneSpot);
 }
 
 /**************** grid_isRoomSpot ****************/
@@ -290,10 +933,7 @@ grid_isSpot(const grid_t* grid, const int r, const int c)
 bool
 grid_isRoomSpot(const grid_t* grid, const int r, const int c)
 {
-  return grid == NULL ? false :
-    CELL(grid, r, c) == GRID_ROOM_SPOT ||
-    CELL(grid, r, c) == GRID_GOLD ||
-    isalpha(CELL(grid, r, c));
+  return grid_hasClass(grid, r, c, PlaneRoom);
 }
 
 /**************** grid_isGold ****************/
@@ -306,14 +946,22 @@ grid_isGold(const grid_t* grid, const int r, const int c)
     CELL(grid, r, c) == GRID_GOLD;
 }
 
-/**************** grid_isGold ****************/
+/**************** grid_isPlayer ****************/
 /* see grid.h for detailed interface description */
-/* is point r,c a spot? */
+/* is point r,c a player? */
 bool
 grid_isPlayer(const grid_t* grid, const int r, const int c)
 {
-  return grid == NULL ? false :
-    isalpha(CELL(grid, r, c));
+  return grid_hasClass(grid, r, c, PlanePlayer);
+}
+
+/**************** grid_isWall ****************/
+/* see grid.h for detailed interface description */
+/* is point r,c a wall or corner? */
+bool
+grid_isWall(const grid_t* grid, const int r, const int c)
+{
+  return grid_hasClass(grid, r, c, PlaneWall);
 }
 
 /**************** grid_isBlank ****************/
@@ -325,6 +973,161 @@ grid_isBlank(const grid_t* grid, const int r, const int c)
   return grid == NULL ? false : CELL(grid, r, c) == GRID_BLANK;
 }
 
+/**************** grid_buildPlanes ****************/
+/* see grid.h for detailed interface description */
+bool
+grid_buildPlanes(grid_t* grid)
+{
+  if (grid == NULL) {
+    return false;
+  }
+  if (grid->planes == NULL) {
+    grid->planeWords = (grid->ncols + 63) / 64;
+    grid->planes = calloc(PlaneCount * grid->nrows * grid->planeWords,
+                          sizeof(uint64_t));
+    if (grid->planes == NULL) {
+      return false;
+    }
+  }
+  grid_planesSync(grid);
+  return true;
+}
+
+/**************** grid_buildSegments ****************/
+/* see grid.h for detailed interface description */
+bool
+grid_buildSegments(grid_t* grid)
+{
+  if (grid == NULL) {
+    return false;
+  }
+  segments_delete(grid->segments);
+  grid->segments = NULL;
+  grid_rebase(grid);            // the terrain the segments describe, unless already taken
+
+  const int ncells = grid->nrows * grid->ncols;
+  segments_t* segments = calloc(1, sizeof(segments_t));
+  int* queue = malloc(ncells * sizeof(int));
+  if (segments == NULL || queue == NULL
+      || (segments->label = calloc(ncells, sizeof(int))) == NULL) {
+    free(queue);
+    segments_delete(segments);
+    return false;
+  }
+  segments->generation = grid->generation;
+
+  // label every region, and note each room's bounding box
+  int capacity = 0;
+  for (int i = 0; i < ncells; i++) {
+    if (segments->label[i] != 0) {
+      continue;
+    }
+    const int r = i / grid->ncols, c = i % grid->ncols;
+    int top, left, bottom, right;
+    if (grid_hasClass(grid, r, c, PlaneRoom)) {
+      if (segments->nrooms == capacity) {
+        capacity = capacity ? 2 * capacity : 16;
+        segRoom_t* rooms = realloc(segments->rooms, capacity * sizeof(segRoom_t));
+        if (rooms == NULL) {
+          free(queue);
+          segments_delete(segments);
+          return false;
+        }
+        segments->rooms = rooms;
+      }
+      const int k = segments->nrooms++;
+      const int size = segments_label(grid, segments->label, queue, i, k + 1,
+                                      PlaneRoom, &top, &left, &bottom, &right);
+      if (!segments_findInterior(grid, segments, k, size, top, left, bottom, right,
+                                 &segments->rooms[k])) {
+        free(queue);
+        segments_delete(segments);
+        return false;
+      }
+    } else if (grid_hasClass(grid, r, c, PlaneSpot)) {
+      segments_label(grid, segments->label, queue, i, -(++segments->npassages),
+                     PlaneSpot, &top, &left, &bottom, &right);
+    }
+  }
+
+  free(queue);
+  grid->segments = segments;
+  return true;
+}
+
+/**************** grid_enableVisCache ****************/
+/* see grid.h for detailed interface description */
+bool
+grid_enableVisCache(grid_t* grid, const size_t budget)
+{
+  if (grid == NULL) {
+    return false;
+  }
+
+  // drop any existing cache
+  visCache_delete(grid->visCache);
+  grid->visCache = NULL;
+  if (budget == 0) {
+    return true;
+  }
+
+  // what does the index cost, and how many entries fit in what remains?
+  const int ncells = grid->nrows * grid->ncols;
+  const int words = (ncells + 63) / 64;
+  const size_t fixed = sizeof(visCache_t) + ncells * sizeof(int);
+  const size_t perEntry = sizeof(visEntry_t) + words * sizeof(uint64_t);
+  if (budget < fixed + perEntry) {
+    return false;               // not even one entry fits
+  }
+
+  visCache_t* cache = malloc(sizeof(visCache_t));
+  if (cache == NULL) {
+    return false;
+  }
+  cache->budget = budget;
+  cache->words = words;
+  cache->maxEntries = (budget - fixed) / perEntry;
+  if (cache->maxEntries > ncells) {
+    cache->maxEntries = ncells; // no use for more entries than viewpoints
+  }
+  cache->nentries = 0;
+  cache->head = cache->tail = -1;
+  cache->hits = cache->misses = cache->evictions = 0;
+  cache->slotOf = malloc(ncells * sizeof(int));
+  cache->entries = malloc(cache->maxEntries * sizeof(visEntry_t));
+  if (cache->slotOf == NULL || cache->entries == NULL) {
+    free(cache->slotOf);
+    free(cache->entries);
+    free(cache);
+    return false;
+  }
+  for (int i = 0; i < ncells; i++) {
+    cache->slotOf[i] = -1;
+  }
+  cache->bytes = fixed + cache->maxEntries * sizeof(visEntry_t);
+
+  grid->visCache = cache;
+  return true;
+}
+
+/**************** grid_visCacheStats ****************/
+/* see grid.h for detailed interface description */
+bool
+grid_visCacheStats(const grid_t* grid, grid_visStats_t* stats)
+{
+  if (grid == NULL || grid->visCache == NULL || stats == NULL) {
+    return false;
+  }
+  const visCache_t* cache = grid->visCache;
+  stats->hits = cache->hits;
+  stats->misses = cache->misses;
+  stats->evictions = cache->evictions;
+  stats->entries = cache->nentries;
+  stats->bytes = cache->bytes;
+  stats->budget = cache->budget;
+  return true;
+}
+
 /**************** grid_isVisible ****************/
 /* see grid.h for detailed interface description */
 /* is point r,c visible from point pr, pc? */
@@ -341,54 +1144,51 @@ grid_isVisible(const grid_t* base,
     return false;
   }
 
-  // How does the destination point (r,c) differ from player point (pr,pc)?
-  const int rdelta = r-pr;                  // row delta
-  const int cdelta = c-pc;                  // col delta
-  const int rsign = (rdelta < 0) ? -1 : +1; // sign of row delta
-  const int csign = (cdelta < 0) ? -1 : +1; // sign of col delta
+  // walk the template for this offset, starting from the viewer
+  return ray_isClear(base, grid_ray(base, r - pr, c - pc), pr, pc);
+}
 
-  // Four cases: same gridpoint, vertical line, horizontal line, sloping line;
-  // return false if anything blocks our vision, otherwise true.
+/**************** grid_visibleComputed ****************/
+/* see grid.h for detailed interface description */
+unsigned long
+grid_visibleComputed(void)
+{
+  return atomic_load_explicit(&visibleComputed, memory_order_relaxed);
+}
 
-  if (rdelta == 0 && cdelta == 0) {       // 1. same gridpoint
-    return true;
-  } else if (cdelta == 0) {               // 2. vertical line
-    // step along the path from pr,c to r,c, and see if we hit a wall
-    for (int row = pr + rsign; row != r; row += rsign) {
-      if (!grid_isRoomSpot(base, row, c)) {
-        return false;
-      }
-    }
-    return true;
-  } else if (rdelta == 0) {               // 3. horizontal line
-    // step along the path from r,pc to r,c, and see if we hit a wall
-    for (int col = pc + csign; col != c; col += csign) {
-      if (!grid_isRoomSpot(base, r, col)) {
-        return false;
-      }
-    }
-    return true;
-  } else {                                // 4. sloping line
-    const float slope = (float) rdelta / (float) cdelta;
-
-    // step along rows
-    for (int row = pr + rsign; row != r; row += rsign) {
-      float colcept = pc + (float)(row - pr) / slope; // intercept
-      if (   !grid_isRoomSpot(base, row, (int) floor(colcept))
-          && !grid_isRoomSpot(base, row, (int) ceil(colcept))) {
-        return false;
-      }
-    }
-    // step along cols
-    for (int col = pc + csign; col != c; col += csign) {
-      float rowcept = pr + slope * (float)(col - pc); // intercept
-      if (   !grid_isRoomSpot(base, (int) floor(rowcept), col)
-          && !grid_isRoomSpot(base, (int) ceil(rowcept), col)) {
-        return false;
-      }
+/**************** grid_freeRays ****************/
+/* see grid.h for detailed interface description */
+void
+grid_freeRays(void)
+{
+  if (rayTable.rays != NULL) {
+    const int nrays = (2 * rayTable.maxdr + 1) * (2 * rayTable.maxdc + 1);
+    for (int i = 0; i < nrays; i++) {
+      free(rayTable.rays[i].probes);
     }
-    return true;
+    free(rayTable.rays);
   }
+  rayTable.maxdr = rayTable.maxdc = 0;
+  rayTable.rays = NULL;
+}
+
+/**************** grid_makeRayKey ****************/
+/* INTERNAL FUNCTION: make the key that frees each thread's ray table
+ * when the thread exits; run once, by pthread_once.
+ */
+static void
+grid_makeRayKey(void)
+{
+  rayKeyMade = (pthread_key_create(&rayKey, grid_raysThreadExit) == 0);
+}
+
+/**************** grid_raysThreadExit ****************/
+/* INTERNAL FUNCTION: free the exiting thread's ray table.
+ */
+static void
+grid_raysThreadExit(void* arg)
+{
+  grid_freeRays();
 }
 
 /**************** grid_allocate ****************/
@@ -408,6 +1208,15 @@ grid_allocate(const int nrows, const int ncols)
   // initialize the members
   grid->nrows = nrows;
   grid->ncols = ncols;
+  grid->planes = NULL;
+  grid->planeWords = 0;
+  grid->generation = grid->generations = 0;
+  grid->baseRoom = NULL;
+  grid->baseDiffs = 0;
+  grid->baseGeneration = 0;
+  grid->visCache = NULL;
+  grid->compiled = NULL;
+  grid->segments = NULL;
   grid->cells = calloc(grid_size(nrows, ncols)+1, sizeof(char));
 
   if (grid->cells == NULL) {
@@ -450,43 +1259,1053 @@ grid_sizesMatch(const grid_t* grid1, const grid_t* grid2)
 }
 
 
-/* ******************************************************************* */
-/* ******************************************************************* */
-
-/**************** UNIT TEST ****************/
-
-#ifdef UNIT_TEST
-
-static int arg2int(const char* progname, char* arg);
-int test2(const int argc, char* argv[]);
-int test3(const int argc, char* argv[]);
-
-/*
- * usage: one of
- *   gridtest nrows ncols > grid.txt
- *   gridtest filename.txt
+/**************** cellClass ****************/
+/* INTERNAL FUNCTION: classify one map character.
+ * Function returns: bitwise-or of the CLASS_* flags that apply to x.
+ * Notes: player letters are tested by range rather than isalpha(),
+ *   so the answer does not depend on the locale.
  */
-int
-main(const int argc, char* argv[])
+static int
+cellClass(const char x)
 {
-  switch (argc) {
-  case 2:
-    return test2(argc, argv);
-  case 3:
-    return test3(argc, argv);
+  switch (x) {
+  case GRID_ROOM_SPOT:
+  case GRID_GOLD:
+    return CLASS_ROOM | CLASS_SPOT;
+  case GRID_PASS_SPOT:
+    return CLASS_SPOT;
+  case GRID_WALL_VERT:
+  case GRID_WALL_HORZ:
+  case GRID_WALL_CORN:
+    return CLASS_WALL;
   default:
-    fprintf(stderr, "usage: %s nrows ncols\n", argv[0]);
-    fprintf(stderr, "   or: %s filename\n", argv[0]);
-    return 1;
+    if ((x >= 'A' && x <= 'Z') || (x >= 'a' && x <= 'z')) {
+      return CLASS_ROOM | CLASS_SPOT | CLASS_PLAYER;
+    }
+    return 0;
   }
 }
 
-/* argc == 2:  gridtest filename */
-int
-test2(const int argc, char* argv[])
+/**************** grid_hasClass ****************/
+/* INTERNAL FUNCTION: does point r,c belong to the given plane's class?
+ * Reads a single bit when the grid carries planes, else classifies the char.
+ * Function returns: false if grid is NULL or r,c out of bounds.
+ */
+static inline bool
+grid_hasClass(const grid_t* grid, const int r, const int c, const int plane)
 {
-  const char* progname = argv[0];
-  const char* filename = argv[1];
+  if (grid == NULL || r < 0 || r >= grid->nrows || c < 0 || c >= grid->ncols) {
+    return false;
+  }
+  if (grid->planes != NULL) {
+    return PLANE_BIT(grid, plane, r, c);
+  }
+  return (cellClass(CELL(grid, r, c)) >> plane) & 1;
+}
+
+/**************** grid_roomAt ****************/
+/* INTERNAL FUNCTION: is point r,c room-transparent?
+ * Like grid_hasClass(grid, r, c, PlaneRoom), but without the checks;
+ * caller guarantees grid is non-NULL and r,c is in bounds.
+ */
+static inline bool
+grid_roomAt(const grid_t* grid, const int r, const int c)
+{
+  if (grid->planes != NULL) {
+    return PLANE_BIT(grid, PlaneRoom, r, c);
+  }
+  return cellClass(CELL(grid, r, c)) & CLASS_ROOM;
+}
+
+/**************** grid_ray ****************/
+/* INTERNAL FUNCTION: return the ray for offset dr,dc from the viewer,
+ * growing the table to cover the grid and building the ray if needed.
+ * Function returns: pointer to the ray, or NULL if out of memory.
+ */
+static const ray_t*
+grid_ray(const grid_t* grid, const int dr, const int dc)
+{
+  // grow the table if this grid is larger than any seen before
+  if (grid->nrows > rayTable.maxdr || grid->ncols > rayTable.maxdc) {
+    const int maxdr = grid->nrows > rayTable.maxdr ? grid->nrows : rayTable.maxdr;
+    const int maxdc = grid->ncols > rayTable.maxdc ? grid->ncols : rayTable.maxdc;
+    const int width = 2 * maxdc + 1;
+    const int nrays = (2 * maxdr + 1) * width;
+    ray_t* rays = malloc(nrays * sizeof(ray_t));
+    if (rays == NULL) {
+      return NULL;
+    }
+    for (int i = 0; i < nrays; i++) {
+      rays[i].nprobes = -1;
+      rays[i].probes = NULL;
+    }
+    // this thread's first table: free it when the thread exits
+    if (rayTable.rays == NULL) {
+      pthread_once(&rayKeyOnce, grid_makeRayKey);
+      if (rayKeyMade) {
+        pthread_setspecific(rayKey, &rayTable);
+      }
+    }
+    // carry over the rays already built
+    if (rayTable.rays != NULL) {
+      const int oldWidth = 2 * rayTable.maxdc + 1;
+      for (int r = -rayTable.maxdr; r <= rayTable.maxdr; r++) {
+        for (int c = -rayTable.maxdc; c <= rayTable.maxdc; c++) {
+          rays[(r + maxdr) * width + (c + maxdc)] =
+            rayTable.rays[(r + rayTable.maxdr) * oldWidth + (c + rayTable.maxdc)];
+        }
+      }
+      free(rayTable.rays);
+    }
+    rayTable.maxdr = maxdr;
+    rayTable.maxdc = maxdc;
+    rayTable.rays = rays;
+  }
+
+  ray_t* ray = &rayTable.rays[(dr + rayTable.maxdr) * (2 * rayTable.maxdc + 1)
+                              + (dc + rayTable.maxdc)];
+  if (ray->nprobes < 0) {
+    ray_build(ray, dr, dc);
+  }
+  return ray;
+}
+
+/**************** ray_build ****************/
+/* INTERNAL FUNCTION: fill in the probes for a point dr,dc from the viewer.
+ * Four cases: same gridpoint, vertical line, horizontal line, sloping line.
+ * A sloping line is probed once per row it crosses, at the two columns
+ * around its intercept, and once per column it crosses, at the two rows
+ * around its intercept.  Intercepts are computed exactly, in integers.
+ * On allocation failure the ray is left unbuilt, and will be retried.
+ */
+static void
+ray_build(ray_t* ray, const int dr, const int dc)
+{
+  const int rsign = (dr < 0) ? -1 : +1;  // sign of row delta
+  const int csign = (dc < 0) ? -1 : +1;  // sign of col delta
+  const int adr = dr * rsign;            // |dr|
+  const int adc = dc * csign;            // |dc|
+
+  // at most one probe per row and per column strictly between the endpoints
+  int maxProbes = (adr > 0 ? adr - 1 : 0) + (adc > 0 ? adc - 1 : 0);
+  probe_t* probes = malloc((maxProbes > 0 ? maxProbes : 1) * sizeof(probe_t));
+  if (probes == NULL) {
+    return;
+  }
+
+  int n = 0;
+  if (dc == 0) {                          // vertical line, or same gridpoint
+    for (int row = rsign; row != dr && dr != 0; row += rsign) {
+      probes[n++] = (probe_t) { row, 0, row, 0 };
+    }
+  } else if (dr == 0) {                   // horizontal line
+    for (int col = csign; col != dc; col += csign) {
+      probes[n++] = (probe_t) { 0, col, 0, col };
+    }
+  } else {                                // sloping line
+    // step along rows: column intercept is row * dc / dr
+    for (int row = rsign; row != dr; row += rsign) {
+      const int num = row * dc * rsign, den = adr;
+      const int lo = floorDiv(num, den);
+      const int hi = lo + (num - lo * den != 0);
+      probes[n++] = (probe_t) { row, lo, row, hi };
+    }
+    // step along cols: row intercept is col * dr / dc
+    for (int col = csign; col != dc; col += csign) {
+      const int num = col * dr * csign, den = adc;
+      const int lo = floorDiv(num, den);
+      const int hi = lo + (num - lo * den != 0);
+      probes[n++] = (probe_t) { lo, col, hi, col };
+    }
+  }
+
+  ray->probes = probes;
+  ray->nprobes = n;
+}
+
+/**************** ray_isClear ****************/
+/* INTERNAL FUNCTION: does every probe of the ray, placed at viewer pr,pc,
+ * find a room-transparent cell?  A NULL ray (out of memory) is not clear.
+ */
+static bool
+ray_isClear(const grid_t* base, const ray_t* ray, const int pr, const int pc)
+{
+  if (ray == NULL) {
+    return false;
+  }
+  const probe_t* probe = ray->probes;
+  for (int i = 0; i < ray->nprobes; i++, probe++) {
+    if (   !grid_roomAt(base, pr + probe->r1, pc + probe->c1)
+        && !grid_roomAt(base, pr + probe->r2, pc + probe->c2)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**************** floorDiv ****************/
+/* INTERNAL FUNCTION: num / den rounded toward negative infinity; den > 0.
+ */
+static int
+floorDiv(const int num, const int den)
+{
+  return (num >= 0) ? num / den : -((-num + den - 1) / den);
+}
+
+/**************** grid_changed ****************/
+/* INTERNAL FUNCTION: note a bulk change to the grid's cells;
+ * rebuild its planes and invalidate anything cached about its walls.
+ * The change may be to more than room-transparency, so the grid has no
+ * base terrain to return to afterward.
+ */
+static void
+grid_changed(grid_t* grid)
+{
+  grid->generation = ++grid->generations;
+  free(grid->baseRoom);
+  grid->baseRoom = NULL;
+  grid->baseDiffs = 0;
+  grid_planesSync(grid);
+}
+
+/**************** grid_rebase ****************/
+/* INTERNAL FUNCTION: take the grid's present terrain (which of its cells are
+ * room-transparent) as its base, the terrain its compiled visible sets and
+ * segments describe, unless it has one already.  From then on, grid_set
+ * returns the grid to the base generation whenever the terrain matches the
+ * base again, as when a player steps out of a passage, so that what was
+ * computed for the base applies again; every other terrain gets a new
+ * generation.  Without memory for the base, every change is a new generation.
+ */
+static void
+grid_rebase(grid_t* grid)
+{
+  if (grid->baseRoom != NULL) {
+    return;
+  }
+  const int ncells = grid->nrows * grid->ncols;
+  grid->baseRoom = calloc((ncells + 63) / 64, sizeof(uint64_t));
+  if (grid->baseRoom == NULL) {
+    return;
+  }
+  for (int r = 0, i = 0; r < grid->nrows; r++) {
+    for (int c = 0; c < grid->ncols; c++, i++) {
+      if (cellClass(CELL(grid, r, c)) & CLASS_ROOM) {
+        grid->baseRoom[i >> 6] |= (uint64_t) 1 << (i & 63);
+      }
+    }
+  }
+  grid->baseDiffs = 0;
+  grid->baseGeneration = grid->generation;
+}
+
+/**************** grid_visibleBits ****************/
+/* INTERNAL FUNCTION: compute the set of gridpoints visible from pr,pc
+ * as a bitset in row-major order, bit r*ncols+c for gridpoint r,c.
+ * Caller provides: bits array of at least (nrows*ncols+63)/64 words.
+ */
+static void
+grid_visibleBits(const grid_t* base, const int pr, const int pc,
+                 uint64_t* bits)
+{
+  if (compiled_visibleBits(base, pr, pc, bits)) {
+    return;                     // read from the compiled map
+  }
+  if (segments_visible(base, pr, pc, bits, NULL)) {
+    return;                     // inside a convex room
+  }
+
+  const int nrows = base->nrows;
+  const int ncols = base->ncols;
+  memset(bits, 0, ((nrows * ncols + 63) / 64) * sizeof(uint64_t));
+
+  for (int r = 0, i = 0; r < nrows; r++) {
+    for (int c = 0; c < ncols; c++, i++) {
+      if (CELL(base, r, c) != GRID_BLANK
+          && ray_isClear(base, grid_ray(base, r - pr, c - pc), pr, pc)) {
+        bits[i >> 6] |= (uint64_t) 1 << (i & 63);
+      }
+    }
+  }
+}
+
+/**************** visCache_get ****************/
+/* INTERNAL FUNCTION: return the visible set for viewpoint pr,pc,
+ * from the cache if it holds a current entry, otherwise computing it into
+ * a free (or the least-recently-used) entry.
+ * Function returns: pointer to the bitset, valid until the next call;
+ *   NULL if there is no cache, pr,pc is out of bounds, or out of memory.
+ */
+static const uint64_t*
+visCache_get(visCache_t* cache, const grid_t* base, const int pr, const int pc)
+{
+  const uint64_t* bits = visCache_find(cache, base, pr, pc);
+  if (bits == NULL) {
+    uint64_t* fresh = visCache_claim(cache, base, pr, pc);
+    if (fresh != NULL) {
+      atomic_fetch_add_explicit(&visibleComputed, 1, memory_order_relaxed);
+      grid_visibleBits(base, pr, pc, fresh);
+    }
+    bits = fresh;
+  }
+  return bits;
+}
+
+/**************** visCache_find ****************/
+/* INTERNAL FUNCTION: look up viewpoint pr,pc, counting a hit or a miss.
+ * Function returns: pointer to the cached bitset, valid until the next
+ *   visCache_claim; NULL if not cached, stale, no cache, or out of bounds.
+ */
+static const uint64_t*
+visCache_find(visCache_t* cache, const grid_t* base, const int pr, const int pc)
+{
+  if (cache == NULL
+      || pr < 0 || pr >= base->nrows || pc < 0 || pc >= base->ncols) {
+    return NULL;
+  }
+
+  const int e = cache->slotOf[pr * base->ncols + pc];
+  if (e >= 0 && cache->entries[e].generation == base->generation) {
+    // hit: move to front of the LRU list
+    cache->hits++;
+    visCache_unlink(cache, e);
+    visCache_pushFront(cache, e);
+    return cache->entries[e].bits;
+  }
+  cache->misses++;
+  return NULL;
+}
+
+/**************** visCache_claim ****************/
+/* INTERNAL FUNCTION: make an entry for viewpoint pr,pc in the current
+ * grid generation, reusing its stale entry, a fresh one, or the
+ * least-recently-used one, in that order of preference.
+ * Function returns: pointer to the entry's bitset, which caller must fill;
+ *   NULL if no cache, pr,pc is out of bounds, or out of memory.
+ */
+static uint64_t*
+visCache_claim(visCache_t* cache, const grid_t* base, const int pr, const int pc)
+{
+  if (cache == NULL
+      || pr < 0 || pr >= base->nrows || pc < 0 || pc >= base->ncols) {
+    return NULL;
+  }
+
+  const int key = pr * base->ncols + pc;
+  int e = cache->slotOf[key];
+  if (e >= 0) {
+    visCache_unlink(cache, e);  // stale entry for this key; recompute
+  } else if (cache->nentries < cache->maxEntries) {
+    e = cache->nentries++;
+    cache->entries[e].bits = NULL;
+  } else {
+    e = cache->tail;
+    cache->slotOf[cache->entries[e].key] = -1;
+    cache->evictions++;
+    visCache_unlink(cache, e);
+  }
+
+  visEntry_t* entry = &cache->entries[e];
+  if (entry->bits == NULL) {
+    entry->bits = malloc(cache->words * sizeof(uint64_t));
+    if (entry->bits == NULL) {
+      cache->nentries--;        // a fresh entry; leave it unused
+      return NULL;
+    }
+    cache->bytes += cache->words * sizeof(uint64_t);
+  }
+  entry->key = key;
+  entry->generation = base->generation;
+  cache->slotOf[key] = e;
+  visCache_pushFront(cache, e);
+  return entry->bits;
+}
+
+/**************** visCache_unlink ****************/
+/* INTERNAL FUNCTION: remove entry e from the LRU list.
+ */
+static void
+visCache_unlink(visCache_t* cache, const int e)
+{
+  visEntry_t* entry = &cache->entries[e];
+  if (entry->prev >= 0) {
+    cache->entries[entry->prev].next = entry->next;
+  } else {
+    cache->head = entry->next;
+  }
+  if (entry->next >= 0) {
+    cache->entries[entry->next].prev = entry->prev;
+  } else {
+    cache->tail = entry->prev;
+  }
+  entry->prev = entry->next = -1;
+}
+
+/**************** visCache_pushFront ****************/
+/* INTERNAL FUNCTION: insert entry e at the most-recently-used end.
+ */
+static void
+visCache_pushFront(visCache_t* cache, const int e)
+{
+  visEntry_t* entry = &cache->entries[e];
+  entry->prev = -1;
+  entry->next = cache->head;
+  if (cache->head >= 0) {
+    cache->entries[cache->head].prev = e;
+  }
+  cache->head = e;
+  if (cache->tail < 0) {
+    cache->tail = e;
+  }
+}
+
+/**************** visCache_delete ****************/
+/* INTERNAL FUNCTION: free the cache and all its entries; NULL is ok.
+ */
+static void
+visCache_delete(visCache_t* cache)
+{
+  if (cache != NULL) {
+    for (int e = 0; e < cache->nentries; e++) {
+      free(cache->entries[e].bits);
+    }
+    free(cache->entries);
+    free(cache->slotOf);
+    free(cache);
+  }
+}
+
+/**************** grid_planesSetCell ****************/
+/* INTERNAL FUNCTION: recompute every plane's bit for point r,c
+ * from the character now stored there.  Grid must carry planes.
+ */
+static void
+grid_planesSetCell(grid_t* grid, const int r, const int c)
+{
+  const int class = cellClass(CELL(grid, r, c));
+  const uint64_t bit = (uint64_t) 1 << (c & 63);
+  for (int p = 0; p < PlaneCount; p++) {
+    if ((class >> p) & 1) {
+      PLANE_WORD(grid, p, r, c) |= bit;
+    } else {
+      PLANE_WORD(grid, p, r, c) &= ~bit;
+    }
+  }
+}
+
+/**************** grid_planesSync ****************/
+/* INTERNAL FUNCTION: rebuild all planes from the cells, after a bulk
+ * update of the grid.  Does nothing if the grid carries no planes.
+ */
+static void
+grid_planesSync(grid_t* grid)
+{
+  if (grid == NULL || grid->planes == NULL) {
+    return;
+  }
+  memset(grid->planes, 0,
+         PlaneCount * grid->nrows * grid->planeWords * sizeof(uint64_t));
+  for (int r = 0; r < grid->nrows; r++) {
+    for (int c = 0; c < grid->ncols; c++) {
+      const int class = cellClass(CELL(grid, r, c));
+      for (int p = 0; p < PlaneCount; p++) {
+        PLANE_WORD(grid, p, r, c) |= (uint64_t) ((class >> p) & 1) << (c & 63);
+      }
+    }
+  }
+}
+
+/**************** compiled_visibleBits ****************/
+/* INTERNAL FUNCTION: fill bits (as grid_visibleBits does) with the set
+ * visible from pr,pc, if the grid came from a compiled map holding that set
+ * and its walls have not changed since.
+ * Function returns: true if filled in; false if caller must compute it.
+ */
+static bool
+compiled_visibleBits(const grid_t* base, const int pr, const int pc,
+                     uint64_t* bits)
+{
+  const compiled_t* compiled = base->compiled;
+  if (compiled == NULL || compiled->visIndex == NULL
+      || compiled->generation != base->generation
+      || pr < 0 || pr >= base->nrows || pc < 0 || pc >= base->ncols) {
+    return false;
+  }
+  const uint64_t ncells = (uint64_t) base->nrows * base->ncols;
+  const int key = pr * base->ncols + pc;
+  const uint8_t* p = compiled->visRuns + compiled->visIndex[key];
+  const uint8_t* end = compiled->visRuns + compiled->visIndex[key + 1];
+  if (p == end) {
+    return false;               // not a spot when compiled
+  }
+
+  memset(bits, 0, ((ncells + 63) / 64) * sizeof(uint64_t));
+  uint64_t b = 0;
+  while (p < end) {
+    uint64_t clear, set;
+    if (!getVarint(&p, end, &clear) || !getVarint(&p, end, &set)
+        || clear > ncells - b || set > ncells - b - clear) {
+      return false;             // corrupt; checked on load, so never expected
+    }
+    b += clear;
+    bits_setRange(bits, b, set);
+    b += set;
+  }
+  return true;
+}
+
+/**************** compiled_validate ****************/
+/* INTERNAL FUNCTION: check that the mapped file is a compiled map we can
+ * use safely: header, checksum, section bounds, and each section's size and
+ * content as far as later reads depend on it.
+ * Fills in sections[kind] and lengths[kind] for each section present.
+ * Function returns: true if valid.
+ */
+static bool
+compiled_validate(const uint8_t* file, const size_t length,
+                  const uint8_t* sections[], uint64_t lengths[])
+{
+  const compiledHeader_t* header = (const compiledHeader_t*) file;
+  if (memcmp(header->magic, CompiledMagic, sizeof(CompiledMagic)) != 0
+      || header->version != CompiledVersion
+      || header->nrows < MinRows || header->ncols < MinCols
+      || (int64_t) header->nrows * (header->ncols + 1) >= INT32_MAX
+      || header->nsections >= SectionCount
+      || (length - sizeof(compiledHeader_t)) / sizeof(compiledSection_t) < header->nsections
+      || fnv1a(file + sizeof(compiledHeader_t), length - sizeof(compiledHeader_t))
+         != header->checksum) {
+    return false;
+  }
+
+  const compiledSection_t* table = (const compiledSection_t*) (file + sizeof(compiledHeader_t));
+  for (uint32_t s = 0; s < header->nsections; s++) {
+    const uint32_t kind = table[s].kind;
+    if (kind == 0 || kind >= SectionCount || sections[kind] != NULL
+        || table[s].offset % 8 != 0
+        || table[s].offset > length || table[s].length > length - table[s].offset) {
+      return false;
+    }
+    sections[kind] = file + table[s].offset;
+    lengths[kind] = table[s].length;
+  }
+
+  // the cells: rows of ncols characters and a newline, then a null
+  const int nrows = header->nrows, ncols = header->ncols;
+  const char* cells = (const char*) sections[SectionCells];
+  if (cells == NULL || lengths[SectionCells] != (uint64_t) grid_size(nrows, ncols) + 1
+      || cells[grid_size(nrows, ncols)] != '\0' || strlen(cells) != grid_size(nrows, ncols)) {
+    return false;
+  }
+  for (int r = 0; r < nrows; r++) {
+    if (cells[r * (ncols + 1) + ncols] != '\n') {
+      return false;
+    }
+  }
+
+  const uint64_t planeWords = (ncols + 63) / 64;
+  if (sections[SectionPlanes] == NULL
+      || lengths[SectionPlanes] != PlaneCount * nrows * planeWords * sizeof(uint64_t)) {
+    return false;
+  }
+
+  // the visible sets are optional, but come as a pair with consistent offsets
+  const uint64_t ncells = (uint64_t) nrows * ncols;
+  const uint32_t* index = (const uint32_t*) sections[SectionVisIndex];
+  if ((index == NULL) != (sections[SectionVisRuns] == NULL)) {
+    return false;
+  }
+  if (index != NULL) {
+    if (lengths[SectionVisIndex] != (ncells + 1) * sizeof(uint32_t)
+        || index[ncells] != lengths[SectionVisRuns]) {
+      return false;
+    }
+    for (uint64_t i = 0; i < ncells; i++) {
+      if (index[i] > index[i + 1]) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/**************** fnv1a ****************/
+/* INTERNAL FUNCTION: 64-bit FNV-1a hash of the given bytes.
+ */
+static uint64_t
+fnv1a(const uint8_t* data, const size_t length)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < length; i++) {
+    hash = (hash ^ data[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+/**************** putVarint ****************/
+/* INTERNAL FUNCTION: write value as a LEB128 varint, 7 bits per byte,
+ * low bits first, high bit set on all but the last byte.
+ * Function returns: number of bytes written, at most 10.
+ */
+static size_t
+putVarint(uint8_t* out, uint64_t value)
+{
+  size_t n = 0;
+  while (value >= 0x80) {
+    out[n++] = (uint8_t) (value | 0x80);
+    value >>= 7;
+  }
+  out[n++] = (uint8_t) value;
+  return n;
+}
+
+/**************** getVarint ****************/
+/* INTERNAL FUNCTION: read a LEB128 varint at *p, not past end,
+ * and advance *p past it.
+ * Function returns: false if it runs past end or is too long.
+ */
+static bool
+getVarint(const uint8_t** p, const uint8_t* end, uint64_t* value)
+{
+  uint64_t result = 0;
+  for (int shift = 0; shift < 64 && *p < end; shift += 7) {
+    const uint8_t byte = *(*p)++;
+    result |= (uint64_t) (byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      *value = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+/**************** bits_setRange ****************/
+/* INTERNAL FUNCTION: set bits [from, from+count) of the bitset.
+ */
+static void
+bits_setRange(uint64_t* bits, uint64_t from, uint64_t count)
+{
+  while (count > 0) {
+    const int shift = from & 63;
+    const uint64_t take = (64 - shift < count) ? 64 - shift : count;
+    const uint64_t mask = (take == 64) ? ~(uint64_t) 0 : (((uint64_t) 1 << take) - 1);
+    bits[from >> 6] |= mask << shift;
+    from += take;
+    count -= take;
+  }
+}
+
+/**************** segments_label ****************/
+/* INTERNAL FUNCTION: flood-fill, 4-connected, the region of cells in the
+ * given plane's class that contains 'start', giving each the label 'value'.
+ * Only cells of room class join a room, and only passage spots (spots not
+ * of room class) join a passage.  Fills in the region's bounding box.
+ * Caller provides: queue of at least nrows*ncols ints.
+ * Function returns: number of cells in the region.
+ */
+static int
+segments_label(const grid_t* grid, int* label, int* queue,
+               const int start, const int value, const int plane,
+               int* top, int* left, int* bottom, int* right)
+{
+  static const int Steps[4][2] = { {0, 1}, {1, 0}, {0, -1}, {-1, 0} };
+  const int ncols = grid->ncols;
+  int head = 0, tail = 0;
+  label[start] = value;
+  queue[tail++] = start;
+  *top = *bottom = start / ncols;
+  *left = *right = start % ncols;
+  while (head < tail) {
+    const int here = queue[head++];
+    const int r = here / ncols, c = here % ncols;
+    if (r < *top) *top = r;
+    if (r > *bottom) *bottom = r;
+    if (c < *left) *left = c;
+    if (c > *right) *right = c;
+    for (int s = 0; s < 4; s++) {
+      const int nr = r + Steps[s][0], nc = c + Steps[s][1];
+      if (nr < 0 || nr >= grid->nrows || nc < 0 || nc >= ncols) {
+        continue;
+      }
+      const int next = nr * ncols + nc;
+      if (label[next] == 0 && grid_hasClass(grid, nr, nc, plane)
+          && (plane == PlaneRoom || !grid_hasClass(grid, nr, nc, PlaneRoom))) {
+        label[next] = value;
+        queue[tail++] = next;
+      }
+    }
+  }
+  return tail;
+}
+
+/**************** segments_findInterior ****************/
+/* INTERNAL FUNCTION: decide whether room k, of 'size' cells within the
+ * given bounding box, is convex, and if so fill in its interior and count its doorways.
+ * Doorway spots stick out one cell past the interior, so first trim each
+ * side of the bounding box that the room does not fill; what remains is the
+ * interior if the room fills it and nothing of the room lies beyond its ring.
+ * Function returns: false only if out of memory.
+ */
+static bool
+segments_findInterior(const grid_t* grid, segments_t* segments,
+                      const int k, const int size, int top, int left,
+                      int bottom, int right, segRoom_t* room)
+{
+  const int* label = segments->label;
+  const int ncols = grid->ncols;
+  const int value = k + 1;
+  room->top = 0;
+  room->bottom = -1;            // not convex, until shown otherwise
+  room->left = room->right = 0;
+  room->firstDoor = room->ndoors = 0;
+
+  // trim each side of the box once, if the room does not fill it
+  int count = 0;
+  for (int c = left; c <= right; c++) count += (label[top * ncols + c] == value);
+  if (count < right - left + 1) top++;
+  count = 0;
+  for (int c = left; c <= right; c++) count += (label[bottom * ncols + c] == value);
+  if (count < right - left + 1) bottom--;
+  count = 0;
+  for (int r = top; r <= bottom; r++) count += (label[r * ncols + left] == value);
+  if (count < bottom - top + 1) left++;
+  count = 0;
+  for (int r = top; r <= bottom; r++) count += (label[r * ncols + right] == value);
+  if (count < bottom - top + 1) right--;
+  if (top > bottom || left > right) {
+    return true;
+  }
+
+  // the room must fill the interior, and lie within the interior's ring
+  for (int r = top - 1; r <= bottom + 1; r++) {
+    for (int c = left - 1; c <= right + 1; c++) {
+      if (r < 0 || r >= grid->nrows || c < 0 || c >= ncols) {
+        continue;
+      }
+      const bool inside = (r >= top && r <= bottom && c >= left && c <= right);
+      if (inside && label[r * ncols + c] != value) {
+        return true;
+      }
+    }
+  }
+  int cells = 0;
+  for (int r = top - 1; r <= bottom + 1; r++) {
+    for (int c = left - 1; c <= right + 1; c++) {
+      if (r >= 0 && r < grid->nrows && c >= 0 && c < ncols) {
+        cells += (label[r * ncols + c] == value);
+      }
+    }
+  }
+  if (size != cells) {
+    return true;                // some of the room lies beyond the ring
+  }
+
+  // note the doorways, for segments_visible to aim at
+  const int first = segments->ndoors;
+  for (int r = top - 1; r <= bottom + 1; r++) {
+    for (int c = left - 1; c <= right + 1; c++) {
+      if ((r < top || r > bottom || c < left || c > right)
+          && grid_roomAt(grid, r, c)) {
+        grid_point_t* doors = realloc(segments->doors,
+                                      (segments->ndoors + 1) * sizeof(grid_point_t));
+        if (doors == NULL) {
+          return false;
+        }
+        segments->doors = doors;
+        segments->doors[segments->ndoors++] = (grid_point_t) { r, c };
+      }
+    }
+  }
+
+  room->top = top;
+  room->left = left;
+  room->bottom = bottom;
+  room->right = right;
+  room->firstDoor = first;
+  room->ndoors = segments->ndoors - first;
+  return true;
+}
+
+/**************** segments_visible ****************/
+/* INTERNAL FUNCTION: fill bits (as grid_visibleBits does) or, if bits is
+ * NULL, out's cells (as grid_visible does) with the set visible from pr,pc,
+ * if pr,pc lies in the interior of a convex room that has not changed since
+ * the segments were built (though the rest of the grid may have): the
+ * interior and its ring without rays, then rays only beyond the ring, and only those that pass
+ * within a cell of one of the room's doorways.
+ * Function returns: true if filled in; false if caller must compute it.
+ */
+static bool
+segments_visible(const grid_t* base, const int pr, const int pc,
+                 uint64_t* bits, grid_t* out)
+{
+  const segments_t* segments = base->segments;
+  if (segments == NULL
+      || pr < 0 || pr >= base->nrows || pc < 0 || pc >= base->ncols) {
+    return false;
+  }
+  const int nrows = base->nrows;
+  const int ncols = base->ncols;
+  const int k = segments->label[pr * ncols + pc] - 1;
+  if (k < 0) {
+    return false;               // not in a room
+  }
+  const segRoom_t* room = &segments->rooms[k];
+  if (pr < room->top || pr > room->bottom || pc < room->left || pc > room->right) {
+    return false;               // not convex, or a doorway rather than inside
+  }
+  if (segments->generation != base->generation
+      && !segments_roomIntact(base, segments, room)) {
+    return false;               // the room or its ring has changed
+  }
+
+  if (bits != NULL) {
+    memset(bits, 0, ((nrows * ncols + 63) / 64) * sizeof(uint64_t));
+  } else {
+    for (int r = 0; r < nrows; r++) {
+      memset(&CELL(out, r, 0), GRID_BLANK, ncols);
+    }
+  }
+  const int top = room->top > 0 ? room->top - 1 : 0;
+  const int bottom = room->bottom < nrows - 1 ? room->bottom + 1 : nrows - 1;
+  const int left = room->left > 0 ? room->left - 1 : 0;
+  const int right = room->right < ncols - 1 ? room->right + 1 : ncols - 1;
+  const grid_point_t* doors = &segments->doors[room->firstDoor];
+
+  for (int r = 0, i = 0; r < nrows; r++) {
+    // rows with nothing of the ring and no doorways to look through
+    if ((r < top || r > bottom) && room->ndoors == 0) {
+      i += ncols;
+      continue;
+    }
+    for (int c = 0; c < ncols; c++, i++) {
+      if (CELL(base, r, c) == GRID_BLANK) {
+        continue;
+      }
+      if (r < top || r > bottom || c < left || c > right) {
+        // beyond the ring: is some doorway ahead, and less than a cell
+        // from the line to r,c?  If so, walk the ray.
+        const long long dr = r - pr, dc = c - pc;
+        bool near = false;
+        for (int d = 0; d < room->ndoors && !near; d++) {
+          const long long ddr = doors[d].r - pr, ddc = doors[d].c - pc;
+          const long long cross = dr * ddc - dc * ddr;
+          near = dr * ddr + dc * ddc > 0 && cross * cross < dr * dr + dc * dc;
+        }
+        if (!near || !ray_isClear(base, grid_ray(base, r - pr, c - pc), pr, pc)) {
+          continue;
+        }
+      }
+      if (bits != NULL) {
+        bits[i >> 6] |= (uint64_t) 1 << (i & 63);
+      } else {
+        CELL(out, r, c) = CELL(base, r, c);
+      }
+    }
+  }
+  return true;
+}
+
+/**************** segments_roomIntact ****************/
+/* INTERNAL FUNCTION: does convex room still have the interior, ring and
+ * doorways it was built with?  That is, is every cell of its interior
+ * room-transparent, and are the cells of its ring that are room-transparent
+ * exactly its doorways?
+ */
+static bool
+segments_roomIntact(const grid_t* grid, const segments_t* segments,
+                    const segRoom_t* room)
+{
+  for (int r = room->top; r <= room->bottom; r++) {
+    for (int c = room->left; c <= room->right; c++) {
+      if (!grid_roomAt(grid, r, c)) {
+        return false;
+      }
+    }
+  }
+  const grid_point_t* doors = &segments->doors[room->firstDoor];
+  for (int d = 0; d < room->ndoors; d++) {
+    if (!grid_roomAt(grid, doors[d].r, doors[d].c)) {
+      return false;
+    }
+  }
+  // the ring, row above and below and then columns left and right
+  int open = 0;
+  for (int c = room->left - 1; c <= room->right + 1; c++) {
+    open += grid_hasClass(grid, room->top - 1, c, PlaneRoom);
+    open += grid_hasClass(grid, room->bottom + 1, c, PlaneRoom);
+  }
+  for (int r = room->top; r <= room->bottom; r++) {
+    open += grid_hasClass(grid, r, room->left - 1, PlaneRoom);
+    open += grid_hasClass(grid, r, room->right + 1, PlaneRoom);
+  }
+  return open == room->ndoors;
+}
+
+/**************** segments_delete ****************/
+/* INTERNAL FUNCTION: free the segments; NULL is ok.
+ */
+static void
+segments_delete(segments_t* segments)
+{
+  if (segments != NULL) {
+    free(segments->label);
+    free(segments->rooms);
+    free(segments->doors);
+    free(segments);
+  }
+}
+
+/**************** visShare_runAll ****************/
+/* INTERNAL FUNCTION: run job on each of the shares, on the pool's threads
+ * and this one, and wait for all of them (but not for other callers' jobs);
+ * on this thread alone if there is no pool, or for any share the pool
+ * cannot take.
+ */
+static void
+visShare_runAll(pool_t* workers, void (*job)(void* arg),
+                visShare_t* shares, const int nshares)
+{
+  poolBatch_t batch = POOL_BATCH_INIT;
+  for (int s = 0; s < nshares; s++) {
+    if (!pool_submit(workers, &batch, job, &shares[s])) {
+      (*job)(&shares[s]);
+    }
+  }
+  pool_wait(workers, &batch);
+}
+
+/**************** visShare_compute ****************/
+/* INTERNAL FUNCTION: to be run by visShare_runAll.  Fill in the visible set
+ * of each viewer in the share's part of the pending list: from the compiled
+ * map or a convex room if possible, and the rest together, in one pass over
+ * the base grid that tests each cell for every one of them.  Reads only the
+ * base grid and writes only those viewers' sets, so shares may run at once.
+ * Reorders the share's part of the pending list.
+ */
+static void
+visShare_compute(void* arg)
+{
+  TRACE_SCOPE("visShare_compute");
+  visShare_t* share = arg;
+  const grid_t* base = share->base;
+  const int nrows = base->nrows;
+  const int ncols = base->ncols;
+  const int words = (nrows * ncols + 63) / 64;
+  int* pending = share->pending;
+
+  // those read from the compiled map, or filled in from a convex room,
+  // go to the end; those left need rays
+  int nrays = share->npending;
+  for (int k = 0; k < nrays; ) {
+    const int v = pending[k];
+    const int pr = share->viewers[v].r, pc = share->viewers[v].c;
+    uint64_t* bits = &share->bits[(size_t) v * words];
+    if (compiled_visibleBits(base, pr, pc, bits)
+        || segments_visible(base, pr, pc, bits, NULL)) {
+      pending[k] = pending[--nrays];
+      pending[nrays] = v;
+    } else {
+      k++;
+    }
+  }
+
+  if (nrays == 0) {
+    return;
+  }
+  for (int r = 0, i = 0; r < nrows; r++) {
+    for (int c = 0; c < ncols; c++, i++) {
+      if (CELL(base, r, c) == GRID_BLANK) {
+        continue;
+      }
+      for (int k = 0; k < nrays; k++) {
+        const int v = pending[k];
+        const int pr = share->viewers[v].r, pc = share->viewers[v].c;
+        if (ray_isClear(base, grid_ray(base, r - pr, c - pc), pr, pc)) {
+          share->bits[(size_t) v * words + (i >> 6)] |= (uint64_t) 1 << (i & 63);
+        }
+      }
+    }
+  }
+}
+
+/**************** visShare_fill ****************/
+/* INTERNAL FUNCTION: to be run by visShare_runAll.  Fill the output grid of
+ * each viewer in the share's range from its visible set, in one pass over
+ * the base grid.
+ */
+static void
+visShare_fill(void* arg)
+{
+  TRACE_SCOPE("visShare_fill");
+  const visShare_t* share = arg;
+  const grid_t* base = share->base;
+  const int nrows = base->nrows;
+  const int ncols = base->ncols;
+  const int words = (nrows * ncols + 63) / 64;
+  grid_t** outs = share->outs;
+
+  for (int r = 0, i = 0; r < nrows; r++) {
+    for (int c = 0; c < ncols; c++, i++) {
+      const char cell = CELL(base, r, c);
+      const uint64_t mask = (uint64_t) 1 << (i & 63);
+      for (int v = share->first; v < share->last; v++) {
+        if (grid_sizesMatch(base, outs[v])) {
+          const bool seen = share->bits[(size_t) v * words + (i >> 6)] & mask;
+          CELL(outs[v], r, c) = seen ? cell : GRID_BLANK;
+        }
+      }
+    }
+  }
+  for (int v = share->first; v < share->last; v++) {
+    if (grid_sizesMatch(base, outs[v])) {
+      grid_changed(outs[v]);
+    }
+  }
+}
+
+/* ******************************************************************* */
+/* ******************************************************************* */
+
+/**************** UNIT TEST ****************/
+
+#ifdef UNIT_TEST
+
+static int arg2int(const char* progname, char* arg);
+int test2(const int argc, char* argv[]);
+int test3(const int argc, char* argv[]);
+int testVisibility(const int argc, char* argv[]);
+
+/*
+ * usage: one of
+ *   gridtest nrows ncols > grid.txt
+ *   gridtest filename.txt
+ *   gridtest --vischeck mapFile...
+ */
+int
+main(const int argc, char* argv[])
+{
+  if (argc >= 3 && strcmp(argv[1], "--vischeck") == 0) {
+    return testVisibility(argc, argv);
+  }
+  switch (argc) {
+  case 2:
+    return test2(argc, argv);
+  case 3:
+    return test3(argc, argv);
+  default:
+    fprintf(stderr, "usage: %s nrows ncols\n", argv[0]);
+    fprintf(stderr, "   or: %s filename\n", argv[0]);
+    fprintf(stderr, "   or: %s --vischeck mapFile...\n", argv[0]);
+    return 1;
+  }
+}
+
+/* argc == 2:  gridtest filename */
+int
+test2(const int argc, char* argv[])
+{
+  const char* progname = argv[0];
+  const char* filename = argv[1];
 
   // load the grid
   grid_t* grid = grid_fromFile(filename);
@@ -603,4 +2422,148 @@ static int arg2int(const char* progname, char* arg)
   }
 }
 
+/* gridtest --vischeck mapFile...: for each map (text, or compiled .nugmap),
+ * check that grid_visible and grid_visibleBatch, through every path they
+ * take (cache, compiled sets, convex rooms, rays), agree with grid_isVisible
+ * cell by cell, from a sample of the map's spots; first in the base terrain,
+ * then with players standing in passages, one far from any room and one at
+ * a room's doorway, and then with the terrain restored.  Each terrain is
+ * checked twice, so the second round answers from the cache; and some
+ * viewers are checked in place, a copy of the map being its own output.
+ */
+int
+testVisibility(const int argc, char* argv[])
+{
+  const char* progname = argv[0];
+  pool_t* workers = pool_new(2);
+  long mismatches = 0;
+
+  for (int a = 2; a < argc; a++) {
+    const char* filename = argv[a];
+    const size_t len = strlen(filename);
+    const bool compiled = len > 7 && strcmp(filename + len - 7, ".nugmap") == 0;
+    grid_t* base = compiled ? grid_fromCompiled(filename) : grid_fromFile(filename);
+    if (base == NULL) {
+      fprintf(stderr, "%s: cannot load %s\n", progname, filename);
+      exit(4);
+    }
+    if (!compiled) {
+      grid_buildPlanes(base);
+    }
+    grid_buildSegments(base);
+    grid_enableVisCache(base, 1 << 20);
+    const int nrows = base->nrows, ncols = base->ncols;
+
+    // the viewers: about 150 spots, spread over the map
+    int nspots = 0;
+    for (int r = 0; r < nrows; r++) {
+      for (int c = 0; c < ncols; c++) {
+        nspots += grid_isSpot(base, r, c);
+      }
+    }
+    const int every = nspots / 150 + 1;
+    grid_point_t* viewers = malloc((nspots / every + 1) * sizeof(grid_point_t));
+    grid_t** outs = malloc((nspots / every + 1) * sizeof(grid_t*));
+    int n = 0;
+    for (int r = 0, k = 0; r < nrows; r++) {
+      for (int c = 0; c < ncols; c++) {
+        if (grid_isSpot(base, r, c) && k++ % every == 0) {
+          viewers[n] = (grid_point_t) { r, c };
+          outs[n++] = grid_new(nrows, ncols);
+        }
+      }
+    }
+
+    // passage spots to stand on: one with no room beside it, one at a doorway
+    grid_point_t far = { -1, -1 }, door = { -1, -1 };
+    for (int r = 0; r < nrows; r++) {
+      for (int c = 0; c < ncols; c++) {
+        if (CELL(base, r, c) != '#') {
+          continue;
+        }
+        int rooms = 0;
+        for (int dr = -1; dr <= 1; dr++) {
+          for (int dc = -1; dc <= 1; dc++) {
+            rooms += grid_isRoomSpot(base, r + dr, c + dc);
+          }
+        }
+        if (rooms == 0 && far.r < 0) {
+          far = (grid_point_t) { r, c };
+        } else if (rooms > 0 && door.r < 0) {
+          door = (grid_point_t) { r, c };
+        }
+      }
+    }
+
+    // base, far, far and door, door, base again
+    const grid_point_t* steps[] = { NULL, &far, &door, &far, &door };
+    const char* names[] = { "base", "+far", "+door", "-far", "-door" };
+    grid_t* want = grid_new(nrows, ncols);
+    grid_t* got = grid_new(nrows, ncols);
+    grid_t* self = grid_new(nrows, ncols);    // with its own planes and rooms
+    grid_copy(base, self);
+    grid_buildPlanes(self);
+    grid_buildSegments(self);
+    long bad = 0;
+    for (int s = 0; s < 5; s++) {
+      if (steps[s] != NULL && steps[s]->r >= 0) {
+        const grid_point_t* p = steps[s];
+        grid_set(base, p->r, p->c, CELL(base, p->r, p->c) == '#' ? 'A' + s : '#');
+      }
+      for (int round = 0; round < 2; round++) {
+        grid_visibleBatch(base, viewers, n, outs, round == 0 ? workers : NULL);
+        for (int v = 0; v < n; v++) {
+          const int pr = viewers[v].r, pc = viewers[v].c;
+          for (int r = 0; r < nrows; r++) {
+            for (int c = 0; c < ncols; c++) {
+              CELL(want, r, c) = grid_isVisible(base, r, c, pr, pc)
+                ? CELL(base, r, c) : GRID_BLANK;
+            }
+          }
+          grid_visible(base, pr, pc, got);
+          if (strcmp(want->cells, got->cells) != 0
+              || strcmp(want->cells, outs[v]->cells) != 0) {
+            if (bad++ == 0) {
+              fprintf(stderr, "%s: %s, %s: wrong visible set from %d,%d\n",
+                      progname, filename, names[s], pr, pc);
+            }
+          }
+          // now and then, in place: a copy of the base is its own output
+          if (round == 0 && v % 16 == 0) {
+            grid_copy(base, self);
+            grid_visible(self, pr, pc, self);
+            const bool single = strcmp(want->cells, self->cells) == 0;
+            grid_copy(base, self);
+            grid_t* selfOuts[] = { got, self };
+            const grid_point_t twice[] = { viewers[v], viewers[v] };
+            grid_visibleBatch(self, twice, 2, selfOuts, workers);
+            if (!single || strcmp(want->cells, self->cells) != 0
+                || strcmp(want->cells, got->cells) != 0) {
+              if (bad++ == 0) {
+                fprintf(stderr, "%s: %s, %s: wrong visible set in place from %d,%d\n",
+                        progname, filename, names[s], pr, pc);
+              }
+            }
+          }
+        }
+      }
+    }
+    printf("%s: %d viewers, passages at %d,%d and %d,%d: %ld mismatches\n",
+           filename, n, far.r, far.c, door.r, door.c, bad);
+    mismatches += bad;
+
+    for (int v = 0; v < n; v++) {
+      grid_delete(outs[v]);
+    }
+    free(outs);
+    free(viewers);
+    grid_delete(want);
+    grid_delete(got);
+    grid_delete(self);
+    grid_delete(base);
+  }
+  pool_delete(workers);
+  return mismatches == 0 ? 0 : 1;
+}
+
 #endif // UNIT_TEST
@@ -31,11 +31,25 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <math.h>
+#include "pool.h"
 
 /********************* types **************************/
 
 typedef struct grid grid_t; // opaque type representing the grid
 
+typedef struct grid_point {   // a gridpoint, e.g., a viewpoint
+  int r, c;                    // row and column
+} grid_point_t;
+
+typedef struct grid_visStats { // counters reported by grid_visCacheStats
+  unsigned long hits;          // grid_visible calls answered from the cache
+  unsigned long misses;        // grid_visible calls that computed the set
+  unsigned long evictions;     // entries recycled to stay within budget
+  int entries;                 // viewpoints currently cached
+  size_t bytes;                // memory now used by the cache
+  size_t budget;               // memory the cache may use
+} grid_visStats_t;
+
 /********************* functions **********************/
 
 grid_t* grid_new(const int nrows, const int ncols);
@@ -67,6 +81,36 @@ grid_t* grid_fromFile(const char* filename);
  * Notes: see grid_fromString.
  */
 
+grid_t* grid_fromCompiled(const char* filename);
+/* Create a new grid from a compiled map, as written by grid_writeCompiled.
+ * Caller provides: filename for the compiled map (a .nugmap file).
+ * Function returns: pointer to new grid object, or NULL if error
+ *   (including a file that is damaged, or from another version or machine).
+ * Contract: caller must later call grid_delete on the new grid.
+ * Notes:
+ *   The file is mapped into memory rather than read, and the grid uses its
+ *   cells and bit planes in place (as if grid_buildPlanes had been called),
+ *   so the grid is ready almost at once whatever its size.  Changes to the
+ *   grid are private; the file is never written.
+ *   If the file holds visible sets, grid_visible and grid_visibleBatch read
+ *   them instead of computing them whenever the gridpoints that block vision
+ *   are those of the file: not while a player stands in a passage, say, but
+ *   again once no player does.
+ */
+
+bool grid_writeCompiled(const grid_t* grid, const char* filename,
+                        const bool withVisibility);
+/* Write the grid to a compiled map file, for grid_fromCompiled.
+ * Caller provides: pointer to an existing grid; filename to write;
+ *   whether to include the set of gridpoints visible from every spot.
+ * Function returns: true if written, false if error.
+ * Notes:
+ *   The file holds the grid, its bit planes, and optionally the visible
+ *   sets, run-length encoded, with a version number and a checksum.
+ *   Computing the visible sets takes time proportional to the number of
+ *   spots times the number of gridpoints.
+ */
+
 void grid_overlay(const grid_t* base, const grid_t* overlay,
                   const grid_t* mask, grid_t* out);
 /* Overlay one grid on an another, producing the output.
@@ -89,15 +133,49 @@ void grid_visible(const grid_t* base, const int pr, const int pc, grid_t* out);
  *   the base grid, which is copied to the output grid;
  *   the output grid, whose non-blank points are a subset of those in base.
  *   A point pr,pc, from which visibility is computed.
+ * The grids 'out' and 'base' may be the same grid, updating 'base'.
  * Function returns: nothing.
  * Notes:
  *   If the two grids are not all the same size, or NULL, no action is taken.
  */
 
+void grid_visibleBatch(const grid_t* base, const grid_point_t viewers[],
+                       const int n, grid_t* outs[], pool_t* workers);
+/* Like grid_visible, for many viewpoints at once: construct in outs[v]
+ * the subset of 'base' visible from viewers[v], for each 0 <= v < n.
+ * Caller provides:
+ *   the base grid;
+ *   an array of n viewpoints, and an array of n output grids;
+ *   a pool of worker threads to share the work, or NULL to do it all on
+ *   the calling thread.
+ * Function returns: nothing.
+ * Notes:
+ *   The base grid is traversed once for all viewers together, rather than
+ *   once per viewer; viewpoints in the base grid's cache, if any, are not
+ *   recomputed, and new ones are added to it.  With a pool, the viewers
+ *   are split among its threads and the calling thread, which alone reads
+ *   and updates the cache, before and after they compute.
+ *   An output grid may be the base grid itself, as in grid_visible: every
+ *   set is computed, and every other output filled, from the base as it was,
+ *   and then the base is updated (to the last such viewer's, if several).
+ *   Any output grid that is NULL or a different size is left untouched;
+ *   a viewpoint outside the grid sees nothing.
+ */
+
 void grid_erase(grid_t* grid);
 /* Erase the grid so it is all blank, as if it were a new grid.
  */
 
+void grid_copy(const grid_t* from, grid_t* to);
+/* Copy the content of one grid into another of the same size.
+ * Caller provides: pointers to two existing grids.
+ * Function returns: nothing.
+ * Notes:
+ *   Only cells that differ are written, as if by grid_set, so planes and
+ *   any visibility cache on 'to' stay valid unless vision-blocking cells
+ *   change.  If either grid is NULL or they differ in size, no action.
+ */
+
 char grid_get(const grid_t* grid, const int r, const int c);
 /* Return the character at a given gridpoint.
  * Caller provides: pointer to a grid; row number, column number.
@@ -157,10 +235,45 @@ bool grid_isRoomSpot(const grid_t* grid, const int r, const int c);
 /* Return true iff the given gridpoint is a "room spot".
  */
 
+bool grid_isWall(const grid_t* grid, const int r, const int c);
+/* Return true iff the given gridpoint is a wall or corner.
+ */
+
 bool grid_isBlank(const grid_t* grid, const int r, const int c);
 /* Return true iff the given gridpoint is GRID_BLANK.
  */
 
+bool grid_buildPlanes(grid_t* grid);
+/* Attach precomputed bit planes to the grid, one bit per gridpoint for
+ * each cell class (room-transparent, spot, wall, player).
+ * Caller provides: pointer to an existing grid.
+ * Function returns: true if the grid now carries planes, false if error.
+ * Notes:
+ *   Once attached, grid_isSpot, grid_isRoomSpot, grid_isPlayer, grid_isWall
+ *   and the visibility walk read a single bit instead of comparing chars.
+ *   The planes are kept in sync by grid_set and every other function that
+ *   modifies the grid, and are freed by grid_delete.
+ *   Predicates on a grid without planes give the same answers, more slowly.
+ *   All predicates return false for gridpoints out of bounds.
+ */
+
+bool grid_buildSegments(grid_t* grid);
+/* Label the grid's rooms (4-connected regions of room spots) and passages
+ * (4-connected regions of passage spots), and find the convex rooms:
+ * those that fill a rectangle, but for doorway spots in its walls.
+ * Caller provides: pointer to an existing grid, normally a map just loaded.
+ * Function returns: true if built, false if error.
+ * Notes:
+ *   From inside a convex room everything in the room and its walls is
+ *   visible, so grid_visible and grid_visibleBatch fill that rectangle
+ *   without rays, and walk rays beyond it only toward gridpoints whose line
+ *   of sight passes next to a doorway spot in its walls.  A room's segment is used
+ *   whenever the gridpoints that block vision in the room and its walls are
+ *   those it was built from, whatever has changed elsewhere (a player
+ *   standing in one of its doorways changes them).
+ *   Building again replaces them; they are freed by grid_delete.
+ */
+
 bool grid_isVisible(const grid_t* base,
                     const int r, const int c, const int pr, const int pc);
 /* Is point r,c visible from point pr, pc?
@@ -170,6 +283,51 @@ bool grid_isVisible(const grid_t* base,
  *   point pr,pc, the point from which we determine visibility.
  * Function returns: true if visible, false otherwise or error.
  * See definition of 'visible' in REQUIREMENTS.md.
+ * Notes:
+ *   The cells tested depend only on the offset r-pr,c-pc; they are kept
+ *   in a table of ray templates shared by all grids and viewpoints,
+ *   built lazily as offsets are queried; each thread has its own table.
+ */
+
+bool grid_enableVisCache(grid_t* grid, const size_t budget);
+/* Attach a visibility cache to the grid, for use by grid_visible
+ * when this grid is the base.
+ * Caller provides: pointer to an existing grid; memory budget in bytes,
+ *   or zero to remove any existing cache.
+ * Function returns: true if successful, false if error
+ *   (including a budget too small to hold a single viewpoint).
+ * Notes:
+ *   The cache is keyed by viewpoint pr,pc and holds each visible set as a
+ *   bitset; when the budget is full, the least-recently-used viewpoint is
+ *   recycled.  Total memory, including the index, never exceeds budget.
+ *   Entries are invalidated whenever a change to the grid alters which
+ *   gridpoints block vision; other changes (e.g., a player letter
+ *   replacing a room spot) keep them valid.
+ *   The cache is freed by grid_delete.
+ */
+
+bool grid_visCacheStats(const grid_t* grid, grid_visStats_t* stats);
+/* Report the visibility cache's counters.
+ * Caller provides: pointer to a grid; pointer to stats to fill in.
+ * Function returns: true if filled in, false if the grid has no cache.
+ */
+
+unsigned long grid_visibleComputed(void);
+/* Count the visible sets computed so far by grid_visible and
+ * grid_visibleBatch, in all grids and on all threads;
+ * sets answered from a visibility cache are not counted.
+ * Caller provides: nothing.
+ * Function returns: the count since the program started.
+ */
+
+void grid_freeRays(void);
+/* Free the table of ray templates used by grid_visible and grid_isVisible.
+ * Caller provides: nothing.
+ * Function returns: nothing.
+ * Notes: safe to call at any time; the table is rebuilt on demand.
+ *   Each thread has its own table; this frees the calling thread's.
+ *   A thread's table is also freed when the thread exits, so worker
+ *   threads need not call this.
  */
 
 #endif // _GRID_H_
@@ -0,0 +1,484 @@
+/*
+ * journal.c - Nuggets 'journal' module
+ *
+ * See journal.h for more information.
+ *
+ * A journal file is a header and then records, all in little-endian bytes;
+ * "varint" is an unsigned number in 7-bit groups, low group first, with the
+ * top bit set on every byte but the last (LEB128).
+ *
+ *   header:  "NUGJRNL1"                    8 bytes
+ *            seed                          8 bytes
+ *            maxPlayers, radius            varint each
+ *            start time (seconds)          varint
+ *            map file name                 varint length, then its bytes
+ *   record:  type                          1 byte, one of those below
+ *            time since previous record    varint, in microseconds
+ *            and then, by type:
+ *     'A'  client, address                 varint; varint length, bytes
+ *     'P'  client, rest of PLAY message    varint; varint length, bytes
+ *     'S'  client                          varint
+ *     'K'  client, key                     varint; 1 byte
+ *     'Q'  client                          varint (the key Q: quit)
+ *     'M'  client, whole message           varint; varint length, bytes
+ *     'C'  messages so far, game hash      varint; 8 bytes
+ *
+ * An 'A' record comes before a client's first message, and gives the client
+ * its number: the first client is 0, the next 1, and so on. 'M' holds any
+ * message the game acts on that fits none of the shorter forms.
+ *
+ * Selena Zhou, Kyla Widodo, 23S
+ */
+
+#define _POSIX_C_SOURCE 200809L     // for clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "game.h"
+#include "journal.h"
+#include "../support/message.h"
+
+/**************** file-local global variables ****************/
+
+static const char Magic[8] = { 'N', 'U', 'G', 'J', 'R', 'N', 'L', '1' };
+static const unsigned long CheckpointEvents = 256;     // messages between checkpoints
+static const uint64_t FlushNanos = 100000000;           // longest a record waits unwritten
+#define BufferSize (64 * 1024)                          // bytes written in one batch
+
+/**************** global types ****************/
+
+typedef struct journal {
+    int fd;
+    unsigned char buffer[BufferSize];
+    size_t used;                    // bytes in buffer
+    uint64_t start;                 // monotonic ns when created
+    uint64_t lastMicros;            // time of the last record, since start
+    uint64_t lastFlush;             // ns when the buffer was last written
+    unsigned long events;           // messages recorded
+    unsigned long sinceCheckpoint;
+    addr_t* clients;                // client numbers' addresses
+    int numClients;
+    int clientCapacity;
+} journal_t;
+
+typedef struct journalReader {
+    FILE* fp;
+    char* mapFile;
+    uint64_t micros;                // time of the last record read
+    unsigned long events;           // messages read
+    char** addresses;               // client numbers' addresses
+    int numClients;
+    int clientCapacity;
+    char* message;                  // [message_MaxBytes + 1], the last one read
+} journalReader_t;
+
+/**************** local functions ****************/
+
+static uint64_t journal_now(void);
+static void journal_flush(journal_t* journal);
+static void journal_put(journal_t* journal, const void* bytes, size_t length);
+static void journal_putVarint(journal_t* journal, uint64_t value);
+static void journal_putString(journal_t* journal, const char* string, size_t length);
+static void journal_putRecord(journal_t* journal, char type);
+static int journal_client(journal_t* journal, addr_t from);
+static bool journal_getVarint(FILE* fp, uint64_t* value);
+static bool journal_getString(FILE* fp, char* string, size_t max);
+
+/**************** journal_new ****************/
+/* see journal.h for description */
+journal_t* journal_new(const char* path, const char* mapFile, unsigned long seed,
+                       int maxPlayers, int radius) {
+    if (path == NULL || mapFile == NULL) return NULL;
+    journal_t* journal = malloc(sizeof(journal_t));
+    if (journal == NULL) return NULL;
+    journal->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (journal->fd < 0) {
+        free(journal);
+        return NULL;
+    }
+    journal->used = 0;
+    journal->start = journal->lastFlush = journal_now();
+    journal->lastMicros = 0;
+    journal->events = journal->sinceCheckpoint = 0;
+    journal->clients = NULL;
+    journal->numClients = journal->clientCapacity = 0;
+
+    journal_put(journal, Magic, sizeof(Magic));
+    unsigned char seedBytes[8];
+    for (int b = 0; b < 8; b++) {
+        seedBytes[b] = (uint64_t) seed >> (8 * b) & 0xff;
+    }
+    journal_put(journal, seedBytes, sizeof(seedBytes));
+    journal_putVarint(journal, maxPlayers);
+    journal_putVarint(journal, radius);
+    journal_putVarint(journal, (uint64_t) time(NULL));
+    journal_putString(journal, mapFile, strlen(mapFile));
+    journal_flush(journal);
+    return journal;
+}
+
+/**************** journal_record ****************/
+/* see journal.h for description */
+void journal_record(journal_t* journal, addr_t from, const char* message) {
+    if (journal == NULL || message == NULL) return;
+
+    const bool play = strncmp(message, "PLAY", strlen("PLAY")) == 0;
+    const bool spectate = strncmp(message, "SPECTATE", strlen("SPECTATE")) == 0;
+    const bool key = strncmp(message, "KEY", strlen("KEY")) == 0;
+    if (!play && !spectate && !key) return;     // the game only answers ERROR
+
+    int client = journal_client(journal, from);
+    if (client < 0) return;
+    if (play) {
+        journal_putRecord(journal, 'P');
+        journal_putVarint(journal, client);
+        journal_putString(journal, message + strlen("PLAY"), strlen(message + strlen("PLAY")));
+    } else if (strcmp(message, "SPECTATE") == 0) {
+        journal_putRecord(journal, 'S');
+        journal_putVarint(journal, client);
+    } else if (strcmp(message, "KEY Q") == 0) {
+        journal_putRecord(journal, 'Q');
+        journal_putVarint(journal, client);
+    } else if (key && strlen(message) == strlen("KEY x") && message[3] == ' ') {
+        journal_putRecord(journal, 'K');
+        journal_putVarint(journal, client);
+        journal_put(journal, &message[4], 1);
+    } else {
+        journal_putRecord(journal, 'M');
+        journal_putVarint(journal, client);
+        journal_putString(journal, message, strlen(message));
+    }
+    journal->events++;
+    journal->sinceCheckpoint++;
+}
+
+/**************** journal_checkpoint ****************/
+/* see journal.h for description */
+void journal_checkpoint(journal_t* journal, game_t* game) {
+    if (journal == NULL) return;
+    if (journal->sinceCheckpoint >= CheckpointEvents && game != NULL) {
+        uint64_t hash = game_hash(game);
+        unsigned char hashBytes[8];
+        for (int b = 0; b < 8; b++) {
+            hashBytes[b] = hash >> (8 * b) & 0xff;
+        }
+        journal_putRecord(journal, 'C');
+        journal_putVarint(journal, journal->events);
+        journal_put(journal, hashBytes, sizeof(hashBytes));
+        journal->sinceCheckpoint = 0;
+        journal_flush(journal);
+    } else if (journal->used > 0 && journal_now() - journal->lastFlush >= FlushNanos) {
+        journal_flush(journal);
+    }
+}
+
+/**************** journal_sync ****************/
+/* see journal.h for description */
+void journal_sync(journal_t* journal, game_t* game) {
+    if (journal == NULL) return;
+    if (game != NULL && journal->sinceCheckpoint > 0) {
+        journal->sinceCheckpoint = CheckpointEvents;   // due now; flushes
+        journal_checkpoint(journal, game);
+    } else if (journal->used > 0) {
+        journal_flush(journal);
+    }
+}
+
+/**************** journal_delete ****************/
+/* see journal.h for description */
+void journal_delete(journal_t* journal, game_t* game) {
+    if (journal == NULL) return;
+    journal_sync(journal, game);
+    close(journal->fd);
+    free(journal->clients);
+    free(journal);
+}
+
+/**************** journal_openReader ****************/
+/* see journal.h for description */
+journalReader_t* journal_openReader(const char* path, journalHeader_t* header) {
+    if (path == NULL || header == NULL) return NULL;
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL) return NULL;
+
+    char magic[sizeof(Magic)];
+    unsigned char seedBytes[8];
+    uint64_t maxPlayers, radius, startTime, nameLength;
+    if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic) || memcmp(magic, Magic, sizeof(Magic)) != 0
+        || fread(seedBytes, 1, sizeof(seedBytes), fp) != sizeof(seedBytes)
+        || !journal_getVarint(fp, &maxPlayers) || !journal_getVarint(fp, &radius)
+        || !journal_getVarint(fp, &startTime) || !journal_getVarint(fp, &nameLength)
+        || nameLength > 4096) {
+        fclose(fp);
+        return NULL;
+    }
+
+    journalReader_t* reader = malloc(sizeof(journalReader_t));
+    char* mapFile = malloc(nameLength + 1);
+    char* message = malloc(message_MaxBytes + 1);
+    if (reader == NULL || mapFile == NULL || message == NULL
+        || fread(mapFile, 1, nameLength, fp) != nameLength) {
+        free(reader);
+        free(mapFile);
+        free(message);
+        fclose(fp);
+        return NULL;
+    }
+    mapFile[nameLength] = '\0';
+    reader->fp = fp;
+    reader->mapFile = mapFile;
+    reader->message = message;
+    reader->micros = 0;
+    reader->events = 0;
+    reader->addresses = NULL;
+    reader->numClients = reader->clientCapacity = 0;
+
+    uint64_t seed = 0;
+    for (int b = 0; b < 8; b++) {
+        seed |= (uint64_t) seedBytes[b] << (8 * b);
+    }
+    header->seed = seed;
+    header->maxPlayers = maxPlayers;
+    header->radius = radius;
+    header->startTime = startTime;
+    header->mapFile = mapFile;
+    return reader;
+}
+
+/**************** journal_next ****************/
+/* see journal.h for description */
+bool journal_next(journalReader_t* reader, journalEvent_t* event) {
+    if (reader == NULL || event == NULL) return false;
+    FILE* fp = reader->fp;
+
+    while (true) {
+        int type = getc(fp);
+        if (type == EOF) return false;      // the end, cleanly between records
+
+        uint64_t micros;
+        if (!journal_getVarint(fp, &micros)) break;
+        reader->micros += micros;
+        event->micros = reader->micros;
+
+        if (type == 'C') {
+            uint64_t events, hash = 0;
+            unsigned char hashBytes[8];
+            if (!journal_getVarint(fp, &events)
+                || fread(hashBytes, 1, sizeof(hashBytes), fp) != sizeof(hashBytes)) {
+                break;
+            }
+            for (int b = 0; b < 8; b++) {
+                hash |= (uint64_t) hashBytes[b] << (8 * b);
+            }
+            event->type = journal_Checkpoint;
+            event->client = -1;
+            event->address = NULL;
+            event->message = NULL;
+            event->events = events;
+            event->hash = hash;
+            return true;
+        }
+
+        uint64_t client;
+        if (!journal_getVarint(fp, &client) || client > (uint64_t) reader->numClients) break;
+        if (type == 'A') {
+            // a new client's address; not an event, so read on
+            if (client != reader->numClients
+                || !journal_getString(fp, reader->message, message_MaxBytes)) {
+                break;
+            }
+            if (reader->numClients == reader->clientCapacity) {
+                int capacity = reader->clientCapacity > 0 ? 2 * reader->clientCapacity : 16;
+                char** addresses = realloc(reader->addresses, capacity * sizeof(char*));
+                if (addresses == NULL) break;
+                reader->addresses = addresses;
+                reader->clientCapacity = capacity;
+            }
+            if ((reader->addresses[reader->numClients] = strdup(reader->message)) == NULL) break;
+            reader->numClients++;
+            continue;
+        }
+        if (client == reader->numClients) break;   // a client never introduced
+
+        bool ok = true;
+        if (type == 'P') {
+            strcpy(reader->message, "PLAY");
+            ok = journal_getString(fp, reader->message + strlen("PLAY"),
+                                   message_MaxBytes - strlen("PLAY"));
+        } else if (type == 'S') {
+            strcpy(reader->message, "SPECTATE");
+        } else if (type == 'Q') {
+            strcpy(reader->message, "KEY Q");
+        } else if (type == 'K') {
+            int key = getc(fp);
+            ok = key != EOF;
+            sprintf(reader->message, "KEY %c", key);
+        } else if (type == 'M') {
+            ok = journal_getString(fp, reader->message, message_MaxBytes);
+        } else {
+            ok = false;
+        }
+        if (!ok) break;
+
+        event->type = journal_Message;
+        event->client = client;
+        event->address = reader->addresses[client];
+        event->message = reader->message;
+        event->events = ++reader->events;
+        return true;
+    }
+    fprintf(stderr, "journal: cut short or damaged after %lu messages\n", reader->events);
+    return false;
+}
+
+/**************** journal_closeReader ****************/
+/* see journal.h for description */
+void journal_closeReader(journalReader_t* reader) {
+    if (reader == NULL) return;
+    fclose(reader->fp);
+    for (int c = 0; c < reader->numClients; c++) {
+        free(reader->addresses[c]);
+    }
+    free(reader->addresses);
+    free(reader->mapFile);
+    free(reader->message);
+    free(reader);
+}
+
+/**************** journal_now ****************/
+/* Returns a monotonic timestamp in nanoseconds.
+ */
+static uint64_t journal_now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+/**************** journal_flush ****************/
+/* Writes out the buffer with one write call (more only if the kernel takes
+ * part of it), and empties it.
+ */
+static void journal_flush(journal_t* journal) {
+    size_t written = 0;
+    while (written < journal->used) {
+        ssize_t n = write(journal->fd, journal->buffer + written, journal->used - written);
+        if (n <= 0) {
+            perror("journal");
+            break;          // drop the batch rather than stall the game
+        }
+        written += n;
+    }
+    journal->used = 0;
+    journal->lastFlush = journal_now();
+}
+
+/**************** journal_put ****************/
+/* Appends bytes to the buffer, writing it out each time it fills.
+ */
+static void journal_put(journal_t* journal, const void* bytes, size_t length) {
+    const unsigned char* from = bytes;
+    while (length > 0) {
+        if (journal->used == BufferSize) {
+            journal_flush(journal);
+        }
+        size_t n = BufferSize - journal->used;
+        if (n > length) n = length;
+        memcpy(journal->buffer + journal->used, from, n);
+        journal->used += n;
+        from += n;
+        length -= n;
+    }
+}
+
+/**************** journal_putVarint ****************/
+/* Appends value as a varint.
+ */
+static void journal_putVarint(journal_t* journal, uint64_t value) {
+    unsigned char bytes[10];
+    int n = 0;
+    do {
+        bytes[n] = value & 0x7f;
+        value >>= 7;
+        if (value != 0) bytes[n] |= 0x80;
+        n++;
+    } while (value != 0);
+    journal_put(journal, bytes, n);
+}
+
+/**************** journal_putString ****************/
+/* Appends a varint length and then the string's bytes (at most a message's).
+ */
+static void journal_putString(journal_t* journal, const char* string, size_t length) {
+    if (length > message_MaxBytes) length = message_MaxBytes;
+    journal_putVarint(journal, length);
+    journal_put(journal, string, length);
+}
+
+/**************** journal_putRecord ****************/
+/* Appends a record's type and its time since the previous record.
+ */
+static void journal_putRecord(journal_t* journal, char type) {
+    uint64_t micros = (journal_now() - journal->start) / 1000;
+    if (micros < journal->lastMicros) micros = journal->lastMicros;
+    journal_put(journal, &type, 1);
+    journal_putVarint(journal, micros - journal->lastMicros);
+    journal->lastMicros = micros;
+}
+
+/**************** journal_client ****************/
+/* Returns the number of the client at the given address, first recording
+ * an 'A' record for it if it is new; -1 if out of memory.
+ */
+static int journal_client(journal_t* journal, addr_t from) {
+    for (int c = journal->numClients - 1; c >= 0; c--) {     // the newest are the busiest
+        if (message_eqAddr(journal->clients[c], from)) return c;
+    }
+    if (journal->numClients == journal->clientCapacity) {
+        int capacity = journal->clientCapacity > 0 ? 2 * journal->clientCapacity : 16;
+        addr_t* clients = realloc(journal->clients, capacity * sizeof(addr_t));
+        if (clients == NULL) return -1;
+        journal->clients = clients;
+        journal->clientCapacity = capacity;
+    }
+    int client = journal->numClients++;
+    journal->clients[client] = from;
+
+    const char* address = message_stringAddr(from);
+    journal_putRecord(journal, 'A');
+    journal_putVarint(journal, client);
+    journal_putString(journal, address, strlen(address));
+    return client;
+}
+
+/**************** journal_getVarint ****************/
+/* Reads a varint; returns false if the file ends first or it is too long.
+ */
+static bool journal_getVarint(FILE* fp, uint64_t* value) {
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = getc(fp);
+        if (c == EOF) return false;
+        *value |= (uint64_t) (c & 0x7f) << shift;
+        if ((c & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+/**************** journal_getString ****************/
+/* Reads a varint length and that many bytes into string, NUL-terminated;
+ * returns false if the file ends first or the string is longer than max.
+ */
+static bool journal_getString(FILE* fp, char* string, size_t max) {
+    uint64_t length;
+    if (!journal_getVarint(fp, &length) || length > max
+        || fread(string, 1, length, fp) != length) {
+        return false;
+    }
+    string[length] = '\0';
+    return true;
+}
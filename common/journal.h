@@ -0,0 +1,117 @@
+/*
+ * journal.h - header file for Nuggets 'journal' module
+ *
+ * A 'journal' is an append-only binary record of every input a game accepts:
+ * each join, spectator, keystroke and quit, with who sent it and when, after
+ * a header holding the map, the game's seed and its limits. Every so often it
+ * also records a hash of the game's state (see game_hash). Replaying the
+ * journal into a new game with the same map and seed rebuilds the same game,
+ * and the checkpoints show whether, and from when, it went a different way.
+ * The server writes one with --journal; ./replay --journal reads it back.
+ *
+ * Records are buffered, and written a batch at a time with one write call.
+ *
+ * Selena Zhou, Kyla Widodo, 23S
+ */
+
+#ifndef __JOURNAL_H
+#define __JOURNAL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "game.h"
+#include "../support/message.h"
+
+/**************** global types ****************/
+typedef struct journal journal_t;               // for writing
+typedef struct journalReader journalReader_t;   // for reading
+
+/* What a journal says about the game it records. */
+typedef struct journalHeader {
+    unsigned long seed;         // as passed to game_new
+    int maxPlayers;             // as passed to game_setLimits
+    int radius;
+    long startTime;             // when the journal began, in seconds since 1970
+    const char* mapFile;        // map file name, as the server was given it
+} journalHeader_t;
+
+/* One record read back from a journal. */
+typedef struct journalEvent {
+    enum {
+        journal_Message,        // a message the game accepted: 'message' from 'client'
+        journal_Checkpoint      // the game's state after 'events' messages was 'hash'
+    } type;
+    uint64_t micros;            // microseconds since the journal began
+    int client;                 // clients are numbered 0, 1, 2... as first heard from
+    const char* address;        // the client's address, as message_stringAddr gave it
+    const char* message;        // the message, as the game received it
+    unsigned long events;       // messages recorded so far
+    uint64_t hash;              // game_hash at the checkpoint
+} journalEvent_t;
+
+/**************** functions ****************/
+
+/**************** journal_new ****************/
+/* Creates (or truncates) the journal file and writes its header.
+ *
+ * Caller provides: path of the journal file, and the map file, seed and
+ *   limits the game was created with.
+ * Returns: new journal, or NULL if the file cannot be written.
+ */
+journal_t* journal_new(const char* path, const char* mapFile, unsigned long seed,
+                       int maxPlayers, int radius);
+
+/**************** journal_record ****************/
+/* Records a message from a client, if it is one the game acts on (PLAY,
+ * SPECTATE or KEY); call it before passing the message to the game.
+ * Does nothing if journal is NULL.
+ */
+void journal_record(journal_t* journal, addr_t from, const char* message);
+
+/**************** journal_checkpoint ****************/
+/* Call after the game has handled each message. Every so many messages,
+ * records the game's hash and writes out everything buffered; and writes out
+ * the buffer if it has been held for long. Does nothing if journal is NULL.
+ */
+void journal_checkpoint(journal_t* journal, game_t* game);
+
+/**************** journal_sync ****************/
+/* Records a checkpoint of the game now, if any message has come since the
+ * last, and writes out everything buffered; for when the game is idle, so a
+ * journal cut off by a crash or a kill has all but the latest messages.
+ * Does nothing if journal is NULL.
+ */
+void journal_sync(journal_t* journal, game_t* game);
+
+/**************** journal_delete ****************/
+/* Syncs the journal (see journal_sync; game may be NULL), closes the file
+ * and frees the journal.
+ * Does nothing if journal is NULL.
+ */
+void journal_delete(journal_t* journal, game_t* game);
+
+/**************** journal_openReader ****************/
+/* Opens a journal to read back, and fills in *header from it. The header's
+ * strings belong to the reader, and last until journal_closeReader.
+ *
+ * Returns: new reader, or NULL if the file cannot be read or is no journal.
+ */
+journalReader_t* journal_openReader(const char* path, journalHeader_t* header);
+
+/**************** journal_next ****************/
+/* Reads the next record into *event. Its strings belong to the reader, and
+ * last until the next call.
+ *
+ * Returns: true if a record was read; false at the end of the journal, or
+ *   if the rest of it is cut short or damaged (and then says so on stderr).
+ */
+bool journal_next(journalReader_t* reader, journalEvent_t* event);
+
+/**************** journal_closeReader ****************/
+/* Closes the journal file and frees the reader.
+ */
+void journal_closeReader(journalReader_t* reader);
+
+#endif // __JOURNAL_H
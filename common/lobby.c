@@ -0,0 +1,191 @@
+/*
+ * lobby.c - Nuggets 'lobby' module
+ *
+ * See lobby.h for more information.
+ *
+ * Ready games wait in a queue, oldest first; returned games wait in another
+ * until they are reset, which moves them to the back of the ready queue with
+ * the next seed. Both are short arrays, at most as long as the games made.
+ *
+ * Selena Zhou, Kyla Widodo, 23S
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "game.h"
+#include "lobby.h"
+#include "../support/trace.h"
+
+/**************** global types ****************/
+
+typedef struct lobby {
+    char* mapFile;
+    int maxPlayers;                 // limits for every game
+    int radius;
+    pool_t* workers;                // shared by every game
+    unsigned long nextSeed;         // for the next game readied
+    game_t** ready;                 // [numGames], oldest first
+    int numReady;
+    game_t** returned;              // [numGames], oldest first
+    int numReturned;
+    int numGames;                   // made, and not deleted
+    int capacity;                   // of ready and returned
+} lobby_t;
+
+/**************** file local helper functions ****************/
+/* opaque to those outside of the file*/
+
+/**************** lobby_grow ****************/
+/* Makes room in both queues for one more game.
+ * Returns: true if there is room, false upon memory failure.
+ */
+static bool lobby_grow(lobby_t* lobby) {
+    if (lobby->numGames < lobby->capacity) {
+        return true;
+    }
+    int newCapacity = lobby->capacity * 2;
+    game_t** ready = realloc(lobby->ready, newCapacity * sizeof(game_t*));
+    if (ready == NULL) {
+        return false;
+    }
+    lobby->ready = ready;
+    game_t** returned = realloc(lobby->returned, newCapacity * sizeof(game_t*));
+    if (returned == NULL) {
+        return false;
+    }
+    lobby->returned = returned;
+    lobby->capacity = newCapacity;
+    return true;
+}
+
+/**************** lobby_makeGame ****************/
+/* Makes a new game with the next seed, and queues it as ready.
+ * Returns: true if made, false upon failure.
+ */
+static bool lobby_makeGame(lobby_t* lobby) {
+    if (!lobby_grow(lobby)) {
+        return false;
+    }
+    game_t* game = game_new(lobby->mapFile, lobby->nextSeed);
+    if (game == NULL) {
+        return false;
+    }
+    if (!game_setLimits(game, lobby->maxPlayers, lobby->radius)) {
+        game_delete(game);
+        return false;
+    }
+    game_setWorkers(game, lobby->workers);
+    lobby->nextSeed++;
+    lobby->ready[lobby->numReady++] = game;
+    lobby->numGames++;
+    return true;
+}
+
+/**************** lobby_resetOldest ****************/
+/* Resets the game returned longest ago, with the next seed, and queues it
+ * as ready.
+ */
+static void lobby_resetOldest(lobby_t* lobby) {
+    game_t* game = lobby->returned[0];
+    lobby->numReturned--;
+    memmove(lobby->returned, lobby->returned + 1, lobby->numReturned * sizeof(game_t*));
+    game_reset(game, lobby->nextSeed++);
+    lobby->ready[lobby->numReady++] = game;
+}
+
+/**************** global functions ****************/
+/* that is, visible outside this file */
+/* see lobby.h for comments about exported functions */
+
+/**************** lobby_new ****************/
+/* see lobby.h for description */
+lobby_t* lobby_new(char* mapFile, int numGames, unsigned long seed,
+                   int maxPlayers, int radius, pool_t* workers) {
+    TRACE_SCOPE("lobby_new");
+
+    if (mapFile == NULL || numGames < 1) {
+        return NULL;
+    }
+    lobby_t* lobby = malloc(sizeof(lobby_t));
+    if (lobby == NULL) {
+        return NULL;
+    }
+    lobby->mapFile = malloc(strlen(mapFile) + 1);
+    lobby->ready = malloc(numGames * sizeof(game_t*));
+    lobby->returned = malloc(numGames * sizeof(game_t*));
+    lobby->capacity = numGames;
+    lobby->numReady = lobby->numReturned = lobby->numGames = 0;
+    lobby->maxPlayers = maxPlayers;
+    lobby->radius = radius;
+    lobby->workers = workers;
+    lobby->nextSeed = seed;
+    if (lobby->mapFile == NULL || lobby->ready == NULL || lobby->returned == NULL) {
+        lobby_delete(lobby);
+        return NULL;
+    }
+    strcpy(lobby->mapFile, mapFile);
+
+    for (int i = 0; i < numGames; i++) {
+        if (!lobby_makeGame(lobby)) {
+            lobby_delete(lobby);
+            return NULL;
+        }
+    }
+    return lobby;
+}
+
+/**************** lobby_take ****************/
+/* see lobby.h for description */
+game_t* lobby_take(lobby_t* lobby) {
+    TRACE_SCOPE("lobby_take");
+
+    if (lobby->numReady == 0) {
+        if (lobby->numReturned > 0) {
+            lobby_resetOldest(lobby);
+        } else if (!lobby_makeGame(lobby)) {
+            return NULL;
+        }
+    }
+    game_t* game = lobby->ready[0];
+    lobby->numReady--;
+    memmove(lobby->ready, lobby->ready + 1, lobby->numReady * sizeof(game_t*));
+    return game;
+}
+
+/**************** lobby_return ****************/
+/* see lobby.h for description */
+void lobby_return(lobby_t* lobby, game_t* game) {
+    if (game != NULL) {
+        lobby->returned[lobby->numReturned++] = game;
+    }
+}
+
+/**************** lobby_tidy ****************/
+/* see lobby.h for description */
+bool lobby_tidy(lobby_t* lobby) {
+    bool any = lobby->numReturned > 0;
+    while (lobby->numReturned > 0) {
+        lobby_resetOldest(lobby);
+    }
+    return any;
+}
+
+/**************** lobby_delete ****************/
+/* see lobby.h for description */
+void lobby_delete(lobby_t* lobby) {
+    if (lobby == NULL) {
+        return;
+    }
+    for (int i = 0; lobby->ready != NULL && i < lobby->numReady; i++) {
+        game_delete(lobby->ready[i]);
+    }
+    for (int i = 0; lobby->returned != NULL && i < lobby->numReturned; i++) {
+        game_delete(lobby->returned[i]);
+    }
+    free(lobby->ready);
+    free(lobby->returned);
+    free(lobby->mapFile);
+    free(lobby);
+}
@@ -0,0 +1,72 @@
+/*
+ * lobby.h - header file for Nuggets 'lobby' module
+ *
+ * A 'lobby' keeps games of one map ready to play: loaded, with their bit
+ * planes, rooms and visibility cache built and their gold placed, so that a
+ * new match starts at once. A finished game comes back to the lobby and is
+ * reset in place (see game_reset) to be played again, rather than freed and
+ * made anew. Games are handed out in the order they were readied, and the
+ * k-th one (from 0) is seeded with the lobby's seed plus k, so a server's
+ * matches are as repeatable as a single game.
+ *
+ * A lobby holds games of its one map only; a program playing several maps
+ * would keep a lobby for each. The server plays the one map it is given, so
+ * it keeps one lobby, not a pool per map: nothing in the protocol lets a
+ * client choose a map.
+ *
+ * Selena Zhou, Kyla Widodo, 23S
+ */
+
+#ifndef __LOBBY_H
+#define __LOBBY_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "game.h"
+
+/**************** global types ****************/
+typedef struct lobby lobby_t;
+
+/**************** functions ****************/
+
+/**************** lobby_new ****************/
+/* Makes a lobby of numGames ready games.
+ *
+ * Caller provides: map file, number of games to keep ready (at least 1),
+ *   seed of the first match, the limits for every game (see
+ *   game_setLimits), and the pool of worker threads they all share (see
+ *   game_setWorkers), or NULL.
+ * Returns: new lobby, or NULL if the map cannot be loaded, the limits are
+ *   out of range, or memory runs out.
+ */
+lobby_t* lobby_new(char* mapFile, int numGames, unsigned long seed,
+                   int maxPlayers, int radius, pool_t* workers);
+
+/**************** lobby_take ****************/
+/* Hands out the next ready game, for the caller to play and then pass back
+ * with lobby_return. If none is ready, readies one first: resetting the
+ * oldest game returned, or else making a new one.
+ * Returns: the game, or NULL upon failure.
+ */
+game_t* lobby_take(lobby_t* lobby);
+
+/**************** lobby_return ****************/
+/* Takes back a game handed out by lobby_take, whose match is over (or
+ * abandoned), to be reset by lobby_tidy or the next lobby_take.
+ */
+void lobby_return(lobby_t* lobby, game_t* game);
+
+/**************** lobby_tidy ****************/
+/* Resets every game returned, so it is ready; call when idle, so matches
+ * need not wait for it. Returns true if there was any to reset.
+ */
+bool lobby_tidy(lobby_t* lobby);
+
+/**************** lobby_delete ****************/
+/* Deletes every game the lobby holds, and frees the lobby; games handed out
+ * and not returned are the caller's. Does nothing if lobby is NULL.
+ */
+void lobby_delete(lobby_t* lobby);
+
+#endif // __LOBBY_H
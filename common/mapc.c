@@ -0,0 +1,121 @@
+/*
+ * mapc.c - compile a Nuggets map into a binary .nugmap file
+ *
+ * usage: ./mapc [--no-vis] mapFile [outFile]
+ *
+ * Reads a map in the usual text format and writes it, with the indexes the
+ * game would otherwise build at every start, as a compiled map that
+ * grid_fromCompiled maps straight into memory (see grid.c for the format).
+ * The output goes to outFile, or by default to mapFile with its .txt suffix
+ * (if any) replaced by .nugmap. The server, and anything else that calls
+ * game_new, loads a map whose name ends in .nugmap this way.
+ *
+ * By default the file includes the set of gridpoints visible from every spot,
+ * which takes time proportional to spots times gridpoints to compute;
+ * --no-vis leaves them out, for maps so large that would take too long.
+ * After writing, mapc loads the file back and checks it against the map.
+ *
+ * Selena Zhou, Kyla Widodo, 23S
+ */
+
+#define _POSIX_C_SOURCE 200809L     // for clock_gettime, stat
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "grid.h"
+
+/**************** file-local global variables ****************/
+
+static const char CompiledSuffix[] = ".nugmap";
+
+/**************** helper functions ****************/
+
+/**************** now ****************/
+/* Returns a monotonic timestamp in seconds.
+ */
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/**************** outputName ****************/
+/* Returns a new string: mapFile with any .txt suffix replaced by .nugmap.
+ * Caller must free it.
+ */
+static char* outputName(const char* mapFile) {
+    size_t len = strlen(mapFile);
+    if (len >= 4 && strcmp(mapFile + len - 4, ".txt") == 0) {
+        len -= 4;
+    }
+    char* name = malloc(len + sizeof(CompiledSuffix));
+    if (name != NULL) {
+        memcpy(name, mapFile, len);
+        strcpy(name + len, CompiledSuffix);
+    }
+    return name;
+}
+
+/**************** main ****************/
+int main(int argc, char* argv[]) {
+    bool withVisibility = true;
+    int first = 1;
+    if (first < argc && strcmp(argv[first], "--no-vis") == 0) {
+        withVisibility = false;
+        first++;
+    }
+    if (argc - first < 1 || argc - first > 2) {
+        fprintf(stderr, "usage: %s [--no-vis] mapFile [outFile]\n", argv[0]);
+        return 1;
+    }
+    const char* mapFile = argv[first];
+    char* outFile = (argc - first == 2) ? strdup(argv[first + 1]) : outputName(mapFile);
+    if (outFile == NULL) {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return 2;
+    }
+
+    grid_t* grid = grid_fromFile(mapFile);
+    if (grid == NULL) {
+        fprintf(stderr, "%s: cannot load map '%s'\n", argv[0], mapFile);
+        free(outFile);
+        return 3;
+    }
+
+    double start = now();
+    if (!grid_writeCompiled(grid, outFile, withVisibility)) {
+        fprintf(stderr, "%s: cannot write '%s'\n", argv[0], outFile);
+        grid_delete(grid);
+        free(outFile);
+        return 4;
+    }
+    double compileTime = now() - start;
+
+    // load it back, and check it holds the same map
+    start = now();
+    grid_t* compiled = grid_fromCompiled(outFile);
+    double loadTime = now() - start;
+    if (compiled == NULL || strcmp(grid_string(compiled), grid_string(grid)) != 0) {
+        fprintf(stderr, "%s: '%s' does not load back as '%s'\n", argv[0], outFile, mapFile);
+        grid_delete(compiled);
+        grid_delete(grid);
+        free(outFile);
+        return 5;
+    }
+
+    struct stat st;
+    long size = (stat(outFile, &st) == 0) ? (long) st.st_size : -1;
+    printf("%s: %d x %d, %s visible sets, %ld bytes; compiled in %.3f s, loads in %.6f s\n",
+           outFile, grid_nrows(grid), grid_ncols(grid), withVisibility ? "with" : "without",
+           size, compileTime, loadTime);
+
+    grid_delete(compiled);
+    grid_delete(grid);
+    grid_freeRays();
+    free(outFile);
+    return 0;
+}
@@ -0,0 +1,434 @@
+/*
+ * mapgen.c - procedural generator of Nuggets maps, for scale testing
+ *
+ * usage: ./mapgen [--rows R] [--cols C] [--rooms N] [--room-min m] [--room-max M]
+ *                 [--passages p] [--open f] seed > mapFile
+ *
+ * Prints to stdout a map of exactly R rows and C columns (default 40 x 120),
+ * in the format grid_fromString reads: rectangular rooms of '.' bounded by
+ * '|', '-' and '+', joined by '#' passages that enter each room through a
+ * '#' doorway in its wall. Every room can be reached from every other.
+ *
+ * The generator tries to place N rooms (default 12) that do not touch one
+ * another; a map too small to hold them all gets fewer. A room is m to M rows
+ * tall inside its walls (default 3 to 8), and two to three times as wide, since
+ * a cell is about twice as tall as it is wide on a terminal. A fraction f of the
+ * rooms (default 0.1) are open areas instead, two to four times larger each way.
+ * Rooms are first joined into a tree, each to the nearest room that a passage
+ * can reach; then p extra passages per room (default 0.3) add loops.
+ *
+ * The output depends only on the arguments: the generator uses its own random
+ * number generator rather than rand(), so a seed gives the same map on every
+ * machine and every build, and benchmark results can be compared.
+ * A summary goes to stderr.
+ *
+ * Selena Zhou, Kyla Widodo, 23S
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "grid.h"
+#include "../support/message.h"
+
+/**************** file-local global variables ****************/
+
+static const int Margin = 1;                // blank cells kept around the map's edge
+static const int Gap = 3;                   // blank cells kept between rooms' walls
+static const int PlaceTries = 200;          // attempts to place each room
+static const int SearchMargin = 12;         // passage search box, beyond its doorways
+static const int ExtraNeighbors = 3;        // extra passages go to one of this many nearest
+
+/**************** local types ****************/
+
+typedef struct options {
+    int rows, cols;
+    int rooms;
+    int roomMin, roomMax;
+    double passages;                // extra passages per room
+    double open;                    // fraction of rooms that are open areas
+    uint64_t seed;
+} options_t;
+
+typedef struct room {
+    int top, left, bottom, right;   // the walls' rows and columns, inclusive
+    bool open;                      // an open area rather than an ordinary room
+} room_t;
+
+typedef struct map {
+    int rows, cols;
+    char* cells;                    // [rows * cols]
+    room_t* rooms;                  // [numRooms]
+    int numRooms;
+    int numPassages;
+    int* dist;                      // scratch for the passage search, [rows * cols]
+    int* queue;                     // scratch for the passage search, [rows * cols]
+    uint64_t rng;                   // splitmix64 state
+} map_t;
+
+/**************** helper functions ****************/
+
+/**************** nextRandom ****************/
+/* Returns the next number from the map's splitmix64 generator.
+ */
+static uint64_t nextRandom(map_t* map) {
+    uint64_t z = (map->rng += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**************** randomIn ****************/
+/* Returns a random integer in [low, high]; low if high < low.
+ */
+static int randomIn(map_t* map, int low, int high) {
+    if (high <= low) return low;
+    return low + (int) (nextRandom(map) % (uint64_t) (high - low + 1));
+}
+
+/**************** randomFraction ****************/
+/* Returns a random number in [0, 1).
+ */
+static double randomFraction(map_t* map) {
+    return (nextRandom(map) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**************** cell ****************/
+/* Returns a pointer to the map's cell at r,c.
+ */
+static char* cell(map_t* map, int r, int c) {
+    return &map->cells[(size_t) r * map->cols + c];
+}
+
+/**************** roomsTouch ****************/
+/* Returns true if the two rooms' walls come within Gap cells of each other.
+ */
+static bool roomsTouch(const room_t* a, const room_t* b) {
+    return a->left - Gap <= b->right && b->left - Gap <= a->right
+        && a->top - Gap <= b->bottom && b->top - Gap <= a->bottom;
+}
+
+/**************** placeRoom ****************/
+/* Tries to place one more room, drawing it into the map if it fits.
+ * Returns: true if placed.
+ */
+static bool placeRoom(map_t* map, const options_t* options) {
+    bool open = randomFraction(map) < options->open;
+    for (int try = 0; try < PlaceTries; try++) {
+        int height = randomIn(map, options->roomMin, options->roomMax);
+        int width = randomIn(map, 2 * height, 3 * height);
+        if (open) {
+            height *= randomIn(map, 2, 4);
+            width *= randomIn(map, 2, 4);
+        }
+        // the room with its walls, and the margin, must fit in the map
+        int maxTop = map->rows - Margin - (height + 2);
+        int maxLeft = map->cols - Margin - (width + 2);
+        if (maxTop < Margin || maxLeft < Margin) continue;
+        room_t room;
+        room.top = randomIn(map, Margin, maxTop);
+        room.left = randomIn(map, Margin, maxLeft);
+        room.bottom = room.top + height + 1;
+        room.right = room.left + width + 1;
+        room.open = open;
+
+        bool fits = true;
+        for (int i = 0; i < map->numRooms && fits; i++) {
+            fits = !roomsTouch(&room, &map->rooms[i]);
+        }
+        if (!fits) continue;
+
+        for (int r = room.top; r <= room.bottom; r++) {
+            for (int c = room.left; c <= room.right; c++) {
+                bool edgeRow = (r == room.top || r == room.bottom);
+                bool edgeCol = (c == room.left || c == room.right);
+                *cell(map, r, c) = (edgeRow && edgeCol) ? GRID_WALL_CORN
+                    : edgeRow ? GRID_WALL_HORZ
+                    : edgeCol ? GRID_WALL_VERT
+                    : GRID_ROOM_SPOT;
+            }
+        }
+        map->rooms[map->numRooms++] = room;
+        return true;
+    }
+    return false;
+}
+
+/**************** eraseRoom ****************/
+/* Blanks out the last room placed, which no passage could reach.
+ */
+static void eraseRoom(map_t* map) {
+    room_t* room = &map->rooms[--map->numRooms];
+    for (int r = room->top; r <= room->bottom; r++) {
+        memset(cell(map, r, room->left), GRID_BLANK, room->right - room->left + 1);
+    }
+}
+
+/**************** chooseDoor ****************/
+/* Picks a random spot, not a corner, on the given side (0 top, 1 right,
+ * 2 bottom, 3 left) of the room, for a doorway; fills in the doorway and the
+ * cell just outside it.
+ * Returns: false if the cell outside is off the map or not blank or passage.
+ */
+static bool chooseDoor(map_t* map, const room_t* room, int side,
+                       int* dr, int* dc, int* outR, int* outC) {
+    switch (side) {
+    case 0: *dr = room->top;    *dc = randomIn(map, room->left + 1, room->right - 1);  break;
+    case 2: *dr = room->bottom; *dc = randomIn(map, room->left + 1, room->right - 1);  break;
+    case 1: *dc = room->right;  *dr = randomIn(map, room->top + 1, room->bottom - 1);  break;
+    default: *dc = room->left;  *dr = randomIn(map, room->top + 1, room->bottom - 1);  break;
+    }
+    *outR = *dr + (side == 0 ? -1 : side == 2 ? 1 : 0);
+    *outC = *dc + (side == 3 ? -1 : side == 1 ? 1 : 0);
+    if (*outR < 0 || *outR >= map->rows || *outC < 0 || *outC >= map->cols) return false;
+    char outside = *cell(map, *outR, *outC);
+    return outside == GRID_BLANK || outside == GRID_PASS_SPOT;
+}
+
+/**************** facingSide ****************/
+/* Returns the side of room a (as in chooseDoor) that faces room b most.
+ */
+static int facingSide(const room_t* a, const room_t* b) {
+    int dr = (b->top + b->bottom) - (a->top + a->bottom);
+    int dc = (b->left + b->right) - (a->left + a->right);
+    // columns are about half as wide as rows are tall
+    if (abs(dc) > 2 * abs(dr)) {
+        return (dc > 0) ? 1 : 3;
+    }
+    return (dr > 0) ? 2 : 0;
+}
+
+/**************** carvePath ****************/
+/* Finds the shortest path of blank or passage cells from r0,c0 to r1,c1,
+ * staying within the box of both ends widened by 'margin', and carves it.
+ * Returns: true if found and carved.
+ */
+static bool carvePath(map_t* map, int r0, int c0, int r1, int c1, int margin) {
+    int top = (r0 < r1 ? r0 : r1) - margin, bottom = (r0 > r1 ? r0 : r1) + margin;
+    int left = (c0 < c1 ? c0 : c1) - margin, right = (c0 > c1 ? c0 : c1) + margin;
+    if (top < 0) top = 0;
+    if (left < 0) left = 0;
+    if (bottom >= map->rows) bottom = map->rows - 1;
+    if (right >= map->cols) right = map->cols - 1;
+
+    for (int r = top; r <= bottom; r++) {
+        for (int c = left; c <= right; c++) {
+            map->dist[r * map->cols + c] = -1;
+        }
+    }
+    static const int Steps[4][2] = { {0, 1}, {1, 0}, {0, -1}, {-1, 0} };
+    int head = 0, tail = 0;
+    int start = r0 * map->cols + c0, goal = r1 * map->cols + c1;
+    map->dist[start] = 0;
+    map->queue[tail++] = start;
+    while (head < tail && map->dist[goal] < 0) {
+        int here = map->queue[head++];
+        int r = here / map->cols, c = here % map->cols;
+        for (int s = 0; s < 4; s++) {
+            int nr = r + Steps[s][0], nc = c + Steps[s][1];
+            if (nr < top || nr > bottom || nc < left || nc > right) continue;
+            int next = nr * map->cols + nc;
+            char there = map->cells[next];
+            if (map->dist[next] >= 0 || (there != GRID_BLANK && there != GRID_PASS_SPOT)) continue;
+            map->dist[next] = map->dist[here] + 1;
+            map->queue[tail++] = next;
+        }
+    }
+    if (map->dist[goal] < 0) return false;
+
+    // walk back from the goal along decreasing distances
+    int here = goal;
+    while (true) {
+        map->cells[here] = GRID_PASS_SPOT;
+        if (here == start) break;
+        int r = here / map->cols, c = here % map->cols;
+        for (int s = 0; s < 4; s++) {
+            int nr = r + Steps[s][0], nc = c + Steps[s][1];
+            if (nr < top || nr > bottom || nc < left || nc > right) continue;
+            int next = nr * map->cols + nc;
+            if (map->dist[next] == map->dist[here] - 1) {
+                here = next;
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+/**************** connectRooms ****************/
+/* Tries to join rooms a and b by a passage, starting with the sides that face
+ * each other, and with a small search box before the whole map.
+ * Returns: true if joined.
+ */
+static bool connectRooms(map_t* map, const room_t* a, const room_t* b) {
+    int sideA = facingSide(a, b), sideB = facingSide(b, a);
+    int margins[2] = { SearchMargin, map->rows + map->cols };
+    for (int m = 0; m < 2; m++) {
+        for (int turn = 0; turn < 4; turn++) {
+            int dra, dca, ra, ca, drb, dcb, rb, cb;
+            if (!chooseDoor(map, a, (sideA + turn) % 4, &dra, &dca, &ra, &ca)
+                || !chooseDoor(map, b, (sideB + turn) % 4, &drb, &dcb, &rb, &cb)) {
+                continue;
+            }
+            if (carvePath(map, ra, ca, rb, cb, margins[m])) {
+                *cell(map, dra, dca) = GRID_PASS_SPOT;
+                *cell(map, drb, dcb) = GRID_PASS_SPOT;
+                map->numPassages++;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**************** roomDistance ****************/
+/* Returns the squared distance between two rooms' centers, counting a row
+ * as two columns.
+ */
+static long roomDistance(const room_t* a, const room_t* b) {
+    long dr = (b->top + b->bottom) - (a->top + a->bottom);
+    long dc = (b->left + b->right) - (a->left + a->right);
+    return 4 * dr * dr + dc * dc;
+}
+
+/**************** nearestRooms ****************/
+/* Fills 'order' with the indexes of rooms 0..n-1, other than 'which', nearest first.
+ * Returns: how many indexes were filled in.
+ */
+static int nearestRooms(map_t* map, int which, int n, int* order) {
+    int count = 0;
+    for (int i = 0; i < n; i++) {
+        if (i == which) continue;
+        // insertion sort; n is small
+        long d = roomDistance(&map->rooms[which], &map->rooms[i]);
+        int j = count++;
+        while (j > 0 && roomDistance(&map->rooms[which], &map->rooms[order[j-1]]) > d) {
+            order[j] = order[j-1];
+            j--;
+        }
+        order[j] = i;
+    }
+    return count;
+}
+
+/**************** parseArgs ****************/
+/* Fills in options from the command line; prints usage and exits if they are bad.
+ */
+static void parseArgs(int argc, char* argv[], options_t* options) {
+    *options = (options_t) { 40, 120, 12, 3, 8, 0.3, 0.1, 0 };
+    bool ok = true;
+    int i = 1;
+    for (; i < argc - 1 && ok && strncmp(argv[i], "--", 2) == 0; i += 2) {
+        const char* name = argv[i];
+        const char* value = argv[i+1];
+        if (strcmp(name, "--rows") == 0) ok = sscanf(value, "%d", &options->rows) == 1;
+        else if (strcmp(name, "--cols") == 0) ok = sscanf(value, "%d", &options->cols) == 1;
+        else if (strcmp(name, "--rooms") == 0) ok = sscanf(value, "%d", &options->rooms) == 1;
+        else if (strcmp(name, "--room-min") == 0) ok = sscanf(value, "%d", &options->roomMin) == 1;
+        else if (strcmp(name, "--room-max") == 0) ok = sscanf(value, "%d", &options->roomMax) == 1;
+        else if (strcmp(name, "--passages") == 0) ok = sscanf(value, "%lf", &options->passages) == 1;
+        else if (strcmp(name, "--open") == 0) ok = sscanf(value, "%lf", &options->open) == 1;
+        else ok = false;
+    }
+    unsigned long long seed = 0;
+    ok = ok && i == argc - 1 && sscanf(argv[i], "%llu", &seed) == 1
+        && options->rows >= MinRows && options->cols >= MinCols
+        && options->rooms >= 1 && options->roomMin >= 1 && options->roomMax >= options->roomMin
+        && options->passages >= 0 && options->open >= 0 && options->open <= 1;
+    if (!ok) {
+        fprintf(stderr, "usage: %s [--rows R] [--cols C] [--rooms N] [--room-min m] [--room-max M]\n"
+                "          [--passages p] [--open f] seed > mapFile\n", argv[0]);
+        exit(1);
+    }
+    options->seed = seed;
+}
+
+/**************** main ****************/
+int main(int argc, char* argv[]) {
+    options_t options;
+    parseArgs(argc, argv, &options);
+
+    map_t map = { options.rows, options.cols };
+    size_t size = (size_t) options.rows * options.cols;
+    map.cells = malloc(size);
+    map.rooms = calloc(options.rooms, sizeof(room_t));
+    map.dist = malloc(size * sizeof(int));
+    map.queue = malloc(size * sizeof(int));
+    int* order = malloc(options.rooms * sizeof(int));
+    if (map.cells == NULL || map.rooms == NULL || map.dist == NULL || map.queue == NULL || order == NULL) {
+        fprintf(stderr, "mapgen: out of memory\n");
+        exit(2);
+    }
+    memset(map.cells, GRID_BLANK, size);
+    map.rng = options.seed;
+
+    // place rooms one at a time, joining each to the nearest room a passage can reach
+    for (int tries = 0; map.numRooms < options.rooms && tries < 2 * options.rooms; tries++) {
+        if (!placeRoom(&map, &options)) continue;
+        int latest = map.numRooms - 1;
+        if (latest == 0) continue;
+        int n = nearestRooms(&map, latest, latest, order);
+        bool joined = false;
+        for (int i = 0; i < n && !joined; i++) {
+            joined = connectRooms(&map, &map.rooms[latest], &map.rooms[order[i]]);
+        }
+        if (!joined) {
+            eraseRoom(&map);
+        }
+    }
+    if (map.numRooms == 0) {
+        fprintf(stderr, "mapgen: no room fits in a %d x %d map\n", options.rows, options.cols);
+        exit(3);
+    }
+
+    // then add loops between near neighbors
+    int extra = (int) (options.passages * map.numRooms + 0.5);
+    for (int e = 0; e < extra && map.numRooms > 1; e++) {
+        int which = randomIn(&map, 0, map.numRooms - 1);
+        int n = nearestRooms(&map, which, map.numRooms, order);
+        int other = order[randomIn(&map, 0, (n < ExtraNeighbors ? n : ExtraNeighbors) - 1)];
+        connectRooms(&map, &map.rooms[which], &map.rooms[other]);
+    }
+
+    // build the text, and check that the game can load it
+    char* text = malloc(size + options.rows + 1);
+    if (text == NULL) {
+        fprintf(stderr, "mapgen: out of memory\n");
+        exit(2);
+    }
+    char* p = text;
+    int spots = 0;
+    for (int r = 0; r < options.rows; r++) {
+        memcpy(p, cell(&map, r, 0), options.cols);
+        for (int c = 0; c < options.cols; c++) {
+            spots += (p[c] == GRID_ROOM_SPOT || p[c] == GRID_PASS_SPOT);
+        }
+        p += options.cols;
+        *p++ = '\n';
+    }
+    *p = '\0';
+    grid_t* grid = grid_fromString(text);
+    if (grid == NULL) {
+        fprintf(stderr, "mapgen: generated map does not load\n");
+        exit(4);
+    }
+    grid_delete(grid);
+    fputs(text, stdout);
+
+    fprintf(stderr, "mapgen: %d x %d, %d rooms, %d passages, %d spots, %lu bytes\n",
+            options.rows, options.cols, map.numRooms, map.numPassages, spots, (unsigned long) (p - text));
+    if (p - text + 8 > message_MaxBytes) {
+        fprintf(stderr, "mapgen: note: too big for a DISPLAY message (%d bytes); fine for bench and replay\n",
+                message_MaxBytes);
+    }
+
+    free(text);
+    free(order);
+    free(map.cells);
+    free(map.rooms);
+    free(map.dist);
+    free(map.queue);
+    return 0;
+}
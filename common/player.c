@@ -12,24 +12,32 @@
 #include "../support/message.h"
 #include "grid.h"
 #include "game.h"
-
-/**************** file-local global variables ****************/
-
-static char nextPlayer = 'A';            // to create unique ID
+#include "player.h"
+#include "../support/trace.h"
 
 /**************** global types ****************/
 
 typedef struct player {
-    addr_t playerAddress;           // player address
-    char playerID;                  // unique ID starting from A, B, C...
     char* playerName;               // player real name that client inputs
+    grid_t* visibleMap;             // player's visible map
+    grid_t* visibleGold;            // player's visible gold
+    playerTable_t* table;           // where its hot fields are: 'own' or a roster's
+    int slot;                       // its slot in that table
+
+    // its own one-slot table, used until it moves to a roster's
+    playerTable_t own;
+    playerID_t playerID;            // unique ID, given by the roster
     int playerXLocation;            // player location x value
     int playerYLocation;            // player location y value
     int numGold;                    // player wallet
-    grid_t* visibleMap;             // player's visible map
-    grid_t* visibleGold;            // player's visible gold
+    addr_t playerAddress;           // player address
+    bool active;                    // player address is valid
 } player_t;
 
+/**************** local functions ****************/
+static void player_useOwnTable(player_t* player);
+static void player_place(playerTable_t* table, int slot, int x, int y);
+
 /**************** functions ****************/
 
 /* create and delete */
@@ -44,11 +52,17 @@ player_t* player_new() {
         return NULL;
     }
 
-    // give player a unique ID
-    player->playerID = nextPlayer;
-    nextPlayer += 1;
-    // start player purse with 0
+    // no ID until added to a roster; start player purse with 0
+    player->playerID = 0;
     player->numGold = 0;
+    player->playerXLocation = 0;
+    player->playerYLocation = 0;
+    player->playerAddress = message_noAddr();
+    player->active = false;
+    player->playerName = NULL;
+    player->visibleMap = NULL;
+    player->visibleGold = NULL;
+    player_useOwnTable(player);
 
     return player;
 
@@ -63,12 +77,77 @@ void player_delete(player_t* player) {
     free(player);
 }
 
+/**************** player_copy ****************/
+/* see player.h for description */
+player_t* player_copy(player_t* player) {
+
+    player_t* copy = malloc(sizeof(player_t));
+    if (copy == NULL) return NULL;
+
+    *copy = *player;
+    // same ID, address, location, and purse, in a table of its own
+    copy->playerID = player_getID(player);
+    copy->playerXLocation = player_getXLocation(player);
+    copy->playerYLocation = player_getYLocation(player);
+    copy->numGold = player_getGold(player);
+    copy->playerAddress = player_getAddr(player);
+    copy->active = player->table->active[player->slot];
+    player_useOwnTable(copy);
+    copy->playerName = malloc(strlen(player->playerName) + 1);
+    copy->visibleMap = grid_new(grid_nrows(player->visibleMap), grid_ncols(player->visibleMap));
+    copy->visibleGold = grid_new(grid_nrows(player->visibleGold), grid_ncols(player->visibleGold));
+    if (copy->playerName == NULL || copy->visibleMap == NULL || copy->visibleGold == NULL) {
+        free(copy->playerName);
+        grid_delete(copy->visibleMap);
+        grid_delete(copy->visibleGold);
+        free(copy);
+        return NULL;
+    }
+    strcpy(copy->playerName, player->playerName);
+    grid_copy(player->visibleMap, copy->visibleMap);
+    grid_copy(player->visibleGold, copy->visibleGold);
+    return copy;
+
+}
+
+/**************** player_moveToTable ****************/
+/* see player.h for description */
+void player_moveToTable(player_t* player, playerTable_t* table, int slot) {
+    table->id[slot] = player_getID(player);
+    table->x[slot] = player_getXLocation(player);
+    table->y[slot] = player_getYLocation(player);
+    const int x = table->x[slot], y = table->y[slot];
+    if (table->slotAt != NULL && x >= 0 && x < table->ncols && y >= 0 && y < table->nrows) {
+        table->slotAt[y * table->ncols + x] = slot;
+        table->below[slot] = -1;
+    }
+    table->gold[slot] = player_getGold(player);
+    table->address[slot] = player_getAddr(player);
+    table->active[slot] = player->table->active[player->slot];
+    player->table = table;
+    player->slot = slot;
+}
+
+/**************** player_useOwnTable ****************/
+/* Points the player at its own one-slot table.
+ */
+static void player_useOwnTable(player_t* player) {
+    player->own = (playerTable_t) {
+        &player->playerID, &player->playerXLocation, &player->playerYLocation,
+        &player->numGold, &player->playerAddress, &player->active,
+        NULL, NULL, 0, 0    // no index by location
+    };
+    player->table = &player->own;
+    player->slot = 0;
+}
+
 /* setters */
 
 /**************** player_setAddress ****************/
 /* see player.h for description */
 void player_setAddress(player_t* player, addr_t address) {
-    player->playerAddress = address;
+    player->table->address[player->slot] = address;
+    player->table->active[player->slot] = message_isAddr(address);
 }
 
 /**************** player_setName ****************/
@@ -81,8 +160,7 @@ void player_setName(player_t* player, char* name) {
 /* see player.h for description */
 void player_initializeGridAndLocation(player_t* player, grid_t* visibleGrid, grid_t* goldMap, int locationX, int locationY) {
     player->visibleMap = visibleGrid;
-    player->playerXLocation = locationX;
-    player->playerYLocation = locationY;
+    player_setLocation(player, locationX, locationY);
 
     grid_t* visibleGold = grid_new(grid_nrows(goldMap), grid_ncols(goldMap));
     grid_overlay(visibleGold, goldMap, visibleGrid, visibleGold);
@@ -91,45 +169,90 @@ void player_initializeGridAndLocation(player_t* player, grid_t* visibleGrid, gri
 
 /* update functions */
 
+/**************** player_setLocation ****************/
+/* see player.h for description */
+void player_setLocation(player_t* player, int locationX, int locationY) {
+    player_place(player->table, player->slot, locationX, locationY);
+}
+
 /**************** player_moveUpAndDown ****************/
 /* see player.h for description */
 void player_moveUpAndDown(player_t* player, int steps, char resetMapSpot) {
-    grid_set(player->visibleMap, player->playerYLocation, player->playerXLocation, resetMapSpot);
-    player->playerYLocation += steps;
-    grid_set(player->visibleMap, player->playerYLocation, player->playerXLocation, GRID_PLAYER_ME);
+    const int y = player->table->y[player->slot];
+    const int x = player->table->x[player->slot];
+    grid_set(player->visibleMap, y, x, resetMapSpot);
+    player_place(player->table, player->slot, x, y + steps);
+    grid_set(player->visibleMap, y + steps, x, GRID_PLAYER_ME);
 }
 /**************** player_moveLeftAndRight ****************/
 /* see player.h for description */
 void player_moveLeftAndRight(player_t* player, int steps, char resetMapSpot) {
-    grid_set(player->visibleMap, player->playerYLocation, player->playerXLocation, resetMapSpot);
-    player->playerXLocation += steps;
-    grid_set(player->visibleMap, player->playerYLocation, player->playerXLocation, GRID_PLAYER_ME);
+    const int x = player->table->x[player->slot];
+    const int y = player->table->y[player->slot];
+    grid_set(player->visibleMap, y, x, resetMapSpot);
+    player_place(player->table, player->slot, x + steps, y);
+    grid_set(player->visibleMap, y, x + steps, GRID_PLAYER_ME);
 }
+/**************** player_place ****************/
+/* Moves the player in the given slot of the table to x,y, keeping the
+ * table's index by location, if any, up to date. Two players share a spot
+ * only partway through a move (a swap, or a diagonal step through an
+ * occupied spot), so the spot names the one who arrived last, and remembers
+ * who was there before; leaving gives the spot back to that player if they
+ * are still on it, and a spot another has since taken is left alone.
+ */
+static void player_place(playerTable_t* table, int slot, int x, int y) {
+    if (table->slotAt != NULL) {
+        const int oldX = table->x[slot], oldY = table->y[slot];
+        if (oldX >= 0 && oldX < table->ncols && oldY >= 0 && oldY < table->nrows) {
+            int* spot = &table->slotAt[oldY * table->ncols + oldX];
+            const int under = table->below[slot];
+            if (*spot == slot) {
+                *spot = (under >= 0 && table->x[under] == oldX && table->y[under] == oldY) ? under : -1;
+            }
+        }
+        table->below[slot] = -1;
+        if (x >= 0 && x < table->ncols && y >= 0 && y < table->nrows) {
+            int* spot = &table->slotAt[y * table->ncols + x];
+            table->below[slot] = *spot;
+            *spot = slot;
+        }
+    }
+    table->x[slot] = x;
+    table->y[slot] = y;
+}
+
 /**************** player_foundGoldNuggets ****************/
 /* see player.h for description */
 void player_foundGoldNuggets(player_t* player, int foundGold) {
-    player->numGold += foundGold;
+    player->table->gold[player->slot] += foundGold;
 }
 
 /**************** player_updateVisibility ****************/
 /* see player.h for description */
 void player_updateVisibility(player_t* player, grid_t* fullMap, grid_t* goldMap) {
+    TRACE_SCOPE("player_updateVisibility");
+    grid_t* updatedVisible = grid_new(grid_nrows(fullMap), grid_ncols(fullMap));
+    grid_visible(fullMap, player_getYLocation(player), player_getXLocation(player), updatedVisible);
+    player_mergeVisibility(player, updatedVisible, fullMap, goldMap);
+    grid_delete(updatedVisible);
+}
+
+/**************** player_mergeVisibility ****************/
+/* see player.h for description */
+void player_mergeVisibility(player_t* player, grid_t* updatedVisible, grid_t* fullMap, grid_t* goldMap) {
     // grid_overlay(const grid_t* base, const grid_t* overlay, const grid_t* mask, grid_t* out)
     // base: player->visibleMap
     // overlay: grid_visible()
     // mask: fullMap
     // out: player->visibleMap
-    grid_t* updatedVisible = grid_new(grid_nrows(fullMap), grid_ncols(fullMap));
-    grid_visible(fullMap, player->playerYLocation, player->playerXLocation, updatedVisible);
-    grid_set(updatedVisible, player->playerYLocation, player->playerXLocation, GRID_PLAYER_ME);
+    grid_set(updatedVisible, player_getYLocation(player), player_getXLocation(player), GRID_PLAYER_ME);
     grid_overlay(player->visibleMap, updatedVisible, fullMap, player->visibleMap);
 
     grid_t* visibleGold = grid_new(grid_nrows(fullMap), grid_ncols(fullMap));
     grid_overlay(visibleGold, goldMap, updatedVisible, visibleGold);
     grid_delete(player->visibleGold);
     player->visibleGold = visibleGold;
-    
-    grid_delete(updatedVisible);
 }
 
 /* getter functions */
@@ -137,13 +260,25 @@ void player_updateVisibility(player_t* player, grid_t* fullMap, grid_t* goldMap)
 /**************** player_getAddr ****************/
 /* see player.h for description */
 addr_t player_getAddr(player_t* player) {
-    return player->playerAddress;
+    return player->table->address[player->slot];
 }
 
 /**************** player_getID ****************/
 /* see player.h for description */
-char player_getID(player_t* player) {
-    return player->playerID;
+playerID_t player_getID(player_t* player) {
+    return player->table->id[player->slot];
+}
+
+/**************** player_getGlyph ****************/
+/* see player.h for description */
+char player_getGlyph(player_t* player) {
+    return player_glyph(player->table->id[player->slot]);
+}
+
+/**************** player_glyph ****************/
+/* see player.h for description */
+char player_glyph(playerID_t playerID) {
+    return 'A' + playerID % 26;
 }
 
 /**************** player_getName ****************/
@@ -155,13 +290,13 @@ char* player_getName(player_t* player) {
 /**************** player_getXLocation ****************/
 /* see player.h for description */
 int player_getXLocation(player_t* player) {
-    return player->playerXLocation;
+    return player->table->x[player->slot];
 }
 
 /**************** player_getYLocation ****************/
 /* see player.h for description */
 int player_getYLocation(player_t* player) {
-    return player->playerYLocation;
+    return player->table->y[player->slot];
 }
 
 /**************** player_getMap ****************/
@@ -179,6 +314,6 @@ grid_t* player_getVisibleGold(player_t* player) {
 /**************** player_getGold ****************/
 /* see player.h for description */
 int player_getGold(player_t* player) {
-    return player->numGold;
+    return player->table->gold[player->slot];
 }
 
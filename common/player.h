@@ -14,6 +14,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include "../support/message.h"
 #include "grid.h"
 #include "game.h"
@@ -21,12 +22,50 @@
 /**************** global types ****************/
 typedef struct player player_t;
 
+/* Players are numbered 0, 1, 2...; on the maps, and to clients, each is shown
+ * by the letter for its number: 'A' for 0 through 'Z' for 25, then 'A' again
+ * for 26, and so on. A game of at most 26 players (the usual) thus shows each
+ * by its own letter; a larger one shows several by the same letter.
+ *
+ * LIMITATION: the protocol names a player only by that letter (in OK, in
+ * GOLDSTEAL, on the DISPLAY map, and in the game-over summary), so in a game
+ * of more than 26 players, clients and spectators cannot tell apart the
+ * players who share a letter. The server keeps them apart by ID and address;
+ * more than 26 players is for load testing, not for play, until the protocol
+ * carries more than a letter.
+ */
+typedef uint16_t playerID_t;
+#define PLAYER_NUM_IDS (UINT16_MAX + 1)  // number of distinct player IDs
+
+/* The fields read for every player on every update - ID, location, purse,
+ * address - are kept apart from the rest of the player, in parallel arrays
+ * with one entry (slot) per player, so loops over all the players read them
+ * in order instead of following a pointer to each player. A roster keeps one
+ * such table for its players (see roster.c); a player not in a roster, or a
+ * copy, keeps a one-slot table of its own. The getters read the table.
+ */
+typedef struct playerTable {
+    playerID_t* id;                 // playerID
+    int* x;                         // column
+    int* y;                         // row
+    int* gold;                      // purse
+    addr_t* address;
+    bool* active;                   // address is valid: joined and not quit
+
+    // in a roster's table that knows the map's size, an index by location,
+    // kept up to date wherever x and y are set; otherwise NULL
+    int* slotAt;                    // [nrows*ncols]: slot of the player at each spot, or -1
+    int* below;                     // [slot]: who was already on the slot's spot, or -1
+    int nrows, ncols;
+} playerTable_t;
+
 /**************** functions ****************/
 
 /* create and delete */
 
 /**************** player_new ****************/
-/* Mallocs space for a new player, creates unique ID for player, initialize other info.
+/* Mallocs space for a new player, initialize other info.
+ * The player has ID 0 until roster_addPlayer gives it one.
  * 
  * Caller provides: nothing
  * Returns: new player struct
@@ -41,6 +80,25 @@ player_t* player_new();
  */
 void player_delete(player_t* player);
 
+/**************** player_copy ****************/
+/* Makes an independent copy of the player: same ID, name, address, location,
+ * purse, and its own copies of the visible map and visible gold.
+ * Does not use up a new player ID.
+ *
+ * Caller provides: player
+ * Returns: new player struct (to be player_delete'd), or NULL upon failure.
+ */
+player_t* player_copy(player_t* player);
+
+/**************** player_moveToTable ****************/
+/* Moves the player's ID, location, purse and address into the given slot
+ * of the given table, where its getters and setters find them from now on.
+ *
+ * Caller provides: player; table whose arrays have room for slot, and which
+ *   outlives the player (the table's arrays may be reallocated meanwhile).
+ */
+void player_moveToTable(player_t* player, playerTable_t* table, int slot);
+
 /* setters */
 
 /**************** player_setAddress ****************/
@@ -60,6 +118,11 @@ void player_initializeGridAndLocation(player_t* player, grid_t* visibleGrid, gri
 
 /* update functions */
 
+/**************** player_setLocation ****************/
+/* Moves player to the given column (x) and row (y), without touching its maps.
+ */
+void player_setLocation(player_t* player, int locationX, int locationY);
+
 /**************** player_moveUpAndDown ****************/
 /* Changes playerYlocation. If steps is negative, player moves up.
  */
@@ -77,6 +140,11 @@ void player_foundGoldNuggets(player_t* player, int numGold);
  * Adds visible map to the player's map, updates from server and server gold.
  */
 void player_updateVisibility(player_t* player, grid_t* fullMap, grid_t* goldMap);
+/**************** player_mergeVisibility ****************/
+/* Like player_updateVisibility, but given the grid visible from the player's
+ * location already computed (e.g., by grid_visibleBatch). Marks the player in that grid.
+ */
+void player_mergeVisibility(player_t* player, grid_t* updatedVisible, grid_t* fullMap, grid_t* goldMap);
 
 /* getter functions */
 
@@ -86,7 +154,15 @@ addr_t player_getAddr(player_t* player);
 
 /**************** player_getID ****************/
 /* Returns player ID. */
-char player_getID(player_t* player);
+playerID_t player_getID(player_t* player);
+
+/**************** player_getGlyph ****************/
+/* Returns the letter that shows the player on maps and to clients. */
+char player_getGlyph(player_t* player);
+
+/**************** player_glyph ****************/
+/* Returns the letter that shows the player with the given ID. */
+char player_glyph(playerID_t playerID);
 
 /**************** player_getName ****************/
 /* Returns player name. */
@@ -0,0 +1,340 @@
+/*
+ * pool.c - Nuggets 'pool' module
+ *
+ * See pool.h for more information.
+ *
+ * Each worker owns a deque of jobs, protected by its own lock. The owner
+ * takes jobs from the back of its deque; other workers steal from the front,
+ * and a thread in pool_wait takes the oldest job of its own batch. Submissions
+ * are dealt round-robin across the deques. A pool-wide lock guards only
+ * sleeping and waking.
+ *
+ * Selena Zhou, Kyla Widodo, 23S
+ */
+
+#define _GNU_SOURCE             // for sysconf(_SC_NPROCESSORS_ONLN)
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "pool.h"
+
+/**************** file-local global variables ****************/
+
+static const int InitialDequeSize = 32;     // jobs per deque before growing
+
+/**************** local types ****************/
+
+typedef struct job {
+    void (*run)(void* arg);         // function to call
+    void* arg;                      // its argument
+    poolBatch_t* batch;             // whose job it is
+} job_t;
+
+typedef struct deque {
+    pthread_mutex_t lock;
+    job_t* jobs;                    // ring buffer of jobs
+    int capacity;                   // size of ring buffer
+    int front;                      // index of oldest job
+    int count;                      // number of jobs queued
+} deque_t;
+
+typedef struct worker {
+    pool_t* pool;
+    int index;                      // which deque is ours
+    pthread_t thread;
+} worker_t;
+
+/**************** global types ****************/
+
+typedef struct pool {
+    int numWorkers;
+    worker_t* workers;              // [numWorkers]
+    deque_t* deques;                // [numWorkers], or one if no workers
+    int numDeques;
+    atomic_int nextDeque;           // round-robin submission
+    atomic_int queued;              // jobs sitting in deques
+    atomic_int pending;             // jobs submitted but not yet finished
+    bool shutdown;                  // protected by lock
+    pthread_mutex_t lock;           // for sleeping and waking
+    pthread_cond_t workReady;       // signaled when a job is queued
+    pthread_cond_t allDone;         // signaled when pending, or a batch's, reaches zero
+} pool_t;
+
+/**************** file local helper functions ****************/
+/* opaque to those outside of the file*/
+
+/**************** deque_pushBack ****************/
+/* Adds a job at the back of the deque, growing it if needed.
+ * Returns: true if added, false upon memory failure.
+ */
+static bool deque_pushBack(deque_t* deque, job_t job) {
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count == deque->capacity) {
+        int newCapacity = (deque->capacity > 0) ? deque->capacity * 2 : InitialDequeSize;
+        job_t* jobs = malloc(newCapacity * sizeof(job_t));
+        if (jobs == NULL) {
+            pthread_mutex_unlock(&deque->lock);
+            return false;
+        }
+        for (int i = 0; i < deque->count; i++) {
+            jobs[i] = deque->jobs[(deque->front + i) % deque->capacity];
+        }
+        free(deque->jobs);
+        deque->jobs = jobs;
+        deque->capacity = newCapacity;
+        deque->front = 0;
+    }
+    deque->jobs[(deque->front + deque->count) % deque->capacity] = job;
+    deque->count++;
+    pthread_mutex_unlock(&deque->lock);
+    return true;
+}
+
+/**************** deque_take ****************/
+/* Removes a job from the back (owner) or the front (thief) of the deque.
+ * Returns: true and fills in *job if there was one, false if deque was empty.
+ */
+static bool deque_take(deque_t* deque, bool fromBack, job_t* job) {
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count == 0) {
+        pthread_mutex_unlock(&deque->lock);
+        return false;
+    }
+    if (fromBack) {
+        *job = deque->jobs[(deque->front + deque->count - 1) % deque->capacity];
+    } else {
+        *job = deque->jobs[deque->front];
+        deque->front = (deque->front + 1) % deque->capacity;
+    }
+    deque->count--;
+    pthread_mutex_unlock(&deque->lock);
+    return true;
+}
+
+/**************** deque_takeBatch ****************/
+/* Removes the oldest job of the given batch from the deque.
+ * Returns: true and fills in *job if there was one, false if not.
+ */
+static bool deque_takeBatch(deque_t* deque, const poolBatch_t* batch, job_t* job) {
+    pthread_mutex_lock(&deque->lock);
+    for (int i = 0; i < deque->count; i++) {
+        if (deque->jobs[(deque->front + i) % deque->capacity].batch == batch) {
+            *job = deque->jobs[(deque->front + i) % deque->capacity];
+            // close the gap, keeping the rest in order
+            for (int j = i; j < deque->count - 1; j++) {
+                deque->jobs[(deque->front + j) % deque->capacity] =
+                    deque->jobs[(deque->front + j + 1) % deque->capacity];
+            }
+            deque->count--;
+            pthread_mutex_unlock(&deque->lock);
+            return true;
+        }
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return false;
+}
+
+/**************** pool_takeJob ****************/
+/* Finds a job: first from our own deque (if home >= 0), then by stealing
+ * from the others, starting just after home.
+ * Returns: true and fills in *job if found, false if all deques were empty.
+ */
+static bool pool_takeJob(pool_t* pool, int home, job_t* job) {
+    if (home >= 0 && deque_take(&pool->deques[home], true, job)) {
+        atomic_fetch_sub(&pool->queued, 1);
+        return true;
+    }
+    for (int i = 1; i <= pool->numDeques; i++) {
+        int victim = ((home < 0 ? 0 : home) + i) % pool->numDeques;
+        if (victim != home && deque_take(&pool->deques[victim], false, job)) {
+            atomic_fetch_sub(&pool->queued, 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**************** pool_takeBatchJob ****************/
+/* Finds a queued job of the given batch, in any deque.
+ * Returns: true and fills in *job if found, false if none is queued.
+ */
+static bool pool_takeBatchJob(pool_t* pool, const poolBatch_t* batch, job_t* job) {
+    for (int i = 0; i < pool->numDeques; i++) {
+        if (deque_takeBatch(&pool->deques[i], batch, job)) {
+            atomic_fetch_sub(&pool->queued, 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**************** pool_runJob ****************/
+/* Runs a job, and wakes the waiters if it was the last one pending in its
+ * batch, or in the pool. The batch is not touched once its count is down.
+ */
+static void pool_runJob(pool_t* pool, job_t job) {
+    job.run(job.arg);
+    bool batchDone = (atomic_fetch_sub(&job.batch->pending, 1) == 1);
+    bool allDone = (atomic_fetch_sub(&pool->pending, 1) == 1);
+    if (batchDone || allDone) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_broadcast(&pool->allDone);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+/**************** pool_workerMain ****************/
+/* Thread body for each worker: run jobs until the pool shuts down.
+ */
+static void* pool_workerMain(void* arg) {
+    worker_t* worker = arg;
+    pool_t* pool = worker->pool;
+    job_t job;
+
+    while (true) {
+        if (pool_takeJob(pool, worker->index, &job)) {
+            pool_runJob(pool, job);
+            continue;
+        }
+        // nothing to do; sleep until a job is queued or we are told to stop
+        pthread_mutex_lock(&pool->lock);
+        while (atomic_load(&pool->queued) == 0 && !pool->shutdown) {
+            pthread_cond_wait(&pool->workReady, &pool->lock);
+        }
+        bool stop = pool->shutdown && atomic_load(&pool->queued) == 0;
+        pthread_mutex_unlock(&pool->lock);
+        if (stop) {
+            return NULL;
+        }
+    }
+}
+
+/**************** functions ****************/
+
+/**************** pool_new ****************/
+/* see pool.h for description */
+pool_t* pool_new(int numWorkers) {
+
+    if (numWorkers <= 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        numWorkers = (cores > 1) ? (int) cores - 1 : 0;
+    }
+
+    pool_t* pool = malloc(sizeof(pool_t));
+    if (pool == NULL) return NULL;
+
+    // with no workers, the waiting thread still needs somewhere to find jobs
+    pool->numDeques = (numWorkers > 0) ? numWorkers : 1;
+    pool->deques = calloc(pool->numDeques, sizeof(deque_t));
+    pool->workers = calloc(numWorkers > 0 ? numWorkers : 1, sizeof(worker_t));
+    if (pool->deques == NULL || pool->workers == NULL) {
+        free(pool->deques); free(pool->workers); free(pool);
+        return NULL;
+    }
+    for (int i = 0; i < pool->numDeques; i++) {
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+        pool->deques[i].jobs = malloc(InitialDequeSize * sizeof(job_t));
+        pool->deques[i].capacity = (pool->deques[i].jobs != NULL) ? InitialDequeSize : 0;
+    }
+
+    atomic_init(&pool->nextDeque, 0);
+    atomic_init(&pool->queued, 0);
+    atomic_init(&pool->pending, 0);
+    pool->shutdown = false;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->workReady, NULL);
+    pthread_cond_init(&pool->allDone, NULL);
+
+    // start the workers; if some fail to start, run with those that did
+    pool->numWorkers = 0;
+    for (int i = 0; i < numWorkers; i++) {
+        worker_t* worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->index = i;
+        if (pthread_create(&worker->thread, NULL, pool_workerMain, worker) != 0) {
+            break;
+        }
+        pool->numWorkers++;
+    }
+
+    return pool;
+}
+
+/**************** pool_submit ****************/
+/* see pool.h for description */
+bool pool_submit(pool_t* pool, poolBatch_t* batch, void (*job)(void* arg), void* arg) {
+    if (pool == NULL || batch == NULL || job == NULL) return false;
+
+    job_t newJob = { job, arg, batch };
+    int target = atomic_fetch_add(&pool->nextDeque, 1) % pool->numDeques;
+    if (target < 0) target += pool->numDeques;
+    atomic_fetch_add(&batch->pending, 1);
+    atomic_fetch_add(&pool->pending, 1);
+    if (!deque_pushBack(&pool->deques[target], newJob)) {
+        atomic_fetch_sub(&pool->pending, 1);
+        atomic_fetch_sub(&batch->pending, 1);
+        return false;
+    }
+    atomic_fetch_add(&pool->queued, 1);
+
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_signal(&pool->workReady);
+    pthread_mutex_unlock(&pool->lock);
+    return true;
+}
+
+/**************** pool_wait ****************/
+/* see pool.h for description */
+void pool_wait(pool_t* pool, poolBatch_t* batch) {
+    if (pool == NULL) return;
+
+    // help out until there is nothing left to take
+    job_t job;
+    while (batch != NULL ? pool_takeBatchJob(pool, batch, &job) : pool_takeJob(pool, -1, &job)) {
+        pool_runJob(pool, job);
+    }
+
+    // then wait for the jobs still running on workers
+    atomic_int* pending = (batch != NULL) ? &batch->pending : &pool->pending;
+    pthread_mutex_lock(&pool->lock);
+    while (atomic_load(pending) > 0) {
+        pthread_cond_wait(&pool->allDone, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/**************** pool_numWorkers ****************/
+/* see pool.h for description */
+int pool_numWorkers(pool_t* pool) {
+    return (pool == NULL) ? 0 : pool->numWorkers;
+}
+
+/**************** pool_delete ****************/
+/* see pool.h for description */
+void pool_delete(pool_t* pool) {
+    if (pool == NULL) return;
+
+    pool_wait(pool, NULL);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->workReady);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->numWorkers; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+
+    for (int i = 0; i < pool->numDeques; i++) {
+        pthread_mutex_destroy(&pool->deques[i].lock);
+        free(pool->deques[i].jobs);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->workReady);
+    pthread_cond_destroy(&pool->allDone);
+    free(pool->deques);
+    free(pool->workers);
+    free(pool);
+}
@@ -0,0 +1,77 @@
+/*
+ * pool.h - header file for Nuggets 'pool' module
+ *
+ * A 'pool' is a fixed set of worker threads that run jobs submitted by the
+ * server thread. Each worker keeps its own queue of jobs; a worker whose queue
+ * is empty steals the oldest job from another worker's queue, so uneven jobs
+ * still keep every core busy. The submitting thread helps run its jobs while
+ * it waits for them to finish; several threads may submit and wait at once.
+ *
+ * Selena Zhou, Kyla Widodo, 23S
+ */
+
+#ifndef __POOL_H
+#define __POOL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+/**************** global types ****************/
+typedef struct pool pool_t;
+
+/* A batch: the jobs one caller submits and then waits for. Several threads
+ * may share a pool, each with its own batches; a caller waits only for its
+ * own batch. The caller keeps the batch (e.g., on its stack) until pool_wait
+ * returns; start each with POOL_BATCH_INIT.
+ */
+typedef struct poolBatch {
+    atomic_int pending;             // jobs submitted but not yet finished
+} poolBatch_t;
+#define POOL_BATCH_INIT { 0 }
+
+/**************** functions ****************/
+
+/**************** pool_new ****************/
+/* Starts a new pool of worker threads.
+ *
+ * Caller provides: number of worker threads, or 0 for one fewer than the
+ *   number of online cores (the waiting thread makes up the last core).
+ * Returns: new pool, or NULL upon failure.
+ * Note: a pool with no workers is valid; pool_wait then runs every job itself.
+ */
+pool_t* pool_new(int numWorkers);
+
+/**************** pool_submit ****************/
+/* Queues job(arg), as part of the batch, to be run by some thread of the pool.
+ * Jobs may run in any order, and concurrently with each other.
+ *
+ * Caller provides: valid pool, the caller's batch, job function, argument
+ *   passed through to job.
+ * Returns: true if queued, false upon failure.
+ */
+bool pool_submit(pool_t* pool, poolBatch_t* batch, void (*job)(void* arg), void* arg);
+
+/**************** pool_wait ****************/
+/* Runs the batch's queued jobs on the calling thread, then waits until every
+ * job of the batch has finished; jobs of other batches, which other threads
+ * wait for, are left to them and the workers. Results written by the jobs
+ * are visible to the caller when this returns.
+ *
+ * Caller provides: valid pool, and the batch, or NULL to wait for every job
+ *   submitted so far.
+ */
+void pool_wait(pool_t* pool, poolBatch_t* batch);
+
+/**************** pool_numWorkers ****************/
+/* Returns number of worker threads in pool (not counting the waiting thread).
+ */
+int pool_numWorkers(pool_t* pool);
+
+/**************** pool_delete ****************/
+/* Waits for all jobs to finish, stops the workers, and frees the pool.
+ */
+void pool_delete(pool_t* pool);
+
+#endif // __POOL_H
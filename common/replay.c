@@ -0,0 +1,288 @@
+/*
+ * replay.c - headless, deterministic replay of a Nuggets game
+ *
+ * usage: ./replay [--players N] [--radius R] mapFile seed traceFile
+ *        ./replay --journal journalFile [mapFile]
+ *        ./replay --synth numPlayers numKeys seed
+ *
+ * The first form creates the game with the given seed, exactly as the server
+ * does, and feeds every event of the trace file straight into game_addPlayer,
+ * game_addSpectator and game_keyPress, with no sockets and no threads beyond
+ * the game's own. It stops at the end of the trace, or when the
+ * game ends. It then reports moves per second, messages and bytes sent per move,
+ * and a hash of everything sent, so that a change to the game logic can be
+ * timed, and checked for unchanged behavior, without any networking noise.
+ * --players and --radius set the game's limits as the server's options do.
+ *
+ * A trace file has one event per line: a client number (0-9999), a space, and
+ * the message that client sends, e.g.,
+ *     1 PLAY alice
+ *     0 SPECTATE
+ *     1 KEY h
+ * Each client number stands for its own synthetic address. Blank lines, and
+ * lines starting with '#', are ignored.
+ *
+ * The second form replays a journal written by the server's --journal option
+ * (see journal.h) the same way: the game gets the map, seed and limits the
+ * server's had (the map file may be named, if it has moved), every message
+ * in order, and at each checkpoint in the journal its state hash is checked
+ * against the server's. It reports as above, and how many checkpoints were
+ * verified; on the first that differs, it says when, and exits 4.
+ *
+ * The third form prints a random trace, determined by the seed, in which
+ * numPlayers players join and then press numKeys movement keys among them.
+ *
+ * message_send is replaced (by linking with -Wl,--wrap=message_send; see
+ * Makefile) by a stub that only counts and hashes what would have been sent.
+ *
+ * Selena Zhou, Kyla Widodo, 23S
+ */
+
+#define _POSIX_C_SOURCE 200809L     // for clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "game.h"
+#include "grid.h"
+#include "journal.h"
+#include "pool.h"
+#include "../support/message.h"
+
+/**************** file-local global variables ****************/
+
+static const int MaxClients = 10000;        // client numbers 0..MaxClients-1
+static const int BasePort = 10000;          // client n is 127.0.0.1:(BasePort+n)
+static const char MoveKeys[] = "hjklyubnHJKLYUBN";
+
+static unsigned long messagesOut = 0;       // counted by the message_send stub
+static unsigned long bytesOut = 0;
+static uint64_t outputHash = 14695981039346656037ULL;   // FNV-1a of everything sent
+static unsigned long moves = 0;             // keystrokes played
+static uint64_t moveTime = 0;               // ns spent in game_keyPress
+
+/**************** message_send stub ****************/
+/* Replaces message_send for the whole program: counts and hashes the message,
+ * with its destination, instead of sending it. The game calls this from one
+ * thread at a time.
+ */
+void __wrap_message_send(const addr_t to, const char* message) {
+    if (message == NULL) return;
+    const char* dest = message_stringAddr(to);
+    for (const char* p = dest; *p != '\0'; p++) {
+        outputHash = (outputHash ^ (unsigned char) *p) * 1099511628211ULL;
+    }
+    size_t len = strlen(message);
+    for (size_t i = 0; i < len; i++) {
+        outputHash = (outputHash ^ (unsigned char) message[i]) * 1099511628211ULL;
+    }
+    messagesOut++;
+    bytesOut += len;
+}
+
+/**************** helper functions ****************/
+
+/**************** now ****************/
+/* Returns a monotonic timestamp in nanoseconds.
+ */
+static uint64_t now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+/**************** clientAddr ****************/
+/* Returns the synthetic address of the given client number.
+ */
+static addr_t clientAddr(int client) {
+    char port[12];
+    addr_t addr = message_noAddr();
+    sprintf(port, "%d", BasePort + client);
+    message_setAddr("127.0.0.1", port, &addr);
+    return addr;
+}
+
+/**************** synthesize ****************/
+/* Prints a random trace: numPlayers join, then press numKeys keys.
+ */
+static void synthesize(int numPlayers, int numKeys) {
+    printf("# %d players, %d keys\n", numPlayers, numKeys);
+    for (int p = 1; p <= numPlayers; p++) {
+        printf("%d PLAY player%d\n", p, p);
+    }
+    for (int k = 0; k < numKeys; k++) {
+        printf("%d KEY %c\n", 1 + rand() % numPlayers, MoveKeys[rand() % (sizeof(MoveKeys) - 1)]);
+    }
+}
+
+/**************** playMessage ****************/
+/* Passes a message from the given address to the game, as the server's
+ * handleMessage does, timing and counting keystrokes.
+ * Returns: true if the game is over.
+ */
+static bool playMessage(game_t* game, addr_t from, const char* message) {
+    if (strncmp(message, "PLAY", strlen("PLAY")) == 0) {
+        game_addPlayer(game, from, message);
+    }
+    else if (strncmp(message, "SPECTATE", strlen("SPECTATE")) == 0) {
+        game_addSpectator(game, from);
+    }
+    else if (strncmp(message, "KEY", strlen("KEY")) == 0) {
+        uint64_t before = now();
+        bool gameOver = game_keyPress(game, from, message);
+        moveTime += now() - before;
+        moves++;
+        return gameOver;
+    }
+    else {
+        game_send(game, from, "ERROR Command not recognized.");
+    }
+    return false;
+}
+
+/**************** main ****************/
+int main(int argc, char* argv[]) {
+    int seed, numPlayers, numKeys;
+    int maxPlayers = 26, radius = 0;
+    const char* journalFile = NULL;
+
+    if (argc == 5 && strcmp(argv[1], "--synth") == 0) {
+        if (sscanf(argv[2], "%d", &numPlayers) != 1 || numPlayers < 1 || numPlayers >= MaxClients
+            || sscanf(argv[3], "%d", &numKeys) != 1 || numKeys < 0
+            || sscanf(argv[4], "%d", &seed) != 1) {
+            fprintf(stderr, "Error: bad numPlayers, numKeys or seed.\n");
+            exit(2);
+        }
+        srand(seed);
+        synthesize(numPlayers, numKeys);
+        return 0;
+    }
+    const char* program = argv[0];
+    while (argc >= 3 && (strcmp(argv[1], "--players") == 0 || strcmp(argv[1], "--radius") == 0)) {
+        int* limit = (argv[1][2] == 'p') ? &maxPlayers : &radius;
+        if (sscanf(argv[2], "%d", limit) != 1 || *limit < 0) {
+            fprintf(stderr, "Error: bad %s.\n", argv[1]);
+            exit(2);
+        }
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc >= 3 && strcmp(argv[1], "--journal") == 0) {
+        journalFile = argv[2];
+        argc -= 2;
+        argv += 2;
+    }
+    if (journalFile != NULL ? argc > 2 : argc != 4) {
+        fprintf(stderr, "usage: %s [--players N] [--radius R] mapFile seed traceFile\n", program);
+        fprintf(stderr, "       %s --journal journalFile [mapFile]\n", program);
+        fprintf(stderr, "       %s --synth numPlayers numKeys seed\n", program);
+        exit(1);
+    }
+
+    // the game's map, seed and limits come from the journal, or the command line
+    const char* mapFile;
+    unsigned long gameSeed;
+    FILE* trace = NULL;
+    journalReader_t* reader = NULL;
+    if (journalFile != NULL) {
+        journalHeader_t header;
+        reader = journal_openReader(journalFile, &header);
+        if (reader == NULL) {
+            fprintf(stderr, "Error: unable to read journal '%s'.\n", journalFile);
+            exit(2);
+        }
+        mapFile = (argc == 2) ? argv[1] : header.mapFile;
+        gameSeed = header.seed;
+        maxPlayers = header.maxPlayers;
+        radius = header.radius;
+    } else {
+        if (sscanf(argv[2], "%d", &seed) != 1) {
+            fprintf(stderr, "Error: seed must be an integer.\n");
+            exit(2);
+        }
+        trace = fopen(argv[3], "r");
+        if (trace == NULL) {
+            fprintf(stderr, "Error: unable to open trace file '%s'.\n", argv[3]);
+            exit(2);
+        }
+        mapFile = argv[1];
+        gameSeed = seed;
+    }
+
+    // as the server does, then synthetic addresses for every client
+    game_t* game = game_new((char*) mapFile, gameSeed);
+    if (game == NULL || !game_setLimits(game, maxPlayers, radius)) {
+        fprintf(stderr, "Unable to create a game from map '%s' for %d players.\n", mapFile, maxPlayers);
+        exit(3);
+    }
+    pool_t* workers = pool_new(0);      // as the server does
+    game_setWorkers(game, workers);
+    addr_t* addrs = malloc(MaxClients * sizeof(addr_t));
+    for (int c = 0; c < MaxClients; c++) {
+        addrs[c] = clientAddr(c);
+    }
+
+    char line[message_MaxBytes < 1024 ? message_MaxBytes : 1024];
+    unsigned long events = 0, checkpoints = 0;
+    bool gameOver = false, diverged = false;
+    const uint64_t start = now();
+
+    if (trace != NULL) {
+        for (int lineNum = 1; !gameOver && fgets(line, sizeof(line), trace) != NULL; lineNum++) {
+            line[strcspn(line, "\n")] = '\0';
+            if (line[0] == '\0' || line[0] == '#') continue;
+
+            int client, offset;
+            if (sscanf(line, "%d %n", &client, &offset) != 1 || client < 0 || client >= MaxClients) {
+                fprintf(stderr, "%s:%d: bad client number; skipped\n", argv[3], lineNum);
+                continue;
+            }
+            events++;
+            gameOver = playMessage(game, addrs[client], line + offset);
+        }
+        fclose(trace);
+    } else {
+        // replay every message; at each checkpoint the game must be as it was
+        journalEvent_t event;
+        while (!diverged && journal_next(reader, &event)) {
+            if (event.type == journal_Checkpoint) {
+                uint64_t hash = game_hash(game);
+                if (hash != event.hash) {
+                    fprintf(stderr, "%s: after %lu messages (%.3f s in), the game hashes to %016llx, "
+                            "but the journal says %016llx\n", journalFile, event.events, event.micros / 1e6,
+                            (unsigned long long) hash, (unsigned long long) event.hash);
+                    diverged = true;
+                } else {
+                    checkpoints++;
+                }
+            } else if (event.client >= MaxClients) {
+                fprintf(stderr, "%s: too many clients; stopped at client %d\n", journalFile, event.client);
+                break;
+            } else if (!gameOver) {
+                events++;
+                gameOver = playMessage(game, addrs[event.client], event.message);
+            }
+        }
+        journal_closeReader(reader);
+    }
+    const double seconds = (now() - start) / 1e9;
+
+    game_delete(game);
+    pool_delete(workers);
+    grid_freeRays();
+    free(addrs);
+
+    printf("events:          %lu%s\n", events, gameOver ? " (game over)" : "");
+    printf("moves:           %lu\n", moves);
+    printf("elapsed:         %.3f s (%.3f s in game_keyPress)\n", seconds, moveTime / 1e9);
+    printf("moves/sec:       %.1f\n", moveTime > 0 ? moves / (moveTime / 1e9) : 0.0);
+    printf("messages out:    %lu (%.2f per move)\n", messagesOut, moves > 0 ? (double) messagesOut / moves : 0.0);
+    printf("bytes out:       %lu (%.1f per move)\n", bytesOut, moves > 0 ? (double) bytesOut / moves : 0.0);
+    printf("output hash:     %016llx\n", (unsigned long long) outputHash);
+    if (journalFile != NULL) {
+        printf("checkpoints:     %lu verified%s\n", checkpoints, diverged ? ", then one failed" : "");
+    }
+    return diverged ? 4 : 0;
+}
@@ -3,6 +3,25 @@
  * 
  * See roster.h for more information.
  *
+ * Players are kept by slot, in the order they joined, and their hot fields
+ * (ID, location, purse, address, whether active) in a playerTable of
+ * parallel arrays indexed by slot (see player.h), so that the loops over all
+ * players below read memory in order. Loops run from the newest slot to the
+ * oldest, the order in which players have always been updated.
+ *
+ * A roster given an interest radius (see roster_setLimits) updates, after
+ * each change, only the players near where it happened: within the radius,
+ * by rows and by columns, of a place a player moved from or to or left the
+ * game. It finds them by comparing each player's location with where they
+ * were at the last update.
+ *
+ * Every KEY looks its sender up by address, and every move looks up who is
+ * in the way, so neither is a scan: addresses are hashed (open addressing,
+ * linear probing) to slots, and, once the roster knows the map's size (see
+ * roster_setMapSize), the table keeps the slot of the player at each spot
+ * (see player.c, which keeps it up to date wherever a location is set).
+ * Removing a player renumbers the slots after it, so rebuilds the hash.
+ *
  * Selena Zhou, Kyla Widodo, 23S
  */
 
@@ -10,92 +29,172 @@
 #include <stdlib.h>
 #include <string.h>
 #include "player.h"
-#include "set.h"
 #include "../support/message.h"
 #include "game.h"
+#include "pool.h"
+#include "roster.h"
+#include "stats.h"
+#include "../support/trace.h"
+
+/**************** file-local global variables ****************/
+
+static const int InitialCapacity = 32;     // slots allocated at first
+static const int DefaultMaxPlayers = 26;   // one letter each
 
 /**************** global types ****************/
 
 typedef struct roster {
-    set_t* players;         // key: playerID    value: player_t*
+    player_t** players;     // [capacity], by slot
+    playerTable_t table;    // [capacity] of each hot field, by slot
+    int numPlayers;         // slots in use
+    int capacity;           // slots allocated
+    int maxPlayers;         // IDs are 0...maxPlayers-1
+    int* slotOf;            // [maxPlayers]: slot of the player with each ID, or -1
+    int radius;             // interest radius; 0 to update everyone
+    int* lastX;             // [capacity]: location at last update; -1 if none
+    int* lastY;
+    grid_point_t* changed;  // places changed since last update, if radius > 0
+    int numChanged;
+    int changedCapacity;
+    pool_t* workers;        // threads for per-player display work, or NULL; not ours
+    int* addrSlot;          // [addrMask+1]: hash of addresses to slots, -1 if empty
+    int addrMask;           // table size - 1; the size is a power of two, > 2*capacity
 } roster_t;
 
-typedef struct findPlayerPack {
-    addr_t matchAddress;
-    char matchPlayerID;
-    player_t* foundPlayer;
-} findPlayerPack_t;
+typedef struct displayJob {
+    player_t* player;       // player whose display to build
+    grid_t* visible;        // grid visible from player's location
+    grid_t* fullMap;
+    grid_t* goldMap;
+    char* message;          // result: DISPLAY message to send
+} displayJob_t;
 
 /**************** file local helper functions ****************/
 /* opaque to those outside of the file*/
 
-/**************** roster_updateAllPlayers_Helper ****************/
-/* To be passed into set_iterate for roster_updateAllPlayers.
- * Given a player, tells them to update their visible map based on new server map,
- * then sends that player new DISPLAY message to update their display.
- */
-void roster_updateAllPlayers_Helper(void* arg, const char* key, void* item) {
-    game_t* game = arg;
-    player_t* currentPlayer = item;
-    player_updateVisibility(currentPlayer, game_returnFullMap(game), game_returnGoldMap(game));
+static unsigned int roster_hashAddr(addr_t address);
+static void roster_hashSlot(roster_t* roster, int slot);
+static void roster_rehash(roster_t* roster);
 
-    grid_t* visibleGrid = player_getMap(currentPlayer);
-    grid_t* visibleGold = player_getVisibleGold(currentPlayer);
-    grid_overlay(visibleGrid, visibleGold, visibleGrid, visibleGrid);
-    const char* gridString = grid_string(visibleGrid);
-    char* sendDisplayMsg = malloc(strlen("DISPLAY") + strlen(gridString) + 5);
-    sprintf(sendDisplayMsg, "DISPLAY\n%s", gridString);
-    message_send(player_getAddr(currentPlayer), sendDisplayMsg);
-    free(sendDisplayMsg);
+/**************** roster_grow ****************/
+/* Makes room for at least 'capacity' slots. Returns true if successful;
+ * upon failure the roster is unchanged but for any arrays already grown.
+ */
+static bool roster_grow(roster_t* roster, int capacity) {
+    if (capacity <= roster->capacity) return true;
+    playerTable_t* t = &roster->table;
+    player_t** players = realloc(roster->players, capacity * sizeof(player_t*));
+    if (players == NULL) return false;
+    roster->players = players;
+    playerID_t* id = realloc(t->id, capacity * sizeof(playerID_t));
+    if (id == NULL) return false;
+    t->id = id;
+    int* x = realloc(t->x, capacity * sizeof(int));
+    if (x == NULL) return false;
+    t->x = x;
+    int* y = realloc(t->y, capacity * sizeof(int));
+    if (y == NULL) return false;
+    t->y = y;
+    int* gold = realloc(t->gold, capacity * sizeof(int));
+    if (gold == NULL) return false;
+    t->gold = gold;
+    addr_t* address = realloc(t->address, capacity * sizeof(addr_t));
+    if (address == NULL) return false;
+    t->address = address;
+    bool* active = realloc(t->active, capacity * sizeof(bool));
+    if (active == NULL) return false;
+    t->active = active;
+    int* below = realloc(t->below, capacity * sizeof(int));
+    if (below == NULL) return false;
+    t->below = below;
+    int* lastX = realloc(roster->lastX, capacity * sizeof(int));
+    if (lastX == NULL) return false;
+    roster->lastX = lastX;
+    int* lastY = realloc(roster->lastY, capacity * sizeof(int));
+    if (lastY == NULL) return false;
+    roster->lastY = lastY;
+    int size = 1;
+    while (size <= 2 * capacity) {
+        size *= 2;
+    }
+    int* addrSlot = realloc(roster->addrSlot, size * sizeof(int));
+    if (addrSlot == NULL) return false;
+    roster->addrSlot = addrSlot;
+    roster->addrMask = size - 1;
+    roster->capacity = capacity;
+    roster_rehash(roster);
+    return true;
 }
 
-/**************** roster_updateAllPlayersGold_Helper ****************/
-/* To be passed into set_iterate for roster_updateAllPlayersGold.
- * Sends a GOLD update remaining gold message to given player.
+/**************** roster_hashAddr ****************/
+/* Hashes an address (host and port) for the roster's address table.
  */
-void roster_updateAllPlayersGold_Helper(void* arg, const char* key, void* item) {
-    game_t* game = arg;
-    player_t* currentPlayer = item;
-
-    char* sendGoldMsg = malloc(20);
-    sprintf(sendGoldMsg, "GOLD 0 %d %d", player_getGold(currentPlayer), game_returnRemainingGold(game));
-    message_send(player_getAddr(currentPlayer), sendGoldMsg);
-    free(sendGoldMsg);
+static unsigned int roster_hashAddr(addr_t address) {
+    uint64_t key = ((uint64_t) address.sin_addr.s_addr << 16) ^ address.sin_port;
+    return (unsigned int) ((key * 0x9E3779B97F4A7C15ULL) >> 32);
 }
 
-/**************** roster_createGameMessage_Helper ****************/
-/* To be passed into set_iterate for roster_createGameMessage.
- * Appends player name and purse to existing message.
+/**************** roster_hashSlot ****************/
+/* Enters the address of the player in 'slot' in the address table, after
+ * any entries already there for the same address, so lookups find the
+ * earliest slot first, as a scan would.
  */
-void roster_createGameMessage_Helper(void* arg, const char* key, void* item) {
-    player_t* player = item;
-    if (!message_isAddr(player_getAddr(player))) return; // If player exited before game over, don't print in summary
-
-    char** playerSummary = arg;
-    char* currentMsg = *playerSummary;
-    char* newMsg = malloc(strlen(currentMsg) + 70);
-
-    sprintf(newMsg, "%s\n%c %7d %s", currentMsg, player_getID(player), player_getGold(player), player_getName(player));
-    free(currentMsg);
+static void roster_hashSlot(roster_t* roster, int slot) {
+    unsigned int h = roster_hashAddr(roster->table.address[slot]) & roster->addrMask;
+    while (roster->addrSlot[h] >= 0) {
+        h = (h + 1) & roster->addrMask;
+    }
+    roster->addrSlot[h] = slot;
+}
 
-    *playerSummary = newMsg;
-    arg = playerSummary;
+/**************** roster_rehash ****************/
+/* Rebuilds the address table from the players' slots.
+ */
+static void roster_rehash(roster_t* roster) {
+    for (int h = 0; h <= roster->addrMask; h++) {
+        roster->addrSlot[h] = -1;
+    }
+    for (int slot = 0; slot < roster->numPlayers; slot++) {
+        roster_hashSlot(roster, slot);
+    }
 }
 
-/**************** roster_createGameMessage_sendHelper ****************/
-/* To be passed into set_iterate for roster_createGameMessage.
- * Sends GAME OVER message to given player.
+/**************** roster_noteChange ****************/
+/* Remembers that something changed at x,y, for roster_getInterested.
+ * Returns false if out of memory.
  */
-void roster_createGameMessage_sendHelper(void* arg, const char* key, void* item) {
-    char* message = arg;
-    player_t* player = item;
-    message_send(player_getAddr(player), message);
+static bool roster_noteChange(roster_t* roster, int x, int y) {
+    if (roster->numChanged == roster->changedCapacity) {
+        int capacity = roster->changedCapacity > 0 ? 2 * roster->changedCapacity : 16;
+        grid_point_t* changed = realloc(roster->changed, capacity * sizeof(grid_point_t));
+        if (changed == NULL) return false;
+        roster->changed = changed;
+        roster->changedCapacity = capacity;
+    }
+    roster->changed[roster->numChanged++] = (grid_point_t) { y, x };
+    return true;
 }
 
-/**************** roster_delete_helper ****************/
-void roster_delete_helper(void* item) {
-    player_t* currPlayer = item;
-    player_delete(currPlayer);
+/**************** roster_buildDisplay_Job ****************/
+/* To be passed into pool_submit for roster_updateAllPlayers.
+ * Given a player and the grid now visible to them, merges it into their visible map,
+ * overlays their visible gold, and builds the DISPLAY message to send them.
+ * Touches only this player's grids, so jobs for different players may run at once.
+ */
+void roster_buildDisplay_Job(void* arg) {
+    TRACE_SCOPE("roster_buildDisplay");
+    displayJob_t* job = arg;
+    player_t* currentPlayer = job->player;
+    player_mergeVisibility(currentPlayer, job->visible, job->fullMap, job->goldMap);
+
+    grid_t* visibleGrid = player_getMap(currentPlayer);
+    grid_t* visibleGold = player_getVisibleGold(currentPlayer);
+    grid_overlay(visibleGrid, visibleGold, visibleGrid, visibleGrid);
+    const char* gridString = grid_string(visibleGrid);
+    job->message = malloc(strlen("DISPLAY") + strlen(gridString) + 5);
+    if (job->message != NULL) {
+        sprintf(job->message, "DISPLAY\n%s", gridString);
+    }
 }
 
 /**************** functions ****************/
@@ -104,98 +203,348 @@ void roster_delete_helper(void* item) {
 /* see roster.h for description */
 roster_t* roster_new() {
 
-    roster_t* roster = malloc(sizeof(roster_t));
+    roster_t* roster = calloc(1, sizeof(roster_t));
     if (roster == NULL) return NULL;
 
-    roster->players = set_new();
+    if (!roster_grow(roster, InitialCapacity) || !roster_setLimits(roster, DefaultMaxPlayers, 0)) {
+        roster_delete(roster);
+        return NULL;
+    }
     return roster;
 
 }
 
-/**************** roster_new ****************/
+/**************** roster_setWorkers ****************/
+/* see roster.h for description */
+void roster_setWorkers(roster_t* roster, pool_t* workers) {
+    roster->workers = workers;
+}
+
+/**************** roster_setLimits ****************/
+/* see roster.h for description */
+bool roster_setLimits(roster_t* roster, int maxPlayers, int radius) {
+    if (roster == NULL || roster->numPlayers > 0
+        || maxPlayers < 1 || maxPlayers > PLAYER_NUM_IDS || radius < 0) {
+        return false;
+    }
+    int* slotOf = realloc(roster->slotOf, maxPlayers * sizeof(int));
+    if (slotOf == NULL) return false;
+    for (int id = 0; id < maxPlayers; id++) {
+        slotOf[id] = -1;
+    }
+    roster->slotOf = slotOf;
+    roster->maxPlayers = maxPlayers;
+    roster->radius = radius;
+    return true;
+}
+
+/**************** roster_setMapSize ****************/
+/* see roster.h for description */
+bool roster_setMapSize(roster_t* roster, int nrows, int ncols) {
+    if (roster == NULL || roster->numPlayers > 0 || nrows < 1 || ncols < 1) {
+        return false;
+    }
+    int* slotAt = realloc(roster->table.slotAt, (size_t) nrows * ncols * sizeof(int));
+    if (slotAt == NULL) return false;
+    for (int i = 0; i < nrows * ncols; i++) {
+        slotAt[i] = -1;
+    }
+    roster->table.slotAt = slotAt;
+    roster->table.nrows = nrows;
+    roster->table.ncols = ncols;
+    return true;
+}
+
+/**************** roster_addPlayer ****************/
 /* see roster.h for description */
 bool roster_addPlayer(roster_t* roster, player_t* player) {
-    char playerID = player_getID(player);
-    return set_insert(roster->players, &playerID, player);
+    if (roster == NULL || player == NULL) return false;
+
+    // the first ID not in use, so IDs of players who quit are reused
+    int id = 0;
+    while (id < roster->maxPlayers && roster->slotOf[id] >= 0) {
+        id++;
+    }
+    return roster_addPlayerWithID(roster, player, id);
+}
+
+/**************** roster_addPlayerWithID ****************/
+/* see roster.h for description */
+bool roster_addPlayerWithID(roster_t* roster, player_t* player, int id) {
+    if (roster == NULL || player == NULL
+        || id < 0 || id >= roster->maxPlayers || roster->slotOf[id] >= 0) {
+        return false;
+    }
+
+    if (roster->numPlayers == roster->capacity
+        && !roster_grow(roster, 2 * roster->capacity)) {
+        return false;
+    }
+    int slot = roster->numPlayers++;
+    roster->players[slot] = player;
+    player_moveToTable(player, &roster->table, slot);
+    roster->table.id[slot] = id;
+    roster->slotOf[id] = slot;
+    roster->lastX[slot] = roster->lastY[slot] = -1;
+    roster_hashSlot(roster, slot);
+    return true;
+}
+
+/**************** roster_removePlayer ****************/
+/* see roster.h for description */
+bool roster_removePlayer(roster_t* roster, player_t* player) {
+    if (roster == NULL || player == NULL) return false;
+    const playerID_t id = player_getID(player);
+    if (id >= roster->maxPlayers || roster->slotOf[id] < 0
+        || roster->players[roster->slotOf[id]] != player) {
+        return false;
+    }
+    const int slot = roster->slotOf[id];
+    if (roster->radius > 0 && roster->lastX[slot] >= 0) {
+        roster_noteChange(roster, roster->lastX[slot], roster->lastY[slot]);
+    }
+    playerTable_t* t = &roster->table;
+    const int x = t->x[slot], y = t->y[slot];
+    if (t->slotAt != NULL && x >= 0 && x < t->ncols && y >= 0 && y < t->nrows
+        && t->slotAt[y * t->ncols + x] == slot) {
+        t->slotAt[y * t->ncols + x] = -1;
+    }
+
+    // close the gap, keeping the others in the order they joined
+    for (int next = slot + 1; next < roster->numPlayers; next++) {
+        roster->players[next - 1] = roster->players[next];
+        player_moveToTable(roster->players[next - 1], &roster->table, next - 1);
+        roster->slotOf[roster->table.id[next - 1]] = next - 1;
+        roster->lastX[next - 1] = roster->lastX[next];
+        roster->lastY[next - 1] = roster->lastY[next];
+    }
+    roster->numPlayers--;
+    roster->slotOf[id] = -1;
+    roster_rehash(roster);
+    player_delete(player);
+    return true;
+}
+
+/**************** roster_maxPlayers ****************/
+/* see roster.h for description */
+int roster_maxPlayers(roster_t* roster) {
+    return roster->maxPlayers;
+}
+
+/**************** roster_numPlayers ****************/
+/* see roster.h for description */
+int roster_numPlayers(roster_t* roster) {
+    return roster->numPlayers;
+}
+
+/**************** roster_getPlayers ****************/
+/* see roster.h for description */
+int roster_getPlayers(roster_t* roster, player_t** players) {
+    int n = 0;
+    for (int slot = roster->numPlayers - 1; slot >= 0; slot--) {
+        players[n++] = roster->players[slot];
+    }
+    return n;
+}
+
+/**************** roster_getInterested ****************/
+/* see roster.h for description */
+int roster_getInterested(roster_t* roster, player_t** players) {
+    if (roster->radius == 0) {
+        return roster_getPlayers(roster, players);
+    }
+    const playerTable_t* t = &roster->table;
+    int* lastX = roster->lastX;
+    int* lastY = roster->lastY;
+
+    // where players have moved from and to since the last update
+    for (int slot = 0; slot < roster->numPlayers; slot++) {
+        if (t->x[slot] != lastX[slot] || t->y[slot] != lastY[slot]) {
+            if (lastX[slot] >= 0) {
+                roster_noteChange(roster, lastX[slot], lastY[slot]);
+            }
+            roster_noteChange(roster, t->x[slot], t->y[slot]);
+            lastX[slot] = t->x[slot];
+            lastY[slot] = t->y[slot];
+        }
+    }
+
+    // those near any of them, and near where players left
+    const int radius = roster->radius;
+    int n = 0;
+    for (int slot = roster->numPlayers - 1; slot >= 0; slot--) {
+        for (int i = 0; i < roster->numChanged; i++) {
+            if (abs(t->x[slot] - roster->changed[i].c) <= radius
+                && abs(t->y[slot] - roster->changed[i].r) <= radius) {
+                players[n++] = roster->players[slot];
+                break;
+            }
+        }
+    }
+    roster->numChanged = 0;
+    return n;
 }
 
 /**************** roster_updateAllPlayers ****************/
 /* see roster.h for description */
 void roster_updateAllPlayers(roster_t* roster, game_t* game) {
-    set_iterate(roster->players, game, roster_updateAllPlayers_Helper);
+    TRACE_SCOPE("roster_updateAllPlayers");
+    // gather the players, in the order we have always updated them
+    int numPlayers = roster_numPlayers(roster);
+    if (numPlayers == 0) return;
+    player_t** players = malloc(numPlayers * sizeof(player_t*));
+    if (players == NULL) return;
+    numPlayers = roster_getInterested(roster, players);
+
+    roster_sendDisplays(roster, players, numPlayers, game_returnFullMap(game), game_returnGoldMap(game));
+    free(players);
+}
+
+/**************** roster_sendDisplays ****************/
+/* see roster.h for description */
+void roster_sendDisplays(roster_t* roster, player_t** players, int numPlayers, grid_t* fullMap, grid_t* goldMap) {
+    TRACE_SCOPE("roster_sendDisplays");
+    if (numPlayers <= 0) return;
+    uint64_t start = stats_now();
+    grid_point_t* viewers = malloc(numPlayers * sizeof(grid_point_t));
+    grid_t** visible = calloc(numPlayers, sizeof(grid_t*));
+    displayJob_t* jobs = malloc(numPlayers * sizeof(displayJob_t));
+    if (viewers == NULL || visible == NULL || jobs == NULL) {
+        free(viewers);
+        free(visible);
+        free(jobs);
+        return;
+    }
+
+    // compute everyone's field of view, the viewers split among the workers
+    for (int i = 0; i < numPlayers; i++) {
+        viewers[i].r = player_getYLocation(players[i]);
+        viewers[i].c = player_getXLocation(players[i]);
+        visible[i] = grid_new(grid_nrows(fullMap), grid_ncols(fullMap));
+    }
+    grid_visibleBatch(fullMap, viewers, numPlayers, visible, roster->workers);
+
+    // merge and format each player's display in parallel
+    poolBatch_t batch = POOL_BATCH_INIT;
+    for (int i = 0; i < numPlayers; i++) {
+        jobs[i] = (displayJob_t) { players[i], visible[i], fullMap, goldMap, NULL };
+        if (!pool_submit(roster->workers, &batch, roster_buildDisplay_Job, &jobs[i])) {
+            roster_buildDisplay_Job(&jobs[i]);      // no pool; do it here
+        }
+    }
+    pool_wait(roster->workers, &batch);             // only for ours; other games may share the pool
+
+    // then send, always in the same order
+    for (int i = 0; i < numPlayers; i++) {
+        if (jobs[i].message != NULL) {
+            stats_send(player_getAddr(players[i]), jobs[i].message);
+            free(jobs[i].message);
+        }
+        grid_delete(visible[i]);
+    }
+
+    free(jobs);
+    free(viewers);
+    free(visible);
+    stats_time(stats_UpdateAllPlayers, start);
 }
 
 /**************** roster_updateAllPlayersGold ****************/
 /* see roster.h for description */
 void roster_updateAllPlayersGold(roster_t* roster, game_t* game) {
-    set_iterate(roster->players, game, roster_updateAllPlayersGold_Helper);
+    const playerTable_t* t = &roster->table;
+    char sendGoldMsg[40];
+    for (int slot = roster->numPlayers - 1; slot >= 0; slot--) {
+        sprintf(sendGoldMsg, "GOLD 0 %d %d", t->gold[slot], game_returnRemainingGold(game));
+        game_send(game, t->address[slot], sendGoldMsg);
+    }
 }
 
 /**************** roster_createGameMessage ****************/
 /* see roster.h for description */
-char* roster_createGameMessage(roster_t* roster) {
+char* roster_createGameMessage(roster_t* roster, game_t* game) {
+    const playerTable_t* t = &roster->table;
     int lineSize = 20 + 50;
-    char* message = calloc(lineSize*26, sizeof(char));
-    sprintf(message, "QUIT GAME OVER:");
-    set_iterate(roster->players, &message, roster_createGameMessage_Helper);
-    set_iterate(roster->players, message, roster_createGameMessage_sendHelper);
+    char* message = calloc(lineSize * (roster->numPlayers + 1), sizeof(char));
+    int length = sprintf(message, "QUIT GAME OVER:");
+    for (int slot = roster->numPlayers - 1; slot >= 0; slot--) {
+        // if player exited before game over, don't print in summary;
+        // in a large game, list only as many as fit in one message
+        if (t->active[slot] && length + lineSize < message_MaxBytes) {
+            length += sprintf(message + length, "\n%c %7d %.*s", player_glyph(t->id[slot]), t->gold[slot],
+                              lineSize - 12, player_getName(roster->players[slot]));
+        }
+    }
+    for (int slot = roster->numPlayers - 1; slot >= 0; slot--) {
+        game_send(game, t->address[slot], message);
+    }
     return message;
 }
 
 /**************** roster_delete ****************/
 /* see roster.h for description */
 void roster_delete(roster_t* roster) {
-    set_delete(roster->players, roster_delete_helper);
+    for (int slot = 0; slot < roster->numPlayers; slot++) {
+        player_delete(roster->players[slot]);
+    }
+    free(roster->players);
+    free(roster->table.id);
+    free(roster->table.x);
+    free(roster->table.y);
+    free(roster->table.gold);
+    free(roster->table.address);
+    free(roster->table.active);
+    free(roster->table.slotAt);
+    free(roster->table.below);
+    free(roster->addrSlot);
+    free(roster->slotOf);
+    free(roster->lastX);
+    free(roster->lastY);
+    free(roster->changed);
     free(roster);
 }
 
 /* get player from info functions */
 
-/**************** roster_getPlayerFromAddr_Helper ****************/
-/* To be passed into set_iterate for roster_getPlayerFromAddr.
- * Given a player, if it matches the address to be found, then add player to info pack.
- */
-void roster_getPlayerFromAddr_Helper(void* arg, const char* key, void* item) {
-    findPlayerPack_t* playerPack = arg;
-    player_t* currPlayer = item;
-    if (message_eqAddr(playerPack->matchAddress, player_getAddr(currPlayer))) {
-        playerPack->foundPlayer = currPlayer;
-    }
-}
-
 /**************** roster_getPlayerFromAddr ****************/
 /* see roster.h for description */
 player_t* roster_getPlayerFromAddr(roster_t* roster, addr_t playerAddr) {
-    findPlayerPack_t* playerPack = malloc(sizeof(findPlayerPack_t));
-    playerPack->matchAddress = playerAddr;
-    playerPack->foundPlayer = NULL;
-    set_iterate(roster->players, playerPack, *roster_getPlayerFromAddr_Helper);
-    player_t* found = playerPack->foundPlayer;
-    free(playerPack);
-    return found;
-}
-
-/**************** roster_getPlayerFromAddr_Helper ****************/
-/* To be passed into set_iterate for roster_getPlayerFromID.
- * Given a player, if it matches the ID to be found, then add player to info pack.
- */
-
-void roster_getPlayerFromID_Helper(void* arg, const char* key, void* item) {
-    findPlayerPack_t* playerPack = arg;
-    player_t* currPlayer = item;
-    if (player_getID(currPlayer) == playerPack->matchPlayerID) {
-        playerPack->foundPlayer = currPlayer;
+    const addr_t* address = roster->table.address;
+    unsigned int h = roster_hashAddr(playerAddr) & roster->addrMask;
+    for (int slot; (slot = roster->addrSlot[h]) >= 0; h = (h + 1) & roster->addrMask) {
+        if (message_eqAddr(playerAddr, address[slot])) {
+            return roster->players[slot];
+        }
     }
+    return NULL;
 }
 
 /**************** roster_getPlayerFromID ****************/
 /* see roster.h for description */
-player_t* roster_getPlayerFromID(roster_t* roster, char playerID) {
-    findPlayerPack_t* playerPack = malloc(sizeof(findPlayerPack_t));
-    playerPack->matchPlayerID = playerID;
-    playerPack->foundPlayer = NULL;
-    set_iterate(roster->players, playerPack, *roster_getPlayerFromID_Helper);
-    player_t* found = playerPack->foundPlayer;
-    free(playerPack);
-    return found;
-}
\ No newline at end of file
+player_t* roster_getPlayerFromID(roster_t* roster, playerID_t playerID) {
+    if (playerID >= roster->maxPlayers || roster->slotOf[playerID] < 0) {
+        return NULL;
+    }
+    return roster->players[roster->slotOf[playerID]];
+}
+
+/**************** roster_getPlayerAt ****************/
+/* see roster.h for description */
+player_t* roster_getPlayerAt(roster_t* roster, int x, int y) {
+    const playerTable_t* t = &roster->table;
+    if (t->slotAt != NULL) {
+        if (x < 0 || x >= t->ncols || y < 0 || y >= t->nrows) {
+            return NULL;
+        }
+        const int slot = t->slotAt[y * t->ncols + x];
+        return slot >= 0 ? roster->players[slot] : NULL;
+    }
+    const int* xs = roster->table.x;
+    const int* ys = roster->table.y;
+    for (int slot = 0; slot < roster->numPlayers; slot++) {
+        if (xs[slot] == x && ys[slot] == y) {
+            return roster->players[slot];
+        }
+    }
+    return NULL;
+}
@@ -2,7 +2,8 @@
  * roster.h - header file for Nuggets 'roster' module
  * 
  * A 'roster' holds informations about all the players in the game.
- * It is essentially a hashtable for players.
+ * Players are kept in the order they joined, their hot fields in parallel
+ * arrays (see player.h).
  *
  * Selena Zhou, Kyla Widodo, 23S
  */
@@ -14,11 +15,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include "player.h"
+#include "pool.h"
 #include "../support/message.h"
 
 /**************** global types ****************/
 typedef struct roster roster_t;
-typedef struct findPlayerPack findPlayerPack_t;
 
 /**************** functions ****************/
 
@@ -27,16 +28,93 @@ typedef struct findPlayerPack findPlayerPack_t;
  */
 roster_t* roster_new();
 
+/**************** roster_setWorkers ****************/
+/* Gives the roster a pool of worker threads, shared with any other rosters,
+ * to compute and build players' displays on (see roster_sendDisplays); NULL
+ * (the default) to do that work on the calling thread. The pool is not the
+ * roster's: the caller deletes it, after the roster.
+ */
+void roster_setWorkers(roster_t* roster, pool_t* workers);
+
+/**************** roster_setLimits ****************/
+/* Sets the most players the roster may hold, and its interest radius: if
+ * positive, each update goes only to players within that many rows and
+ * columns of where a player moved from or to, or left the game, since the
+ * last update; if 0 (the default), to every player. At most 26 players
+ * (the default) are each shown by their own letter; see player.h.
+ * Return true if successful, false if the roster is not empty or the
+ * limits are out of range (maxPlayers 1...PLAYER_NUM_IDS, radius >= 0).
+ */
+bool roster_setLimits(roster_t* roster, int maxPlayers, int radius);
+
+/**************** roster_setMapSize ****************/
+/* Tells the roster the size of the map its players are on, so that
+ * roster_getPlayerAt looks the spot up instead of checking every player.
+ * Return true if successful, false if the roster is not empty, the size is
+ * not positive, or out of memory.
+ */
+bool roster_setMapSize(roster_t* roster, int nrows, int ncols);
+
 /**************** roster_addPlayer ****************/
-/* Given a player, adds to roster. Return true if successful
+/* Given a player, gives them the first ID (0, 1, ...) no other player in the
+ * roster has, and adds them to roster. Return true if successful, false if
+ * every ID is taken.
  */
 bool roster_addPlayer(roster_t* roster, player_t* player);
 
+/**************** roster_addPlayerWithID ****************/
+/* Like roster_addPlayer, but gives the player the ID given, as when
+ * restoring a saved game. Return true if successful, false if that ID is
+ * out of range or taken.
+ */
+bool roster_addPlayerWithID(roster_t* roster, player_t* player, int id);
+
+/**************** roster_removePlayer ****************/
+/* Removes the given player from the roster and deletes them, so their ID
+ * may be given to a later player. The other players keep their order.
+ * Return true if successful, false if the player is not in the roster.
+ */
+bool roster_removePlayer(roster_t* roster, player_t* player);
+
+/**************** roster_maxPlayers ****************/
+/* Returns the most players the roster may hold, so its IDs are 0...that-1.
+ */
+int roster_maxPlayers(roster_t* roster);
+
+/**************** roster_numPlayers ****************/
+/* Returns number of players in roster: those who have joined and not quit.
+ */
+int roster_numPlayers(roster_t* roster);
+
+/**************** roster_getPlayers ****************/
+/* Fills the caller's array, of at least roster_numPlayers entries, with the
+ * players in the order they are always updated. Returns number filled in.
+ */
+int roster_getPlayers(roster_t* roster, player_t** players);
+
+/**************** roster_getInterested ****************/
+/* Like roster_getPlayers, but fills in only the players to be sent this
+ * update (all of them unless the roster has an interest radius), and notes
+ * where every player now is, for the next update. Returns number filled in.
+ */
+int roster_getInterested(roster_t* roster, player_t** players);
+
 /**************** roster_updateAllPlayers ****************/
-/* Given a server map update, updates the visible portion of map for each individual player.
+/* Given a server map update, updates the visible portion of map for each individual player
+ * (each player near the change, if the roster has an interest radius).
  */
 void roster_updateAllPlayers(roster_t* roster, game_t* fullMap);
 
+/**************** roster_sendDisplays ****************/
+/* Does the work of roster_updateAllPlayers for the given players (which need
+ * not be in the roster), against the given maps: merges what each now sees
+ * into their visible map, and sends each their DISPLAY, in array order.
+ * Uses the roster's worker threads, and waits only for its own jobs on them,
+ * so rosters sharing a pool may send at once; call from one thread at a
+ * time for any one roster.
+ */
+void roster_sendDisplays(roster_t* roster, player_t** players, int numPlayers, grid_t* fullMap, grid_t* goldMap);
+
 /**************** roster_updateAllPlayersGold ****************/
 /* Given a gold update, sends new gold message to all players.
  */
@@ -44,9 +122,9 @@ void roster_updateAllPlayersGold(roster_t* roster, game_t* fullMap);
 
 /**************** roster_createGameMessage ****************/
 /* At the game end, create and return game over message with player purses
- * ordered by who last entered the game.
+ * ordered by who last entered the game. Sends it to each player through game_send.
  */
-char* roster_createGameMessage(roster_t* roster);
+char* roster_createGameMessage(roster_t* roster, game_t* game);
 
 /**************** roster_delete ****************/
 /* Frees all information and deletes roster.
@@ -56,6 +134,7 @@ void roster_delete(roster_t* roster);
 /* get player from info functions */
 
 player_t* roster_getPlayerFromAddr(roster_t* roster, addr_t playerAddr);
-player_t* roster_getPlayerFromID(roster_t* roster, char playerID);
+player_t* roster_getPlayerFromID(roster_t* roster, playerID_t playerID);
+player_t* roster_getPlayerAt(roster_t* roster, int x, int y);      // column x, row y
 
 #endif // __ROSTER_H
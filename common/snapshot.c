@@ -0,0 +1,379 @@
+/*
+ * snapshot.c - Nuggets 'snapshot' module
+ *
+ * See snapshot.h for more information.
+ *
+ * A snapshot file is, all in little-endian bytes:
+ *
+ *   "NUGSNAPS"                 8 bytes
+ *   version                    4 bytes (SnapshotVersion)
+ *   length of the body         8 bytes
+ *   body                       as put by the game (see game_snapshot)
+ *   hash of the body           8 bytes (see snapshot_hash)
+ *
+ * A snapshot cut short by a crash, or written by another version, is
+ * refused whole rather than half restored.
+ *
+ * Selena Zhou, Kyla Widodo, 23S
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "snapshot.h"
+
+/**************** file-local global variables ****************/
+
+static const char Magic[8] = { 'N', 'U', 'G', 'S', 'N', 'A', 'P', 'S' };
+static const uint32_t SnapshotVersion = 1;      // change with the body's layout
+static const size_t InitialCapacity = 64 * 1024;
+#define HeaderSize 20                           // magic, version, length
+#define NumBuffers 2                            // double buffered
+
+/**************** global types ****************/
+
+typedef struct snapshot {
+    unsigned char* bytes;           // header, body, and at last the hash
+    size_t used;
+    size_t capacity;
+    bool failed;                    // out of memory while building
+    int fd;                         // where to write it, once committed
+} snapshot_t;
+
+typedef struct snapshotWriter {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;         // signaled when a snapshot is queued or written
+    snapshot_t buffers[NumBuffers];
+    int next;                       // buffer to build next
+    int queued;                     // committed and not yet written; the oldest
+                                    // is 'queued' buffers before 'next'
+    bool failed;                    // a write failed since the last snapshot_wait
+    bool stopping;
+} snapshotWriter_t;
+
+typedef struct snapshotReader {
+    unsigned char* bytes;           // the body
+    size_t length;
+    size_t at;                      // bytes read so far
+    bool ok;                        // every get so far found its bytes
+} snapshotReader_t;
+
+/**************** local functions ****************/
+
+static void* snapshot_writerMain(void* arg);
+static void snapshot_put(snapshot_t* snapshot, const void* bytes, size_t length);
+static void snapshot_putLittle(unsigned char* at, uint64_t value, int size);
+static uint64_t snapshot_getLittle(const unsigned char* at, int size);
+static uint64_t snapshot_hash(const unsigned char* bytes, size_t length);
+static bool snapshot_writeAll(int fd, const unsigned char* bytes, size_t length);
+
+/**************** snapshot_newWriter ****************/
+/* see snapshot.h for description */
+snapshotWriter_t* snapshot_newWriter(void) {
+    snapshotWriter_t* writer = calloc(1, sizeof(snapshotWriter_t));
+    if (writer == NULL) return NULL;
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->changed, NULL);
+    if (pthread_create(&writer->thread, NULL, snapshot_writerMain, writer) != 0) {
+        pthread_mutex_destroy(&writer->lock);
+        pthread_cond_destroy(&writer->changed);
+        free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+/**************** snapshot_begin ****************/
+/* see snapshot.h for description */
+snapshot_t* snapshot_begin(snapshotWriter_t* writer) {
+    pthread_mutex_lock(&writer->lock);
+    while (writer->queued == NumBuffers) {
+        pthread_cond_wait(&writer->changed, &writer->lock);
+    }
+    snapshot_t* snapshot = &writer->buffers[writer->next];
+    pthread_mutex_unlock(&writer->lock);
+
+    snapshot->used = 0;
+    snapshot->failed = false;
+    unsigned char header[HeaderSize];
+    memset(header, 0, HeaderSize);        // filled in by snapshot_commit
+    snapshot_put(snapshot, header, HeaderSize);
+    return snapshot;
+}
+
+/**************** snapshot_putInt ****************/
+/* see snapshot.h for description */
+void snapshot_putInt(snapshot_t* snapshot, uint64_t value, int size) {
+    unsigned char bytes[8];
+    snapshot_putLittle(bytes, value, size);
+    snapshot_put(snapshot, bytes, size);
+}
+
+/**************** snapshot_putString ****************/
+/* see snapshot.h for description */
+void snapshot_putString(snapshot_t* snapshot, const char* string) {
+    const size_t length = strlen(string);
+    snapshot_putInt(snapshot, length, 4);
+    snapshot_put(snapshot, string, length);
+}
+
+/**************** snapshot_commit ****************/
+/* see snapshot.h for description */
+bool snapshot_commit(snapshotWriter_t* writer, snapshot_t* snapshot, int fd) {
+    const size_t bodyLength = snapshot->used - HeaderSize;
+    snapshot_putInt(snapshot, 0, 8);        // the hash, taken by the writer thread
+    if (snapshot->failed) {
+        close(fd);
+        return false;
+    }
+    memcpy(snapshot->bytes, Magic, sizeof(Magic));
+    snapshot_putLittle(snapshot->bytes + 8, SnapshotVersion, 4);
+    snapshot_putLittle(snapshot->bytes + 12, bodyLength, 8);
+    snapshot->fd = fd;
+
+    pthread_mutex_lock(&writer->lock);
+    writer->next = (writer->next + 1) % NumBuffers;
+    writer->queued++;
+    pthread_cond_broadcast(&writer->changed);
+    pthread_mutex_unlock(&writer->lock);
+    return true;
+}
+
+/**************** snapshot_wait ****************/
+/* see snapshot.h for description */
+bool snapshot_wait(snapshotWriter_t* writer) {
+    pthread_mutex_lock(&writer->lock);
+    while (writer->queued > 0) {
+        pthread_cond_wait(&writer->changed, &writer->lock);
+    }
+    const bool ok = !writer->failed;
+    writer->failed = false;
+    pthread_mutex_unlock(&writer->lock);
+    return ok;
+}
+
+/**************** snapshot_pending ****************/
+/* see snapshot.h for description */
+int snapshot_pending(snapshotWriter_t* writer) {
+    pthread_mutex_lock(&writer->lock);
+    const int queued = writer->queued;
+    pthread_mutex_unlock(&writer->lock);
+    return queued;
+}
+
+/**************** snapshot_deleteWriter ****************/
+/* see snapshot.h for description */
+void snapshot_deleteWriter(snapshotWriter_t* writer) {
+    if (writer == NULL) return;
+    pthread_mutex_lock(&writer->lock);
+    writer->stopping = true;
+    pthread_cond_broadcast(&writer->changed);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->thread, NULL);     // after it writes what is queued
+
+    for (int b = 0; b < NumBuffers; b++) {
+        free(writer->buffers[b].bytes);
+    }
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->changed);
+    free(writer);
+}
+
+/**************** snapshot_openReader ****************/
+/* see snapshot.h for description */
+snapshotReader_t* snapshot_openReader(int fd) {
+    // read it all
+    size_t used = 0, capacity = InitialCapacity;
+    unsigned char* bytes = malloc(capacity);
+    ssize_t got = 0;
+    while (bytes != NULL && (got = read(fd, bytes + used, capacity - used)) > 0) {
+        used += got;
+        if (used == capacity) {
+            capacity *= 2;
+            unsigned char* bigger = realloc(bytes, capacity);
+            if (bigger == NULL) {
+                free(bytes);
+            }
+            bytes = bigger;
+        }
+    }
+    if (bytes == NULL || got < 0) {
+        fprintf(stderr, "snapshot: unable to read it: %s\n", bytes == NULL ? "out of memory" : strerror(errno));
+        free(bytes);
+        return NULL;
+    }
+
+    // check it
+    const char* problem = NULL;
+    uint64_t bodyLength = 0;
+    if (used < HeaderSize + 8 || memcmp(bytes, Magic, sizeof(Magic)) != 0) {
+        problem = "it is no snapshot";
+    } else if (snapshot_getLittle(bytes + 8, 4) != SnapshotVersion) {
+        problem = "it was written by another version";
+    } else if ((bodyLength = snapshot_getLittle(bytes + 12, 8)) != used - HeaderSize - 8
+               || snapshot_hash(bytes + HeaderSize, bodyLength)
+                  != snapshot_getLittle(bytes + HeaderSize + bodyLength, 8)) {
+        problem = "it is cut short or damaged";
+    }
+    snapshotReader_t* reader = (problem == NULL) ? malloc(sizeof(snapshotReader_t)) : NULL;
+    if (reader == NULL) {
+        fprintf(stderr, "snapshot: unable to read it: %s\n", problem != NULL ? problem : "out of memory");
+        free(bytes);
+        return NULL;
+    }
+    memmove(bytes, bytes + HeaderSize, bodyLength);
+    *reader = (snapshotReader_t) { bytes, bodyLength, 0, true };
+    return reader;
+}
+
+/**************** snapshot_getInt ****************/
+/* see snapshot.h for description */
+uint64_t snapshot_getInt(snapshotReader_t* reader, int size) {
+    if (!reader->ok || reader->length - reader->at < size) {
+        reader->ok = false;
+        return 0;
+    }
+    uint64_t value = snapshot_getLittle(reader->bytes + reader->at, size);
+    reader->at += size;
+    return value;
+}
+
+/**************** snapshot_getString ****************/
+/* see snapshot.h for description */
+char* snapshot_getString(snapshotReader_t* reader) {
+    const uint64_t length = snapshot_getInt(reader, 4);
+    char* string = NULL;
+    if (!reader->ok || reader->length - reader->at < length
+        || (string = malloc(length + 1)) == NULL) {
+        reader->ok = false;
+        return NULL;
+    }
+    memcpy(string, reader->bytes + reader->at, length);
+    string[length] = '\0';
+    reader->at += length;
+    return string;
+}
+
+/**************** snapshot_closeReader ****************/
+/* see snapshot.h for description */
+bool snapshot_closeReader(snapshotReader_t* reader) {
+    const bool ok = reader->ok && reader->at == reader->length;
+    free(reader->bytes);
+    free(reader);
+    return ok;
+}
+
+/**************** snapshot_writerMain ****************/
+/* The writer thread: writes each snapshot committed, oldest first, until
+ * told to stop with none left.
+ */
+static void* snapshot_writerMain(void* arg) {
+    snapshotWriter_t* writer = arg;
+    pthread_mutex_lock(&writer->lock);
+    while (true) {
+        while (writer->queued == 0 && !writer->stopping) {
+            pthread_cond_wait(&writer->changed, &writer->lock);
+        }
+        if (writer->queued == 0) break;
+        snapshot_t* snapshot = &writer->buffers[(writer->next - writer->queued + NumBuffers) % NumBuffers];
+        pthread_mutex_unlock(&writer->lock);
+
+        const size_t bodyLength = snapshot->used - HeaderSize - 8;
+        snapshot_putLittle(snapshot->bytes + HeaderSize + bodyLength,
+                           snapshot_hash(snapshot->bytes + HeaderSize, bodyLength), 8);
+        bool ok = snapshot_writeAll(snapshot->fd, snapshot->bytes, snapshot->used)
+            && (fsync(snapshot->fd) == 0 || errno == EINVAL);     // EINVAL: a pipe
+        ok = (close(snapshot->fd) == 0) && ok;
+        if (!ok) {
+            fprintf(stderr, "snapshot: unable to write it: %s\n", strerror(errno));
+        }
+
+        pthread_mutex_lock(&writer->lock);
+        writer->failed = writer->failed || !ok;
+        writer->queued--;
+        pthread_cond_broadcast(&writer->changed);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+/**************** snapshot_put ****************/
+/* Appends bytes to the snapshot, growing it as needed; on running out of
+ * memory, marks it failed and appends nothing more.
+ */
+static void snapshot_put(snapshot_t* snapshot, const void* bytes, size_t length) {
+    if (snapshot->failed) return;
+    if (snapshot->capacity - snapshot->used < length) {
+        size_t capacity = snapshot->capacity ? snapshot->capacity : InitialCapacity;
+        while (capacity - snapshot->used < length) {
+            capacity *= 2;
+        }
+        unsigned char* bigger = realloc(snapshot->bytes, capacity);
+        if (bigger == NULL) {
+            snapshot->failed = true;
+            return;
+        }
+        snapshot->bytes = bigger;
+        snapshot->capacity = capacity;
+    }
+    memcpy(snapshot->bytes + snapshot->used, bytes, length);
+    snapshot->used += length;
+}
+
+/**************** snapshot_putLittle ****************/
+/* Stores the low 'size' bytes of value at 'at', little-endian.
+ */
+static void snapshot_putLittle(unsigned char* at, uint64_t value, int size) {
+    for (int b = 0; b < size; b++) {
+        at[b] = value >> (8 * b) & 0xff;
+    }
+}
+
+/**************** snapshot_getLittle ****************/
+/* Returns the little-endian integer of the given size at 'at'.
+ */
+static uint64_t snapshot_getLittle(const unsigned char* at, int size) {
+    uint64_t value = 0;
+    for (int b = 0; b < size; b++) {
+        value |= (uint64_t) at[b] << (8 * b);
+    }
+    return value;
+}
+
+/**************** snapshot_hash ****************/
+/* Returns the FNV-1a hash of the bytes, taken 8 bytes (a little-endian
+ * word) at a time, and then byte by byte for the last few; a snapshot may
+ * be megabytes, and one multiply per byte is slow.
+ */
+static uint64_t snapshot_hash(const unsigned char* bytes, size_t length) {
+    uint64_t hash = 14695981039346656037ULL;
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        hash = (hash ^ snapshot_getLittle(bytes + i, 8)) * 1099511628211ULL;
+    }
+    for (; i < length; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**************** snapshot_writeAll ****************/
+/* Writes all the bytes to fd, however many calls it takes.
+ * Returns: true if all were written.
+ */
+static bool snapshot_writeAll(int fd, const unsigned char* bytes, size_t length) {
+    while (length > 0) {
+        ssize_t wrote = write(fd, bytes, length);
+        if (wrote < 0 && errno == EINTR) continue;
+        if (wrote <= 0) return false;
+        bytes += wrote;
+        length -= wrote;
+    }
+    return true;
+}
@@ -0,0 +1,108 @@
+/*
+ * snapshot.h - header file for Nuggets 'snapshot' module
+ *
+ * A 'snapshot' is a saved game, as a versioned, checksummed blob of bytes
+ * (see game_snapshot for what it holds). The game's thread builds each one
+ * in memory, which takes microseconds; a writer thread of its own writes it
+ * out, syncs and closes the file, so the game need not wait for the disk.
+ * Two are kept: one may be built while the other is written.
+ *
+ * A 'snapshotReader' reads one back, checking its version and checksum
+ * before anything in it is used.
+ *
+ * Selena Zhou, Kyla Widodo, 23S
+ */
+
+#ifndef __SNAPSHOT_H
+#define __SNAPSHOT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**************** global types ****************/
+typedef struct snapshot snapshot_t;                 // one being built
+typedef struct snapshotWriter snapshotWriter_t;     // writes them out
+typedef struct snapshotReader snapshotReader_t;     // reads one back
+
+/**************** functions ****************/
+
+/**************** snapshot_newWriter ****************/
+/* Starts a writer thread.
+ * Returns: new writer, or NULL upon failure.
+ */
+snapshotWriter_t* snapshot_newWriter(void);
+
+/**************** snapshot_begin ****************/
+/* Returns an empty snapshot to build, with the put functions below, and
+ * then pass to snapshot_commit. If both are still being written, waits
+ * until the older one is.
+ */
+snapshot_t* snapshot_begin(snapshotWriter_t* writer);
+
+/**************** snapshot_putInt ****************/
+/* Appends the low 'size' (1 to 8) bytes of value, little-endian.
+ */
+void snapshot_putInt(snapshot_t* snapshot, uint64_t value, int size);
+
+/**************** snapshot_putString ****************/
+/* Appends a string: its length (4 bytes), then its bytes.
+ */
+void snapshot_putString(snapshot_t* snapshot, const char* string);
+
+/**************** snapshot_commit ****************/
+/* Seals the snapshot begun, and queues it to be written to fd, which the
+ * writer then owns: it writes, syncs and closes it.
+ *
+ * Returns: false (and closes fd) if memory ran out while building it.
+ */
+bool snapshot_commit(snapshotWriter_t* writer, snapshot_t* snapshot, int fd);
+
+/**************** snapshot_wait ****************/
+/* Waits until every snapshot committed has been written.
+ * Returns: true if all were written in full since the last call.
+ */
+bool snapshot_wait(snapshotWriter_t* writer);
+
+/**************** snapshot_pending ****************/
+/* Returns how many snapshots committed are still being written, without
+ * waiting for any.
+ */
+int snapshot_pending(snapshotWriter_t* writer);
+
+/**************** snapshot_deleteWriter ****************/
+/* Writes everything committed, stops the writer thread, and frees it.
+ * Does nothing if writer is NULL.
+ */
+void snapshot_deleteWriter(snapshotWriter_t* writer);
+
+/**************** snapshot_openReader ****************/
+/* Reads a whole snapshot from fd, from its current position to its end,
+ * and checks its version and checksum.
+ *
+ * Returns: new reader, or NULL (after saying why on stderr) if the file
+ *   cannot be read or is no snapshot this version can read, or damaged.
+ */
+snapshotReader_t* snapshot_openReader(int fd);
+
+/**************** snapshot_getInt ****************/
+/* Returns the next 'size' (1 to 8) bytes, as put by snapshot_putInt;
+ * 0 if there are too few left, which the reader remembers.
+ */
+uint64_t snapshot_getInt(snapshotReader_t* reader, int size);
+
+/**************** snapshot_getString ****************/
+/* Returns the next string, as put by snapshot_putString, in memory the
+ * caller must free; NULL if there is none, which the reader remembers.
+ */
+char* snapshot_getString(snapshotReader_t* reader);
+
+/**************** snapshot_closeReader ****************/
+/* Frees the reader.
+ * Returns: true if every get found what it asked for, and nothing was
+ *   left unread.
+ */
+bool snapshot_closeReader(snapshotReader_t* reader);
+
+#endif // __SNAPSHOT_H
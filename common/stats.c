@@ -0,0 +1,251 @@
+/*
+ * stats.c - Nuggets 'stats' module
+ *
+ * See stats.h for more information.
+ *
+ * Counters are relaxed atomics, so counting costs one uncontended add and
+ * never takes a lock. Latencies go into log-linear histograms: each power of
+ * two of nanoseconds is split into HistSubBuckets equal buckets, so every
+ * percentile is exact to within 1/HistSubBuckets of its value.
+ * Rates and the previous print's totals are only touched by the thread that
+ * prints (the server's admin console).
+ *
+ * Selena Zhou, Kyla Widodo, 23S
+ */
+
+#define _POSIX_C_SOURCE 200809L     // for clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "grid.h"
+#include "stats.h"
+#include "../support/message.h"
+
+/**************** file-local global variables ****************/
+
+// message types we count separately; anything else is "other"
+static const char* MessageTypes[] = {
+    "PLAY", "SPECTATE", "KEY", "OK", "GRID", "GOLD", "DISPLAY", "QUIT", "ERROR", "other"
+};
+#define NumTypes ((int) (sizeof(MessageTypes) / sizeof(MessageTypes[0])))
+
+static const char* TimerNames[stats_NumTimers] = {
+    "game_keyPress", "roster_updateAllPlayers", "message_send"
+};
+
+#define HistSubBits 3                       // log2 of buckets per power of two
+#define HistSubBuckets (1 << HistSubBits)
+#define HistBuckets (64 * HistSubBuckets)   // plenty for any uint64_t
+
+/**************** local types ****************/
+
+typedef struct counts {
+    unsigned long messagesIn[NumTypes];
+    unsigned long messagesOut[NumTypes];
+    unsigned long bytesIn, bytesOut;
+    unsigned long allocs;
+    unsigned long moves;
+    unsigned long fov;
+} counts_t;
+
+/**************** file-local global variables ****************/
+
+static struct {
+    atomic_ulong messagesIn[NumTypes];
+    atomic_ulong messagesOut[NumTypes];
+    atomic_ulong bytesIn, bytesOut;
+    atomic_ulong allocs;
+    atomic_ulong hist[stats_NumTimers][HistBuckets];
+} live;                             // zero-initialized, as atomics may be
+
+static unsigned long fovBase;       // grid_visibleComputed() at last reset
+static counts_t previous;           // totals at last print or reset
+static uint64_t previousTime;       // stats_now() at last print or reset
+
+/**************** file local helper functions ****************/
+/* opaque to those outside of the file*/
+
+/**************** stats_type ****************/
+/* Returns the index in MessageTypes of the message's first word.
+ */
+static int stats_type(const char* message) {
+    size_t len = strcspn(message, " \n");
+    for (int t = 0; t < NumTypes - 1; t++) {
+        if (strlen(MessageTypes[t]) == len && strncmp(message, MessageTypes[t], len) == 0) {
+            return t;
+        }
+    }
+    return NumTypes - 1;
+}
+
+/**************** stats_bucket ****************/
+/* Returns the histogram bucket holding the given number of nanoseconds.
+ */
+static int stats_bucket(uint64_t ns) {
+    if (ns < HistSubBuckets) return (int) ns;
+    int msb = 63 - __builtin_clzll(ns);
+    int sub = (int) (ns >> (msb - HistSubBits)) & (HistSubBuckets - 1);
+    return (msb - HistSubBits + 1) * HistSubBuckets + sub;
+}
+
+/**************** stats_bucketTop ****************/
+/* Returns the largest number of nanoseconds the bucket holds.
+ */
+static uint64_t stats_bucketTop(int bucket) {
+    if (bucket < HistSubBuckets) return bucket;
+    int msb = bucket / HistSubBuckets + HistSubBits - 1;
+    uint64_t sub = bucket % HistSubBuckets;
+    uint64_t width = (uint64_t) 1 << (msb - HistSubBits);
+    return ((HistSubBuckets + sub) << (msb - HistSubBits)) + width - 1;
+}
+
+/**************** stats_collect ****************/
+/* Reads every live counter into *counts.
+ */
+static void stats_collect(counts_t* counts) {
+    for (int t = 0; t < NumTypes; t++) {
+        counts->messagesIn[t] = atomic_load_explicit(&live.messagesIn[t], memory_order_relaxed);
+        counts->messagesOut[t] = atomic_load_explicit(&live.messagesOut[t], memory_order_relaxed);
+    }
+    counts->bytesIn = atomic_load_explicit(&live.bytesIn, memory_order_relaxed);
+    counts->bytesOut = atomic_load_explicit(&live.bytesOut, memory_order_relaxed);
+    counts->allocs = atomic_load_explicit(&live.allocs, memory_order_relaxed);
+    counts->moves = counts->messagesIn[stats_type("KEY")];
+    counts->fov = grid_visibleComputed() - fovBase;
+}
+
+/**************** stats_percentile ****************/
+/* Returns the given percentile (0 < p < 1) of a histogram, in microseconds.
+ */
+static double stats_percentile(const unsigned long hist[], unsigned long total, double p) {
+    unsigned long rank = (unsigned long) (p * total);
+    if (rank >= total) rank = total - 1;
+    unsigned long seen = 0;
+    for (int b = 0; b < HistBuckets; b++) {
+        seen += hist[b];
+        if (seen > rank) return stats_bucketTop(b) / 1000.0;
+    }
+    return 0;
+}
+
+/**************** functions ****************/
+
+/**************** stats_now ****************/
+/* see stats.h for description */
+uint64_t stats_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**************** stats_time ****************/
+/* see stats.h for description */
+void stats_time(stats_timer_t timer, uint64_t start) {
+    if (timer < 0 || timer >= stats_NumTimers) return;
+    uint64_t now = stats_now();
+    int bucket = stats_bucket(now > start ? now - start : 0);
+    atomic_fetch_add_explicit(&live.hist[timer][bucket], 1, memory_order_relaxed);
+}
+
+/**************** stats_messageIn ****************/
+/* see stats.h for description */
+void stats_messageIn(const char* message) {
+    if (message == NULL) return;
+    atomic_fetch_add_explicit(&live.messagesIn[stats_type(message)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&live.bytesIn, strlen(message), memory_order_relaxed);
+}
+
+/**************** stats_send ****************/
+/* see stats.h for description */
+void stats_send(const addr_t to, const char* message) {
+    if (message == NULL) return;
+    uint64_t start = stats_now();
+    message_send(to, message);
+    stats_time(stats_MessageSend, start);
+    atomic_fetch_add_explicit(&live.messagesOut[stats_type(message)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&live.bytesOut, strlen(message), memory_order_relaxed);
+}
+
+/**************** stats_countAlloc ****************/
+/* see stats.h for description */
+void stats_countAlloc(void) {
+    atomic_fetch_add_explicit(&live.allocs, 1, memory_order_relaxed);
+}
+
+/**************** stats_print ****************/
+/* see stats.h for description */
+void stats_print(FILE* fp) {
+    if (fp == NULL) return;
+
+    counts_t now;
+    stats_collect(&now);
+    uint64_t nowTime = stats_now();
+    double seconds = (nowTime - previousTime) / 1e9;
+    if (seconds <= 0) seconds = 1e-9;
+
+    fprintf(fp, "stats: rates over the last %.1f s\n", seconds);
+    fprintf(fp, "  %-10s %10s %10s %10s %10s\n", "message", "in", "in/s", "out", "out/s");
+    for (int t = 0; t < NumTypes; t++) {
+        if (now.messagesIn[t] == 0 && now.messagesOut[t] == 0) continue;
+        fprintf(fp, "  %-10s %10lu %10.1f %10lu %10.1f\n", MessageTypes[t],
+                now.messagesIn[t], (now.messagesIn[t] - previous.messagesIn[t]) / seconds,
+                now.messagesOut[t], (now.messagesOut[t] - previous.messagesOut[t]) / seconds);
+    }
+    fprintf(fp, "  %-10s %10lu %10.1f %10lu %10.1f\n", "bytes",
+            now.bytesIn, (now.bytesIn - previous.bytesIn) / seconds,
+            now.bytesOut, (now.bytesOut - previous.bytesOut) / seconds);
+
+    fprintf(fp, "  %-24s %10s %10s %10s %10s\n", "latency (us)", "count", "p50", "p99", "p999");
+    for (int timer = 0; timer < stats_NumTimers; timer++) {
+        static unsigned long hist[HistBuckets];     // only the printing thread uses it
+        unsigned long total = 0;
+        for (int b = 0; b < HistBuckets; b++) {
+            hist[b] = atomic_load_explicit(&live.hist[timer][b], memory_order_relaxed);
+            total += hist[b];
+        }
+        if (total == 0) {
+            fprintf(fp, "  %-24s %10lu %10s %10s %10s\n", TimerNames[timer], total, "-", "-", "-");
+        } else {
+            fprintf(fp, "  %-24s %10lu %10.1f %10.1f %10.1f\n", TimerNames[timer], total,
+                    stats_percentile(hist, total, 0.50),
+                    stats_percentile(hist, total, 0.99),
+                    stats_percentile(hist, total, 0.999));
+        }
+    }
+
+    unsigned long moves = now.moves - previous.moves;
+    unsigned long allocs = now.allocs - previous.allocs;
+    fprintf(fp, "  allocations: %lu total, %.1f/s", now.allocs, allocs / seconds);
+    if (moves > 0) {
+        fprintf(fp, ", %.1f per move", (double) allocs / moves);
+    }
+    fprintf(fp, "\n");
+    fprintf(fp, "  FOV computed: %lu total, %.1f/s\n", now.fov, (now.fov - previous.fov) / seconds);
+    fflush(fp);
+
+    previous = now;
+    previousTime = nowTime;
+}
+
+/**************** stats_reset ****************/
+/* see stats.h for description */
+void stats_reset(void) {
+    for (int t = 0; t < NumTypes; t++) {
+        atomic_store_explicit(&live.messagesIn[t], 0, memory_order_relaxed);
+        atomic_store_explicit(&live.messagesOut[t], 0, memory_order_relaxed);
+    }
+    atomic_store_explicit(&live.bytesIn, 0, memory_order_relaxed);
+    atomic_store_explicit(&live.bytesOut, 0, memory_order_relaxed);
+    atomic_store_explicit(&live.allocs, 0, memory_order_relaxed);
+    for (int timer = 0; timer < stats_NumTimers; timer++) {
+        for (int b = 0; b < HistBuckets; b++) {
+            atomic_store_explicit(&live.hist[timer][b], 0, memory_order_relaxed);
+        }
+    }
+    fovBase = grid_visibleComputed();
+    memset(&previous, 0, sizeof(previous));
+    previousTime = stats_now();
+}
@@ -0,0 +1,72 @@
+/*
+ * stats.h - header file for Nuggets 'stats' module
+ *
+ * 'stats' keeps the server's live performance counters: messages and bytes
+ * in and out, by message type; latency histograms for the busiest code paths;
+ * allocations; and visibility (field-of-view) computations. Every counter may
+ * be updated from any thread. The server prints them on its admin console.
+ *
+ * Selena Zhou, Kyla Widodo, 23S
+ */
+
+#ifndef __STATS_H
+#define __STATS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "../support/message.h"
+
+/**************** global types ****************/
+
+/* The code paths whose latency we keep histograms of. */
+typedef enum stats_timer {
+    stats_KeyPress,             // game_keyPress: one key from one client
+    stats_UpdateAllPlayers,     // building and sending all players' displays
+    stats_MessageSend,          // one message_send call
+    stats_NumTimers
+} stats_timer_t;
+
+/**************** functions ****************/
+
+/**************** stats_now ****************/
+/* Returns a monotonic timestamp in nanoseconds, to pass to stats_time.
+ */
+uint64_t stats_now(void);
+
+/**************** stats_time ****************/
+/* Records one sample of the given timer: the time from start until now.
+ *
+ * Caller provides: which timer, and a timestamp from stats_now.
+ */
+void stats_time(stats_timer_t timer, uint64_t start);
+
+/**************** stats_messageIn ****************/
+/* Counts one inbound message, by type (its first word), and its bytes.
+ */
+void stats_messageIn(const char* message);
+
+/**************** stats_send ****************/
+/* Sends the message with message_send, counting it by type and its bytes,
+ * and timing the call.
+ */
+void stats_send(const addr_t to, const char* message);
+
+/**************** stats_countAlloc ****************/
+/* Counts one memory allocation. The server calls this from its malloc
+ * wrappers; programs that do not will report no allocations.
+ */
+void stats_countAlloc(void);
+
+/**************** stats_print ****************/
+/* Prints every counter to fp: totals since the last reset, and rates over
+ * the interval since the last print (or reset).
+ */
+void stats_print(FILE* fp);
+
+/**************** stats_reset ****************/
+/* Zeroes every counter and histogram, and restarts the interval.
+ */
+void stats_reset(void);
+
+#endif // __STATS_H
@@ -4,6 +4,7 @@
  * server.c runs the game server that individual clients can connect to.
  * The server initializes the port, and then listens to connections from clients,
  * updating the master game and sending update info to each client.
+ * Lines typed on stdin are admin commands (see handleInput).
  *
  * Selena Zhou, Kyla Widodo, 23S
  */
@@ -12,21 +13,50 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include "common/grid.h"
 #include "common/player.h"
 #include "common/game.h"
+#include "common/stats.h"
+#include "common/journal.h"
+#include "common/lobby.h"
+#include "common/pool.h"
 #include "support/message.h"
+#include "support/trace.h"
 
 /**************** global variable ****************/
 
 game_t* game;           // Global game variable
+pool_t* workers = NULL; // Threads every game shares for display work
+bool pipelined = false; // Network I/O on its own threads (--pipeline)
+int maxPlayers = 26;    // Most players at once (--players)
+int radius = 0;         // Interest radius, 0 for everyone (--radius)
+unsigned long seed;     // Seed of the game's random numbers
+char* journalFile = NULL;   // Where to record every input (--journal)
+char* captureFile = NULL;   // Where to record every datagram (--capture)
+char* snapshotFile = NULL;  // Where to save the game, and resume it from (--snapshot)
+char* snapshotTemp = NULL;  // snapshotFile.new, where each is written first
+int poolSize = 0;       // Games kept ready, 0 to play just one (--pool)
+lobby_t* lobby = NULL;  // holds them
+int match = 1;          // this server's matches, numbered from 1
+bool resumed = false;   // this match's game came from the snapshot file
+journal_t* journal = NULL;
+bool gameChanged = false;   // since the last snapshot
+bool gameEnded = false;     // all the gold is found
+static const float IdleSeconds = 0.1;   // pause in input after which to write out records
+static const uint64_t SnapshotNanos = 1000000000;   // least time between snapshots
 
 /**************** function declarations ****************/
 
 void parseArgs(const int argc, char* argv[]);
 void initializeGame(char* mapFileName);
+void startJournal(char* mapFileName);
+bool nextMatch(char* mapFileName);
 bool handleInput (void *arg);
+bool handleTimeout(void* arg);
 bool handleMessage(void* arg, const addr_t from, const char* message);
+void runCommand(const char* command);
+void saveSnapshot(bool now);
 void game_over(); // calls message_done
 
 /**************** main ****************/
@@ -35,14 +65,44 @@ int main(const int argc, char* argv[]) {
 
     // Verify arguments and seed, initializes game.
     parseArgs(argc, argv);
+#ifdef TRACE
+    // before any thread starts; see support/trace.h
+    const char* traceFile = getenv("NUGGETS_TRACE");
+    if (traceFile != NULL && !trace_start(traceFile)) {
+        fprintf(stderr, "Warning: unable to write trace to '%s'.\n", traceFile);
+    }
+#endif
     initializeGame(argv[1]);
+    if (journalFile != NULL && resumed) {
+        fprintf(stderr, "Warning: the journal of a resumed game does not replay from its start.\n");
+    }
+    startJournal(argv[1]);
+    if (journalFile != NULL && journal == NULL) {
+        exit(2);
+    }
+    stats_reset();
 
     // Initialize the network and announce the port number.
     int portID = message_init(stdin);
     fprintf(stdout, "Server is running at %d\n", portID);
+    if (captureFile != NULL && !message_startCapture(captureFile)) {
+        fprintf(stderr, "Unable to write capture '%s'.\n", captureFile);
+        exit(2);
+    }
+    if (pipelined && !message_startPipeline()) {
+        fprintf(stderr, "Warning: unable to start pipeline; continuing without it.\n");
+    }
+    if (pipelined && !game_startBroadcaster(game)) {
+        fprintf(stderr, "Warning: unable to start broadcaster; continuing without it.\n");
+    }
 
     // Wait for messages from clients (players or spectators). (call message_loop() from message)
-    message_loop(NULL, 0, NULL, handleInput, handleMessage);        // figure out the first three args
+    // When recording or saving, write out the records whenever input pauses;
+    // with a pool, reset the games that are over then too.
+    const bool recording = (journal != NULL || captureFile != NULL || snapshotFile != NULL
+                            || lobby != NULL);
+    message_loop(argv[1], recording ? IdleSeconds : 0, recording ? handleTimeout : NULL,
+                 handleInput, handleMessage);
 
     // Free everything and exit server
     game_over();
@@ -58,11 +118,61 @@ int main(const int argc, char* argv[]) {
  * - (1): incorrect number of arguments
  * - (2): invalid argument
  * - (3): unable to create map grid
+ *
+ * Options may follow the map file and seed, in any order:
+ * --pipeline moves network receive and send onto their own threads,
+ * and building and sending displays onto another;
+ * --players N lets up to N players join (default 26);
+ * --radius R sends each update only to players within R of a change;
+ * --journal file records every input there, for ./replay --journal;
+ * --capture file records every datagram received there, for support/capreplay;
+ * --snapshot file saves the game there every second or so while it changes,
+ * and if the file holds a saved game when the server starts, resumes that
+ * game (with its own map, seed and limits) instead of starting a new one;
+ * --pool K keeps K games of the map ready, and plays match after match (the
+ * k-th seeded with seed + k - 1) until stdin ends, instead of just one.
  */
 void parseArgs(const int argc, char* argv[]) {
 
-    if (argc < 2 || argc > 3) {     // incorrect number of arguments
-        fprintf(stderr, "Usage: ./server mapFile.txt [seed]\n");
+    int nargs = argc;
+    while (nargs > 2) {
+        if (strcmp(argv[nargs-1], "--pipeline") == 0) {
+            pipelined = true;
+            nargs--;
+        } else if (strcmp(argv[nargs-2], "--players") == 0) {
+            if (sscanf(argv[nargs-1], "%d", &maxPlayers) != 1 || maxPlayers < 1) {
+                fprintf(stderr, "Error: --players must be a positive integer.\n");
+                exit(2);
+            }
+            nargs -= 2;
+        } else if (strcmp(argv[nargs-2], "--capture") == 0) {
+            captureFile = argv[nargs-1];
+            nargs -= 2;
+        } else if (strcmp(argv[nargs-2], "--snapshot") == 0) {
+            snapshotFile = argv[nargs-1];
+            nargs -= 2;
+        } else if (strcmp(argv[nargs-2], "--journal") == 0) {
+            journalFile = argv[nargs-1];
+            nargs -= 2;
+        } else if (strcmp(argv[nargs-2], "--pool") == 0) {
+            if (sscanf(argv[nargs-1], "%d", &poolSize) != 1 || poolSize < 1) {
+                fprintf(stderr, "Error: --pool must be a positive integer.\n");
+                exit(2);
+            }
+            nargs -= 2;
+        } else if (strcmp(argv[nargs-2], "--radius") == 0) {
+            if (sscanf(argv[nargs-1], "%d", &radius) != 1 || radius < 0) {
+                fprintf(stderr, "Error: --radius must be a nonnegative integer.\n");
+                exit(2);
+            }
+            nargs -= 2;
+        } else {
+            break;
+        }
+    }
+
+    if (nargs < 2 || nargs > 3) {     // incorrect number of arguments
+        fprintf(stderr, "Usage: ./server mapFile.txt [seed] [--pipeline] [--players N] [--radius R] [--journal file] [--capture file] [--snapshot file] [--pool K]\n");
         exit(1);
     }
 
@@ -73,55 +183,233 @@ void parseArgs(const int argc, char* argv[]) {
     }
     fclose(fp);
 
-    if (argc == 3) {    // create random seed if no seed provided, or validate provided seed
-        int seed;
-        if (sscanf(argv[2], "%d", &seed) != 1) {
+    if (snapshotFile != NULL) {
+        snapshotTemp = malloc(strlen(snapshotFile) + strlen(".new") + 1);
+        if (snapshotTemp == NULL) {
+            fprintf(stderr, "Error: out of memory.\n");
+            exit(2);
+        }
+        sprintf(snapshotTemp, "%s.new", snapshotFile);
+    }
+
+    if (nargs == 3) {    // create random seed if no seed provided, or validate provided seed
+        int givenSeed;
+        if (sscanf(argv[2], "%d", &givenSeed) != 1) {
             fprintf(stderr, "Error: seed must be an integer.\n");
             exit(2);
         }
-        srand(seed);
+        seed = givenSeed;
     } else {
-        srand(getpid());
+        seed = getpid();
+        fprintf(stderr, "Game seed is %d; pass it as the seed to play this game again.\n", (int) seed);
     }
 
 }
 
 /**************** initializeGame ****************/
-/* Initializes game locally. Creates game/grid from map file, sets up random gold piles.
+/* Initializes game locally. Creates game/grid from map file, sets up random gold piles;
+ * or resumes the game saved in the snapshot file, if there is one.
+ * With --pool, the lobby readies the games first, and the game comes from it.
  *
  * Caller provides: mapFileName
  * Returns: nothing, exits nonzero if fails.
  */
 void initializeGame(char* mapFileName) {
 
-    game = game_new(mapFileName);
+    workers = pool_new(0);      // NULL if it cannot; then the work is done here
+    if (poolSize > 0) {
+        lobby = lobby_new(mapFileName, poolSize, seed, maxPlayers, radius, workers);
+        if (lobby == NULL) {
+            fprintf(stderr, "Unable to ready %d games of %d players from given map file.\n",
+                    poolSize, maxPlayers);
+            exit(3);
+        }
+    }
+
+    int fd = (snapshotFile != NULL) ? open(snapshotFile, O_RDONLY) : -1;
+    if (fd >= 0) {
+        game = game_restore(fd);
+        close(fd);
+        if (game == NULL) {
+            fprintf(stderr, "Unable to resume the game saved in '%s'.\n", snapshotFile);
+            exit(3);
+        }
+        seed = game_getSeed(game);
+        game_setWorkers(game, workers);
+        resumed = true;
+        gameChanged = true;     // so it is saved again, under this server
+        fprintf(stderr, "Resuming the game saved in '%s'.\n", snapshotFile);
+        return;
+    }
+
+    game = (lobby != NULL) ? lobby_take(lobby) : game_new(mapFileName, seed);
     if (game == NULL) {
         fprintf(stderr, "Unable to create a new game from given map file.\n");
         exit(3);
     }
+    if (lobby == NULL && !game_setLimits(game, maxPlayers, radius)) {
+        fprintf(stderr, "Unable to allow %d players.\n", maxPlayers);
+        exit(3);
+    }
+    game_setWorkers(game, workers);
 
 }
+
+/**************** startJournal ****************/
+/* With --journal, starts the journal of this match: the file given for the
+ * first, and file.k for the k-th after that, so each replays on its own.
+ * Says so on stderr, and leaves journal NULL, if it cannot be written.
+ */
+void startJournal(char* mapFileName) {
+    if (journalFile == NULL) return;
+
+    char* path = malloc(strlen(journalFile) + 12);
+    if (path == NULL) {
+        fprintf(stderr, "Error: out of memory.\n");
+        return;
+    }
+    if (match == 1) {
+        strcpy(path, journalFile);
+    } else {
+        sprintf(path, "%s.%d", journalFile, match);
+    }
+    journal = journal_new(path, mapFileName, seed, maxPlayers, radius);
+    if (journal == NULL) {
+        fprintf(stderr, "Unable to write journal '%s'.\n", path);
+    }
+    free(path);
+}
+
+/**************** nextMatch ****************/
+/* With --pool, called when a match is over: ends its journal and snapshots,
+ * hands its game back to the lobby to be reset, and starts the next match
+ * on a ready game. A resumed game did not come from the lobby, and is
+ * deleted instead.
+ *
+ * Caller provides: mapFileName
+ * Returns: true if the server must stop, for want of a game; false otherwise.
+ */
+bool nextMatch(char* mapFileName) {
+    journal_delete(journal, game);
+    journal = NULL;
+    saveSnapshot(true);                 // renames the last one taken, if any
+    if (snapshotFile != NULL) {
+        unlink(snapshotTemp);
+        unlink(snapshotFile);           // nothing left to resume
+    }
+    if (resumed) {
+        game_delete(game);
+        resumed = false;
+    } else {
+        lobby_return(lobby, game);
+    }
+
+    game = lobby_take(lobby);
+    if (game == NULL) {
+        fprintf(stderr, "Unable to ready a game for the next match.\n");
+        return true;
+    }
+    match++;
+    seed = game_getSeed(game);
+    gameChanged = gameEnded = false;
+    fprintf(stderr, "Starting match %d (seed %lu).\n", match, seed);
+    startJournal(mapFileName);
+    if (pipelined && !game_startBroadcaster(game)) {
+        fprintf(stderr, "Warning: unable to start broadcaster; continuing without it.\n");
+    }
+    return false;
+}
 /**************** handleInput ****************/
-/* To be passed into message_loop(). Handles input from stdin.
+/* To be passed into message_loop(). Handles input from stdin: each line
+ * is an admin command, run by runCommand.
  *
  * Caller provides: entered input
  * Returns: true if EOF, false otherwise.
  */
 bool handleInput (void *arg) {
-    if(feof(stdin)) {
-        return true;
-    } else {
-        return false;
+    // read() rather than stdio, so no line is left buffered where select() cannot see it
+    static char line[101];      // command so far; longer ones are truncated
+    static int length = 0;
+    char buf[100];
+
+    ssize_t nbytes = read(STDIN_FILENO, buf, sizeof(buf));
+    if (nbytes <= 0) {
+        return true;        // EOF (or error): stop the server
+    }
+    for (int i = 0; i < nbytes; i++) {
+        if (buf[i] == '\n') {
+            line[length] = '\0';
+            runCommand(line);
+            length = 0;
+        } else if (length < sizeof(line) - 1) {
+            line[length++] = buf[i];
+        }
+    }
+    return false;
+}
+
+/**************** handleTimeout ****************/
+/* To be passed into message_loop() when journaling, capturing, saving or
+ * pooling: input has paused, so checkpoint and write out the journal, write
+ * out the capture, save the game if it is time, and reset the games over.
+ *
+ * Returns: false, to keep looping.
+ */
+bool handleTimeout(void* arg) {
+    journal_sync(journal, game);
+    message_flushCapture();
+    saveSnapshot(false);
+    if (lobby != NULL) {
+        lobby_tidy(lobby);
+    }
+    return false;
+}
+
+/**************** runCommand ****************/
+/* Runs one admin command, printing its output to stdout:
+ * - stats: message, latency, allocation and visibility counters
+ * - players: who is playing, where, with how much gold
+ * - reset-stats: zero the counters
+ * - snapshot: save the game now (with --snapshot)
+ */
+void runCommand(const char* command) {
+    if (strcmp(command, "stats") == 0) {
+        stats_print(stdout);
+    }
+    else if (strcmp(command, "players") == 0) {
+        game_printPlayers(game, stdout);
+    }
+    else if (strcmp(command, "reset-stats") == 0) {
+        stats_reset();
+        fprintf(stdout, "stats reset\n");
+    }
+    else if (strcmp(command, "snapshot") == 0) {
+        if (snapshotFile == NULL) {
+            fprintf(stdout, "No snapshot file; start the server with --snapshot file.\n");
+        } else {
+            gameChanged = true;
+            saveSnapshot(true);
+            fprintf(stdout, "game saved in '%s'\n", snapshotFile);
+        }
+    }
+    else if (command[0] != '\0') {
+        fprintf(stdout, "Unknown command '%s'; try stats, players, reset-stats, or snapshot.\n", command);
     }
+    fflush(stdout);
 }
 
 /**************** handleMessage ****************/
 /* To be passed into message_loop(). Calls game functions based on input from client.
+ * When the game is over, the server quits; with --pool, the next match starts.
  *
- * Caller provides: from address, command message
+ * Caller provides: map file name (as arg), from address, command message
  * Returns: true if server is quitting, false otherwise.
  */
 bool handleMessage(void* arg, const addr_t from, const char* message) {
+    TRACE_SCOPE("handleMessage");
+    stats_messageIn(message);
+    journal_record(journal, from, message);     // before, in case handling it crashes
+    bool gameOver = false;
     if (strncmp(message, "PLAY", strlen("PLAY")) == 0) {
         game_addPlayer(game, from, message);                        // new player
     }
@@ -129,19 +417,104 @@ bool handleMessage(void* arg, const addr_t from, const char* message) {
         game_addSpectator(game, from);                              // new spectator
     }
     else if (strncmp(message, "KEY", strlen("KEY")) == 0) {
-        return game_keyPress(game, from, message);                  // key press
+        uint64_t start = stats_now();
+        gameOver = game_keyPress(game, from, message);              // key press
+        stats_time(stats_KeyPress, start);
     }
     else {
-        message_send(from, "ERROR Command not recognized.");
+        game_send(game, from, "ERROR Command not recognized.");
+    }
+    journal_checkpoint(journal, game);
+    gameChanged = true;
+    gameEnded = gameOver;
+    saveSnapshot(false);
+    if (gameOver && lobby != NULL) {
+        return nextMatch(arg);
+    }
+    return gameOver;
+}
+
+/**************** saveSnapshot ****************/
+/* With --snapshot, called after each message and whenever input pauses.
+ * Once the last snapshot taken has been written, renames it over the
+ * snapshot file, so that file always holds a whole game. Then, if the game
+ * has changed and SnapshotNanos have passed since the last, takes the next
+ * into snapshotTemp; taking one copies the game in memory, and the writing
+ * is done on another thread (see game_snapshot), so neither step waits for
+ * the disk. With now, takes one whatever the time, and waits until it has
+ * been renamed.
+ */
+void saveSnapshot(bool now) {
+    static bool taken = false;          // one taken and not yet renamed
+    static uint64_t takenAt = 0;
+    if (snapshotFile == NULL) return;
+
+    if (taken && (now || game_snapshotsPending(game) == 0)) {
+        if (!game_snapshotWait(game) || rename(snapshotTemp, snapshotFile) != 0) {
+            fprintf(stderr, "Warning: unable to save the game in '%s'.\n", snapshotFile);
+        }
+        taken = false;
+    }
+    const uint64_t time = stats_now();
+    if (gameChanged && !gameEnded && (now || time - takenAt >= SnapshotNanos)) {
+        int fd = open(snapshotTemp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        taken = (fd >= 0) && game_snapshot(game, fd);
+        if (!taken) {
+            fprintf(stderr, "Warning: unable to save the game in '%s'.\n", snapshotTemp);
+        }
+        takenAt = time;
+        gameChanged = false;
+        if (now && taken) {
+            saveSnapshot(true);         // rename it
+        }
     }
-    return false;
 }
 
 /**************** game_over ****************/
-/* Frees everything from game, calls message_done()
+/* Frees everything from game (and the lobby), calls message_done()
  */
 void game_over() {
-    game_delete(game);
+    journal_delete(journal, game);      // with a last checkpoint
+    if (gameEnded) {
+        game_delete(game);              // after any snapshot still being written
+        if (snapshotFile != NULL) {
+            unlink(snapshotTemp);
+            unlink(snapshotFile);       // nothing left to resume
+        }
+    } else {
+        saveSnapshot(true);             // to resume where it stopped
+        game_delete(game);
+    }
+    lobby_delete(lobby);
+    pool_delete(workers);               // after every game that used it
+    free(snapshotTemp);
+    grid_freeRays();
     fprintf(stdout, "Server is shutting down.\n");
     message_done();
+    trace_stop();       // after every other thread has exited
+}
+
+/**************** allocation counting ****************/
+/* The server is linked with -Wl,--wrap=malloc (and calloc, realloc), so every
+ * call to these in the server and its libraries comes here first; we count it
+ * for the 'stats' command and pass it on. (Allocations made inside the C
+ * library itself, e.g. by strdup, are not seen.)
+ */
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size) {
+    stats_countAlloc();
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    stats_countAlloc();
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    stats_countAlloc();
+    return __real_realloc(ptr, size);
 }
@@ -0,0 +1,258 @@
+/*
+ * capreplay - send a capture of a server's inbound traffic to a server again
+ *
+ * usage: ./capreplay captureFile hostname port [--speed S | --fast] [--verbose]
+ *
+ * Reads a capture written by message_startCapture (the server's --capture
+ * option), opens one socket (message endpoint) for each sender in it, and
+ * sends every datagram again, from its sender's socket, to the given server,
+ * in the order and at the times they first arrived: as fast as they came
+ * (the default), S times as fast with --speed S, or with no waiting at
+ * all with --fast.  Bursts and duplicate datagrams go out just as they came
+ * in; each sender looks to the server like its own client.  Replies from the
+ * server are not read.
+ *
+ * At the end it reports the datagrams and bytes sent, the rate, and (unless
+ * --fast) how far behind schedule the sends ran: the 50th and 99th
+ * percentiles and the maximum.  With --verbose it also prints each datagram.
+ *
+ * Selena Zhou, Kyla Widodo, 23S
+ */
+
+#define _GNU_SOURCE             // for clock_nanosleep
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "message.h"
+#include "log.h"
+
+/**************** file-local constants ****************/
+static const char CaptureMagic[8] = { 'N','U','G','C','A','P','0','1' };
+
+/**************** file-local types ****************/
+typedef struct options {
+  const char* captureFile;
+  double speed;               // 0 for as fast as possible
+  bool verbose;
+  addr_t server;
+} options_t;
+
+typedef struct datagram {
+  uint64_t ns;                // arrival, since the capture started
+  int sender;
+  char* text;                 // null-terminated
+  uint32_t length;            // bytes as captured
+} datagram_t;
+
+/**************** file-local functions ****************/
+static void parseArgs(const int argc, char* argv[], options_t* options);
+static datagram_t* readCapture(const char* path, int* numDatagrams, int* numSenders);
+static uint64_t getLittle(const unsigned char* bytes, const int size);
+static uint64_t now(void);
+static int compareLateness(const void* a, const void* b);
+
+/***************** main *******************************/
+int
+main(const int argc, char* argv[])
+{
+  options_t options;
+  parseArgs(argc, argv, &options);
+  log_init(NULL);
+
+  // read it all first, so reading the file does not disturb the timing
+  int numDatagrams, numSenders;
+  datagram_t* datagrams = readCapture(options.captureFile, &numDatagrams, &numSenders);
+  if (datagrams == NULL) {
+    return 2;
+  }
+  message_endpoint_t** endpoints = calloc(numSenders > 0 ? numSenders : 1,
+                                          sizeof(message_endpoint_t*));
+  uint64_t* lateness = malloc((numDatagrams > 0 ? numDatagrams : 1) * sizeof(uint64_t));
+  if (endpoints == NULL || lateness == NULL) {
+    fprintf(stderr, "capreplay: out of memory\n");
+    return 2;
+  }
+  for (int s = 0; s < numSenders; s++) {
+    endpoints[s] = message_endpoint_new(0, false);
+    if (endpoints[s] == NULL) {
+      fprintf(stderr, "capreplay: cannot open socket for sender %d of %d\n", s, numSenders);
+      return 2;
+    }
+  }
+
+  unsigned long bytes = 0;
+  const uint64_t start = now();
+  for (int i = 0; i < numDatagrams; i++) {
+    datagram_t* d = &datagrams[i];
+    uint64_t due = start;
+    if (options.speed > 0) {
+      due += (uint64_t) (d->ns / options.speed);
+      struct timespec at = { due / 1000000000, due % 1000000000 };
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &at, NULL) != 0) {
+        // interrupted; sleep again
+      }
+    }
+    const uint64_t sent = now();
+    lateness[i] = (sent > due) ? sent - due : 0;
+    message_endpoint_send(endpoints[d->sender], options.server, d->text);
+    bytes += d->length;
+    if (options.verbose) {
+      printf("%10.6f %4d %s\n", d->ns / 1e9, d->sender, d->text);
+    }
+  }
+  const double seconds = (now() - start) / 1e9;
+  const double span = (numDatagrams > 0) ? datagrams[numDatagrams - 1].ns / 1e9 : 0.0;
+
+  printf("datagrams:  %d from %d senders, %lu bytes\n", numDatagrams, numSenders, bytes);
+  printf("captured:   over %.3f s\n", span);
+  printf("replayed:   in %.3f s (%.1f datagrams/sec)\n", seconds,
+         seconds > 0 ? numDatagrams / seconds : 0.0);
+  if (options.speed > 0 && numDatagrams > 0) {
+    qsort(lateness, numDatagrams, sizeof(uint64_t), compareLateness);
+    printf("behind schedule: p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+           lateness[numDatagrams / 2] / 1e6, lateness[(int) (numDatagrams * 0.99)] / 1e6,
+           lateness[numDatagrams - 1] / 1e6);
+  }
+
+  for (int s = 0; s < numSenders; s++) {
+    message_endpoint_delete(endpoints[s]);
+  }
+  for (int i = 0; i < numDatagrams; i++) {
+    free(datagrams[i].text);
+  }
+  free(datagrams);
+  free(endpoints);
+  free(lateness);
+  return 0;
+}
+
+/**************** parseArgs ****************/
+/* Parse the command line into options; print usage and exit if bad.
+ */
+static void
+parseArgs(const int argc, char* argv[], options_t* options)
+{
+  *options = (options_t) { NULL, 1.0, false };
+  bool ok = (argc >= 4) && message_setAddr(argv[2], argv[3], &options->server);
+  if (ok) {
+    options->captureFile = argv[1];
+  }
+  for (int i = 4; ok && i < argc; i++) {
+    const char* arg = argv[i];
+    const char* value = (i + 1 < argc) ? argv[i + 1] : "";
+    if (strcmp(arg, "--verbose") == 0) {
+      options->verbose = true;
+    } else if (strcmp(arg, "--fast") == 0) {
+      options->speed = 0;
+    } else if (strcmp(arg, "--speed") == 0) {
+      ok = sscanf(value, "%lf", &options->speed) == 1 && options->speed > 0;
+      i++;
+    } else {
+      ok = false;
+    }
+  }
+  if (!ok) {
+    fprintf(stderr, "usage: %s captureFile hostname port [--speed S | --fast] [--verbose]\n",
+            argv[0]);
+    exit(1);
+  }
+}
+
+/**************** readCapture ****************/
+/* Read every datagram of the capture file (see message_startCapture) into a
+ * new array, and count them and their senders.  A capture cut short (as
+ * when a server is killed) ends at its last whole datagram.
+ * Returns the array, which the caller must free along with each text;
+ * NULL, after saying why, if the file cannot be read or is no capture.
+ */
+static datagram_t*
+readCapture(const char* path, int* numDatagrams, int* numSenders)
+{
+  FILE* fp = fopen(path, "rb");
+  char magic[sizeof(CaptureMagic)];
+  if (fp == NULL || fread(magic, 1, sizeof(magic), fp) != sizeof(magic)
+      || memcmp(magic, CaptureMagic, sizeof(magic)) != 0) {
+    fprintf(stderr, "capreplay: '%s' is not a readable capture\n", path);
+    if (fp != NULL) {
+      fclose(fp);
+    }
+    return NULL;
+  }
+
+  int count = 0, max = 1024, senders = 0;
+  datagram_t* datagrams = malloc(max * sizeof(datagram_t));
+  unsigned char header[16];
+  size_t got = 0;             // bytes of the last header read
+  while (datagrams != NULL && (got = fread(header, 1, sizeof(header), fp)) == sizeof(header)) {
+    datagram_t d = { getLittle(header, 8), getLittle(header + 8, 4), NULL,
+                     getLittle(header + 12, 4) };
+    if (d.length > message_MaxBytes || d.sender < 0
+        || (d.text = malloc(d.length + 1)) == NULL) {
+      break;
+    }
+    if (fread(d.text, 1, d.length, fp) != d.length) {
+      free(d.text);
+      break;
+    }
+    d.text[d.length] = '\0';
+    if (count == max) {
+      max *= 2;
+      datagram_t* bigger = realloc(datagrams, max * sizeof(datagram_t));
+      if (bigger == NULL) {
+        free(d.text);
+        break;
+      }
+      datagrams = bigger;
+    }
+    datagrams[count++] = d;
+    if (d.sender >= senders) {
+      senders = d.sender + 1;
+    }
+  }
+  if (datagrams == NULL) {
+    fprintf(stderr, "capreplay: out of memory\n");
+  } else if (got != 0) {
+    fprintf(stderr, "capreplay: '%s' cut short or damaged after %d datagrams\n", path, count);
+  }
+  fclose(fp);
+  *numDatagrams = count;
+  *numSenders = senders;
+  return datagrams;
+}
+
+/**************** getLittle ****************/
+/* Return the little-endian integer of the given size at bytes.
+ */
+static uint64_t
+getLittle(const unsigned char* bytes, const int size)
+{
+  uint64_t value = 0;
+  for (int b = 0; b < size; b++) {
+    value |= (uint64_t) bytes[b] << (8 * b);
+  }
+  return value;
+}
+
+/**************** now ****************/
+/* Return a monotonic timestamp in nanoseconds.
+ */
+static uint64_t
+now(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+/**************** compareLateness ****************/
+/* For qsort: order lateness ascending.
+ */
+static int
+compareLateness(const void* a, const void* b)
+{
+  const uint64_t x = *(const uint64_t*) a, y = *(const uint64_t*) b;
+  return (x > y) - (x < y);
+}
@@ -0,0 +1,541 @@
+/* 
+ * loadgen - a UDP load generator for the Nuggets server
+ *
+ * usage: ./loadgen hostname port [--players N] [--spectators M]
+ *          [--rate keysPerSecond] [--pattern random|run|gold]
+ *          [--duration seconds] [--verbose]
+ *
+ * Joins N bot players (default 10) and M spectators (default 0) to a running
+ * server, each on its own socket (message endpoint) and thread.  Every player
+ * presses keys at the given rate (default 5 per second), chosen by pattern:
+ *   random - a random walk, one step at a time, onto spots it can see;
+ *   run    - a random direction it can move in, as a run (capital) key;
+ *   gold   - a step along the shortest visible path to the nearest gold,
+ *            or a random step if it sees none.
+ * After the duration (default 10 seconds), players quit and loadgen reports
+ * how many keys were sent and answered, and the input-to-DISPLAY latency:
+ * the time from sending a key that should move the player until the first
+ * DISPLAY showing the player ('@') somewhere else.  A key is counted as lost
+ * if no such DISPLAY arrives within a second (the request, or the reply,
+ * was dropped; or the server is that far behind).
+ * Only one key per player is measured at a time; keys sent while one is
+ * being measured still load the server but are not timed.
+ *
+ * The server allows one spectator; each new one replaces the last, so M > 1
+ * mostly exercises that path.
+ *
+ * Selena Zhou, Kyla Widodo, 23S
+ */
+
+#define _GNU_SOURCE             // for rand_r
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "message.h"
+#include "log.h"
+
+/**************** file-local constants ****************/
+static const uint64_t LostAfterNs = 1000000000;   // key unanswered after 1 s
+static const float MaxLoopSeconds = 0.05;          // longest a bot sleeps
+
+/**************** file-local types ****************/
+typedef enum { PatternRandom, PatternRun, PatternGold } pattern_t;
+
+typedef struct options {
+  int players, spectators;
+  double rate;                // keys per second, per player
+  pattern_t pattern;
+  double duration;            // seconds
+  bool verbose;
+  addr_t server;
+} options_t;
+
+typedef struct bot {
+  int index;                  // bot number, for names and reports
+  bool spectator;
+  const options_t* options;
+  message_endpoint_t* endpoint;
+  pthread_t thread;
+  unsigned int seed;          // for rand_r
+
+  // what the bot knows of the game
+  bool joined, quit;
+  int nrows, ncols;           // from GRID
+  char* frame;                // last DISPLAY, without the "DISPLAY\n"; or NULL
+  int atR, atC;               // where '@' is in frame; -1 if unknown
+
+  // timing of the key being measured
+  uint64_t nextKey;           // when to send the next key
+  bool pending;               // a key is being measured
+  uint64_t pendingSince;      // when it was sent
+  int pendingR, pendingC;     // where '@' was then
+
+  // counters
+  unsigned long keysSent, measured, answered, lost, displays, bytesIn;
+  uint64_t* latencies;        // [answered], nanoseconds
+  size_t latencyCap;
+} bot_t;
+
+/* Direction keys and the step each takes. */
+static const struct { char key; int dr, dc; } Directions[] = {
+  { 'h', 0, -1 }, { 'l', 0, 1 }, { 'j', 1, 0 }, { 'k', -1, 0 },
+  { 'y', -1, -1 }, { 'u', -1, 1 }, { 'b', 1, -1 }, { 'n', 1, 1 },
+};
+static const int NumDirections = 8;
+
+/**************** file-local global variables ****************/
+static atomic_bool stopping = false;    // set by main when duration is up
+
+/**************** file-local functions ****************/
+static void parseArgs(const int argc, char* argv[], options_t* options);
+static void* botMain(void* arg);
+static bool botTimeout(void* arg);
+static bool botMessage(void* arg, const addr_t from, const char* message);
+static bool botTick(bot_t* bot);
+static void botSendKey(bot_t* bot);
+static int botChooseDirection(bot_t* bot);
+static int botGoldDirection(bot_t* bot);
+static bool botOpen(const bot_t* bot, const int r, const int c);
+static void botRecord(bot_t* bot, const uint64_t ns);
+static uint64_t now(void);
+static int compareLatency(const void* a, const void* b);
+static double percentile(const uint64_t* sorted, const size_t n, const double p);
+
+/***************** main *******************************/
+int
+main(const int argc, char* argv[])
+{
+  options_t options;
+  parseArgs(argc, argv, &options);
+  log_init(NULL);
+
+  const int numBots = options.players + options.spectators;
+  bot_t* bots = calloc(numBots, sizeof(bot_t));
+  if (bots == NULL) {
+    fprintf(stderr, "loadgen: out of memory\n");
+    return 2;
+  }
+
+  // open every socket first, so a shortage of sockets shows up before any load
+  for (int i = 0; i < numBots; i++) {
+    bot_t* bot = &bots[i];
+    bot->index = i;
+    bot->spectator = (i >= options.players);
+    bot->options = &options;
+    bot->seed = 12345u + i;
+    bot->atR = bot->atC = -1;
+    bot->endpoint = message_endpoint_new(0, false);
+    if (bot->endpoint == NULL) {
+      fprintf(stderr, "loadgen: cannot open socket for bot %d\n", i);
+      return 2;
+    }
+  }
+
+  const uint64_t start = now();
+  int started = 0;
+  for (int i = 0; i < numBots; i++, started++) {
+    if (pthread_create(&bots[i].thread, NULL, botMain, &bots[i]) != 0) {
+      fprintf(stderr, "loadgen: cannot start thread for bot %d; running %d bots\n", i, i);
+      break;
+    }
+  }
+
+  struct timespec duration = { (time_t) options.duration,
+                               (long) ((options.duration - (time_t) options.duration) * 1e9) };
+  nanosleep(&duration, NULL);
+  atomic_store(&stopping, true);
+  for (int i = 0; i < started; i++) {
+    pthread_join(bots[i].thread, NULL);
+  }
+  const double seconds = (now() - start) / 1e9;
+
+  // gather everyone's counters
+  unsigned long keysSent = 0, measured = 0, answered = 0, lost = 0, displays = 0, bytesIn = 0;
+  int joined = 0;
+  for (int i = 0; i < started; i++) {
+    keysSent += bots[i].keysSent;
+    measured += bots[i].measured;
+    answered += bots[i].answered;
+    lost += bots[i].lost;
+    displays += bots[i].displays;
+    bytesIn += bots[i].bytesIn;
+    joined += bots[i].joined ? 1 : 0;
+  }
+  uint64_t* all = malloc((answered > 0 ? answered : 1) * sizeof(uint64_t));
+  size_t n = 0;
+  for (int i = 0; i < started; i++) {
+    memcpy(all + n, bots[i].latencies, bots[i].answered * sizeof(uint64_t));
+    n += bots[i].answered;
+  }
+  qsort(all, n, sizeof(uint64_t), compareLatency);
+
+  static const char* PatternNames[] = { "random", "run", "gold" };
+  printf("loadgen: %d players, %d spectators (%d joined), %.1f keys/s each, pattern %s, %.1f s\n",
+         options.players, options.spectators, joined, options.rate,
+         PatternNames[options.pattern], seconds);
+  printf("keys sent:         %lu (%.1f/s)\n", keysSent, keysSent / seconds);
+  printf("displays received: %lu (%.1f/s), %lu bytes (%.0f/s)\n",
+         displays, displays / seconds, bytesIn, bytesIn / seconds);
+  printf("keys measured:     %lu, answered %lu, lost %lu (%.2f%%)\n",
+         measured, answered, lost, measured > 0 ? 100.0 * lost / measured : 0.0);
+  if (n > 0) {
+    printf("latency (ms):      p50 %.2f  p90 %.2f  p99 %.2f  p999 %.2f  max %.2f\n",
+           percentile(all, n, 0.50), percentile(all, n, 0.90), percentile(all, n, 0.99),
+           percentile(all, n, 0.999), all[n-1] / 1e6);
+  }
+  if (options.verbose) {
+    printf("%5s %8s %8s %8s %6s %9s %9s\n",
+           "bot", "keys", "measured", "answered", "lost", "p50(ms)", "p99(ms)");
+    for (int i = 0; i < started; i++) {
+      bot_t* bot = &bots[i];
+      if (bot->spectator) {
+        printf("%5d %s, %lu displays\n", i, "spectator", bot->displays);
+        continue;
+      }
+      qsort(bot->latencies, bot->answered, sizeof(uint64_t), compareLatency);
+      printf("%5d %8lu %8lu %8lu %6lu %9.2f %9.2f\n", i, bot->keysSent, bot->measured,
+             bot->answered, bot->lost,
+             percentile(bot->latencies, bot->answered, 0.50),
+             percentile(bot->latencies, bot->answered, 0.99));
+    }
+  }
+
+  free(all);
+  for (int i = 0; i < numBots; i++) {
+    message_endpoint_delete(bots[i].endpoint);
+    free(bots[i].frame);
+    free(bots[i].latencies);
+  }
+  free(bots);
+  return 0;
+}
+
+/**************** parseArgs ****************/
+/* Parse the command line into options; print usage and exit if bad.
+ */
+static void
+parseArgs(const int argc, char* argv[], options_t* options)
+{
+  *options = (options_t) { 10, 0, 5.0, PatternRandom, 10.0, false };
+  bool ok = (argc >= 3) && message_setAddr(argv[1], argv[2], &options->server);
+  for (int i = 3; ok && i < argc; i++) {
+    const char* arg = argv[i];
+    const char* value = (i + 1 < argc) ? argv[i + 1] : "";
+    if (strcmp(arg, "--verbose") == 0) {
+      options->verbose = true;
+    } else if (strcmp(arg, "--players") == 0) {
+      ok = sscanf(value, "%d", &options->players) == 1 && options->players >= 0;
+      i++;
+    } else if (strcmp(arg, "--spectators") == 0) {
+      ok = sscanf(value, "%d", &options->spectators) == 1 && options->spectators >= 0;
+      i++;
+    } else if (strcmp(arg, "--rate") == 0) {
+      ok = sscanf(value, "%lf", &options->rate) == 1 && options->rate > 0;
+      i++;
+    } else if (strcmp(arg, "--duration") == 0) {
+      ok = sscanf(value, "%lf", &options->duration) == 1 && options->duration > 0;
+      i++;
+    } else if (strcmp(arg, "--pattern") == 0) {
+      if (strcmp(value, "random") == 0) {
+        options->pattern = PatternRandom;
+      } else if (strcmp(value, "run") == 0) {
+        options->pattern = PatternRun;
+      } else if (strcmp(value, "gold") == 0) {
+        options->pattern = PatternGold;
+      } else {
+        ok = false;
+      }
+      i++;
+    } else {
+      ok = false;
+    }
+  }
+  if (!ok || options->players + options->spectators == 0) {
+    fprintf(stderr, "usage: %s hostname port [--players N] [--spectators M]\n"
+            "         [--rate keysPerSecond] [--pattern random|run|gold]\n"
+            "         [--duration seconds] [--verbose]\n", argv[0]);
+    exit(1);
+  }
+}
+
+/**************** botMain ****************/
+/* Thread body for each bot: join, then loop on its endpoint until stopped.
+ */
+static void*
+botMain(void* arg)
+{
+  bot_t* bot = arg;
+  char name[32];
+  if (bot->spectator) {
+    message_endpoint_send(bot->endpoint, bot->options->server, "SPECTATE");
+  } else {
+    snprintf(name, sizeof(name), "PLAY bot%d", bot->index);
+    message_endpoint_send(bot->endpoint, bot->options->server, name);
+  }
+  // spread the bots' first keys across one key interval
+  const double interval = 1e9 / bot->options->rate;
+  bot->nextKey = now() + (uint64_t) (interval * rand_r(&bot->seed) / RAND_MAX);
+
+  float timeout = 1.0 / bot->options->rate;
+  if (timeout > MaxLoopSeconds) {
+    timeout = MaxLoopSeconds;
+  }
+  message_endpoint_loop(bot->endpoint, bot, timeout, botTimeout, NULL, botMessage);
+  if (bot->pending) {
+    bot->measured--;        // still in flight when we stopped; neither answered nor lost
+  }
+
+  if (bot->joined && !bot->quit && !bot->spectator) {
+    message_endpoint_send(bot->endpoint, bot->options->server, "KEY Q");
+  }
+  return NULL;
+}
+
+/**************** botTimeout ****************/
+/* Nothing arrived for a while; send a key if it is time.
+ * Return true to stop the bot's loop.
+ */
+static bool
+botTimeout(void* arg)
+{
+  return botTick(arg);
+}
+
+/**************** botMessage ****************/
+/* A message arrived from the server: learn from it, then send a key if due.
+ * Return true to stop the bot's loop.
+ */
+static bool
+botMessage(void* arg, const addr_t from, const char* message)
+{
+  bot_t* bot = arg;
+  bot->bytesIn += strlen(message);
+
+  if (strncmp(message, "OK ", 3) == 0) {
+    bot->joined = true;
+  } else if (strncmp(message, "GRID ", 5) == 0) {
+    sscanf(message, "GRID %d %d", &bot->nrows, &bot->ncols);
+    bot->joined = true;     // spectators get no OK
+  } else if (strncmp(message, "QUIT", 4) == 0) {
+    bot->quit = true;
+    return true;
+  } else if (strncmp(message, "DISPLAY\n", 8) == 0) {
+    bot->displays++;
+    const char* body = message + 8;
+    free(bot->frame);
+    bot->frame = malloc(strlen(body) + 1);
+    if (bot->frame == NULL) {
+      return true;
+    }
+    strcpy(bot->frame, body);
+    const char* at = strchr(bot->frame, '@');
+    if (at != NULL && bot->ncols > 0) {
+      const int offset = at - bot->frame;
+      bot->atR = offset / (bot->ncols + 1);
+      bot->atC = offset % (bot->ncols + 1);
+    }
+    // has our key been answered?
+    if (bot->pending && (bot->atR != bot->pendingR || bot->atC != bot->pendingC)) {
+      botRecord(bot, now() - bot->pendingSince);
+      bot->pending = false;
+    }
+  }
+  return botTick(bot);
+}
+
+/**************** botTick ****************/
+/* Expire an unanswered key, and send the next key if it is due.
+ * Return true if the bot should stop.
+ */
+static bool
+botTick(bot_t* bot)
+{
+  if (atomic_load(&stopping)) {
+    return true;
+  }
+  if (bot->spectator || !bot->joined) {
+    return false;
+  }
+  const uint64_t t = now();
+  if (bot->pending && t - bot->pendingSince > LostAfterNs) {
+    bot->lost++;
+    bot->pending = false;
+  }
+  if (t >= bot->nextKey) {
+    botSendKey(bot);
+    bot->nextKey += (uint64_t) (1e9 / bot->options->rate);
+    if (bot->nextKey < t) {
+      bot->nextKey = t;     // we fell behind; do not send a burst to catch up
+    }
+  }
+  return false;
+}
+
+/**************** botSendKey ****************/
+/* Choose and send one key; start measuring it if it should move us.
+ */
+static void
+botSendKey(bot_t* bot)
+{
+  const int d = botChooseDirection(bot);
+  char key = (d >= 0) ? Directions[d].key
+    : Directions[rand_r(&bot->seed) % NumDirections].key;
+  if (bot->options->pattern == PatternRun) {
+    key -= 'a' - 'A';
+  }
+  char message[8];
+  snprintf(message, sizeof(message), "KEY %c", key);
+  message_endpoint_send(bot->endpoint, bot->options->server, message);
+  bot->keysSent++;
+
+  if (d >= 0 && !bot->pending) {
+    bot->pending = true;
+    bot->pendingSince = now();
+    bot->pendingR = bot->atR;
+    bot->pendingC = bot->atC;
+    bot->measured++;
+  }
+}
+
+/**************** botChooseDirection ****************/
+/* Pick a direction by the bot's pattern, among those it can see are open.
+ * Return index into Directions, or -1 if it knows of none.
+ */
+static int
+botChooseDirection(bot_t* bot)
+{
+  if (bot->frame == NULL || bot->atR < 0) {
+    return -1;
+  }
+  if (bot->options->pattern == PatternGold) {
+    const int d = botGoldDirection(bot);
+    if (d >= 0) {
+      return d;
+    }
+  }
+  int open[8], nopen = 0;
+  for (int d = 0; d < NumDirections; d++) {
+    if (botOpen(bot, bot->atR + Directions[d].dr, bot->atC + Directions[d].dc)) {
+      open[nopen++] = d;
+    }
+  }
+  return (nopen == 0) ? -1 : open[rand_r(&bot->seed) % nopen];
+}
+
+/**************** botGoldDirection ****************/
+/* Breadth-first search of the visible map from '@' to the nearest gold.
+ * Return index into Directions of the first step, or -1 if no gold is reachable.
+ */
+static int
+botGoldDirection(bot_t* bot)
+{
+  const int nrows = bot->nrows, ncols = bot->ncols;
+  const int size = nrows * ncols;
+  int* firstStep = malloc(size * sizeof(int));    // -2 unvisited; else first direction
+  int* queue = malloc(size * sizeof(int));
+  if (firstStep == NULL || queue == NULL) {
+    free(firstStep);
+    free(queue);
+    return -1;
+  }
+  for (int i = 0; i < size; i++) {
+    firstStep[i] = -2;
+  }
+  int head = 0, tail = 0, found = -1;
+  firstStep[bot->atR * ncols + bot->atC] = -1;
+  queue[tail++] = bot->atR * ncols + bot->atC;
+  while (head < tail && found < 0) {
+    const int cell = queue[head++];
+    const int r = cell / ncols, c = cell % ncols;
+    for (int d = 0; d < NumDirections; d++) {
+      const int nr = r + Directions[d].dr, nc = c + Directions[d].dc;
+      if (!botOpen(bot, nr, nc) || firstStep[nr * ncols + nc] != -2) {
+        continue;
+      }
+      const int step = (firstStep[cell] == -1) ? d : firstStep[cell];
+      firstStep[nr * ncols + nc] = step;
+      if (bot->frame[nr * (ncols + 1) + nc] == '*') {
+        found = step;
+        break;
+      }
+      queue[tail++] = nr * ncols + nc;
+    }
+  }
+  free(firstStep);
+  free(queue);
+  return found;
+}
+
+/**************** botOpen ****************/
+/* Can the bot step onto r,c, as far as its last DISPLAY shows?
+ */
+static bool
+botOpen(const bot_t* bot, const int r, const int c)
+{
+  if (r < 0 || r >= bot->nrows || c < 0 || c >= bot->ncols) {
+    return false;
+  }
+  const char cell = bot->frame[r * (bot->ncols + 1) + c];
+  return cell == '.' || cell == '#' || cell == '*' || (cell >= 'A' && cell <= 'Z');
+}
+
+/**************** botRecord ****************/
+/* Remember one answered key's latency.
+ */
+static void
+botRecord(bot_t* bot, const uint64_t ns)
+{
+  if (bot->answered == bot->latencyCap) {
+    size_t cap = (bot->latencyCap == 0) ? 256 : 2 * bot->latencyCap;
+    uint64_t* latencies = realloc(bot->latencies, cap * sizeof(uint64_t));
+    if (latencies == NULL) {
+      return;
+    }
+    bot->latencies = latencies;
+    bot->latencyCap = cap;
+  }
+  bot->latencies[bot->answered++] = ns;
+}
+
+/**************** now ****************/
+/* Monotonic time in nanoseconds.
+ */
+static uint64_t
+now(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+/**************** compareLatency ****************/
+/* For qsort: order latencies ascending.
+ */
+static int
+compareLatency(const void* a, const void* b)
+{
+  const uint64_t x = *(const uint64_t*) a, y = *(const uint64_t*) b;
+  return (x > y) - (x < y);
+}
+
+/**************** percentile ****************/
+/* The p'th percentile (0 < p < 1) of n sorted latencies, in milliseconds.
+ */
+static double
+percentile(const uint64_t* sorted, const size_t n, const double p)
+{
+  if (n == 0) {
+    return 0.0;
+  }
+  size_t i = (size_t) (p * n);
+  if (i >= n) {
+    i = n - 1;
+  }
+  return sorted[i] / 1e6;
+}
@@ -6,13 +6,19 @@
  * and may be reordered, but require no connection setup or teardown.
  * 
  * See message.h for detailed interface description for each function.
- * Depends on the 'log' module and thus must be linked with log.o.
+ * Depends on the 'log' and 'ring' modules and thus must be linked with
+ * log.o and ring.o.
+ *
+ * Each endpoint carries its own socket, receive buffer, and pipeline, so
+ * endpoints may be used concurrently from different threads; the original
+ * global functions operate on a default endpoint made by message_init.
  * 
  * Compile with -DUNIT_TEST for a standalone unit test; see below.
  *
  * David Kotz - May 2019
  */
 
+#define _GNU_SOURCE             // for SO_REUSEPORT
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
@@ -24,8 +30,18 @@
 #include <arpa/inet.h>
 #include <sys/select.h>
 #include <math.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h>
 #include "message.h"
 #include "log.h"
+#include "ring.h"
+#include "trace.h"
 
 /**************** file-local constants ****************/
 /* See message.h for other constants (shared with users of this module).
@@ -35,24 +51,107 @@
 static const int MinPort = 1024;
 static const int MaxPort = 65535;
 
+static const int PipelineRingSize = 4096;   // datagrams in flight each way
+static const int PipelinePollMs = 100;      // how often receiver checks 'stopping'
+static const float WorkerPollSeconds = 0.1; // how often workers check 'stopping'
+static const char CaptureMagic[8] = { 'N','U','G','C','A','P','0','1' };
+static const int CaptureBufferSize = 1 << 16; // bytes of capture written at once
+
+/**************** file-local types ****************/
+
+/* In pipeline mode (see message_endpoint_startPipeline), a receiver thread
+ * drains the socket into the 'inbound' ring and pokes the endpoint's loop
+ * through a pipe; sends are queued onto the 'outbound' ring, drained by a
+ * sender thread.
+ */
+typedef struct datagram {
+  addr_t addr;                // where it came from, or is going to
+  char text[];                // null-terminated message
+} datagram_t;
+
+typedef struct pipeline {
+  bool active;                // threads are running
+  atomic_bool stopping;       // tells the threads to finish
+  pthread_t receiver;         // socket -> inbound
+  pthread_t sender;           // outbound -> socket
+  ring_t* inbound;            // SPSC: receiver thread -> endpoint's loop
+  ring_t* outbound;           // MPSC: any sending thread -> sender thread
+  int wakeFds[2];             // pipe: receiver -> loop's select()
+  sem_t outReady;             // posted once per datagram queued outbound
+} pipeline_t;
+
+/* An endpoint is one socket, with everything needed to use it;
+ * no two endpoints share any state, so each may be used on its own thread.
+ */
+struct message_endpoint {
+  int socket;                 // on which to send and receive
+  int port;                   // port number to which socket is bound
+  char* buf;                  // [message_MaxBytes] for receiving
+  pipeline_t pipeline;        // see message_endpoint_startPipeline
+};
+
+typedef struct worker {
+  message_endpoint_t* endpoint;       // this worker's socket
+  pthread_t thread;
+  struct message_workers* workers;    // the group
+} worker_t;
+
+struct message_workers {
+  int numWorkers;             // number of workers started
+  int port;                   // port shared by all workers
+  atomic_bool stopping;       // tells the workers to finish
+  void* arg;                  // passed through to handleMessage
+  bool (*handleMessage)(void* arg, const addr_t from, const char* message);
+  worker_t* workers;          // [numWorkers]
+};
+
 /**************** file-local global variables ****************/
 /* This is an example of a judicious use of a global variable.
- * This module provides init() and done() functions that allow it
- * to initialize and cleanup; specifically, it needs to open and close
- * a socket it will use for all the messaging operations. We keep the
- * socket number (a file descriptor) here inside the module, unseen by
- * any code outside this module, but convenient for use internally.
- * One disadvantage to this approach is that all users of this module
- * must work with the same socket, and thus the same port number,
- * but a more flexible approach would require a much more complex interface.
+ * The global functions (message_init, message_send, message_loop, ...)
+ * all work on one default endpoint, created by message_init and closed by
+ * message_done.  We keep it here inside the module, unseen by any code
+ * outside this module, so that simple programs need not pass it around.
+ * Programs that need more than one socket, or one per thread, use the
+ * message_endpoint functions instead.
  */
-static int ourSocket = 0;     // socket on which to receive messages
+static message_endpoint_t* defaultEndpoint = NULL;
+
+// the endpoint whose loop is running on this thread, if any
+static _Thread_local message_endpoint_t* currentEndpoint = NULL;
+
+/* The capture of inbound datagrams (see message_startCapture), if any.
+ * Any receiving thread may write to it, so all but 'active' is protected
+ * by 'lock'; 'active' lets the receive path skip the lock when idle.
+ */
+static struct {
+  atomic_bool active;
+  pthread_mutex_t lock;
+  FILE* fp;                   // the capture file, buffered
+  struct timespec start;      // when the capture started
+  addr_t* senders;            // sender numbers' addresses
+  int numSenders;
+  int maxSenders;             // size of senders array
+  int* senderOf;              // [indexMask+1]: hash of addresses to sender numbers, -1 if empty
+  int indexMask;              // its size - 1; a power of two, at least 2*maxSenders
+  unsigned long count;        // datagrams captured
+} capture = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/**************** file-local functions ****************/
+static void message_stopPipeline(message_endpoint_t* endpoint);
+static void message_capture(const addr_t from, const char* buf, const int nbytes);
+static int message_captureSender(const addr_t from);
+static unsigned int message_hashAddr(const addr_t addr);
+static bool message_endpoint_receive(message_endpoint_t* endpoint,
+                                     const bool pipelined, void* arg,
+                                     bool (*handleMessage)(void* arg,
+                                                           const addr_t from,
+                                                           const char* message));
 
 /***********************************************************************/
 /**************** message_init ****************/
 /* 
- * Set up a socket on which to receive messages; return the port number.
- * Invariant: ourSocket = 0 if we return with error, else ourSocket > 0.
+ * Set up the default endpoint; return its port number.
+ * Invariant: defaultEndpoint = NULL if we return with error.
  * Log error and return zero if any error.
  * See message.h for detailed description.
  */
@@ -62,44 +161,101 @@ message_init(FILE* logFP)
   log_init(logFP);
 
   // Have we already been initialized?
-  if (ourSocket != 0) {
+  if (defaultEndpoint != NULL) {
     log_v("message_init: called again, when already initialized");
     return 0;
   }
 
-  // Create socket on which to listen (file descriptor)
-  ourSocket = socket(AF_INET, SOCK_DGRAM, 0);
-  if (ourSocket < 0) {
-    log_e("message_init: error opening datagram socket");
-    ourSocket = 0;
+  defaultEndpoint = message_endpoint_new(0, false);
+  if (defaultEndpoint == NULL) {
     return 0;
   }
+  return defaultEndpoint->port;
+}
+
+/**************** message_endpoint_new ****************/
+/* 
+ * Set up a socket on which to receive messages.
+ * Log error and return NULL if any error.
+ * See message.h for detailed description.
+ */
+message_endpoint_t*
+message_endpoint_new(const int port, const bool reusePort)
+{
+  if (port != 0 && (port < MinPort || port > MaxPort)) {
+    log_d("message_endpoint_new: illegal port number '%d'", port);
+    return NULL;
+  }
+
+  message_endpoint_t* endpoint = calloc(1, sizeof(message_endpoint_t));
+  if (endpoint == NULL) {
+    log_v("message_endpoint_new: out of memory");
+    return NULL;
+  }
+  endpoint->buf = malloc(message_MaxBytes);
+  if (endpoint->buf == NULL) {
+    log_v("message_endpoint_new: out of memory");
+    free(endpoint);
+    return NULL;
+  }
+
+  // Create socket on which to listen (file descriptor)
+  endpoint->socket = socket(AF_INET, SOCK_DGRAM, 0);
+  if (endpoint->socket < 0) {
+    log_e("message_endpoint_new: error opening datagram socket");
+    free(endpoint->buf);
+    free(endpoint);
+    return NULL;
+  }
+
+  // Let other sockets bind the same port, if asked; must precede bind
+  const int on = 1;
+  if (reusePort && setsockopt(endpoint->socket, SOL_SOCKET, SO_REUSEPORT,
+                              &on, sizeof(on)) != 0) {
+    log_e("message_endpoint_new: setting SO_REUSEPORT");
+    message_endpoint_delete(endpoint);
+    return NULL;
+  }
 
   // Name socket using wildcards
   struct sockaddr_in self;  // our address
   self.sin_family = AF_INET;
   self.sin_addr.s_addr = INADDR_ANY;
-  self.sin_port = 0;
-  if (bind(ourSocket, (struct sockaddr *) &self, sizeof(self))) {
-    log_e("message_init: binding socket name");
-    close(ourSocket);
-    ourSocket = 0;
-    return 0;
+  self.sin_port = htons(port);
+  if (bind(endpoint->socket, (struct sockaddr *) &self, sizeof(self))) {
+    log_e("message_endpoint_new: binding socket name");
+    message_endpoint_delete(endpoint);
+    return NULL;
   }
 
   // get our assigned address
   socklen_t selflen = sizeof(self); // length of our address
-  if (getsockname(ourSocket, (struct sockaddr *) &self, &selflen)) {
-    log_e("message_init: getting socket name");
-    close(ourSocket);
-    ourSocket = 0;
-    return 0;
+  if (getsockname(endpoint->socket, (struct sockaddr *) &self, &selflen)) {
+    log_e("message_endpoint_new: getting socket name");
+    message_endpoint_delete(endpoint);
+    return NULL;
   }
   // extract our port number
-  int port = ntohs(self.sin_port);
-  log_d("message_init: ready at port '%d'", port);
+  endpoint->port = ntohs(self.sin_port);
+  log_d("message_endpoint_new: ready at port '%d'", endpoint->port);
+
+  return endpoint;
+}
+
+/**************** message_endpoint_port ****************/
+/* see message.h for detailed description */
+int
+message_endpoint_port(const message_endpoint_t* endpoint)
+{
+  return (endpoint == NULL) ? 0 : endpoint->port;
+}
 
-  return port;
+/**************** message_endpoint_current ****************/
+/* see message.h for detailed description */
+message_endpoint_t*
+message_endpoint_current(void)
+{
+  return currentEndpoint;
 }
 
 /**************** message_noAddr ****************/
@@ -188,23 +344,37 @@ message_setAddr(const char* hostname, const char* portString, addr_t* addr)
   return true;
 }
 
+/**************** message_formatAddr ****************/
+/* Produce a string representation of the address, in caller's buffer.
+ * See message.h for detailed description.
+ */
+const char*
+message_formatAddr(const addr_t addr, char* buf, const size_t size)
+{
+  if (buf == NULL || size == 0) {
+    return NULL;
+  }
+  char ip[INET_ADDRSTRLEN];   // inet_ntoa would use a static buffer
+  if (inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip)) == NULL) {
+    snprintf(ip, sizeof(ip), "?");
+  }
+  snprintf(buf, size, "%s:%05d", ip, ntohs(addr.sin_port));
+  return buf;
+}
+
 /**************** message_stringAddr ****************/
 /* Produce a string representation of the address.
  * Returns pointer to static storage that should not be retained
- * (because every call to this function returns the same pointer).
+ * (because every call to this function, on this thread, returns the
+ * same pointer).
  * See message.h for detailed description.
  */
 const char*
 message_stringAddr(const addr_t addr)
 {
-  // Maximum string length to hold an IP address and port, plus null.
-  // e.g., 255.255.255.255:65507
-  static char addrString[22]; // constant appears in snprintf below
-
-  snprintf(addrString, 22, "%s:%05d",
-	   inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+  static _Thread_local char addrString[message_AddrStringSize];
 
-  return addrString;
+  return message_formatAddr(addr, addrString, sizeof(addrString));
 }
 
 /**************** numLines ****************/
@@ -237,6 +407,40 @@ numLines(const char* string)
   }
 }
 
+/**************** datagram_new ****************/
+/*
+ * Allocate a datagram holding a copy of the message; NULL if out of memory.
+ */
+static datagram_t*
+datagram_new(const addr_t addr, const char* message, const size_t len)
+{
+  datagram_t* datagram = malloc(sizeof(datagram_t) + len + 1);
+  if (datagram != NULL) {
+    datagram->addr = addr;
+    memcpy(datagram->text, message, len);
+    datagram->text[len] = '\0';
+  }
+  return datagram;
+}
+
+/**************** message_sendNow ****************/
+/*
+ * Send a string message on the endpoint's socket, right now, from this thread.
+ */
+static void
+message_sendNow(message_endpoint_t* endpoint, const addr_t to, const char* message)
+{
+  if (sendto(endpoint->socket, message, strlen(message), 0,
+             (struct sockaddr *) &to, sizeof(to)) < 0) {
+    log_e("message_send: error sending to datagram socket");
+  } else {
+    char addrString[message_AddrStringSize];
+    log_s("message_send: TO %s", message_formatAddr(to, addrString, sizeof(addrString)));
+    log_d("message_send: %d lines:", numLines(message));
+    log_s("%s", message);
+  }
+}
+
 /**************** message_send ****************/
 /* 
  * Send a string message to the correspondent address.
@@ -245,29 +449,226 @@ numLines(const char* string)
 void
 message_send(const addr_t to, const char* message)
 {
-  if (ourSocket == 0) {
+  if (defaultEndpoint == NULL) {
     log_v("message_send: called before message_init");
     return; // error in usage of this function.
   }
+  message_endpoint_send(defaultEndpoint, to, message);
+}
+
+/**************** message_endpoint_send ****************/
+/* 
+ * Send a string message to the correspondent address, from this endpoint.
+ * In pipeline mode, queue it for the sender thread instead.
+ * See message.h for detailed description.
+ */
+void
+message_endpoint_send(message_endpoint_t* endpoint, const addr_t to, const char* message)
+{
+  TRACE_SCOPE("message_send");
+  if (endpoint == NULL) {
+    log_v("message_endpoint_send: called with null endpoint");
+    return; // error in usage of this function.
+  }
   if (message == NULL) {
     log_v("message_send: called with null message");
     return; // error in usage of this function.
   }
-  if (sendto(ourSocket, message, strlen(message), 0,
-             (struct sockaddr *) &to, sizeof(to)) < 0) {
-    log_e("message_send: error sending to datagram socket");
-  } else {
-    log_s("message_send: TO %s", message_stringAddr(to));
-    log_d("message_send: %d lines:", numLines(message));
-    log_s("%s", message);
+  if (!endpoint->pipeline.active) {
+    message_sendNow(endpoint, to, message);
+    return;
+  }
+
+  datagram_t* datagram = datagram_new(to, message, strlen(message));
+  if (datagram == NULL) {
+    log_v("message_send: out of memory; sending inline");
+    message_sendNow(endpoint, to, message);
+    return;
   }
+  while (!ring_push(endpoint->pipeline.outbound, datagram)) {
+    sched_yield();            // ring full; let the sender catch up
+  }
+  sem_post(&endpoint->pipeline.outReady);
+}
+
+/**************** message_receiverMain ****************/
+/*
+ * Pipeline receiver thread: read datagrams from the socket as fast as they
+ * arrive, queue them on the inbound ring, and poke the endpoint's loop.
+ */
+static void*
+message_receiverMain(void* arg)
+{
+  message_endpoint_t* endpoint = arg;
+  pipeline_t* pipeline = &endpoint->pipeline;
+  char* buf = endpoint->buf;  // the loop does not read the socket meanwhile
+  struct pollfd pfd = { .fd = endpoint->socket, .events = POLLIN };
+
+  while (!atomic_load(&pipeline->stopping)) {
+    if (poll(&pfd, 1, PipelinePollMs) <= 0) {
+      continue;               // timeout or signal; check 'stopping' again
+    }
+    struct sockaddr_in sender;
+    socklen_t senderlen = sizeof(sender);
+    int nbytes = recvfrom(endpoint->socket, buf, message_MaxBytes-1,
+                          0, (struct sockaddr *) &sender, &senderlen);
+    if (nbytes < 0) {
+      log_e("message_receiverMain: receiving from socket");
+      continue;
+    }
+    if (sender.sin_family != AF_INET) {
+      log_d("message_receiverMain: non-Internet family %d\n", sender.sin_family);
+      continue;
+    }
+    message_capture(sender, buf, nbytes);
+    datagram_t* datagram = datagram_new(sender, buf, nbytes);
+    if (datagram == NULL) {
+      log_v("message_receiverMain: out of memory; dropping datagram");
+      continue;
+    }
+    while (!ring_push(pipeline->inbound, datagram)) {
+      if (atomic_load(&pipeline->stopping)) {
+        free(datagram);
+        break;
+      }
+      sched_yield();          // ring full; let the loop catch up
+    }
+    // wake the loop; if the pipe is already full, it is awake anyway
+    if (write(pipeline->wakeFds[1], "", 1) < 0 && errno != EAGAIN) {
+      log_e("message_receiverMain: writing wakeup pipe");
+    }
+  }
+  return NULL;
+}
+
+/**************** message_senderMain ****************/
+/*
+ * Pipeline sender thread: send every datagram queued on the outbound ring,
+ * in order, until told to stop and the ring is empty.
+ */
+static void*
+message_senderMain(void* arg)
+{
+  message_endpoint_t* endpoint = arg;
+  pipeline_t* pipeline = &endpoint->pipeline;
+
+  while (true) {
+    sem_wait(&pipeline->outReady);
+    // drain everything published so far; a post may cover several items
+    datagram_t* datagram;
+    while ((datagram = ring_pop(pipeline->outbound)) != NULL) {
+      message_sendNow(endpoint, datagram->addr, datagram->text);
+      free(datagram);
+    }
+    if (atomic_load(&pipeline->stopping)) {
+      return NULL;
+    }
+  }
+}
+
+/**************** message_startPipeline ****************/
+/* 
+ * Start the receiver and sender threads for the default endpoint.
+ * See message.h for detailed description.
+ */
+bool
+message_startPipeline(void)
+{
+  if (defaultEndpoint == NULL) {
+    log_v("message_startPipeline: called before message_init");
+    return false;
+  }
+  return message_endpoint_startPipeline(defaultEndpoint);
+}
+
+/**************** message_endpoint_startPipeline ****************/
+/* 
+ * Start the receiver and sender threads.
+ * See message.h for detailed description.
+ */
+bool
+message_endpoint_startPipeline(message_endpoint_t* endpoint)
+{
+  if (endpoint == NULL) {
+    log_v("message_endpoint_startPipeline: called with null endpoint");
+    return false;
+  }
+  pipeline_t* pipeline = &endpoint->pipeline;
+  if (pipeline->active) {
+    return true;
+  }
+
+  pipeline->inbound = ring_newSPSC(PipelineRingSize);
+  pipeline->outbound = ring_newMPSC(PipelineRingSize);
+  if (pipeline->inbound == NULL || pipeline->outbound == NULL
+      || pipe(pipeline->wakeFds) != 0) {
+    log_v("message_startPipeline: cannot allocate rings or pipe");
+    ring_delete(pipeline->inbound);
+    ring_delete(pipeline->outbound);
+    return false;
+  }
+  fcntl(pipeline->wakeFds[0], F_SETFL, O_NONBLOCK);
+  fcntl(pipeline->wakeFds[1], F_SETFL, O_NONBLOCK);
+  sem_init(&pipeline->outReady, 0, 0);
+  atomic_init(&pipeline->stopping, false);
+
+  if (pthread_create(&pipeline->receiver, NULL, message_receiverMain, endpoint) != 0) {
+    log_v("message_startPipeline: cannot start receiver thread");
+    close(pipeline->wakeFds[0]);
+    close(pipeline->wakeFds[1]);
+    sem_destroy(&pipeline->outReady);
+    ring_delete(pipeline->inbound);
+    ring_delete(pipeline->outbound);
+    return false;
+  }
+  if (pthread_create(&pipeline->sender, NULL, message_senderMain, endpoint) != 0) {
+    log_v("message_startPipeline: cannot start sender thread");
+    atomic_store(&pipeline->stopping, true);
+    pthread_join(pipeline->receiver, NULL);
+    close(pipeline->wakeFds[0]);
+    close(pipeline->wakeFds[1]);
+    sem_destroy(&pipeline->outReady);
+    ring_delete(pipeline->inbound);
+    ring_delete(pipeline->outbound);
+    return false;
+  }
+  pipeline->active = true;
+  log_v("message_startPipeline: receiver and sender threads running");
+  return true;
+}
+
+/**************** message_stopPipeline ****************/
+/*
+ * Stop the endpoint's pipeline threads, after sending everything queued
+ * outbound; discard anything received but not yet handled.
+ */
+static void
+message_stopPipeline(message_endpoint_t* endpoint)
+{
+  pipeline_t* pipeline = &endpoint->pipeline;
+  if (!pipeline->active) {
+    return;
+  }
+  atomic_store(&pipeline->stopping, true);
+  pthread_join(pipeline->receiver, NULL);
+  sem_post(&pipeline->outReady);
+  pthread_join(pipeline->sender, NULL);
+
+  datagram_t* datagram;
+  while ((datagram = ring_pop(pipeline->inbound)) != NULL) {
+    free(datagram);
+  }
+  ring_delete(pipeline->inbound);
+  ring_delete(pipeline->outbound);
+  close(pipeline->wakeFds[0]);
+  close(pipeline->wakeFds[1]);
+  sem_destroy(&pipeline->outReady);
+  pipeline->active = false;
 }
 
 /**************** message_loop ****************/
 /* 
- * Loop forever, calling handler functions for stdin or socket,
- * as input is available from either.
- * Returns false on error or true if any of the handlers return true.
+ * Loop on the default endpoint.
  * See message.h for detailed description.
  */
 bool
@@ -275,19 +676,27 @@ message_loop(void* arg, const float timeout,
              bool (*handleTimeout)(void* arg),
              bool (*handleInput)  (void* arg),
              bool (*handleMessage)(void* arg,
-                                   const addr_t from, const char* buf))
+                                   const addr_t from,
+                                   const char* message))
 {
-  // check if we're ready for messaging
-  if (ourSocket == 0) {
-    log_v("message_loop called before message_init");
-    return false; // error in usage of this function.
-  }
+  return message_endpoint_loop(defaultEndpoint, arg, timeout,
+                               handleTimeout, handleInput, handleMessage);
+}
 
-  // check parameters
-  if (handleTimeout == NULL && handleInput == NULL && handleMessage == NULL) {
-    log_v("message_loop called with all handlers null");
-    return false; // error in usage of this function.
-  }
+/**************** message_endpoint_loop ****************/
+/* 
+ * Loop, handling input and incoming messages on this endpoint.
+ * See message.h for detailed description.
+ */
+bool
+message_endpoint_loop(message_endpoint_t* endpoint, void* arg, const float timeout,
+                      bool (*handleTimeout)(void* arg),
+                      bool (*handleInput)  (void* arg),
+                      bool (*handleMessage)(void* arg,
+                                            const addr_t from,
+                                            const char* message))
+{
+  // check arguments
   if (handleTimeout == NULL && timeout > 0.0) {
     log_v("message_loop called with null handleTimeout but timeout > 0");
     return false; // error in usage of this function.
@@ -303,9 +712,14 @@ message_loop(void* arg, const float timeout,
   struct timeval  timeoutval;     // timeval equivalent of parameter 'timeout'
   if (timeout > 0.0) {
     timeoutval.tv_sec  = (int)timeout;
-    timeoutval.tv_usec = timeout - (int)timeout;
+    timeoutval.tv_usec = (timeout - (int)timeout) * 1000000;
   }
 
+  // handlers may ask which endpoint they were called from
+  message_endpoint_t* outerEndpoint = currentEndpoint;
+  currentEndpoint = endpoint;
+  bool ok = true;
+
   // loop until error or some handler indicates time to quit looping
   while (true) {
     // for use with select()
@@ -318,9 +732,13 @@ message_loop(void* arg, const float timeout,
       FD_SET(0, &rfds);       // monitor stdin
       nfds = 1;
     }
-    if (handleMessage != NULL && ourSocket != 0) {
-      FD_SET(ourSocket, &rfds); // monitor the socket
-      nfds = ourSocket+1;       // highest-numbered fd in rfds
+    // in pipeline mode the receiver thread owns the socket; watch its pipe
+    const bool pipelined = (endpoint != NULL && endpoint->pipeline.active);
+    const int netfd = (endpoint == NULL) ? -1
+      : pipelined ? endpoint->pipeline.wakeFds[0] : endpoint->socket;
+    if (handleMessage != NULL && netfd >= 0) {
+      FD_SET(netfd, &rfds);     // monitor the socket
+      nfds = netfd+1;           // highest-numbered fd in rfds
     }
     if (timeout > 0.0) {      // is timeout desired?
       timer = timeoutval;     // set the timer to the timeout value
@@ -341,7 +759,8 @@ message_loop(void* arg, const float timeout,
       } else {
 	// some error occurred; this should not happen
 	log_e("message_loop: select()");
-	return false; // error
+	ok = false; // error
+	break;
       }
     } else if (select_response == 0) {
       // timeout occurred
@@ -359,42 +778,277 @@ message_loop(void* arg, const float timeout,
           break; // handler says to exit loop 
         }
       }
-      if (FD_ISSET(ourSocket, &rfds)) {
-        // socket has input ready
-        log_v("message_loop: message ready on socket");
-        struct sockaddr_in sender;     // sender of this message
-        struct sockaddr *senderp = (struct sockaddr *) &sender;
-        socklen_t senderlen = sizeof(sender);  // must pass address to length
-        char buf[message_MaxBytes]; // buffer for reading data from socket
-        int nbytes = recvfrom(ourSocket, buf, message_MaxBytes-1, 
-                              0, senderp, &senderlen);
-        if (nbytes < 0) {
-          // error, ignore it
-          log_e("message_loop: receiving from socket");
-        } else {
-          buf[nbytes] = '\0';     // null terminate message string
-          // where was it from?
-          if (sender.sin_family != AF_INET) {
-            // ignore it
-            log_d("message_loop: non-Internet family %d\n", sender.sin_family);
-          } else {
-	    // record it
-	    log_s("message_loop: FROM %s", message_stringAddr(sender));
-	    log_d("message_loop: %d lines:", numLines(buf));
-	    log_s("%s", buf);
-
-            // handle it
-            if (handleMessage != NULL && (*handleMessage)(arg, sender, buf)) {
-              break; // handler says to exit loop 
-            }
-          }
+      if (netfd >= 0 && FD_ISSET(netfd, &rfds)
+          && message_endpoint_receive(endpoint, pipelined, arg, handleMessage)) {
+        break; // handler says to exit loop
+      }
+    }
+  }
+  currentEndpoint = outerEndpoint;
+  return ok;
+}
+
+/**************** message_endpoint_receive ****************/
+/*
+ * The endpoint's socket (or, in pipeline mode, its wakeup pipe) is ready:
+ * handle the datagram(s) waiting there.
+ * Return true if the handler says to exit the loop.
+ */
+static bool
+message_endpoint_receive(message_endpoint_t* endpoint, const bool pipelined, void* arg,
+                         bool (*handleMessage)(void* arg,
+                                               const addr_t from,
+                                               const char* message))
+{
+  char addrString[message_AddrStringSize];
+
+  if (pipelined) {
+    // receiver thread has queued datagrams; handle all that are ready
+    pipeline_t* pipeline = &endpoint->pipeline;
+    char drain[64];
+    while (read(pipeline->wakeFds[0], drain, sizeof(drain)) > 0) {
+      // empty the wakeup pipe
+    }
+    datagram_t* datagram;
+    while ((datagram = ring_pop(pipeline->inbound)) != NULL) {
+      log_s("message_loop: FROM %s", message_formatAddr(datagram->addr, addrString, sizeof(addrString)));
+      log_d("message_loop: %d lines:", numLines(datagram->text));
+      log_s("%s", datagram->text);
+      bool quit = (*handleMessage)(arg, datagram->addr, datagram->text);
+      free(datagram);
+      if (quit) {
+        // anything left waits for the next loop; make sure it wakes
+        if (write(pipeline->wakeFds[1], "", 1) < 0 && errno != EAGAIN) {
+          log_e("message_loop: writing wakeup pipe");
         }
+        return true;
       }
     }
+    return false;
+  }
+
+  // socket has input ready
+  log_v("message_loop: message ready on socket");
+  struct sockaddr_in sender;     // sender of this message
+  struct sockaddr *senderp = (struct sockaddr *) &sender;
+  socklen_t senderlen = sizeof(sender);  // must pass address to length
+  char* buf = endpoint->buf;     // buffer for reading data from socket
+  int nbytes = recvfrom(endpoint->socket, buf, message_MaxBytes-1, 
+                        0, senderp, &senderlen);
+  if (nbytes < 0) {
+    // error, ignore it
+    log_e("message_loop: receiving from socket");
+    return false;
+  }
+  buf[nbytes] = '\0';     // null terminate message string
+  // where was it from?
+  if (sender.sin_family != AF_INET) {
+    // ignore it
+    log_d("message_loop: non-Internet family %d\n", sender.sin_family);
+    return false;
+  }
+  message_capture(sender, buf, nbytes);
+  // record it
+  log_s("message_loop: FROM %s", message_formatAddr(sender, addrString, sizeof(addrString)));
+  log_d("message_loop: %d lines:", numLines(buf));
+  log_s("%s", buf);
+
+  // handle it
+  return (*handleMessage)(arg, sender, buf);
+}
+
+/**************** message_startCapture ****************/
+/*
+ * Open the capture file and write its header.
+ * See message.h for detailed description.
+ */
+bool
+message_startCapture(const char* path)
+{
+  if (path == NULL) {
+    log_v("message_startCapture: NULL path");
+    return false;
+  }
+  pthread_mutex_lock(&capture.lock);
+  if (capture.fp != NULL) {
+    pthread_mutex_unlock(&capture.lock);
+    log_v("message_startCapture: a capture is already running");
+    return false;
+  }
+  FILE* fp = fopen(path, "wb");
+  if (fp == NULL) {
+    pthread_mutex_unlock(&capture.lock);
+    log_e("message_startCapture: opening capture file");
+    return false;
   }
+  setvbuf(fp, NULL, _IOFBF, CaptureBufferSize);
+  fwrite(CaptureMagic, 1, sizeof(CaptureMagic), fp);
+
+  capture.fp = fp;
+  clock_gettime(CLOCK_MONOTONIC, &capture.start);
+  capture.senders = NULL;
+  capture.numSenders = capture.maxSenders = 0;
+  capture.senderOf = NULL;
+  capture.indexMask = -1;
+  capture.count = 0;
+  atomic_store(&capture.active, true);
+  pthread_mutex_unlock(&capture.lock);
   return true;
 }
 
+/**************** message_flushCapture ****************/
+/*
+ * Write out the capture file's buffer, if a capture is running.
+ * See message.h for detailed description.
+ */
+void
+message_flushCapture(void)
+{
+  pthread_mutex_lock(&capture.lock);
+  if (capture.fp != NULL && fflush(capture.fp) != 0) {
+    log_e("message_flushCapture: writing capture file");
+  }
+  pthread_mutex_unlock(&capture.lock);
+}
+
+/**************** message_stopCapture ****************/
+/*
+ * Flush and close the capture file, if any.
+ * See message.h for detailed description.
+ */
+unsigned long
+message_stopCapture(void)
+{
+  pthread_mutex_lock(&capture.lock);
+  unsigned long count = capture.count;
+  if (capture.fp != NULL) {
+    atomic_store(&capture.active, false);
+    if (fclose(capture.fp) != 0) {
+      log_e("message_stopCapture: writing capture file");
+    }
+    capture.fp = NULL;
+    free(capture.senders);
+    capture.senders = NULL;
+    free(capture.senderOf);
+    capture.senderOf = NULL;
+  }
+  pthread_mutex_unlock(&capture.lock);
+  return count;
+}
+
+/**************** message_captureSender ****************/
+/*
+ * Return the capture's number for the sender 'from', numbering it next if
+ * it is new; -1 if out of memory.  Caller holds capture.lock.
+ * Senders are found through a hash table (open addressing, linear probing)
+ * of their numbers, rebuilt from the senders array whenever that grows.
+ */
+static int
+message_captureSender(const addr_t from)
+{
+  unsigned int h = message_hashAddr(from) & capture.indexMask;
+  if (capture.senderOf != NULL) {
+    for (int sender; (sender = capture.senderOf[h]) >= 0; h = (h + 1) & capture.indexMask) {
+      if (message_eqAddr(capture.senders[sender], from)) {
+        return sender;
+      }
+    }
+  }
+
+  // a new sender; make room, keeping the table at most half full
+  if (capture.numSenders == capture.maxSenders) {
+    const int max = capture.maxSenders > 0 ? 2 * capture.maxSenders : 64;
+    addr_t* senders = realloc(capture.senders, max * sizeof(addr_t));
+    if (senders == NULL) {
+      return -1;
+    }
+    capture.senders = senders;
+    int* senderOf = malloc(2 * max * sizeof(int));
+    if (senderOf == NULL) {
+      return -1;
+    }
+    free(capture.senderOf);
+    capture.senderOf = senderOf;
+    capture.indexMask = 2 * max - 1;
+    capture.maxSenders = max;
+    for (int i = 0; i <= capture.indexMask; i++) {
+      capture.senderOf[i] = -1;
+    }
+    for (int s = 0; s < capture.numSenders; s++) {
+      unsigned int i = message_hashAddr(capture.senders[s]) & capture.indexMask;
+      while (capture.senderOf[i] >= 0) {
+        i = (i + 1) & capture.indexMask;
+      }
+      capture.senderOf[i] = s;
+    }
+    h = message_hashAddr(from) & capture.indexMask;
+    while (capture.senderOf[h] >= 0) {
+      h = (h + 1) & capture.indexMask;
+    }
+  }
+  const int sender = capture.numSenders++;
+  capture.senders[sender] = from;
+  capture.senderOf[h] = sender;
+  return sender;
+}
+
+/**************** message_hashAddr ****************/
+/*
+ * Hash an address (host and port).
+ */
+static unsigned int
+message_hashAddr(const addr_t addr)
+{
+  const uint64_t key = ((uint64_t) addr.sin_addr.s_addr << 16) ^ addr.sin_port;
+  return (unsigned int) ((key * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+/**************** message_capture ****************/
+/*
+ * Record one inbound datagram in the capture, if one is running;
+ * see message_startCapture for the format.
+ */
+static void
+message_capture(const addr_t from, const char* buf, const int nbytes)
+{
+  if (!atomic_load_explicit(&capture.active, memory_order_relaxed)) {
+    return;
+  }
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  pthread_mutex_lock(&capture.lock);
+  if (capture.fp == NULL) {
+    pthread_mutex_unlock(&capture.lock);
+    return;                   // stopped meanwhile
+  }
+
+  const int sender = message_captureSender(from);
+  if (sender < 0) {
+    pthread_mutex_unlock(&capture.lock);
+    log_v("message_capture: out of memory; datagram not captured");
+    return;
+  }
+
+  uint64_t ns = (uint64_t) (now.tv_sec - capture.start.tv_sec) * 1000000000
+    + now.tv_nsec - capture.start.tv_nsec;
+  uint64_t fields[] = { ns, (uint64_t) sender, (uint64_t) nbytes };
+  const int sizes[] = { 8, 4, 4 };
+  unsigned char header[16];
+  unsigned char* p = header;
+  for (int f = 0; f < 3; f++) {
+    for (int b = 0; b < sizes[f]; b++) {
+      *p++ = fields[f] >> (8 * b) & 0xff;
+    }
+  }
+  if (fwrite(header, 1, sizeof(header), capture.fp) != sizeof(header)
+      || fwrite(buf, 1, nbytes, capture.fp) != nbytes) {
+    log_e("message_capture: writing capture file");
+  }
+  capture.count++;
+  pthread_mutex_unlock(&capture.lock);
+}
+
 /**************** message_done ****************/
 /* 
  * Clean up the message module, prior to exit.
@@ -403,13 +1057,143 @@ message_loop(void* arg, const float timeout,
 void
 message_done(void)
 {
-  if (ourSocket != 0) {
-    close(ourSocket);
-    ourSocket = 0;
-  }
+  message_stopCapture();
+  message_endpoint_delete(defaultEndpoint);
+  defaultEndpoint = NULL;
   log_v("message_done: message module closing down.");
 }
 
+/**************** message_endpoint_delete ****************/
+/* 
+ * Stop the endpoint's pipeline, if any, and close its socket.
+ * See message.h for detailed description.
+ */
+void
+message_endpoint_delete(message_endpoint_t* endpoint)
+{
+  if (endpoint != NULL) {
+    message_stopPipeline(endpoint);
+    if (endpoint->socket >= 0) {
+      close(endpoint->socket);
+    }
+    free(endpoint->buf);
+    free(endpoint);
+  }
+}
+
+/**************** message_workerTimeout ****************/
+/* Worker's loop is idle: keep looping unless the group is stopping. */
+static bool
+message_workerTimeout(void* arg)
+{
+  worker_t* worker = arg;
+  return atomic_load(&worker->workers->stopping);
+}
+
+/**************** message_workerMessage ****************/
+/* Worker received a message: pass it to the group's handler. */
+static bool
+message_workerMessage(void* arg, const addr_t from, const char* message)
+{
+  worker_t* worker = arg;
+  message_workers_t* workers = worker->workers;
+  return (*workers->handleMessage)(workers->arg, from, message)
+    || atomic_load(&workers->stopping);
+}
+
+/**************** message_workerMain ****************/
+/* Thread body for each worker: loop on its own endpoint until stopped. */
+static void*
+message_workerMain(void* arg)
+{
+  worker_t* worker = arg;
+  message_endpoint_loop(worker->endpoint, worker, WorkerPollSeconds,
+                        message_workerTimeout, NULL, message_workerMessage);
+  return NULL;
+}
+
+/**************** message_workers_start ****************/
+/* 
+ * Open one SO_REUSEPORT endpoint per worker, all on one port,
+ * and start a thread looping on each.
+ * See message.h for detailed description.
+ */
+message_workers_t*
+message_workers_start(const int numWorkers, const int port, void* arg,
+                      bool (*handleMessage)(void* arg,
+                                            const addr_t from,
+                                            const char* message))
+{
+  if (numWorkers <= 0 || handleMessage == NULL) {
+    log_v("message_workers_start: need at least one worker and a handler");
+    return NULL;
+  }
+  message_workers_t* workers = calloc(1, sizeof(message_workers_t));
+  if (workers == NULL) {
+    return NULL;
+  }
+  workers->workers = calloc(numWorkers, sizeof(worker_t));
+  if (workers->workers == NULL) {
+    free(workers);
+    return NULL;
+  }
+  workers->arg = arg;
+  workers->handleMessage = handleMessage;
+  workers->port = port;
+  atomic_init(&workers->stopping, false);
+
+  // the first socket picks the port, if caller did not; the rest join it
+  for (int i = 0; i < numWorkers; i++) {
+    worker_t* worker = &workers->workers[i];
+    worker->workers = workers;
+    worker->endpoint = message_endpoint_new(workers->port, true);
+    if (worker->endpoint == NULL) {
+      break;
+    }
+    workers->port = worker->endpoint->port;
+    if (pthread_create(&worker->thread, NULL, message_workerMain, worker) != 0) {
+      message_endpoint_delete(worker->endpoint);
+      break;
+    }
+    workers->numWorkers++;
+  }
+  if (workers->numWorkers == 0) {
+    free(workers->workers);
+    free(workers);
+    return NULL;
+  }
+  log_d("message_workers_start: %d workers sharing port", workers->numWorkers);
+  return workers;
+}
+
+/**************** message_workers_port ****************/
+/* see message.h for detailed description */
+int
+message_workers_port(const message_workers_t* workers)
+{
+  return (workers == NULL) ? 0 : workers->port;
+}
+
+/**************** message_workers_stop ****************/
+/* 
+ * Stop every worker, close their endpoints, and free the group.
+ * See message.h for detailed description.
+ */
+void
+message_workers_stop(message_workers_t* workers)
+{
+  if (workers == NULL) {
+    return;
+  }
+  atomic_store(&workers->stopping, true);
+  for (int i = 0; i < workers->numWorkers; i++) {
+    pthread_join(workers->workers[i].thread, NULL);
+    message_endpoint_delete(workers->workers[i].endpoint);
+  }
+  free(workers->workers);
+  free(workers);
+}
+
 
 /* ****************************************************************** */
 /* ************************* UNIT_TEST ****************************** */
@@ -437,6 +1221,13 @@ message_done(void)
  *   ./messagetest 2>second.log hostName portNumber
  * 
  * ^D (EOF) to exit either side.
+ *
+ * It also tests message_workers_* on its own, with the command line
+ *   ./messagetest --workers N
+ * which starts N workers sharing a port, sends datagrams to that port
+ * from many senders, and checks that each datagram is handled once, by
+ * some worker, that every worker handles some, and that each reply comes
+ * back from the shared port.  It exits zero if all is well.
  */
 
 #ifdef UNIT_TEST
@@ -444,6 +1235,21 @@ message_done(void)
 static bool handleTimeout(void* arg);
 static bool handleInput  (void* arg);
 static bool handleMessage(void* arg, const addr_t from, const char* message);
+static int testWorkers(const int numWorkers);
+static bool handleWorkerMessage(void* arg, const addr_t from, const char* message);
+
+static const int TestSenders = 64;      // each sends TestRounds datagrams
+static const int TestRounds = 8;
+#define TestMaxWorkers 64
+
+/* What the workers have handled, for testWorkers. */
+typedef struct tally {
+  pthread_mutex_t lock;
+  message_endpoint_t* endpoints[TestMaxWorkers];  // each worker's, as first seen
+  int counts[TestMaxWorkers];                     // datagrams each handled
+  int numSeen;
+  int total;
+} tally_t;
 
 int
 main(const int argc, char* argv[])
@@ -453,6 +1259,15 @@ main(const int argc, char* argv[])
   // initialize the logging module
   log_init(stderr);
 
+  if (argc == 3 && strcmp(argv[1], "--workers") == 0) {
+    const int numWorkers = atoi(argv[2]);
+    if (numWorkers < 1 || numWorkers > TestMaxWorkers) {
+      fprintf(stderr, "usage: %s --workers N (1 to %d)\n", argv[0], TestMaxWorkers);
+      return 3;
+    }
+    return testWorkers(numWorkers);
+  }
+
   // initialize the message module
   int ourPort = message_init(stderr);
   if (ourPort == 0) {
@@ -579,4 +1394,115 @@ handleMessage(void* arg, const addr_t from, const char* message)
   return false;
 }
 
+/**************** testWorkers ****************/
+/* Start numWorkers workers on one port, and send TestRounds datagrams to it
+ * from each of TestSenders endpoints, each its own sender; wait (up to two
+ * seconds per sender) for each reply before sending the next round.
+ * Return 0 if every datagram was handled once, every worker handled some,
+ * and every reply came from the shared port; 1 otherwise.
+ */
+static int
+testWorkers(const int numWorkers)
+{
+  tally_t tally = { .numSeen = 0, .total = 0 };
+  pthread_mutex_init(&tally.lock, NULL);
+  message_workers_t* workers = message_workers_start(numWorkers, 0, &tally,
+                                                     handleWorkerMessage);
+  if (workers == NULL) {
+    fprintf(stderr, "testWorkers: cannot start workers\n");
+    return 1;
+  }
+  const int port = message_workers_port(workers);
+  printf("%d of %d workers started on port %d\n", workers->numWorkers, numWorkers, port);
+
+  addr_t to;
+  char portString[10];
+  sprintf(portString, "%d", port);
+  message_endpoint_t* senders[TestSenders];
+  if (!message_setAddr("127.0.0.1", portString, &to)) {
+    return 1;
+  }
+  for (int s = 0; s < TestSenders; s++) {
+    senders[s] = message_endpoint_new(0, false);
+    if (senders[s] == NULL) {
+      fprintf(stderr, "testWorkers: cannot open sender %d\n", s);
+      return 1;
+    }
+  }
+  // a round at a time, so no socket buffer overflows; each reply must
+  // come from the shared port
+  const int expected = TestSenders * TestRounds;
+  int replies = 0, strays = 0;
+  for (int round = 0; round < TestRounds; round++) {
+    for (int s = 0; s < TestSenders; s++) {
+      char message[40];
+      sprintf(message, "ping %d %d", s, round);
+      message_endpoint_send(senders[s], to, message);
+    }
+    for (int s = 0; s < TestSenders; s++) {
+      struct pollfd pfd = { senders[s]->socket, POLLIN, 0 };
+      struct sockaddr_in sender;
+      socklen_t senderLength = sizeof(sender);
+      char buf[100];
+      if (poll(&pfd, 1, 2000) <= 0
+          || recvfrom(senders[s]->socket, buf, sizeof(buf), 0,
+                      (struct sockaddr*) &sender, &senderLength) < 0) {
+        continue;
+      }
+      if (ntohs(sender.sin_port) == port) {
+        replies++;
+      } else {
+        strays++;
+      }
+    }
+  }
+  for (int s = 0; s < TestSenders; s++) {
+    message_endpoint_delete(senders[s]);
+  }
+  const int started = workers->numWorkers;
+  message_workers_stop(workers);
+
+  bool ok = (tally.total == expected && replies == expected && strays == 0
+             && tally.numSeen == started);
+  printf("handled %d of %d datagrams; %d replies from port %d, %d from elsewhere\n",
+         tally.total, expected, replies, port, strays);
+  printf("per worker:");
+  for (int w = 0; w < tally.numSeen; w++) {
+    printf(" %d", tally.counts[w]);
+    ok = ok && tally.counts[w] > 0;
+  }
+  printf("\n%s\n", ok ? "ok" : "FAILED");
+  pthread_mutex_destroy(&tally.lock);
+  return ok ? 0 : 1;
+}
+
+/**************** handleWorkerMessage ****************/
+/* Datagram received by one of the workers; count it against that worker
+ * (known by its endpoint), and echo it back from the same endpoint.
+ */
+static bool
+handleWorkerMessage(void* arg, const addr_t from, const char* message)
+{
+  tally_t* tally = arg;
+  message_endpoint_t* endpoint = message_endpoint_current();
+
+  pthread_mutex_lock(&tally->lock);
+  int w = 0;
+  while (w < tally->numSeen && tally->endpoints[w] != endpoint) {
+    w++;
+  }
+  if (w == tally->numSeen && w < TestMaxWorkers) {
+    tally->endpoints[tally->numSeen++] = endpoint;
+    tally->counts[w] = 0;
+  }
+  if (w < TestMaxWorkers) {
+    tally->counts[w]++;
+  }
+  tally->total++;
+  pthread_mutex_unlock(&tally->lock);
+
+  message_endpoint_send(endpoint, from, message);
+  return false;
+}
+
 #endif // UNIT_TEST
@@ -20,6 +20,13 @@
  *  handleInput may be NULL if no input expected.
  *  arg may be NULL if not needed by handlers.
  *
+ * Programs needing more than one socket, or a socket per thread, use the
+ * message_endpoint_* functions, which take an explicit endpoint; the
+ * functions above are equivalent to those on a default endpoint.
+ * message_workers_* runs a group of endpoints bound to the same port
+ * with SO_REUSEPORT, one per thread, so the kernel spreads inbound
+ * datagrams (by sender address) across them.
+ *
  * David Kotz - May 2019
  */
 
@@ -45,11 +52,22 @@
  */
 typedef struct sockaddr_in addr_t;
 
+/* An endpoint is one socket with its own receive buffer and (optional)
+ * pipeline threads; opaque to users of the module.
+ */
+typedef struct message_endpoint message_endpoint_t;
+
+/* A group of worker threads, each looping on its own endpoint. */
+typedef struct message_workers message_workers_t;
+
 /****************** constants *********************/
 // Maximum payload size for UDP messages, according to
 // https://en.wikipedia.org/wiki/User_Datagram_Protocol
 static const int message_MaxBytes = 65507;
 
+// Buffer size sufficient for message_formatAddr: "255.255.255.255:65535"
+#define message_AddrStringSize 22
+
 /****************** global functions *********************/
 
 /******************************************/
@@ -115,11 +133,24 @@ bool message_setAddr(const char* hostname, const char* portStr, addr_t* addr);
  * Returns:
  *   a string representation of the address,
  *   which is a pointer to static storage that cannot be retained!
+ *   (Each thread has its own storage.)
  * Logs:
  *   nothing.
  */
 const char* message_stringAddr(const addr_t addr);
 
+/******************************************/
+/* message_formatAddr:
+ * Like message_stringAddr, but writes into the caller's buffer.
+ * Caller provides:
+ *   an address, a buffer, and its size (message_AddrStringSize suffices).
+ * Returns:
+ *   the buffer, or NULL if buffer is NULL or size is 0.
+ * Logs:
+ *   nothing.
+ */
+const char* message_formatAddr(const addr_t addr, char* buf, const size_t size);
+
 /******************************************/
 /* message_send: send a message.
  * Caller provides:
@@ -166,6 +197,162 @@ bool message_loop(void* arg, const float timeout,
                                         const addr_t from, 
                                         const char* message));
 
+/******************************************/
+/* message_startPipeline: move network I/O onto dedicated threads.
+ * Caller provides: nothing.
+ * Function returns: true if the pipeline is running, false on error
+ *   (in which case the module keeps working as before).
+ * Assumptions: message_init() has already been called.
+ * Notes:
+ *   A receiver thread reads the socket continuously into a lock-free
+ *   single-producer ring, so a slow handler no longer leaves datagrams
+ *   waiting in the kernel, where they may be dropped.  message_loop then
+ *   calls handleMessage, on its own thread as always, for each queued
+ *   datagram, in arrival order.
+ *   message_send copies the message onto a lock-free multi-producer ring
+ *   and returns; a sender thread sends them in order.  message_send may
+ *   then be called from any thread.
+ *   message_done stops both threads, after sending everything queued.
+ * Logs: errors starting the threads; each datagram as it is sent/handled.
+ */
+bool message_startPipeline(void);
+
+/******************************************/
+/* message_endpoint_new: open a socket of our own.
+ * Caller provides:
+ *   port number to bind, or 0 for any available port;
+ *   true to set SO_REUSEPORT, so that other endpoints (made the same way,
+ *   by the same user) may bind the same port.
+ * Function returns:
+ *   a new endpoint, or NULL on error.
+ * Assumptions: log_init() has been called (message_init does so).
+ * Caller expectations:
+ *   call message_endpoint_delete() when done with it.
+ * Logs: errors; the port number.
+ */
+message_endpoint_t* message_endpoint_new(const int port, const bool reusePort);
+
+/******************************************/
+/* message_endpoint_port: the port number to which the endpoint is bound;
+ *   0 if endpoint is NULL.
+ */
+int message_endpoint_port(const message_endpoint_t* endpoint);
+
+/******************************************/
+/* message_endpoint_send, message_endpoint_loop,
+ * message_endpoint_startPipeline:
+ *   exactly as message_send, message_loop, and message_startPipeline,
+ *   but on the given endpoint.
+ * Notes:
+ *   Different endpoints may be used on different threads at the same time;
+ *   each endpoint's loop should run on only one thread at a time.
+ *   message_endpoint_loop accepts a NULL endpoint, and then watches only
+ *   stdin and the timer.
+ */
+void message_endpoint_send(message_endpoint_t* endpoint,
+                           const addr_t to, const char* message);
+bool message_endpoint_loop(message_endpoint_t* endpoint,
+                           void* arg, const float timeout,
+                           bool (*handleTimeout)(void* arg),
+                           bool (*handleInput)  (void* arg),
+                           bool (*handleMessage)(void* arg,
+                                                 const addr_t from, 
+                                                 const char* message));
+bool message_endpoint_startPipeline(message_endpoint_t* endpoint);
+
+/******************************************/
+/* message_endpoint_current: the endpoint whose loop called this handler.
+ * Function returns:
+ *   the endpoint of the innermost message_loop/message_endpoint_loop
+ *   running on this thread; NULL if none.
+ * Notes:
+ *   handlers use this to reply from the endpoint on which a message arrived.
+ */
+message_endpoint_t* message_endpoint_current(void);
+
+/******************************************/
+/* message_endpoint_delete: stop the endpoint's pipeline (if any, after
+ *   sending everything queued), close its socket, and free it.
+ *   Ignores NULL.
+ */
+void message_endpoint_delete(message_endpoint_t* endpoint);
+
+/******************************************/
+/* message_workers_start: receive on one port from several threads.
+ * Caller provides:
+ *   number of worker threads (> 0),
+ *   port number to share, or 0 for any available port,
+ *   a pointer for an arg (may be NULL), passed to the handler,
+ *   a function for handling an inbound message.
+ * Function returns:
+ *   the group of workers, or NULL on error.  If some workers cannot
+ *   start, the group runs with those that did.
+ * Notes:
+ *   Each worker opens its own SO_REUSEPORT endpoint on the port and
+ *   loops on it; the kernel keeps each sender's datagrams on one worker.
+ *   handleMessage is called on the worker's thread, concurrently with other
+ *   workers, with the same contract as for message_loop; it should reply
+ *   with message_endpoint_send(message_endpoint_current(), ...).
+ *   A handler returning true stops only the worker that called it.
+ * Logs: errors; the number of workers started.
+ */
+message_workers_t* message_workers_start(const int numWorkers, const int port,
+                                         void* arg,
+                                         bool (*handleMessage)(void* arg,
+                                                               const addr_t from,
+                                                               const char* message));
+
+/******************************************/
+/* message_workers_port: the port shared by the workers; 0 if NULL. */
+int message_workers_port(const message_workers_t* workers);
+
+/******************************************/
+/* message_workers_stop: stop every worker (within about 0.1 second),
+ *   close their endpoints, and free the group.  Ignores NULL.
+ */
+void message_workers_stop(message_workers_t* workers);
+
+/******************************************/
+/* message_startCapture: record every inbound datagram to a capture file.
+ * Every datagram received from then on, by any endpoint and on any thread,
+ * is written with its arrival time; its sender is written only as a
+ * number (0 for the first sender seen, 1 for the next, ...), so the file
+ * holds no addresses.  The file is a header and then one record per
+ * datagram, all integers little-endian:
+ *   header:  "NUGCAP01"                                 8 bytes
+ *   record:  nanoseconds since the capture started     8 bytes
+ *            sender number                             4 bytes
+ *            length of the datagram                    4 bytes
+ *            the datagram                              that many bytes
+ * Writes are buffered; see support/capreplay.c to send a capture again.
+ * Caller provides:
+ *   path of the capture file, which is created or truncated.
+ * Function returns:
+ *   true if capturing, false if the file cannot be written or a
+ *   capture is already running.
+ * Logs:
+ *   errors in opening or writing the file.
+ */
+bool message_startCapture(const char* path);
+
+/******************************************/
+/* message_flushCapture: write out whatever of the capture is buffered,
+ * e.g., when the program is idle, so a capture cut off by a crash or a
+ * kill loses nothing from before then.
+ * Caller provides: nothing.
+ * Function returns: nothing.
+ */
+void message_flushCapture(void);
+
+/******************************************/
+/* message_stopCapture: finish the capture, if any, and close its file.
+ * message_done does this too.
+ * Caller provides: nothing.
+ * Function returns:
+ *   the number of datagrams captured.
+ */
+unsigned long message_stopCapture(void);
+
 /******************************************/
 /* message_done: shut down the module.
  * Caller provides: nothing.
@@ -0,0 +1,181 @@
+/*
+ * ring - bounded lock-free queues of pointers, for passing work between threads
+ *
+ * See ring.h for detailed interface description for each function.
+ *
+ * The SPSC ring is the classic pair of free-running head and tail counters:
+ * only the producer writes the tail and only the consumer writes the head.
+ * The MPSC ring gives every slot a sequence number (after Vyukov's bounded
+ * queue): producers claim a slot by compare-and-swap on the tail, then
+ * publish it by advancing the slot's sequence, so the consumer never sees
+ * a claimed slot before its item is written.
+ *
+ * Selena Zhou, Kyla Widodo, 23S
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include "ring.h"
+
+/**************** local types ****************/
+typedef struct slot {
+  atomic_size_t seq;          // MPSC only: which lap this slot is ready for
+  void* item;
+} slot_t;
+
+/**************** global types ****************/
+typedef struct ring {
+  bool multi;                 // true for MPSC, false for SPSC
+  size_t mask;                // capacity - 1; capacity is a power of two
+  slot_t* slots;              // [capacity]
+  // keep producer and consumer counters on separate cache lines
+  _Alignas(64) atomic_size_t head;    // next slot to pop
+  _Alignas(64) atomic_size_t tail;    // next slot to push
+} ring_t;
+
+/**************** local functions ****************/
+static ring_t* ring_new(const int capacity, const bool multi);
+
+/**************** ring_newSPSC ****************/
+/* see ring.h for detailed interface description */
+ring_t*
+ring_newSPSC(const int capacity)
+{
+  return ring_new(capacity, false);
+}
+
+/**************** ring_newMPSC ****************/
+/* see ring.h for detailed interface description */
+ring_t*
+ring_newMPSC(const int capacity)
+{
+  return ring_new(capacity, true);
+}
+
+/**************** ring_push ****************/
+/* see ring.h for detailed interface description */
+bool
+ring_push(ring_t* ring, void* item)
+{
+  if (ring == NULL || item == NULL) {
+    return false;
+  }
+
+  if (!ring->multi) {
+    // single producer: only we move the tail
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (tail - head > ring->mask) {
+      return false;           // full
+    }
+    ring->slots[tail & ring->mask].item = item;
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return true;
+  }
+
+  // multiple producers: claim a slot whose sequence says it is free this lap
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  while (true) {
+    slot_t* slot = &ring->slots[tail & ring->mask];
+    size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    ptrdiff_t diff = (ptrdiff_t) seq - (ptrdiff_t) tail;
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&ring->tail, &tail, tail + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        slot->item = item;
+        atomic_store_explicit(&slot->seq, tail + 1, memory_order_release);
+        return true;
+      }
+      // lost the race; 'tail' now holds the current value, try again
+    } else if (diff < 0) {
+      return false;           // full: consumer has not freed this slot yet
+    } else {
+      tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    }
+  }
+}
+
+/**************** ring_pop ****************/
+/* see ring.h for detailed interface description */
+void*
+ring_pop(ring_t* ring)
+{
+  if (ring == NULL) {
+    return NULL;
+  }
+
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  slot_t* slot = &ring->slots[head & ring->mask];
+
+  if (!ring->multi) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head == tail) {
+      return NULL;            // empty
+    }
+    void* item = slot->item;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return item;
+  }
+
+  // single consumer: the slot is ready once a producer has published it
+  size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+  if (seq != head + 1) {
+    return NULL;              // empty, or next producer not finished yet
+  }
+  void* item = slot->item;
+  // free the slot for the producers' next lap around the ring
+  atomic_store_explicit(&slot->seq, head + ring->mask + 1, memory_order_release);
+  atomic_store_explicit(&ring->head, head + 1, memory_order_relaxed);
+  return item;
+}
+
+/**************** ring_delete ****************/
+/* see ring.h for detailed interface description */
+void
+ring_delete(ring_t* ring)
+{
+  if (ring != NULL) {
+    free(ring->slots);
+    free(ring);
+  }
+}
+
+/**************** ring_new ****************/
+/* INTERNAL FUNCTION: allocate a ring of at least 'capacity' slots.
+ */
+static ring_t*
+ring_new(const int capacity, const bool multi)
+{
+  if (capacity <= 0) {
+    return NULL;
+  }
+  size_t size = 1;
+  while (size < (size_t) capacity) {
+    size <<= 1;
+  }
+
+  ring_t* ring = aligned_alloc(_Alignof(ring_t),
+                               (sizeof(ring_t) + _Alignof(ring_t) - 1)
+                               / _Alignof(ring_t) * _Alignof(ring_t));
+  if (ring == NULL) {
+    return NULL;
+  }
+  ring->slots = malloc(size * sizeof(slot_t));
+  if (ring->slots == NULL) {
+    free(ring);
+    return NULL;
+  }
+  ring->multi = multi;
+  ring->mask = size - 1;
+  for (size_t i = 0; i < size; i++) {
+    atomic_init(&ring->slots[i].seq, i);
+    ring->slots[i].item = NULL;
+  }
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+  return ring;
+}
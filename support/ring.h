@@ -0,0 +1,61 @@
+/*
+ * ring - bounded lock-free queues of pointers, for passing work between threads
+ *
+ * Two flavors share one interface:
+ *   a single-producer/single-consumer ring (ring_newSPSC), in which exactly
+ *     one thread calls ring_push and exactly one other thread calls ring_pop;
+ *   a multi-producer/single-consumer ring (ring_newMPSC), in which any number
+ *     of threads may call ring_push concurrently, and one thread calls ring_pop.
+ * Neither takes a lock; a full ring refuses the push, and an empty ring
+ * refuses the pop, so callers decide whether to retry, wait, or drop.
+ * Items are opaque pointers and are never NULL.
+ *
+ * Selena Zhou, Kyla Widodo, 23S
+ */
+
+#ifndef _RING_H_
+#define _RING_H_
+
+#include <stdio.h>
+#include <stdbool.h>
+
+/****************** types *********************/
+typedef struct ring ring_t;   // opaque to users of the module
+
+/****************** global functions *********************/
+
+/******************************************/
+/* ring_newSPSC, ring_newMPSC: create an empty ring.
+ * Caller provides:
+ *   the minimum number of items the ring must hold; it is rounded up
+ *   to a power of two.
+ * Function returns:
+ *   pointer to a new ring, or NULL on error.
+ * Caller expectations:
+ *   call ring_delete() when no thread uses the ring any longer.
+ */
+ring_t* ring_newSPSC(const int capacity);
+ring_t* ring_newMPSC(const int capacity);
+
+/******************************************/
+/* ring_push: add an item at the tail of the ring.
+ * Caller provides: a ring, and a non-NULL item.
+ * Function returns: true if added; false if the ring was full, or bad args.
+ */
+bool ring_push(ring_t* ring, void* item);
+
+/******************************************/
+/* ring_pop: remove the item at the head of the ring.
+ * Caller provides: a ring.
+ * Function returns: the item, or NULL if the ring was empty.
+ * Notes: items come out in the order their pushes completed.
+ */
+void* ring_pop(ring_t* ring);
+
+/******************************************/
+/* ring_delete: free the ring.
+ * Items still in the ring are not freed; pop them first if needed.
+ */
+void ring_delete(ring_t* ring);
+
+#endif // _RING_H_
@@ -0,0 +1,221 @@
+/* 
+ * trace - optional tracepoints, written as Chrome trace-event JSON
+ *
+ * See trace.h for detailed interface description for each function.
+ *
+ * Each thread collects events in its own buffer, found through a
+ * pthread key whose destructor writes out the buffer when the thread
+ * exits; a mutex guards only the file.  Timestamps are microseconds since
+ * trace_start; thread IDs are the kernel's, as shown by top and gdb.
+ *
+ * Selena Zhou, Kyla Widodo, 23S
+ */
+
+#define _GNU_SOURCE             // for syscall(SYS_gettid)
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include "trace.h"
+
+/**************** file-local constants ****************/
+static const int BufferEvents = 4096;   // events per thread between writes
+
+/**************** file-local types ****************/
+typedef struct event {
+  const char* name;           // span name
+  uint64_t ns;                // when, since trace_start
+  char phase;                 // 'B' begin, 'E' end
+} event_t;
+
+typedef struct buffer {
+  long tid;                   // kernel thread ID
+  int count;                  // events in buffer
+  event_t events[];           // [BufferEvents]
+} buffer_t;
+
+/**************** global variables ****************/
+bool trace_on = false;
+
+/**************** file-local global variables ****************/
+static FILE* traceFP = NULL;            // protected by fileLock
+static bool firstEvent = true;          // protected by fileLock
+static pthread_mutex_t fileLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t bufferKey;
+static uint64_t startNs;                // set by trace_start
+
+/**************** file-local functions ****************/
+static uint64_t trace_now(void);
+static buffer_t* trace_buffer(void);
+static void trace_flush(buffer_t* buffer);
+static void trace_threadExit(void* arg);
+static void trace_record(const char* name, const char phase);
+
+/**************** trace_start ****************/
+/* see trace.h for detailed interface description */
+bool
+trace_start(const char* filename)
+{
+  if (trace_on || filename == NULL) {
+    return trace_on;
+  }
+  FILE* fp = fopen(filename, "w");
+  if (fp == NULL) {
+    return false;
+  }
+  if (pthread_key_create(&bufferKey, trace_threadExit) != 0) {
+    fclose(fp);
+    return false;
+  }
+  pthread_mutex_lock(&fileLock);
+  traceFP = fp;
+  firstEvent = true;
+  fprintf(traceFP, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  pthread_mutex_unlock(&fileLock);
+
+  startNs = trace_now();
+  trace_on = true;
+  return true;
+}
+
+/**************** trace_stop ****************/
+/* see trace.h for detailed interface description */
+void
+trace_stop(void)
+{
+  if (!trace_on) {
+    return;
+  }
+  trace_on = false;
+
+  buffer_t* buffer = pthread_getspecific(bufferKey);
+  if (buffer != NULL) {
+    trace_flush(buffer);
+    free(buffer);
+    pthread_setspecific(bufferKey, NULL);
+  }
+
+  pthread_mutex_lock(&fileLock);
+  fprintf(traceFP, "\n]}\n");
+  fclose(traceFP);
+  traceFP = NULL;
+  pthread_mutex_unlock(&fileLock);
+  pthread_key_delete(bufferKey);
+}
+
+/**************** trace_begin ****************/
+/* see trace.h for detailed interface description */
+void
+trace_begin(const char* name)
+{
+  trace_record(name, 'B');
+}
+
+/**************** trace_end ****************/
+/* see trace.h for detailed interface description */
+void
+trace_end(const char* name)
+{
+  trace_record(name, 'E');
+}
+
+/**************** trace_endScope ****************/
+/* see trace.h for detailed interface description */
+void
+trace_endScope(const char** name)
+{
+  if (*name != NULL) {
+    trace_record(*name, 'E');
+  }
+}
+
+/**************** trace_record ****************/
+/* INTERNAL FUNCTION: append an event to this thread's buffer,
+ * writing out the buffer first if it is full.
+ */
+static void
+trace_record(const char* name, const char phase)
+{
+  if (!trace_on) {
+    return;                   // a span that began before trace_stop
+  }
+  buffer_t* buffer = trace_buffer();
+  if (buffer == NULL) {
+    return;
+  }
+  if (buffer->count == BufferEvents) {
+    trace_flush(buffer);
+  }
+  event_t* event = &buffer->events[buffer->count++];
+  event->name = name;
+  event->ns = trace_now() - startNs;
+  event->phase = phase;
+}
+
+/**************** trace_buffer ****************/
+/* INTERNAL FUNCTION: this thread's buffer, made on first use;
+ * NULL if out of memory.
+ */
+static buffer_t*
+trace_buffer(void)
+{
+  buffer_t* buffer = pthread_getspecific(bufferKey);
+  if (buffer == NULL) {
+    buffer = malloc(sizeof(buffer_t) + BufferEvents * sizeof(event_t));
+    if (buffer != NULL) {
+      buffer->tid = syscall(SYS_gettid);
+      buffer->count = 0;
+      pthread_setspecific(bufferKey, buffer);
+    }
+  }
+  return buffer;
+}
+
+/**************** trace_flush ****************/
+/* INTERNAL FUNCTION: write the buffer's events to the file, and empty it.
+ */
+static void
+trace_flush(buffer_t* buffer)
+{
+  pthread_mutex_lock(&fileLock);
+  if (traceFP != NULL) {
+    for (int i = 0; i < buffer->count; i++) {
+      const event_t* event = &buffer->events[i];
+      fprintf(traceFP, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu.%03u,"
+              "\"pid\":%d,\"tid\":%ld}",
+              firstEvent ? "" : ",\n", event->name, event->phase,
+              (unsigned long long) (event->ns / 1000),
+              (unsigned) (event->ns % 1000), (int) getpid(), buffer->tid);
+      firstEvent = false;
+    }
+  }
+  pthread_mutex_unlock(&fileLock);
+  buffer->count = 0;
+}
+
+/**************** trace_threadExit ****************/
+/* INTERNAL FUNCTION: destructor for bufferKey; a thread is exiting,
+ * so write out and free its buffer.
+ */
+static void
+trace_threadExit(void* arg)
+{
+  buffer_t* buffer = arg;
+  trace_flush(buffer);
+  free(buffer);
+}
+
+/**************** trace_now ****************/
+/* INTERNAL FUNCTION: monotonic time in nanoseconds.
+ */
+static uint64_t
+trace_now(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
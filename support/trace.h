@@ -0,0 +1,77 @@
+/* 
+ * trace - optional tracepoints, written as Chrome trace-event JSON
+ *
+ * Code marks a span with TRACE_SCOPE("name") at the top of a block; the span
+ * ends when the block is left, by any path, so early returns need no care.
+ * Spans on one thread nest.  The resulting file opens in chrome://tracing
+ * or https://ui.perfetto.dev, one row per thread.
+ *
+ * Tracepoints are compiled in only with -DTRACE (e.g., make FLAGS=-DTRACE);
+ * otherwise TRACE_SCOPE expands to nothing.  When compiled in, a span costs
+ * a single well-predicted branch until trace_start is called.
+ *
+ * Each thread buffers its events and writes them to the file in batches,
+ * when its buffer fills, when the thread exits, and at trace_stop.
+ *
+ * Selena Zhou, Kyla Widodo, 23S
+ */
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdio.h>
+#include <stdbool.h>
+
+/****************** global variables *********************/
+/* True from trace_start until trace_stop; read by TRACE_SCOPE.
+ * Users of the module should not set it.
+ */
+extern bool trace_on;
+
+/****************** global functions *********************/
+
+/******************************************/
+/* trace_start: begin writing events to a new file.
+ * Caller provides:
+ *   pathname of the file to create (or overwrite).
+ * Function returns:
+ *   true if tracing is on; false if the file cannot be opened.
+ * Assumptions:
+ *   called before any thread that is to be traced is started.
+ */
+bool trace_start(const char* filename);
+
+/******************************************/
+/* trace_stop: write out the calling thread's events, finish and close
+ * the file, and turn tracing off.
+ * Assumptions:
+ *   every other traced thread has exited (their events are written then).
+ */
+void trace_stop(void);
+
+/******************************************/
+/* trace_begin, trace_end: record the start or end of a span on this thread.
+ * Use TRACE_SCOPE rather than calling these directly.
+ * Caller provides: name of the span, a string that outlives the trace.
+ */
+void trace_begin(const char* name);
+void trace_end(const char* name);
+
+/******************************************/
+/* trace_endScope: for TRACE_SCOPE's cleanup; ends the span if it began.
+ */
+void trace_endScope(const char** name);
+
+/****************** macros *********************/
+#ifdef TRACE
+#define TRACE_JOIN_(a, b) a ## b
+#define TRACE_JOIN(a, b) TRACE_JOIN_(a, b)
+#define TRACE_SCOPE(name)                                                   \
+  const char* TRACE_JOIN(trace_scope_, __LINE__)                            \
+    __attribute__((cleanup(trace_endScope), unused))                         \
+    = (trace_on ? (trace_begin(name), (name)) : NULL)
+#else
+#define TRACE_SCOPE(name)
+#endif
+
+#endif // _TRACE_H_